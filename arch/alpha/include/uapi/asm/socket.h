@@ -124,6 +124,11 @@
 
 #define SO_DETACH_REUSEPORT_BPF 68
 
+#define SO_PREFER_BUSY_POLL	69
+#define SO_BUSY_POLL_BUDGET	70
+
+#define SCM_TIMESTAMPING_BATCH	96
+
 #if !defined(__KERNEL__)
 
 #if __BITS_PER_LONG == 64
@@ -116,6 +116,11 @@
 
 #define SO_DETACH_REUSEPORT_BPF 0x4042
 
+#define SO_PREFER_BUSY_POLL	0x4043
+#define SO_BUSY_POLL_BUDGET	0x4044
+
+#define SCM_TIMESTAMPING_BATCH	0x4060
+
 #if !defined(__KERNEL__)
 
 #if __BITS_PER_LONG == 64
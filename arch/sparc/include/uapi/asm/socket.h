@@ -117,6 +117,11 @@
 
 #define SO_DETACH_REUSEPORT_BPF  0x0047
 
+#define SO_PREFER_BUSY_POLL	 0x0048
+#define SO_BUSY_POLL_BUDGET	 0x0049
+
+#define SCM_TIMESTAMPING_BATCH	0x0070
+
 #if !defined(__KERNEL__)
 
 
@@ -473,6 +473,29 @@ stmmac_set_pauseparam(struct net_device *netdev,
 	}
 }
 
+#ifdef CONFIG_PAGE_POOL_STATS
+static u64 *stmmac_get_page_pool_stats(struct stmmac_priv *priv, u64 *data)
+{
+	u32 rx_queues_count = priv->plat->rx_queues_to_use;
+	struct page_pool_stats stats = {};
+	u32 queue;
+
+	for (queue = 0; queue < rx_queues_count; queue++) {
+		struct page_pool *pool = priv->rx_queue[queue].page_pool;
+
+		if (pool)
+			page_pool_get_stats(pool, &stats);
+	}
+
+	return page_pool_ethtool_stats_get(data, &stats);
+}
+#else
+static u64 *stmmac_get_page_pool_stats(struct stmmac_priv *priv, u64 *data)
+{
+	return data;
+}
+#endif
+
 static void stmmac_get_ethtool_stats(struct net_device *dev,
 				 struct ethtool_stats *dummy, u64 *data)
 {
@@ -523,6 +546,7 @@ static void stmmac_get_ethtool_stats(struct net_device *dev,
 		data[j++] = (stmmac_gstrings_stats[i].sizeof_stat ==
 			     sizeof(u64)) ? (*(u64 *)p) : (*(u32 *)p);
 	}
+	stmmac_get_page_pool_stats(priv, &data[j]);
 }
 
 static int stmmac_get_sset_count(struct net_device *netdev, int sset)
@@ -532,7 +556,7 @@ static int stmmac_get_sset_count(struct net_device *netdev, int sset)
 
 	switch (sset) {
 	case ETH_SS_STATS:
-		len = STMMAC_STATS_LEN;
+		len = STMMAC_STATS_LEN + page_pool_ethtool_stats_get_count();
 
 		if (priv->dma_cap.rmon)
 			len += STMMAC_MMC_STATS_LEN;
@@ -585,6 +609,7 @@ static void stmmac_get_strings(struct net_device *dev, u32 stringset, u8 *data)
 				ETH_GSTRING_LEN);
 			p += ETH_GSTRING_LEN;
 		}
+		page_pool_ethtool_stats_get_strings(p);
 		break;
 	case ETH_SS_TEST:
 		stmmac_selftest_get_strings(priv, p);
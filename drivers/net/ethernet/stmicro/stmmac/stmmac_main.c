@@ -3591,8 +3591,10 @@ static int stmmac_rx(struct stmmac_priv *priv, int limit, u32 queue)
 					buf->page, 0, buf_len,
 					priv->dma_buf_sz);
 
-			/* Data payload appended into SKB */
-			page_pool_release_page(rx_q->page_pool, buf->page);
+			/* Data payload appended into SKB, the stack gives
+			 * the page back to the pool once it is done with it
+			 */
+			skb_mark_for_recycle(skb);
 			buf->page = NULL;
 		}
 
@@ -3606,7 +3608,7 @@ static int stmmac_rx(struct stmmac_priv *priv, int limit, u32 queue)
 			len += sec_len;
 
 			/* Data payload appended into SKB */
-			page_pool_release_page(rx_q->page_pool, buf->sec_page);
+			skb_mark_for_recycle(skb);
 			buf->sec_page = NULL;
 		}
 
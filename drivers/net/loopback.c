@@ -183,6 +183,7 @@ static void gen_lo_setup(struct net_device *dev,
 		| NETIF_F_NETNS_LOCAL
 		| NETIF_F_VLAN_CHALLENGED
 		| NETIF_F_LOOPBACK;
+	netif_set_tso_max_size(dev, GSO_MAX_SIZE);
 	dev->ethtool_ops	= eth_ops;
 	dev->header_ops		= hdr_ops;
 	dev->netdev_ops		= dev_ops;
@@ -0,0 +1,501 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Async discard
+ *
+ * With -o discard=async freed extents are not discarded during transaction
+ * commit.  They are returned to the free space cache marked untrimmed and the
+ * block group is put on a discard list, from where a delayed work item trims
+ * the untrimmed free space one region at a time.
+ *
+ * A block group waits BTRFS_DISCARD_DELAY on the lists before it becomes
+ * eligible.  This gives adjacent frees the chance to be merged by the free
+ * space cache and freed space the chance to be reallocated, both of which
+ * save discards.  The lists act as size buckets: index 0 holds unused block
+ * groups, which are trimmed completely before the cleaner may remove them, and
+ * the following lists only discard regions of at least
+ * BTRFS_ASYNC_DISCARD_MAX_FILTER and then BTRFS_ASYNC_DISCARD_MIN_FILTER
+ * bytes, so large frees are discarded first.
+ *
+ * The rate is bounded by iops_limit and kbps_limit, both of which can be
+ * tuned through /sys/fs/btrfs/<uuid>/discard/.
+ */
+
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/sizes.h>
+#include <linux/workqueue.h>
+#include "ctree.h"
+#include "block-group.h"
+#include "discard.h"
+#include "free-space-cache.h"
+
+/* Initial delay to give freed space some chance of reuse or merging */
+#define BTRFS_DISCARD_DELAY		(120ULL * NSEC_PER_SEC)
+#define BTRFS_DISCARD_UNUSED_DELAY	(10ULL * NSEC_PER_SEC)
+
+static const u64 discard_minlen[BTRFS_NR_DISCARD_LISTS] = {
+	0,
+	BTRFS_ASYNC_DISCARD_MAX_FILTER,
+	BTRFS_ASYNC_DISCARD_MIN_FILTER
+};
+
+static inline u64 block_group_end(struct btrfs_block_group_cache *block_group)
+{
+	return block_group->key.objectid + block_group->key.offset;
+}
+
+static struct list_head *get_discard_list(
+				struct btrfs_discard_ctl *discard_ctl,
+				struct btrfs_block_group_cache *block_group)
+{
+	return &discard_ctl->discard_list[block_group->discard_index];
+}
+
+static void add_to_discard_list(struct btrfs_discard_ctl *discard_ctl,
+				struct btrfs_block_group_cache *block_group,
+				int index, u64 delay)
+{
+	block_group->discard_index = index;
+	block_group->discard_eligible_time = ktime_get_ns() + delay;
+	block_group->discard_state = BTRFS_DISCARD_RESET_CURSOR;
+	list_move_tail(&block_group->discard_list,
+		       get_discard_list(discard_ctl, block_group));
+}
+
+/*
+ * Returns true if the block group was the one being discarded by the work
+ * item, in which case the caller needs to wait for it to finish.
+ */
+static bool remove_from_discard_list(struct btrfs_discard_ctl *discard_ctl,
+				     struct btrfs_block_group_cache *block_group)
+{
+	bool running = false;
+
+	spin_lock(&discard_ctl->lock);
+
+	if (block_group == discard_ctl->block_group) {
+		running = true;
+		discard_ctl->block_group = NULL;
+	}
+
+	block_group->discard_eligible_time = 0;
+	list_del_init(&block_group->discard_list);
+
+	spin_unlock(&discard_ctl->lock);
+
+	return running;
+}
+
+/*
+ * Find the block group to discard next.  Lower indices win as long as their
+ * head is eligible, otherwise the head that becomes eligible first is picked
+ * so the work can be scheduled for it.
+ *
+ * discard_ctl->lock must be held.
+ */
+static struct btrfs_block_group_cache *find_next_block_group(
+					struct btrfs_discard_ctl *discard_ctl,
+					u64 now)
+{
+	struct btrfs_block_group_cache *ret_block_group = NULL;
+	struct btrfs_block_group_cache *block_group;
+	int i;
+
+	for (i = 0; i < BTRFS_NR_DISCARD_LISTS; i++) {
+		struct list_head *discard_list = &discard_ctl->discard_list[i];
+
+		if (list_empty(discard_list))
+			continue;
+
+		block_group = list_first_entry(discard_list,
+					       struct btrfs_block_group_cache,
+					       discard_list);
+
+		if (!ret_block_group)
+			ret_block_group = block_group;
+
+		if (ret_block_group->discard_eligible_time < now)
+			break;
+
+		if (ret_block_group->discard_eligible_time >
+		    block_group->discard_eligible_time)
+			ret_block_group = block_group;
+	}
+
+	return ret_block_group;
+}
+
+/*
+ * Pick the next eligible block group and mark it as the one being discarded.
+ * The cursor is reset here if the block group was (re)queued.
+ */
+static struct btrfs_block_group_cache *peek_discard_list(
+					struct btrfs_discard_ctl *discard_ctl,
+					enum btrfs_discard_state *discard_state,
+					int *discard_index)
+{
+	struct btrfs_block_group_cache *block_group;
+	const u64 now = ktime_get_ns();
+
+	spin_lock(&discard_ctl->lock);
+
+	block_group = find_next_block_group(discard_ctl, now);
+	if (block_group && now >= block_group->discard_eligible_time) {
+		if (block_group->discard_state == BTRFS_DISCARD_RESET_CURSOR) {
+			block_group->discard_cursor =
+				block_group->key.objectid;
+			block_group->discard_state = BTRFS_DISCARD_EXTENTS;
+		}
+		discard_ctl->block_group = block_group;
+		*discard_state = block_group->discard_state;
+		*discard_index = block_group->discard_index;
+	} else {
+		block_group = NULL;
+	}
+
+	spin_unlock(&discard_ctl->lock);
+
+	return block_group;
+}
+
+/*
+ * The extents and bitmaps of the block group have been walked with the filter
+ * of the current list.  Move it to the list with the next smaller filter, or
+ * take it off the lists once the smallest filter has been applied.  A fully
+ * discarded unused block group is handed back to the cleaner for removal,
+ * this has to happen under discard_ctl->lock so that a concurrent
+ * btrfs_discard_cancel_work() waits for us.
+ *
+ * discard_ctl->lock must be held.
+ */
+static void finish_discard_pass(struct btrfs_discard_ctl *discard_ctl,
+				struct btrfs_block_group_cache *block_group)
+{
+	/* Freed space was added behind the cursor, walk the group again */
+	if (block_group->discard_state == BTRFS_DISCARD_RESET_CURSOR)
+		return;
+
+	if (block_group->discard_index == BTRFS_DISCARD_INDEX_UNUSED) {
+		list_del_init(&block_group->discard_list);
+		if (btrfs_block_group_used(&block_group->item) == 0)
+			btrfs_mark_bg_unused(block_group);
+		return;
+	}
+
+	if (block_group->discard_index + 1 < BTRFS_NR_DISCARD_LISTS)
+		add_to_discard_list(discard_ctl, block_group,
+				    block_group->discard_index + 1, 0);
+	else
+		list_del_init(&block_group->discard_list);
+}
+
+static void btrfs_discard_workfn(struct work_struct *work)
+{
+	struct btrfs_discard_ctl *discard_ctl;
+	struct btrfs_block_group_cache *block_group;
+	enum btrfs_discard_state discard_state;
+	int discard_index = 0;
+	u64 trimmed = 0;
+	u64 minlen;
+
+	discard_ctl = container_of(work, struct btrfs_discard_ctl, work.work);
+
+	block_group = peek_discard_list(discard_ctl, &discard_state,
+					&discard_index);
+	if (!block_group || !btrfs_run_discard_work(discard_ctl))
+		return;
+
+	minlen = discard_minlen[discard_index];
+
+	if (discard_state == BTRFS_DISCARD_BITMAPS) {
+		btrfs_trim_block_group_bitmaps(block_group, &trimmed,
+				       block_group->discard_cursor,
+				       block_group_end(block_group),
+				       minlen, discard_ctl->max_discard_size,
+				       true);
+		discard_ctl->discard_bitmap_bytes += trimmed;
+	} else {
+		btrfs_trim_block_group_extents(block_group, &trimmed,
+				       block_group->discard_cursor,
+				       block_group_end(block_group),
+				       minlen, discard_ctl->max_discard_size,
+				       true);
+		discard_ctl->discard_extent_bytes += trimmed;
+	}
+
+	discard_ctl->prev_discard = trimmed;
+
+	spin_lock(&discard_ctl->lock);
+	/* The block group may have been removed while we were discarding */
+	if (discard_ctl->block_group == block_group &&
+	    block_group->discard_cursor >= block_group_end(block_group)) {
+		if (discard_state == BTRFS_DISCARD_BITMAPS) {
+			finish_discard_pass(discard_ctl, block_group);
+		} else if (block_group->discard_state !=
+			   BTRFS_DISCARD_RESET_CURSOR) {
+			block_group->discard_cursor =
+				block_group->key.objectid;
+			block_group->discard_state = BTRFS_DISCARD_BITMAPS;
+		}
+	}
+	discard_ctl->block_group = NULL;
+	spin_unlock(&discard_ctl->lock);
+
+	btrfs_discard_schedule_work(discard_ctl, false);
+}
+
+/*
+ * btrfs_run_discard_work - determines if async discard should be running
+ * @discard_ctl: discard control
+ *
+ * Checks if BTRFS_FS_DISCARD_RUNNING is set and the file system is writeable.
+ */
+bool btrfs_run_discard_work(struct btrfs_discard_ctl *discard_ctl)
+{
+	struct btrfs_fs_info *fs_info = container_of(discard_ctl,
+						     struct btrfs_fs_info,
+						     discard_ctl);
+
+	return (test_bit(BTRFS_FS_DISCARD_RUNNING, &fs_info->flags) &&
+		btrfs_test_opt(fs_info, DISCARD_ASYNC) &&
+		!(fs_info->sb->s_flags & SB_RDONLY));
+}
+
+/*
+ * btrfs_discard_schedule_work - responsible for scheduling the discard work
+ * @discard_ctl: discard control
+ * @override: override the current timer
+ *
+ * Discards are issued by a delayed workqueue item.  @override is used to
+ * update the current delay as the baseline delay interval is reevaluated on
+ * transaction commit.  This is also maxed with any other rate limit.
+ */
+void btrfs_discard_schedule_work(struct btrfs_discard_ctl *discard_ctl,
+				 bool override)
+{
+	struct btrfs_block_group_cache *block_group;
+	const u64 now = ktime_get_ns();
+
+	spin_lock(&discard_ctl->lock);
+
+	if (!btrfs_run_discard_work(discard_ctl))
+		goto out;
+
+	if (!override && delayed_work_pending(&discard_ctl->work))
+		goto out;
+
+	block_group = find_next_block_group(discard_ctl, now);
+	if (block_group) {
+		u64 delay = discard_ctl->delay;
+
+		/*
+		 * A single discard can be up to max_discard_size, so bound the
+		 * bandwidth by delaying the next one by the time the previous
+		 * one is worth at kbps_limit.
+		 */
+		if (discard_ctl->kbps_limit && discard_ctl->prev_discard) {
+			u64 bps_limit = ((u64)discard_ctl->kbps_limit) * SZ_1K;
+			u64 bps_delay = div64_u64(discard_ctl->prev_discard *
+						  MSEC_PER_SEC, bps_limit);
+
+			delay = max(delay, bps_delay);
+		}
+
+		/* Wait for the block group to become eligible */
+		if (now < block_group->discard_eligible_time) {
+			u64 bg_timeout = block_group->discard_eligible_time -
+					 now;
+
+			delay = max(delay, div_u64(bg_timeout, NSEC_PER_MSEC));
+		}
+
+		mod_delayed_work(discard_ctl->discard_workers,
+				 &discard_ctl->work, msecs_to_jiffies(delay));
+	}
+out:
+	spin_unlock(&discard_ctl->lock);
+}
+
+/*
+ * btrfs_discard_cancel_work - remove a block group from the discard lists
+ * @discard_ctl: discard control
+ * @block_group: block_group of interest
+ *
+ * This removes @block_group from the discard lists.  If necessary, it waits on
+ * the current work and then reschedules the delayed work.
+ */
+void btrfs_discard_cancel_work(struct btrfs_discard_ctl *discard_ctl,
+			       struct btrfs_block_group_cache *block_group)
+{
+	if (remove_from_discard_list(discard_ctl, block_group)) {
+		cancel_delayed_work_sync(&discard_ctl->work);
+		btrfs_discard_schedule_work(discard_ctl, true);
+	}
+}
+
+/*
+ * btrfs_discard_queue_work - handles queuing the block groups
+ * @discard_ctl: discard control
+ * @block_group: block_group of interest
+ *
+ * Queue a block group that is not on the discard lists yet.  Unused block
+ * groups go to the unused list with a shorter delay, as they are fully
+ * discarded and then removed.
+ */
+void btrfs_discard_queue_work(struct btrfs_discard_ctl *discard_ctl,
+			      struct btrfs_block_group_cache *block_group)
+{
+	bool unused = false;
+
+	if (!block_group || !btrfs_run_discard_work(discard_ctl))
+		return;
+
+	spin_lock(&discard_ctl->lock);
+	if (btrfs_block_group_used(&block_group->item) == 0) {
+		if (block_group->discard_index != BTRFS_DISCARD_INDEX_UNUSED ||
+		    list_empty(&block_group->discard_list)) {
+			add_to_discard_list(discard_ctl, block_group,
+					    BTRFS_DISCARD_INDEX_UNUSED,
+					    BTRFS_DISCARD_UNUSED_DELAY);
+			unused = true;
+		}
+	} else if (list_empty(&block_group->discard_list)) {
+		add_to_discard_list(discard_ctl, block_group,
+				    BTRFS_DISCARD_INDEX_START,
+				    BTRFS_DISCARD_DELAY);
+	}
+	spin_unlock(&discard_ctl->lock);
+
+	btrfs_discard_schedule_work(discard_ctl, unused);
+}
+
+/*
+ * btrfs_discard_queue_freed - queue a block group after freeing space in it
+ * @block_group: block_group of interest
+ * @offset: start of the freed region
+ * @bytes: size of the freed region
+ *
+ * Queues @block_group if needed.  A block group that is already queued is
+ * promoted to the list of large regions when the freed region passes that
+ * filter, and has its cursor reset when the region lies behind the cursor so
+ * that the current walk does not miss it.
+ */
+void btrfs_discard_queue_freed(struct btrfs_block_group_cache *block_group,
+			       u64 offset, u64 bytes)
+{
+	struct btrfs_discard_ctl *discard_ctl =
+		&block_group->fs_info->discard_ctl;
+
+	if (!btrfs_run_discard_work(discard_ctl))
+		return;
+
+	spin_lock(&discard_ctl->lock);
+	if (list_empty(&block_group->discard_list)) {
+		spin_unlock(&discard_ctl->lock);
+		btrfs_discard_queue_work(discard_ctl, block_group);
+		return;
+	}
+
+	if (block_group->discard_index > BTRFS_DISCARD_INDEX_START &&
+	    bytes >= discard_minlen[BTRFS_DISCARD_INDEX_START]) {
+		block_group->discard_index = BTRFS_DISCARD_INDEX_START;
+		block_group->discard_state = BTRFS_DISCARD_RESET_CURSOR;
+		list_move_tail(&block_group->discard_list,
+			       get_discard_list(discard_ctl, block_group));
+	} else if (block_group->discard_state != BTRFS_DISCARD_RESET_CURSOR &&
+		   (block_group->discard_state == BTRFS_DISCARD_BITMAPS ||
+		    offset < block_group->discard_cursor)) {
+		block_group->discard_state = BTRFS_DISCARD_RESET_CURSOR;
+	}
+	spin_unlock(&discard_ctl->lock);
+}
+
+/*
+ * btrfs_discard_calc_delay - recalculate the base delay
+ * @discard_ctl: discard control
+ *
+ * The base delay between two discards follows from iops_limit, a limit of 0
+ * means discards are issued back to back.
+ */
+void btrfs_discard_calc_delay(struct btrfs_discard_ctl *discard_ctl)
+{
+	u32 iops_limit;
+
+	spin_lock(&discard_ctl->lock);
+	iops_limit = READ_ONCE(discard_ctl->iops_limit);
+	if (iops_limit)
+		discard_ctl->delay = MSEC_PER_SEC / iops_limit;
+	else
+		discard_ctl->delay = 0;
+	spin_unlock(&discard_ctl->lock);
+}
+
+void btrfs_discard_resume(struct btrfs_fs_info *fs_info)
+{
+	if (!btrfs_test_opt(fs_info, DISCARD_ASYNC)) {
+		btrfs_discard_cleanup(fs_info);
+		return;
+	}
+
+	set_bit(BTRFS_FS_DISCARD_RUNNING, &fs_info->flags);
+	btrfs_discard_schedule_work(&fs_info->discard_ctl, true);
+}
+
+void btrfs_discard_stop(struct btrfs_fs_info *fs_info)
+{
+	clear_bit(BTRFS_FS_DISCARD_RUNNING, &fs_info->flags);
+}
+
+void btrfs_discard_init(struct btrfs_fs_info *fs_info)
+{
+	struct btrfs_discard_ctl *discard_ctl = &fs_info->discard_ctl;
+	int i;
+
+	spin_lock_init(&discard_ctl->lock);
+	INIT_DELAYED_WORK(&discard_ctl->work, btrfs_discard_workfn);
+
+	for (i = 0; i < BTRFS_NR_DISCARD_LISTS; i++)
+		INIT_LIST_HEAD(&discard_ctl->discard_list[i]);
+
+	discard_ctl->block_group = NULL;
+	discard_ctl->prev_discard = 0;
+	atomic_set(&discard_ctl->discardable_extents, 0);
+	atomic64_set(&discard_ctl->discardable_bytes, 0);
+	discard_ctl->max_discard_size = BTRFS_ASYNC_DISCARD_DEFAULT_MAX_SIZE;
+	discard_ctl->iops_limit = BTRFS_DISCARD_DEFAULT_IOPS;
+	discard_ctl->delay = MSEC_PER_SEC / BTRFS_DISCARD_DEFAULT_IOPS;
+	discard_ctl->kbps_limit = 0;
+	discard_ctl->discard_extent_bytes = 0;
+	discard_ctl->discard_bitmap_bytes = 0;
+	atomic64_set(&discard_ctl->discard_bytes_saved, 0);
+}
+
+/*
+ * Stop the work and take all block groups off the lists.  Their untrimmed free
+ * space is left to fstrim, or to the next frees once async discard resumes.
+ */
+void btrfs_discard_cleanup(struct btrfs_fs_info *fs_info)
+{
+	struct btrfs_discard_ctl *discard_ctl = &fs_info->discard_ctl;
+	int i;
+
+	btrfs_discard_stop(fs_info);
+	cancel_delayed_work_sync(&discard_ctl->work);
+
+	spin_lock(&discard_ctl->lock);
+	for (i = 0; i < BTRFS_NR_DISCARD_LISTS; i++) {
+		struct btrfs_block_group_cache *block_group, *next;
+
+		list_for_each_entry_safe(block_group, next,
+					 &discard_ctl->discard_list[i],
+					 discard_list) {
+			list_del_init(&block_group->discard_list);
+			block_group->discard_eligible_time = 0;
+		}
+	}
+	spin_unlock(&discard_ctl->lock);
+}
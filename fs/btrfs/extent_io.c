@@ -4943,12 +4943,16 @@ __alloc_extent_buffer(struct btrfs_fs_info *fs_info, u64 start,
 	eb->len = len;
 	eb->fs_info = fs_info;
 	eb->bflags = 0;
+#ifdef CONFIG_BTRFS_RWSEM_TREE_LOCK
+	init_rwsem(&eb->lock);
+#else
 	rwlock_init(&eb->lock);
 	atomic_set(&eb->blocking_readers, 0);
 	eb->blocking_writers = 0;
-	eb->lock_nested = false;
 	init_waitqueue_head(&eb->write_lock_wq);
 	init_waitqueue_head(&eb->read_lock_wq);
+#endif
+	eb->lock_nested = false;
 
 	btrfs_leak_debug_add(&eb->leak_list, &buffers);
 
@@ -4964,8 +4968,10 @@ __alloc_extent_buffer(struct btrfs_fs_info *fs_info, u64 start,
 	BUG_ON(len > MAX_INLINE_EXTENT_BUFFER_SIZE);
 
 #ifdef CONFIG_BTRFS_DEBUG
+#ifndef CONFIG_BTRFS_RWSEM_TREE_LOCK
 	eb->spinning_writers = 0;
 	atomic_set(&eb->spinning_readers, 0);
+#endif
 	atomic_set(&eb->read_locks, 0);
 	eb->write_locks = 0;
 #endif
@@ -169,12 +169,17 @@ struct extent_buffer {
 	struct rcu_head rcu_head;
 	pid_t lock_owner;
 
+#ifndef CONFIG_BTRFS_RWSEM_TREE_LOCK
 	int blocking_writers;
 	atomic_t blocking_readers;
+#endif
 	bool lock_nested;
 	/* >= 0 if eb belongs to a log tree, -1 otherwise */
 	short log_index;
 
+#ifdef CONFIG_BTRFS_RWSEM_TREE_LOCK
+	struct rw_semaphore lock;
+#else
 	/* protects write locks */
 	rwlock_t lock;
 
@@ -187,10 +192,13 @@ struct extent_buffer {
 	 * to unlock
 	 */
 	wait_queue_head_t read_lock_wq;
+#endif
 	struct page *pages[INLINE_EXTENT_BUFFER_PAGES];
 #ifdef CONFIG_BTRFS_DEBUG
+#ifndef CONFIG_BTRFS_RWSEM_TREE_LOCK
 	int spinning_writers;
 	atomic_t spinning_readers;
+#endif
 	atomic_t read_locks;
 	int write_locks;
 	struct list_head leak_list;
@@ -21,6 +21,7 @@
 #include "space-info.h"
 #include "delalloc-space.h"
 #include "block-group.h"
+#include "discard.h"
 
 #define BITS_PER_BITMAP		(PAGE_SIZE * 8UL)
 #define MAX_CACHE_BYTES_PER_GIG	SZ_32K
@@ -35,6 +36,7 @@ static int link_free_space(struct btrfs_free_space_ctl *ctl,
 			   struct btrfs_free_space *info);
 static void unlink_free_space(struct btrfs_free_space_ctl *ctl,
 			      struct btrfs_free_space *info);
+static const struct btrfs_free_space_op free_space_op;
 static int btrfs_wait_cache_io_root(struct btrfs_root *root,
 			     struct btrfs_trans_handle *trans,
 			     struct btrfs_io_ctl *io_ctl,
@@ -761,6 +763,12 @@ static int __load_free_space_cache(struct btrfs_root *root, struct inode *inode,
 			goto free_cache;
 		}
 
+		/*
+		 * Space loaded at mount is treated as trimmed, async discard
+		 * only goes after space freed while mounted.
+		 */
+		e->trim_state = BTRFS_TRIM_STATE_TRIMMED;
+
 		if (type == BTRFS_FREE_SPACE_EXTENT) {
 			spin_lock(&ctl->tree_lock);
 			ret = link_free_space(ctl, e);
@@ -1624,12 +1632,32 @@ tree_search_offset(struct btrfs_free_space_ctl *ctl,
 	return entry;
 }
 
+/*
+ * Every untrimmed entry, extent or bitmap, counts as one discardable extent
+ * holding its free bytes.  Only block group free space is discarded, the inode
+ * number cache shares this code but never reaches the discard machinery.
+ */
+static void update_discardable(struct btrfs_free_space_ctl *ctl,
+			       int extents, s64 bytes)
+{
+	struct btrfs_block_group_cache *block_group = ctl->private;
+
+	if (ctl->op != &free_space_op || !block_group)
+		return;
+
+	btrfs_discard_update_discardable(&block_group->fs_info->discard_ctl,
+					 extents, bytes);
+}
+
 static inline void
 __unlink_free_space(struct btrfs_free_space_ctl *ctl,
 		    struct btrfs_free_space *info)
 {
 	rb_erase(&info->offset_index, &ctl->free_space_offset);
 	ctl->free_extents--;
+
+	if (!btrfs_free_space_trimmed(info))
+		update_discardable(ctl, -1, -info->bytes);
 }
 
 static void unlink_free_space(struct btrfs_free_space_ctl *ctl,
@@ -1650,6 +1678,9 @@ static int link_free_space(struct btrfs_free_space_ctl *ctl,
 	if (ret)
 		return ret;
 
+	if (!btrfs_free_space_trimmed(info))
+		update_discardable(ctl, 1, info->bytes);
+
 	ctl->free_space += info->bytes;
 	ctl->free_extents++;
 	return ret;
@@ -1717,6 +1748,9 @@ static inline void __bitmap_clear_bits(struct btrfs_free_space_ctl *ctl,
 	info->bytes -= bytes;
 	if (info->max_extent_size > ctl->unit)
 		info->max_extent_size = 0;
+
+	if (!btrfs_free_space_trimmed(info))
+		update_discardable(ctl, 0, -bytes);
 }
 
 static void bitmap_clear_bits(struct btrfs_free_space_ctl *ctl,
@@ -1741,6 +1775,35 @@ static void bitmap_set_bits(struct btrfs_free_space_ctl *ctl,
 
 	info->bytes += bytes;
 	ctl->free_space += bytes;
+
+	if (!btrfs_free_space_trimmed(info))
+		update_discardable(ctl, 0, bytes);
+}
+
+/*
+ * Untrimmed space handed out to an allocation no longer needs a discard, keep
+ * track of how much async discard got to skip this way.
+ */
+static void discard_bytes_saved(struct btrfs_block_group_cache *block_group,
+				u64 bytes)
+{
+	struct btrfs_fs_info *fs_info = block_group->fs_info;
+
+	if (btrfs_test_opt(fs_info, DISCARD_ASYNC))
+		atomic64_add(bytes, &fs_info->discard_ctl.discard_bytes_saved);
+}
+
+static void set_trim_state(struct btrfs_free_space_ctl *ctl,
+			   struct btrfs_free_space *info,
+			   enum btrfs_trim_state trim_state)
+{
+	bool was_trimmed = btrfs_free_space_trimmed(info);
+
+	info->trim_state = trim_state;
+	if (was_trimmed && !btrfs_free_space_trimmed(info))
+		update_discardable(ctl, 1, info->bytes);
+	else if (!was_trimmed && btrfs_free_space_trimmed(info))
+		update_discardable(ctl, -1, -info->bytes);
 }
 
 /*
@@ -1881,6 +1944,7 @@ static void add_new_bitmap(struct btrfs_free_space_ctl *ctl,
 {
 	info->offset = offset_to_bitmap(ctl, offset);
 	info->bytes = 0;
+	info->trim_state = BTRFS_TRIM_STATE_TRIMMED;
 	INIT_LIST_HEAD(&info->list);
 	link_free_space(ctl, info);
 	ctl->total_bitmaps++;
@@ -1977,11 +2041,18 @@ static noinline int remove_from_bitmap(struct btrfs_free_space_ctl *ctl,
 
 static u64 add_bytes_to_bitmap(struct btrfs_free_space_ctl *ctl,
 			       struct btrfs_free_space *info, u64 offset,
-			       u64 bytes)
+			       u64 bytes, enum btrfs_trim_state trim_state)
 {
 	u64 bytes_to_set = 0;
 	u64 end;
 
+	/*
+	 * Bitmaps only carry a single trim state, so adding any untrimmed
+	 * space makes the whole bitmap untrimmed again.
+	 */
+	if (trim_state == BTRFS_TRIM_STATE_UNTRIMMED)
+		set_trim_state(ctl, info, BTRFS_TRIM_STATE_UNTRIMMED);
+
 	end = info->offset + (u64)(BITS_PER_BITMAP * ctl->unit);
 
 	bytes_to_set = min(end - offset, bytes);
@@ -2056,10 +2127,12 @@ static int insert_into_bitmap(struct btrfs_free_space_ctl *ctl,
 	struct btrfs_block_group_cache *block_group = NULL;
 	int added = 0;
 	u64 bytes, offset, bytes_added;
+	enum btrfs_trim_state trim_state;
 	int ret;
 
 	bytes = info->bytes;
 	offset = info->offset;
+	trim_state = info->trim_state;
 
 	if (!ctl->op->use_bitmap(ctl, info))
 		return 0;
@@ -2094,8 +2167,8 @@ static int insert_into_bitmap(struct btrfs_free_space_ctl *ctl,
 		}
 
 		if (entry->offset == offset_to_bitmap(ctl, offset)) {
-			bytes_added = add_bytes_to_bitmap(ctl, entry,
-							  offset, bytes);
+			bytes_added = add_bytes_to_bitmap(ctl, entry, offset,
+							  bytes, trim_state);
 			bytes -= bytes_added;
 			offset += bytes_added;
 		}
@@ -2114,7 +2187,8 @@ static int insert_into_bitmap(struct btrfs_free_space_ctl *ctl,
 		goto new_bitmap;
 	}
 
-	bytes_added = add_bytes_to_bitmap(ctl, bitmap_info, offset, bytes);
+	bytes_added = add_bytes_to_bitmap(ctl, bitmap_info, offset, bytes,
+					  trim_state);
 	bytes -= bytes_added;
 	offset += bytes_added;
 	added = 0;
@@ -2175,6 +2249,7 @@ static bool try_merge_free_space(struct btrfs_free_space_ctl *ctl,
 	bool merged = false;
 	u64 offset = info->offset;
 	u64 bytes = info->bytes;
+	const bool is_trimmed = btrfs_free_space_trimmed(info);
 
 	/*
 	 * first we want to see if there is free space adjacent to the range we
@@ -2188,7 +2263,13 @@ static bool try_merge_free_space(struct btrfs_free_space_ctl *ctl,
 	else if (!right_info)
 		left_info = tree_search_offset(ctl, offset - 1, 0, 0);
 
-	if (right_info && !right_info->bitmap) {
+	/*
+	 * Trimmed space must not pick up untrimmed neighbours or it would be
+	 * skipped by async discard, the other way around is fine as the
+	 * merged entry is simply untrimmed.
+	 */
+	if (right_info && !right_info->bitmap &&
+	    (!is_trimmed || btrfs_free_space_trimmed(right_info))) {
 		if (update_stat)
 			unlink_free_space(ctl, right_info);
 		else
@@ -2199,7 +2280,8 @@ static bool try_merge_free_space(struct btrfs_free_space_ctl *ctl,
 	}
 
 	if (left_info && !left_info->bitmap &&
-	    left_info->offset + left_info->bytes == offset) {
+	    left_info->offset + left_info->bytes == offset &&
+	    (!is_trimmed || btrfs_free_space_trimmed(left_info))) {
 		if (update_stat)
 			unlink_free_space(ctl, left_info);
 		else
@@ -2235,6 +2317,10 @@ static bool steal_from_bitmap_to_end(struct btrfs_free_space_ctl *ctl,
 	bytes = (j - i) * ctl->unit;
 	info->bytes += bytes;
 
+	/* See try_merge_free_space() comment. */
+	if (!btrfs_free_space_trimmed(bitmap))
+		info->trim_state = BTRFS_TRIM_STATE_UNTRIMMED;
+
 	if (update_stat)
 		bitmap_clear_bits(ctl, bitmap, end, bytes);
 	else
@@ -2288,6 +2374,10 @@ static bool steal_from_bitmap_to_front(struct btrfs_free_space_ctl *ctl,
 	info->offset -= bytes;
 	info->bytes += bytes;
 
+	/* See try_merge_free_space() comment. */
+	if (!btrfs_free_space_trimmed(bitmap))
+		info->trim_state = BTRFS_TRIM_STATE_UNTRIMMED;
+
 	if (update_stat)
 		bitmap_clear_bits(ctl, bitmap, info->offset, bytes);
 	else
@@ -2335,9 +2425,10 @@ static void steal_from_bitmap(struct btrfs_free_space_ctl *ctl,
 	}
 }
 
-int __btrfs_add_free_space(struct btrfs_fs_info *fs_info,
-			   struct btrfs_free_space_ctl *ctl,
-			   u64 offset, u64 bytes)
+static int __add_free_space(struct btrfs_fs_info *fs_info,
+			    struct btrfs_free_space_ctl *ctl,
+			    u64 offset, u64 bytes,
+			    enum btrfs_trim_state trim_state)
 {
 	struct btrfs_free_space *info;
 	int ret = 0;
@@ -2348,6 +2439,7 @@ int __btrfs_add_free_space(struct btrfs_fs_info *fs_info,
 
 	info->offset = offset;
 	info->bytes = bytes;
+	info->trim_state = trim_state;
 	RB_CLEAR_NODE(&info->offset_index);
 
 	spin_lock(&ctl->tree_lock);
@@ -2390,12 +2482,58 @@ int __btrfs_add_free_space(struct btrfs_fs_info *fs_info,
 	return ret;
 }
 
+int __btrfs_add_free_space(struct btrfs_fs_info *fs_info,
+			   struct btrfs_free_space_ctl *ctl,
+			   u64 offset, u64 bytes)
+{
+	return __add_free_space(fs_info, ctl, offset, bytes,
+				BTRFS_TRIM_STATE_UNTRIMMED);
+}
+
+static int add_block_group_free_space(struct btrfs_block_group_cache *block_group,
+				      u64 bytenr, u64 size,
+				      enum btrfs_trim_state trim_state)
+{
+	int ret;
+
+	ret = __add_free_space(block_group->fs_info,
+			       block_group->free_space_ctl,
+			       bytenr, size, trim_state);
+	if (!ret && trim_state == BTRFS_TRIM_STATE_UNTRIMMED)
+		btrfs_discard_queue_freed(block_group, bytenr, size);
+
+	return ret;
+}
+
 int btrfs_add_free_space(struct btrfs_block_group_cache *block_group,
 			 u64 bytenr, u64 size)
 {
-	return __btrfs_add_free_space(block_group->fs_info,
-				      block_group->free_space_ctl,
-				      bytenr, size);
+	enum btrfs_trim_state trim_state = BTRFS_TRIM_STATE_UNTRIMMED;
+
+	/* Synchronous discard already trimmed the range before freeing it. */
+	if (btrfs_test_opt(block_group->fs_info, DISCARD))
+		trim_state = BTRFS_TRIM_STATE_TRIMMED;
+
+	return add_block_group_free_space(block_group, bytenr, size,
+					  trim_state);
+}
+
+/*
+ * Used when caching a block group or creating a new one.  Freed space is added
+ * untrimmed so async discard picks it up, but the free space found at load
+ * time is considered trimmed so mounting does not discard the whole disk.
+ */
+int btrfs_add_free_space_async_trimmed(struct btrfs_block_group_cache *block_group,
+				       u64 bytenr, u64 size)
+{
+	enum btrfs_trim_state trim_state = BTRFS_TRIM_STATE_UNTRIMMED;
+
+	if (btrfs_test_opt(block_group->fs_info, DISCARD) ||
+	    btrfs_test_opt(block_group->fs_info, DISCARD_ASYNC))
+		trim_state = BTRFS_TRIM_STATE_TRIMMED;
+
+	return add_block_group_free_space(block_group, bytenr, size,
+					  trim_state);
 }
 
 int btrfs_remove_free_space(struct btrfs_block_group_cache *block_group,
@@ -2452,6 +2590,7 @@ int btrfs_remove_free_space(struct btrfs_block_group_cache *block_group,
 			goto again;
 		} else {
 			u64 old_end = info->bytes + info->offset;
+			enum btrfs_trim_state trim_state = info->trim_state;
 
 			info->bytes = offset - info->offset;
 			ret = link_free_space(ctl, info);
@@ -2470,8 +2609,11 @@ int btrfs_remove_free_space(struct btrfs_block_group_cache *block_group,
 			}
 			spin_unlock(&ctl->tree_lock);
 
-			ret = btrfs_add_free_space(block_group, offset + bytes,
-						   old_end - (offset + bytes));
+			/* The tail keeps the trim state of the split entry. */
+			ret = __add_free_space(block_group->fs_info, ctl,
+					       offset + bytes,
+					       old_end - (offset + bytes),
+					       trim_state);
 			WARN_ON(ret);
 			goto out;
 		}
@@ -2568,8 +2710,19 @@ __btrfs_return_cluster_to_free_space(
 
 		bitmap = (entry->bitmap != NULL);
 		if (!bitmap) {
+			/*
+			 * Merging folds neighbours into entry and drops their
+			 * discardable counts, so take entry out of the counts
+			 * and add the merged result back afterwards.
+			 */
+			if (!btrfs_free_space_trimmed(entry))
+				update_discardable(ctl, -1, -entry->bytes);
+
 			try_merge_free_space(ctl, entry, false);
 			steal_from_bitmap(ctl, entry, false);
+
+			if (!btrfs_free_space_trimmed(entry))
+				update_discardable(ctl, 1, entry->bytes);
 		}
 		tree_insert_offset(&ctl->free_space_offset,
 				   entry->offset, &entry->offset_index, bitmap);
@@ -2640,6 +2793,7 @@ u64 btrfs_find_space_for_alloc(struct btrfs_block_group_cache *block_group,
 	u64 ret = 0;
 	u64 align_gap = 0;
 	u64 align_gap_len = 0;
+	enum btrfs_trim_state align_gap_trim_state = BTRFS_TRIM_STATE_UNTRIMMED;
 
 	spin_lock(&ctl->tree_lock);
 	entry = find_free_space(ctl, &offset, &bytes_search,
@@ -2648,6 +2802,9 @@ u64 btrfs_find_space_for_alloc(struct btrfs_block_group_cache *block_group,
 		goto out;
 
 	ret = offset;
+	if (!btrfs_free_space_trimmed(entry))
+		discard_bytes_saved(block_group, bytes);
+
 	if (entry->bitmap) {
 		bitmap_clear_bits(ctl, entry, offset, bytes);
 		if (!entry->bytes)
@@ -2656,6 +2813,7 @@ u64 btrfs_find_space_for_alloc(struct btrfs_block_group_cache *block_group,
 		unlink_free_space(ctl, entry);
 		align_gap_len = offset - entry->offset;
 		align_gap = entry->offset;
+		align_gap_trim_state = entry->trim_state;
 
 		entry->offset = offset + bytes;
 		WARN_ON(entry->bytes < bytes + align_gap_len);
@@ -2670,8 +2828,9 @@ u64 btrfs_find_space_for_alloc(struct btrfs_block_group_cache *block_group,
 	spin_unlock(&ctl->tree_lock);
 
 	if (align_gap_len)
-		__btrfs_add_free_space(block_group->fs_info, ctl,
-				       align_gap, align_gap_len);
+		__add_free_space(block_group->fs_info, ctl,
+				 align_gap, align_gap_len,
+				 align_gap_trim_state);
 	return ret;
 }
 
@@ -2820,9 +2979,18 @@ u64 btrfs_alloc_from_cluster(struct btrfs_block_group_cache *block_group,
 
 	spin_lock(&ctl->tree_lock);
 
+	if (!btrfs_free_space_trimmed(entry)) {
+		discard_bytes_saved(block_group, bytes);
+		/* Bitmap bits were accounted for when they were cleared. */
+		if (!entry->bitmap)
+			update_discardable(ctl, 0, -bytes);
+	}
+
 	ctl->free_space -= bytes;
 	if (entry->bytes == 0) {
 		ctl->free_extents--;
+		if (!btrfs_free_space_trimmed(entry))
+			update_discardable(ctl, -1, 0);
 		if (entry->bitmap) {
 			kmem_cache_free(btrfs_free_space_bitmap_cachep,
 					entry->bitmap);
@@ -3154,6 +3322,7 @@ void btrfs_init_free_cluster(struct btrfs_free_cluster *cluster)
 static int do_trimming(struct btrfs_block_group_cache *block_group,
 		       u64 *total_trimmed, u64 start, u64 bytes,
 		       u64 reserved_start, u64 reserved_bytes,
+		       enum btrfs_trim_state reserved_trim_state,
 		       struct btrfs_trim_range *trim_entry)
 {
 	struct btrfs_space_info *space_info = block_group->space_info;
@@ -3161,6 +3330,9 @@ static int do_trimming(struct btrfs_block_group_cache *block_group,
 	struct btrfs_free_space_ctl *ctl = block_group->free_space_ctl;
 	int ret;
 	int update = 0;
+	const u64 end = start + bytes;
+	const u64 reserved_end = reserved_start + reserved_bytes;
+	enum btrfs_trim_state trim_state = BTRFS_TRIM_STATE_UNTRIMMED;
 	u64 trimmed = 0;
 
 	spin_lock(&space_info->lock);
@@ -3174,11 +3346,23 @@ static int do_trimming(struct btrfs_block_group_cache *block_group,
 	spin_unlock(&space_info->lock);
 
 	ret = btrfs_discard_extent(fs_info, start, bytes, &trimmed);
-	if (!ret)
+	if (!ret) {
 		*total_trimmed += trimmed;
+		trim_state = BTRFS_TRIM_STATE_TRIMMED;
+	}
 
+	/*
+	 * Only [start, end) was discarded, the rest of the reserved range goes
+	 * back with the trim state it had.
+	 */
 	mutex_lock(&ctl->cache_writeout_mutex);
-	btrfs_add_free_space(block_group, reserved_start, reserved_bytes);
+	if (reserved_start < start)
+		__add_free_space(fs_info, ctl, reserved_start,
+				 start - reserved_start, reserved_trim_state);
+	if (end < reserved_end)
+		__add_free_space(fs_info, ctl, end, reserved_end - end,
+				 reserved_trim_state);
+	__add_free_space(fs_info, ctl, start, bytes, trim_state);
 	list_del(&trim_entry->list);
 	mutex_unlock(&ctl->cache_writeout_mutex);
 
@@ -3196,8 +3380,14 @@ static int do_trimming(struct btrfs_block_group_cache *block_group,
 	return ret;
 }
 
+/*
+ * If @async is set, trim one untrimmed extent of at least @minlen, at most
+ * @maxlen bytes of it, and leave block_group->discard_cursor behind it.
+ * Otherwise trim everything in [@start, @end).
+ */
 static int trim_no_bitmap(struct btrfs_block_group_cache *block_group,
-			  u64 *total_trimmed, u64 start, u64 end, u64 minlen)
+			  u64 *total_trimmed, u64 start, u64 end, u64 minlen,
+			  u64 maxlen, bool async)
 {
 	struct btrfs_free_space_ctl *ctl = block_group->free_space_ctl;
 	struct btrfs_free_space *entry;
@@ -3205,6 +3395,7 @@ static int trim_no_bitmap(struct btrfs_block_group_cache *block_group,
 	int ret = 0;
 	u64 extent_start;
 	u64 extent_bytes;
+	enum btrfs_trim_state extent_trim_state;
 	u64 bytes;
 
 	while (start < end) {
@@ -3213,49 +3404,64 @@ static int trim_no_bitmap(struct btrfs_block_group_cache *block_group,
 		mutex_lock(&ctl->cache_writeout_mutex);
 		spin_lock(&ctl->tree_lock);
 
-		if (ctl->free_space < minlen) {
-			spin_unlock(&ctl->tree_lock);
-			mutex_unlock(&ctl->cache_writeout_mutex);
-			break;
-		}
+		if (ctl->free_space < minlen)
+			goto out_unlock;
 
 		entry = tree_search_offset(ctl, start, 0, 1);
-		if (!entry) {
-			spin_unlock(&ctl->tree_lock);
-			mutex_unlock(&ctl->cache_writeout_mutex);
-			break;
-		}
+		if (!entry)
+			goto out_unlock;
 
-		/* skip bitmaps */
-		while (entry->bitmap) {
+		/* skip bitmaps and, if async, already trimmed extents */
+		while (entry->bitmap ||
+		       (async && btrfs_free_space_trimmed(entry))) {
 			node = rb_next(&entry->offset_index);
-			if (!node) {
-				spin_unlock(&ctl->tree_lock);
-				mutex_unlock(&ctl->cache_writeout_mutex);
-				goto out;
-			}
+			if (!node)
+				goto out_unlock;
 			entry = rb_entry(node, struct btrfs_free_space,
 					 offset_index);
 		}
 
-		if (entry->offset >= end) {
-			spin_unlock(&ctl->tree_lock);
-			mutex_unlock(&ctl->cache_writeout_mutex);
-			break;
-		}
+		if (entry->offset >= end)
+			goto out_unlock;
 
 		extent_start = entry->offset;
 		extent_bytes = entry->bytes;
-		start = max(start, extent_start);
-		bytes = min(extent_start + extent_bytes, end) - start;
-		if (bytes < minlen) {
-			spin_unlock(&ctl->tree_lock);
-			mutex_unlock(&ctl->cache_writeout_mutex);
-			goto next;
-		}
+		extent_trim_state = entry->trim_state;
+		if (async) {
+			start = entry->offset;
+			bytes = entry->bytes;
+			if (bytes < minlen) {
+				spin_unlock(&ctl->tree_lock);
+				mutex_unlock(&ctl->cache_writeout_mutex);
+				goto next;
+			}
+			unlink_free_space(ctl, entry);
+			/*
+			 * Split off what is left after @maxlen, unless it would
+			 * be too small to be worth coming back for.
+			 */
+			if (maxlen &&
+			    bytes >= maxlen + BTRFS_ASYNC_DISCARD_MIN_FILTER) {
+				bytes = maxlen;
+				extent_bytes = maxlen;
+				entry->offset += maxlen;
+				entry->bytes -= maxlen;
+				link_free_space(ctl, entry);
+			} else {
+				kmem_cache_free(btrfs_free_space_cachep, entry);
+			}
+		} else {
+			start = max(start, extent_start);
+			bytes = min(extent_start + extent_bytes, end) - start;
+			if (bytes < minlen) {
+				spin_unlock(&ctl->tree_lock);
+				mutex_unlock(&ctl->cache_writeout_mutex);
+				goto next;
+			}
 
-		unlink_free_space(ctl, entry);
-		kmem_cache_free(btrfs_free_space_cachep, entry);
+			unlink_free_space(ctl, entry);
+			kmem_cache_free(btrfs_free_space_cachep, entry);
+		}
 
 		spin_unlock(&ctl->tree_lock);
 		trim_entry.start = extent_start;
@@ -3264,11 +3470,17 @@ static int trim_no_bitmap(struct btrfs_block_group_cache *block_group,
 		mutex_unlock(&ctl->cache_writeout_mutex);
 
 		ret = do_trimming(block_group, total_trimmed, start, bytes,
-				  extent_start, extent_bytes, &trim_entry);
-		if (ret)
+				  extent_start, extent_bytes, extent_trim_state,
+				  &trim_entry);
+		if (ret) {
+			block_group->discard_cursor = start + bytes;
 			break;
+		}
 next:
 		start += bytes;
+		block_group->discard_cursor = start;
+		if (async && *total_trimmed)
+			break;
 
 		if (fatal_signal_pending(current)) {
 			ret = -ERESTARTSYS;
@@ -3277,12 +3489,49 @@ static int trim_no_bitmap(struct btrfs_block_group_cache *block_group,
 
 		cond_resched();
 	}
-out:
+
 	return ret;
+
+out_unlock:
+	block_group->discard_cursor = end;
+	spin_unlock(&ctl->tree_lock);
+	mutex_unlock(&ctl->cache_writeout_mutex);
+
+	return ret;
+}
+
+/*
+ * A bitmap is only considered trimmed once it has been walked from its first
+ * bit to its last without adding untrimmed space in between, which
+ * BTRFS_TRIM_STATE_TRIMMING tracks.  Both helpers need ctl->tree_lock.
+ */
+static void end_trimming_bitmap(struct btrfs_free_space_ctl *ctl,
+				struct btrfs_free_space *entry)
+{
+	if (btrfs_free_space_trimming_bitmap(entry))
+		set_trim_state(ctl, entry, BTRFS_TRIM_STATE_TRIMMED);
+}
+
+static void reset_trimming_bitmap(struct btrfs_free_space_ctl *ctl,
+				  u64 offset)
+{
+	struct btrfs_free_space *entry;
+
+	spin_lock(&ctl->tree_lock);
+	entry = tree_search_offset(ctl, offset, 1, 0);
+	if (entry && btrfs_free_space_trimming_bitmap(entry))
+		set_trim_state(ctl, entry, BTRFS_TRIM_STATE_UNTRIMMED);
+	spin_unlock(&ctl->tree_lock);
 }
 
+/*
+ * If @async is set, trim a single region of at least @minlen and leave
+ * block_group->discard_cursor behind it, capping the region at @maxlen.
+ * Otherwise trim everything in [@start, @end).
+ */
 static int trim_bitmaps(struct btrfs_block_group_cache *block_group,
-			u64 *total_trimmed, u64 start, u64 end, u64 minlen)
+			u64 *total_trimmed, u64 start, u64 end, u64 minlen,
+			u64 maxlen, bool async)
 {
 	struct btrfs_free_space_ctl *ctl = block_group->free_space_ctl;
 	struct btrfs_free_space *entry;
@@ -3299,28 +3548,59 @@ static int trim_bitmaps(struct btrfs_block_group_cache *block_group,
 		spin_lock(&ctl->tree_lock);
 
 		if (ctl->free_space < minlen) {
+			block_group->discard_cursor = end;
 			spin_unlock(&ctl->tree_lock);
 			mutex_unlock(&ctl->cache_writeout_mutex);
 			break;
 		}
 
+		/*
+		 * Trimmed bitmaps are skipped by the size filtered passes, the
+		 * unused pass (@minlen of 0) walks them again as the whole
+		 * block group has to be discarded before it is removed.
+		 */
 		entry = tree_search_offset(ctl, offset, 1, 0);
-		if (!entry) {
+		if (!entry || (async && minlen && start == offset &&
+			       btrfs_free_space_trimmed(entry))) {
 			spin_unlock(&ctl->tree_lock);
 			mutex_unlock(&ctl->cache_writeout_mutex);
 			next_bitmap = true;
 			goto next;
 		}
 
+		/* Starting at the first bit means the whole bitmap is walked */
+		if (start == offset)
+			set_trim_state(ctl, entry, BTRFS_TRIM_STATE_TRIMMING);
+
 		bytes = minlen;
 		ret2 = search_bitmap(ctl, entry, &start, &bytes, false);
 		if (ret2 || start >= end) {
+			/*
+			 * Regions below the smallest filter are never
+			 * discarded, so a bitmap that only has those left
+			 * counts as trimmed.
+			 */
+			if (ret2 && minlen <= BTRFS_ASYNC_DISCARD_MIN_FILTER)
+				end_trimming_bitmap(ctl, entry);
+			else if (btrfs_free_space_trimming_bitmap(entry))
+				set_trim_state(ctl, entry,
+					       BTRFS_TRIM_STATE_UNTRIMMED);
 			spin_unlock(&ctl->tree_lock);
 			mutex_unlock(&ctl->cache_writeout_mutex);
 			next_bitmap = true;
 			goto next;
 		}
 
+		/*
+		 * Async discard already issued its region and only came back
+		 * around to settle the trim state of the bitmap above.
+		 */
+		if (async && *total_trimmed) {
+			spin_unlock(&ctl->tree_lock);
+			mutex_unlock(&ctl->cache_writeout_mutex);
+			break;
+		}
+
 		bytes = min(bytes, end - start);
 		if (bytes < minlen) {
 			spin_unlock(&ctl->tree_lock);
@@ -3328,6 +3608,13 @@ static int trim_bitmaps(struct btrfs_block_group_cache *block_group,
 			goto next;
 		}
 
+		/*
+		 * Bits are not tracked individually, so a remainder smaller
+		 * than @minlen would never be picked up again.  Trim it now.
+		 */
+		if (async && maxlen && bytes > maxlen + minlen)
+			bytes = maxlen;
+
 		bitmap_clear_bits(ctl, entry, start, bytes);
 		if (entry->bytes == 0)
 			free_bitmap(ctl, entry);
@@ -3339,19 +3626,25 @@ static int trim_bitmaps(struct btrfs_block_group_cache *block_group,
 		mutex_unlock(&ctl->cache_writeout_mutex);
 
 		ret = do_trimming(block_group, total_trimmed, start, bytes,
-				  start, bytes, &trim_entry);
-		if (ret)
+				  start, bytes, BTRFS_TRIM_STATE_UNTRIMMED,
+				  &trim_entry);
+		if (ret) {
+			reset_trimming_bitmap(ctl, offset);
+			block_group->discard_cursor = end;
 			break;
+		}
 next:
 		if (next_bitmap) {
 			offset += BITS_PER_BITMAP * ctl->unit;
+			start = offset;
 		} else {
 			start += bytes;
-			if (start >= offset + BITS_PER_BITMAP * ctl->unit)
-				offset += BITS_PER_BITMAP * ctl->unit;
 		}
+		block_group->discard_cursor = start;
 
 		if (fatal_signal_pending(current)) {
+			if (start != offset)
+				reset_trimming_bitmap(ctl, offset);
 			ret = -ERESTARTSYS;
 			break;
 		}
@@ -3359,6 +3652,9 @@ static int trim_bitmaps(struct btrfs_block_group_cache *block_group,
 		cond_resched();
 	}
 
+	if (offset >= end)
+		block_group->discard_cursor = end;
+
 	return ret;
 }
 
@@ -3417,16 +3713,92 @@ int btrfs_trim_block_group(struct btrfs_block_group_cache *block_group,
 	btrfs_get_block_group_trimming(block_group);
 	spin_unlock(&block_group->lock);
 
-	ret = trim_no_bitmap(block_group, trimmed, start, end, minlen);
+	ret = trim_no_bitmap(block_group, trimmed, start, end, minlen, 0,
+			     false);
 	if (ret)
 		goto out;
 
-	ret = trim_bitmaps(block_group, trimmed, start, end, minlen);
+	ret = trim_bitmaps(block_group, trimmed, start, end, minlen, 0, false);
 out:
 	btrfs_put_block_group_trimming(block_group);
 	return ret;
 }
 
+int btrfs_trim_block_group_extents(struct btrfs_block_group_cache *block_group,
+				   u64 *trimmed, u64 start, u64 end, u64 minlen,
+				   u64 maxlen, bool async)
+{
+	int ret;
+
+	*trimmed = 0;
+
+	spin_lock(&block_group->lock);
+	if (block_group->removed) {
+		spin_unlock(&block_group->lock);
+		return 0;
+	}
+	btrfs_get_block_group_trimming(block_group);
+	spin_unlock(&block_group->lock);
+
+	ret = trim_no_bitmap(block_group, trimmed, start, end, minlen, maxlen,
+			     async);
+
+	btrfs_put_block_group_trimming(block_group);
+	return ret;
+}
+
+int btrfs_trim_block_group_bitmaps(struct btrfs_block_group_cache *block_group,
+				   u64 *trimmed, u64 start, u64 end, u64 minlen,
+				   u64 maxlen, bool async)
+{
+	int ret;
+
+	*trimmed = 0;
+
+	spin_lock(&block_group->lock);
+	if (block_group->removed) {
+		spin_unlock(&block_group->lock);
+		return 0;
+	}
+	btrfs_get_block_group_trimming(block_group);
+	spin_unlock(&block_group->lock);
+
+	ret = trim_bitmaps(block_group, trimmed, start, end, minlen, maxlen,
+			   async);
+
+	btrfs_put_block_group_trimming(block_group);
+	return ret;
+}
+
+/*
+ * Check whether all free space of @block_group has been trimmed, used before
+ * removing an unused block group with async discard enabled.
+ */
+bool btrfs_is_free_space_trimmed(struct btrfs_block_group_cache *block_group)
+{
+	struct btrfs_free_space_ctl *ctl = block_group->free_space_ctl;
+	struct btrfs_free_space *info;
+	struct rb_node *node;
+	bool ret = true;
+
+	spin_lock(&ctl->tree_lock);
+	node = rb_first(&ctl->free_space_offset);
+
+	while (node) {
+		info = rb_entry(node, struct btrfs_free_space, offset_index);
+
+		if (!btrfs_free_space_trimmed(info)) {
+			ret = false;
+			break;
+		}
+
+		node = rb_next(node);
+	}
+
+	spin_unlock(&ctl->tree_lock);
+	return ret;
+}
+
 /*
  * Find the left-most item in the cache tree, and then return the
  * smallest inode number in the item.
@@ -3647,7 +4019,8 @@ int test_add_free_space_entry(struct btrfs_block_group_cache *cache,
 		info = NULL;
 	}
 
-	bytes_added = add_bytes_to_bitmap(ctl, bitmap_info, offset, bytes);
+	bytes_added = add_bytes_to_bitmap(ctl, bitmap_info, offset, bytes,
+					  BTRFS_TRIM_STATE_UNTRIMMED);
 
 	bytes -= bytes_added;
 	offset += bytes_added;
@@ -13,7 +13,10 @@
 #include "extent_io.h"
 #include "locking.h"
 
+static_assert(BTRFS_NESTING_MAX <= MAX_LOCKDEP_SUBCLASSES);
+
 #ifdef CONFIG_BTRFS_DEBUG
+#ifndef CONFIG_BTRFS_RWSEM_TREE_LOCK
 static void btrfs_assert_spinning_writers_get(struct extent_buffer *eb)
 {
 	WARN_ON(eb->spinning_writers);
@@ -41,6 +44,7 @@ static void btrfs_assert_spinning_readers_put(struct extent_buffer *eb)
 	WARN_ON(atomic_read(&eb->spinning_readers) == 0);
 	atomic_dec(&eb->spinning_readers);
 }
+#endif
 
 static void btrfs_assert_tree_read_locks_get(struct extent_buffer *eb)
 {
@@ -73,11 +77,13 @@ void btrfs_assert_tree_locked(struct extent_buffer *eb)
 }
 
 #else
+#ifndef CONFIG_BTRFS_RWSEM_TREE_LOCK
 static void btrfs_assert_spinning_writers_get(struct extent_buffer *eb) { }
 static void btrfs_assert_spinning_writers_put(struct extent_buffer *eb) { }
 static void btrfs_assert_no_spinning_writers(struct extent_buffer *eb) { }
 static void btrfs_assert_spinning_readers_put(struct extent_buffer *eb) { }
 static void btrfs_assert_spinning_readers_get(struct extent_buffer *eb) { }
+#endif
 static void btrfs_assert_tree_read_locked(struct extent_buffer *eb) { }
 static void btrfs_assert_tree_read_locks_get(struct extent_buffer *eb) { }
 static void btrfs_assert_tree_read_locks_put(struct extent_buffer *eb) { }
@@ -86,6 +92,167 @@ static void btrfs_assert_tree_write_locks_get(struct extent_buffer *eb) { }
 static void btrfs_assert_tree_write_locks_put(struct extent_buffer *eb) { }
 #endif
 
+#ifdef CONFIG_BTRFS_RWSEM_TREE_LOCK
+/*
+ * Extent buffer locking based on a plain rw_semaphore.
+ *
+ * Lock holders may sleep with the lock held, so there is no separate blocking
+ * mode and btrfs_set_lock_blocking_read/write only emit their tracepoints.
+ * Waiters spin while the lock owner is running on another CPU (rwsem
+ * optimistic spinning) and go to sleep otherwise, which replaces the manual
+ * switch between spinning and blocking locks done by the callers.
+ *
+ * The lock is taken with the nesting subclass given by the caller so lockdep
+ * can validate locking of several blocks on the same level, see
+ * enum btrfs_lock_nesting.
+ *
+ * The only recursion allowed is a read lock taken by the thread that already
+ * holds the write lock.  btrfs_find_all_roots() depends on this as it may be
+ * called on a partly (write-)locked tree.  This is tracked by lock_owner and
+ * lock_nested, same as the spinning locks do.
+ */
+
+void btrfs_set_lock_blocking_read(struct extent_buffer *eb)
+{
+	trace_btrfs_set_lock_blocking_read(eb);
+}
+
+void btrfs_set_lock_blocking_write(struct extent_buffer *eb)
+{
+	trace_btrfs_set_lock_blocking_write(eb);
+}
+
+/*
+ * take a read lock.  This will wait for any writers
+ */
+void btrfs_tree_read_lock_nested(struct extent_buffer *eb,
+				 enum btrfs_lock_nesting nest)
+{
+	u64 start_ns = 0;
+
+	if (trace_btrfs_tree_read_lock_enabled())
+		start_ns = ktime_get_ns();
+
+	if (eb->lock_owner == current->pid) {
+		/*
+		 * This extent is already write-locked by our thread, the
+		 * additional read lock is accounted in lock_nested only.
+		 */
+		BUG_ON(eb->lock_nested);
+		eb->lock_nested = true;
+		trace_btrfs_tree_read_lock(eb, start_ns);
+		return;
+	}
+	down_read_nested(&eb->lock, nest);
+	btrfs_assert_tree_read_locks_get(eb);
+	trace_btrfs_tree_read_lock(eb, start_ns);
+}
+
+/*
+ * take a read lock without sleeping.
+ * returns 1 if we get the read lock and 0 if we don't
+ */
+int btrfs_tree_read_lock_atomic(struct extent_buffer *eb)
+{
+	if (!down_read_trylock(&eb->lock))
+		return 0;
+	btrfs_assert_tree_read_locks_get(eb);
+	trace_btrfs_tree_read_lock_atomic(eb);
+	return 1;
+}
+
+/*
+ * returns 1 if we get the read lock and 0 if we don't
+ * this won't wait for writers
+ */
+int btrfs_try_tree_read_lock(struct extent_buffer *eb)
+{
+	if (!down_read_trylock(&eb->lock))
+		return 0;
+	btrfs_assert_tree_read_locks_get(eb);
+	trace_btrfs_try_tree_read_lock(eb);
+	return 1;
+}
+
+/*
+ * returns 1 if we get the write lock and 0 if we don't
+ * this won't wait for readers or writers
+ */
+int btrfs_try_tree_write_lock(struct extent_buffer *eb)
+{
+	if (!down_write_trylock(&eb->lock))
+		return 0;
+	btrfs_assert_tree_write_locks_get(eb);
+	eb->lock_owner = current->pid;
+	trace_btrfs_try_tree_write_lock(eb);
+	return 1;
+}
+
+static void __btrfs_tree_read_unlock(struct extent_buffer *eb)
+{
+	/*
+	 * if we're nested, we have the write lock.  No new locking
+	 * is needed as long as we are the lock owner.
+	 */
+	if (eb->lock_nested && current->pid == eb->lock_owner) {
+		eb->lock_nested = false;
+		return;
+	}
+	btrfs_assert_tree_read_locked(eb);
+	btrfs_assert_tree_read_locks_put(eb);
+	up_read(&eb->lock);
+}
+
+/*
+ * drop a read lock
+ */
+void btrfs_tree_read_unlock(struct extent_buffer *eb)
+{
+	trace_btrfs_tree_read_unlock(eb);
+	__btrfs_tree_read_unlock(eb);
+}
+
+/*
+ * drop a read lock that was set blocking, same as btrfs_tree_read_unlock
+ */
+void btrfs_tree_read_unlock_blocking(struct extent_buffer *eb)
+{
+	trace_btrfs_tree_read_unlock_blocking(eb);
+	__btrfs_tree_read_unlock(eb);
+}
+
+/*
+ * take a write lock.  This will wait for both readers and writers
+ */
+void btrfs_tree_lock_nested(struct extent_buffer *eb,
+			    enum btrfs_lock_nesting nest)
+{
+	u64 start_ns = 0;
+
+	if (trace_btrfs_tree_lock_enabled())
+		start_ns = ktime_get_ns();
+
+	WARN_ON(eb->lock_owner == current->pid);
+	down_write_nested(&eb->lock, nest);
+	btrfs_assert_tree_write_locks_get(eb);
+	eb->lock_owner = current->pid;
+	trace_btrfs_tree_lock(eb, start_ns);
+}
+
+/*
+ * drop a write lock
+ */
+void btrfs_tree_unlock(struct extent_buffer *eb)
+{
+	btrfs_assert_tree_locked(eb);
+	trace_btrfs_tree_unlock(eb);
+	eb->lock_owner = 0;
+	btrfs_assert_tree_write_locks_put(eb);
+	up_write(&eb->lock);
+}
+
+#else /* CONFIG_BTRFS_RWSEM_TREE_LOCK */
+
 void btrfs_set_lock_blocking_read(struct extent_buffer *eb)
 {
 	trace_btrfs_set_lock_blocking_read(eb);
@@ -123,8 +290,12 @@ void btrfs_set_lock_blocking_write(struct extent_buffer *eb)
 /*
  * take a spinning read lock.  This will wait for any blocking
  * writers
+ *
+ * The spinning lock is never held across a blocking section, lockdep only
+ * sees the short spinning sections and the nesting is not used.
  */
-void btrfs_tree_read_lock(struct extent_buffer *eb)
+void btrfs_tree_read_lock_nested(struct extent_buffer *eb,
+				 enum btrfs_lock_nesting nest)
 {
 	u64 start_ns = 0;
 
@@ -272,7 +443,8 @@ void btrfs_tree_read_unlock_blocking(struct extent_buffer *eb)
  * take a spinning write lock.  This will wait for both
  * blocking readers or writers
  */
-void btrfs_tree_lock(struct extent_buffer *eb)
+void btrfs_tree_lock_nested(struct extent_buffer *eb,
+			    enum btrfs_lock_nesting nest)
 {
 	u64 start_ns = 0;
 
@@ -322,3 +494,14 @@ void btrfs_tree_unlock(struct extent_buffer *eb)
 		write_unlock(&eb->lock);
 	}
 }
+#endif /* CONFIG_BTRFS_RWSEM_TREE_LOCK */
+
+void btrfs_tree_read_lock(struct extent_buffer *eb)
+{
+	btrfs_tree_read_lock_nested(eb, BTRFS_NESTING_NORMAL);
+}
+
+void btrfs_tree_lock(struct extent_buffer *eb)
+{
+	btrfs_tree_lock_nested(eb, BTRFS_NESTING_NORMAL);
+}
@@ -11,9 +11,67 @@
 #define BTRFS_WRITE_LOCK_BLOCKING 3
 #define BTRFS_READ_LOCK_BLOCKING 4
 
+/*
+ * Lockdep subclasses for extent buffer locks.  The lockdep class of a tree
+ * block is picked by owner and level (see btrfs_set_buffer_lockdep_class()),
+ * these distinguish several blocks of the same level locked at once.  We are
+ * limited to MAX_LOCKDEP_SUBCLASSES (8) and use all of them.
+ */
+enum btrfs_lock_nesting {
+	BTRFS_NESTING_NORMAL,
+
+	/*
+	 * When we COW a block we are holding the lock on the original block,
+	 * and since our lockdep maps are rootid+level, this confuses lockdep
+	 * when we lock the newly allocated COW'd block.  Handle this by having
+	 * a subclass for COW'ed blocks so that lockdep doesn't complain.
+	 */
+	BTRFS_NESTING_COW,
+
+	/*
+	 * Oftentimes we need to lock adjacent nodes on the same level while
+	 * still holding the lock on the original node we searched to, such as
+	 * for searching forward or for split/balance.
+	 *
+	 * Because of this we need to indicate to lockdep that this is
+	 * acceptable by having a different subclass for each of these
+	 * operations.
+	 */
+	BTRFS_NESTING_LEFT,
+	BTRFS_NESTING_RIGHT,
+
+	/*
+	 * When splitting we will be holding a lock on the left/right node when
+	 * we need to cow that node, thus we need a new set of subclasses for
+	 * these two operations.
+	 */
+	BTRFS_NESTING_LEFT_COW,
+	BTRFS_NESTING_RIGHT_COW,
+
+	/*
+	 * When splitting we need to lock the newly allocated split block while
+	 * still holding the original block.
+	 */
+	BTRFS_NESTING_SPLIT,
+
+	/*
+	 * When we add a new root we hold the old root locked while locking the
+	 * new one, and a double split of a leaf allocates its second block
+	 * while still holding the first.
+	 */
+	BTRFS_NESTING_NEW_ROOT,
+
+	/* Checked against MAX_LOCKDEP_SUBCLASSES in locking.c */
+	BTRFS_NESTING_MAX,
+};
+
+void btrfs_tree_lock_nested(struct extent_buffer *eb,
+			    enum btrfs_lock_nesting nest);
 void btrfs_tree_lock(struct extent_buffer *eb);
 void btrfs_tree_unlock(struct extent_buffer *eb);
 
+void btrfs_tree_read_lock_nested(struct extent_buffer *eb,
+				 enum btrfs_lock_nesting nest);
 void btrfs_tree_read_lock(struct extent_buffer *eb);
 void btrfs_tree_read_unlock(struct extent_buffer *eb);
 void btrfs_tree_read_unlock_blocking(struct extent_buffer *eb);
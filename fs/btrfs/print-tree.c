@@ -153,6 +153,13 @@ static void print_uuid_item(struct extent_buffer *l, unsigned long offset,
 static void print_eb_refs_lock(struct extent_buffer *eb)
 {
 #ifdef CONFIG_BTRFS_DEBUG
+#ifdef CONFIG_BTRFS_RWSEM_TREE_LOCK
+	btrfs_info(eb->fs_info,
+		   "refs %u lock (w:%d r:%d) lock_owner %u current %u",
+		   atomic_read(&eb->refs), eb->write_locks,
+		   atomic_read(&eb->read_locks),
+		   eb->lock_owner, current->pid);
+#else
 	btrfs_info(eb->fs_info,
 "refs %u lock (w:%d r:%d bw:%d br:%d sw:%d sr:%d) lock_owner %u current %u",
 		   atomic_read(&eb->refs), eb->write_locks,
@@ -163,6 +170,7 @@ static void print_eb_refs_lock(struct extent_buffer *eb)
 		   atomic_read(&eb->spinning_readers),
 		   eb->lock_owner, current->pid);
 #endif
+#endif
 }
 
 void btrfs_print_leaf(struct extent_buffer *l)
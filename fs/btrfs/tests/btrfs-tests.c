@@ -226,6 +226,7 @@ btrfs_alloc_dummy_block_group(struct btrfs_fs_info *fs_info,
 	INIT_LIST_HEAD(&cache->list);
 	INIT_LIST_HEAD(&cache->cluster_list);
 	INIT_LIST_HEAD(&cache->bg_list);
+	INIT_LIST_HEAD(&cache->discard_list);
 	btrfs_init_free_space_ctl(cache);
 	mutex_init(&cache->free_space_lock);
 
@@ -26,15 +26,45 @@
 #include <linux/namei.h>
 #include "fscrypt_private.h"
 
-static void __fscrypt_decrypt_bio(struct bio *bio, bool done)
+/*
+ * Bios of at most this many bytes whose inode uses a synchronous cipher are
+ * decrypted directly in their completion handler, see
+ * fscrypt_decrypt_bio_atomic().  0 disables this.
+ */
+static unsigned int max_inline_decrypt_bytes = 16384;
+module_param(max_inline_decrypt_bytes, uint, 0644);
+MODULE_PARM_DESC(max_inline_decrypt_bytes,
+		 "Largest read bio to decrypt in its completion handler");
+
+static inline struct inode *bio_inode(struct bio *bio)
+{
+	return bio_first_page_all(bio)->mapping->host;
+}
+
+/*
+ * Decrypt all the pages of @bio with a single request, marking the ones that
+ * fail with PG_error.  Returns false without touching any page if the request
+ * can't be allocated.
+ */
+static bool decrypt_bio_pages(struct bio *bio, bool done, gfp_t gfp_flags)
 {
+	const struct inode *inode = bio_inode(bio);
+	FSCRYPT_REQUEST_ON_STACK(stack_req);
+	DECLARE_CRYPTO_WAIT(wait);
+	struct skcipher_request *req;
 	struct bio_vec *bv;
 	struct bvec_iter_all iter_all;
 
+	req = fscrypt_alloc_request(inode->i_crypt_info, stack_req, &wait,
+				    gfp_flags);
+	if (!req)
+		return false;
+
 	bio_for_each_segment_all(bv, bio, iter_all) {
 		struct page *page = bv->bv_page;
-		int ret = fscrypt_decrypt_pagecache_blocks(page, bv->bv_len,
-							   bv->bv_offset);
+		int ret = fscrypt_decrypt_pagecache_blocks_req(req, page,
+							       bv->bv_len,
+							       bv->bv_offset);
 		if (ret)
 			SetPageError(page);
 		else if (done)
@@ -42,6 +72,25 @@ static void __fscrypt_decrypt_bio(struct bio *bio, bool done)
 		if (done)
 			unlock_page(page);
 	}
+
+	fscrypt_free_request(req, stack_req);
+	return true;
+}
+
+static void __fscrypt_decrypt_bio(struct bio *bio, bool done)
+{
+	struct bio_vec *bv;
+	struct bvec_iter_all iter_all;
+
+	if (!decrypt_bio_pages(bio, done, GFP_NOFS)) {
+		bio_for_each_segment_all(bv, bio, iter_all) {
+			SetPageError(bv->bv_page);
+			if (done)
+				unlock_page(bv->bv_page);
+		}
+		return;
+	}
+	fscrypt_stats_add_bio(bio_inode(bio), false);
 }
 
 void fscrypt_decrypt_bio(struct bio *bio)
@@ -50,6 +99,43 @@ void fscrypt_decrypt_bio(struct bio *bio)
 }
 EXPORT_SYMBOL(fscrypt_decrypt_bio);
 
+/**
+ * fscrypt_decrypt_bio_atomic() - decrypt a bio from its completion handler
+ * @bio: the completed read bio
+ *
+ * Decrypting in a workqueue costs a context switch per bio, which dominates for
+ * small reads when the cipher is fast.  So when the inode's cipher is
+ * synchronous (and thus needs no request allocation and never sleeps) and the
+ * bio is small, decrypt it right away, even in softirq context.  Pages that
+ * fail decryption are set to the Error state, as with fscrypt_decrypt_bio().
+ *
+ * Return: true if the bio was decrypted, false if the caller must decrypt it
+ *	   from process context with fscrypt_decrypt_bio() as usual.
+ */
+bool fscrypt_decrypt_bio_atomic(struct bio *bio)
+{
+	const struct inode *inode = bio_inode(bio);
+	struct bio_vec *bv;
+	struct bvec_iter_all iter_all;
+	unsigned int bytes = 0;
+
+	/* SIMD ciphers can't run in hardirq context, so defer there too */
+	if (!inode->i_crypt_info->ci_ctfm_sync || in_irq())
+		return false;
+
+	bio_for_each_segment_all(bv, bio, iter_all) {
+		bytes += bv->bv_len;
+		if (bytes > READ_ONCE(max_inline_decrypt_bytes))
+			return false;
+	}
+
+	if (!decrypt_bio_pages(bio, false, GFP_ATOMIC))
+		return false;
+	fscrypt_stats_add_bio(inode, true);
+	return true;
+}
+EXPORT_SYMBOL(fscrypt_decrypt_bio_atomic);
+
 static void completion_pages(struct work_struct *work)
 {
 	struct fscrypt_ctx *ctx = container_of(work, struct fscrypt_ctx, work);
@@ -148,51 +148,221 @@ void fscrypt_generate_iv(union fscrypt_iv *iv, u64 lblk_num,
 		crypto_cipher_encrypt_one(ci->ci_essiv_tfm, iv->raw, iv->raw);
 }
 
+/*
+ * Allocate ->s_crypt_stats for @sb if not done yet.  Called when an inode's key
+ * is set up, so the counters exist before any of its contents are en/decrypted.
+ */
+int fscrypt_init_sb_stats(struct super_block *sb)
+{
+	struct fscrypt_stats __percpu *stats;
+
+	if (likely(READ_ONCE(sb->s_crypt_stats)))
+		return 0;
+
+	stats = alloc_percpu(struct fscrypt_stats);
+	if (!stats)
+		return -ENOMEM;
+	if (cmpxchg(&sb->s_crypt_stats, NULL, stats) != NULL)
+		free_percpu(stats);
+	return 0;
+}
+
+static void fscrypt_stats_add_blocks(const struct inode *inode,
+				     fscrypt_direction_t rw,
+				     unsigned int nr_blocks, u64 start_ns)
+{
+	struct fscrypt_stats __percpu *stats = inode->i_sb->s_crypt_stats;
+	u64 ns = ktime_get_ns() - start_ns;
+
+	if (unlikely(!stats))
+		return;
+	if (rw == FS_DECRYPT) {
+		this_cpu_add(stats->decrypt_blocks, nr_blocks);
+		this_cpu_add(stats->decrypt_ns, ns);
+	} else {
+		this_cpu_add(stats->encrypt_blocks, nr_blocks);
+		this_cpu_add(stats->encrypt_ns, ns);
+	}
+}
+
+void fscrypt_stats_add_bio(const struct inode *inode, bool inline_bio)
+{
+	struct fscrypt_stats __percpu *stats = inode->i_sb->s_crypt_stats;
+
+	if (unlikely(!stats))
+		return;
+	this_cpu_inc(stats->decrypt_bios);
+	if (inline_bio)
+		this_cpu_inc(stats->decrypt_inline_bios);
+}
+
+/**
+ * fscrypt_show_stats() - format a filesystem's file contents crypto counters
+ * @sb:  The filesystem
+ * @buf: A PAGE_SIZE buffer, as passed to a sysfs ->show() method
+ *
+ * Return: the number of bytes written to @buf
+ */
+ssize_t fscrypt_show_stats(struct super_block *sb, char *buf)
+{
+	struct fscrypt_stats __percpu *stats = READ_ONCE(sb->s_crypt_stats);
+	struct fscrypt_stats sum = { 0 };
+	int cpu;
+
+	if (stats) {
+		for_each_possible_cpu(cpu) {
+			struct fscrypt_stats *s = per_cpu_ptr(stats, cpu);
+
+			sum.decrypt_bios += s->decrypt_bios;
+			sum.decrypt_inline_bios += s->decrypt_inline_bios;
+			sum.decrypt_blocks += s->decrypt_blocks;
+			sum.decrypt_ns += s->decrypt_ns;
+			sum.encrypt_blocks += s->encrypt_blocks;
+			sum.encrypt_ns += s->encrypt_ns;
+		}
+	}
+
+	return snprintf(buf, PAGE_SIZE,
+			"decrypt_bios %llu\n"
+			"decrypt_inline_bios %llu\n"
+			"decrypt_blocks %llu\n"
+			"decrypt_ns %llu\n"
+			"encrypt_blocks %llu\n"
+			"encrypt_ns %llu\n",
+			sum.decrypt_bios, sum.decrypt_inline_bios,
+			sum.decrypt_blocks, sum.decrypt_ns,
+			sum.encrypt_blocks, sum.encrypt_ns);
+}
+EXPORT_SYMBOL(fscrypt_show_stats);
+
+/**
+ * fscrypt_alloc_request() - get a request for an inode's contents transform
+ * @ci:        The inode's fscrypt_info
+ * @stack_req: Stack space declared with FSCRYPT_REQUEST_ON_STACK()
+ * @wait:      Completion to signal when an asynchronous request is done
+ * @gfp_flags: Memory allocation flags
+ *
+ * A synchronous transform runs out of @stack_req, so no memory is allocated and
+ * this may be used from atomic context.  Otherwise the request is allocated.
+ * The request may only sleep if @gfp_flags allow blocking.  Release it with
+ * fscrypt_free_request().
+ *
+ * Return: the request, or NULL if it couldn't be allocated
+ */
+struct skcipher_request *fscrypt_alloc_request(const struct fscrypt_info *ci,
+					       void *stack_req,
+					       struct crypto_wait *wait,
+					       gfp_t gfp_flags)
+{
+	struct skcipher_request *req;
+	u32 flags = CRYPTO_TFM_REQ_MAY_BACKLOG;
+
+	if (ci->ci_ctfm_sync) {
+		req = stack_req;
+		skcipher_request_set_tfm(req, ci->ci_ctfm);
+	} else {
+		req = skcipher_request_alloc(ci->ci_ctfm, gfp_flags);
+		if (!req)
+			return NULL;
+	}
+	if (gfpflags_allow_blocking(gfp_flags))
+		flags |= CRYPTO_TFM_REQ_MAY_SLEEP;
+	skcipher_request_set_callback(req, flags, crypto_req_done, wait);
+	return req;
+}
+
+void fscrypt_free_request(struct skcipher_request *req, void *stack_req)
+{
+	if (req == stack_req)
+		skcipher_request_zero(req);
+	else
+		skcipher_request_free(req);
+}
+
+/**
+ * fscrypt_crypt_data_units() - encrypt or decrypt a run of file contents
+ * @inode:     The inode to which the data belongs
+ * @req:       A request from fscrypt_alloc_request()
+ * @rw:        FS_DECRYPT or FS_ENCRYPT
+ * @lblk_num:  Logical block number of the first unit, used for the IV
+ * @src_page:  The page containing the source data
+ * @dest_page: The page to write the result to, possibly @src_page
+ * @len:       Number of bytes to process, a multiple of @unit_size
+ * @offs:      Byte offset of the data within the pages
+ * @unit_size: Size of each unit; each gets its own IV from an incrementing
+ *		logical block number
+ *
+ * All the units are run through @req, so processing a page or a whole bio
+ * costs at most one request allocation rather than one per block.
+ *
+ * Return: 0 on success; -errno on failure
+ */
+int fscrypt_crypt_data_units(const struct inode *inode,
+			     struct skcipher_request *req,
+			     fscrypt_direction_t rw, u64 lblk_num,
+			     struct page *src_page, struct page *dest_page,
+			     unsigned int len, unsigned int offs,
+			     unsigned int unit_size)
+{
+	const struct fscrypt_info *ci = inode->i_crypt_info;
+	struct crypto_wait *wait = req->base.data;
+	struct scatterlist dst, src;
+	union fscrypt_iv iv;
+	u64 start_ns = ktime_get_ns();
+	unsigned int i;
+	int res;
+
+	if (WARN_ON_ONCE(len <= 0 || unit_size <= 0))
+		return -EINVAL;
+	if (WARN_ON_ONCE(unit_size % FS_CRYPTO_BLOCK_SIZE != 0 ||
+			 len % unit_size != 0))
+		return -EINVAL;
+
+	for (i = offs; i < offs + len; i += unit_size, lblk_num++) {
+		fscrypt_generate_iv(&iv, lblk_num, ci);
+
+		sg_init_table(&dst, 1);
+		sg_set_page(&dst, dest_page, unit_size, i);
+		sg_init_table(&src, 1);
+		sg_set_page(&src, src_page, unit_size, i);
+		skcipher_request_set_crypt(req, &src, &dst, unit_size, &iv);
+		if (rw == FS_DECRYPT)
+			res = crypto_wait_req(crypto_skcipher_decrypt(req),
+					      wait);
+		else
+			res = crypto_wait_req(crypto_skcipher_encrypt(req),
+					      wait);
+		if (res) {
+			fscrypt_err(inode,
+				    "%scryption failed for block %llu: %d",
+				    (rw == FS_DECRYPT ? "De" : "En"),
+				    lblk_num, res);
+			return res;
+		}
+	}
+	fscrypt_stats_add_blocks(inode, rw, len / unit_size, start_ns);
+	return 0;
+}
+
 /* Encrypt or decrypt a single filesystem block of file contents */
 int fscrypt_crypt_block(const struct inode *inode, fscrypt_direction_t rw,
 			u64 lblk_num, struct page *src_page,
 			struct page *dest_page, unsigned int len,
 			unsigned int offs, gfp_t gfp_flags)
 {
-	union fscrypt_iv iv;
-	struct skcipher_request *req = NULL;
+	FSCRYPT_REQUEST_ON_STACK(stack_req);
 	DECLARE_CRYPTO_WAIT(wait);
-	struct scatterlist dst, src;
-	struct fscrypt_info *ci = inode->i_crypt_info;
-	struct crypto_skcipher *tfm = ci->ci_ctfm;
-	int res = 0;
-
-	if (WARN_ON_ONCE(len <= 0))
-		return -EINVAL;
-	if (WARN_ON_ONCE(len % FS_CRYPTO_BLOCK_SIZE != 0))
-		return -EINVAL;
+	struct skcipher_request *req;
+	int res;
 
-	fscrypt_generate_iv(&iv, lblk_num, ci);
-
-	req = skcipher_request_alloc(tfm, gfp_flags);
+	req = fscrypt_alloc_request(inode->i_crypt_info, stack_req, &wait,
+				    gfp_flags);
 	if (!req)
 		return -ENOMEM;
-
-	skcipher_request_set_callback(
-		req, CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
-		crypto_req_done, &wait);
-
-	sg_init_table(&dst, 1);
-	sg_set_page(&dst, dest_page, len, offs);
-	sg_init_table(&src, 1);
-	sg_set_page(&src, src_page, len, offs);
-	skcipher_request_set_crypt(req, &src, &dst, len, &iv);
-	if (rw == FS_DECRYPT)
-		res = crypto_wait_req(crypto_skcipher_decrypt(req), &wait);
-	else
-		res = crypto_wait_req(crypto_skcipher_encrypt(req), &wait);
-	skcipher_request_free(req);
-	if (res) {
-		fscrypt_err(inode, "%scryption failed for block %llu: %d",
-			    (rw == FS_DECRYPT ? "De" : "En"), lblk_num, res);
-		return res;
-	}
-	return 0;
+	res = fscrypt_crypt_data_units(inode, req, rw, lblk_num, src_page,
+				       dest_page, len, offs, len);
+	fscrypt_free_request(req, stack_req);
+	return res;
 }
 
 /**
@@ -226,7 +396,9 @@ struct page *fscrypt_encrypt_pagecache_blocks(struct page *page,
 	struct page *ciphertext_page;
 	u64 lblk_num = ((u64)page->index << (PAGE_SHIFT - blockbits)) +
 		       (offs >> blockbits);
-	unsigned int i;
+	FSCRYPT_REQUEST_ON_STACK(stack_req);
+	DECLARE_CRYPTO_WAIT(wait);
+	struct skcipher_request *req;
 	int err;
 
 	if (WARN_ON_ONCE(!PageLocked(page)))
@@ -239,14 +411,18 @@ struct page *fscrypt_encrypt_pagecache_blocks(struct page *page,
 	if (!ciphertext_page)
 		return ERR_PTR(-ENOMEM);
 
-	for (i = offs; i < offs + len; i += blocksize, lblk_num++) {
-		err = fscrypt_crypt_block(inode, FS_ENCRYPT, lblk_num,
-					  page, ciphertext_page,
-					  blocksize, i, gfp_flags);
-		if (err) {
-			fscrypt_free_bounce_page(ciphertext_page);
-			return ERR_PTR(err);
-		}
+	req = fscrypt_alloc_request(inode->i_crypt_info, stack_req, &wait,
+				    gfp_flags);
+	if (!req) {
+		fscrypt_free_bounce_page(ciphertext_page);
+		return ERR_PTR(-ENOMEM);
+	}
+	err = fscrypt_crypt_data_units(inode, req, FS_ENCRYPT, lblk_num, page,
+				       ciphertext_page, len, offs, blocksize);
+	fscrypt_free_request(req, stack_req);
+	if (err) {
+		fscrypt_free_bounce_page(ciphertext_page);
+		return ERR_PTR(err);
 	}
 	SetPagePrivate(ciphertext_page);
 	set_page_private(ciphertext_page, (unsigned long)page);
@@ -280,6 +456,30 @@ int fscrypt_encrypt_block_inplace(const struct inode *inode, struct page *page,
 }
 EXPORT_SYMBOL(fscrypt_encrypt_block_inplace);
 
+/*
+ * Decrypt the blocks at @offs in a locked pagecache page using @req, which the
+ * caller may reuse for all the pages of a bio.
+ */
+int fscrypt_decrypt_pagecache_blocks_req(struct skcipher_request *req,
+					 struct page *page, unsigned int len,
+					 unsigned int offs)
+{
+	const struct inode *inode = page->mapping->host;
+	const unsigned int blockbits = inode->i_blkbits;
+	const unsigned int blocksize = 1 << blockbits;
+	u64 lblk_num = ((u64)page->index << (PAGE_SHIFT - blockbits)) +
+		       (offs >> blockbits);
+
+	if (WARN_ON_ONCE(!PageLocked(page)))
+		return -EINVAL;
+
+	if (WARN_ON_ONCE(len <= 0 || !IS_ALIGNED(len | offs, blocksize)))
+		return -EINVAL;
+
+	return fscrypt_crypt_data_units(inode, req, FS_DECRYPT, lblk_num, page,
+					page, len, offs, blocksize);
+}
+
 /**
  * fscrypt_decrypt_pagecache_blocks() - Decrypt filesystem blocks in a pagecache page
  * @page:      The locked pagecache page containing the block(s) to decrypt
@@ -300,26 +500,18 @@ int fscrypt_decrypt_pagecache_blocks(struct page *page, unsigned int len,
 				     unsigned int offs)
 {
 	const struct inode *inode = page->mapping->host;
-	const unsigned int blockbits = inode->i_blkbits;
-	const unsigned int blocksize = 1 << blockbits;
-	u64 lblk_num = ((u64)page->index << (PAGE_SHIFT - blockbits)) +
-		       (offs >> blockbits);
-	unsigned int i;
+	FSCRYPT_REQUEST_ON_STACK(stack_req);
+	DECLARE_CRYPTO_WAIT(wait);
+	struct skcipher_request *req;
 	int err;
 
-	if (WARN_ON_ONCE(!PageLocked(page)))
-		return -EINVAL;
-
-	if (WARN_ON_ONCE(len <= 0 || !IS_ALIGNED(len | offs, blocksize)))
-		return -EINVAL;
-
-	for (i = offs; i < offs + len; i += blocksize, lblk_num++) {
-		err = fscrypt_crypt_block(inode, FS_DECRYPT, lblk_num, page,
-					  page, blocksize, i, GFP_NOFS);
-		if (err)
-			return err;
-	}
-	return 0;
+	req = fscrypt_alloc_request(inode->i_crypt_info, stack_req, &wait,
+				    GFP_NOFS);
+	if (!req)
+		return -ENOMEM;
+	err = fscrypt_decrypt_pagecache_blocks_req(req, page, len, offs);
+	fscrypt_free_request(req, stack_req);
+	return err;
 }
 EXPORT_SYMBOL(fscrypt_decrypt_pagecache_blocks);
 
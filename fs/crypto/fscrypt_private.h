@@ -13,6 +13,7 @@
 
 #include <linux/fscrypt.h>
 #include <crypto/hash.h>
+#include <crypto/skcipher.h>
 
 #define CONST_STRLEN(str)	(sizeof(str) - 1)
 
@@ -166,6 +167,13 @@ struct fscrypt_info {
 	/* The actual crypto transform used for encryption and decryption */
 	struct crypto_skcipher *ci_ctfm;
 
+	/*
+	 * True if ci_ctfm is synchronous and its requests fit on the stack, so
+	 * file contents can be en/decrypted without allocating request memory
+	 * and from atomic context.
+	 */
+	bool ci_ctfm_sync;
+
 	/*
 	 * Cipher for ESSIV IV generation.  Only set for CBC contents
 	 * encryption, otherwise is NULL.
@@ -214,6 +222,20 @@ typedef enum {
 
 #define FS_CTX_REQUIRES_FREE_ENCRYPT_FL		0x00000001
 
+/*
+ * Per-filesystem file contents crypto counters, kept per-CPU in
+ * ->s_crypt_stats.  The _ns fields accumulate the time spent in the cipher so
+ * that the average latency per block can be derived.
+ */
+struct fscrypt_stats {
+	u64 decrypt_bios;
+	u64 decrypt_inline_bios;
+	u64 decrypt_blocks;
+	u64 decrypt_ns;
+	u64 encrypt_blocks;
+	u64 encrypt_ns;
+};
+
 static inline bool fscrypt_valid_enc_modes(u32 contents_mode,
 					   u32 filenames_mode)
 {
@@ -235,6 +257,32 @@ static inline bool fscrypt_valid_enc_modes(u32 contents_mode,
 /* crypto.c */
 extern struct kmem_cache *fscrypt_info_cachep;
 extern int fscrypt_initialize(unsigned int cop_flags);
+extern int fscrypt_init_sb_stats(struct super_block *sb);
+extern void fscrypt_stats_add_bio(const struct inode *inode, bool inline_bio);
+
+/*
+ * Stack space for a request on a synchronous ->ci_ctfm, to be passed to
+ * fscrypt_alloc_request().
+ */
+#define FSCRYPT_REQUEST_ON_STACK(name)					\
+	char name[sizeof(struct skcipher_request) +			\
+		  MAX_SYNC_SKCIPHER_REQSIZE] CRYPTO_MINALIGN_ATTR
+
+extern struct skcipher_request *
+fscrypt_alloc_request(const struct fscrypt_info *ci, void *stack_req,
+		      struct crypto_wait *wait, gfp_t gfp_flags);
+extern void fscrypt_free_request(struct skcipher_request *req,
+				 void *stack_req);
+extern int fscrypt_crypt_data_units(const struct inode *inode,
+				    struct skcipher_request *req,
+				    fscrypt_direction_t rw, u64 lblk_num,
+				    struct page *src_page,
+				    struct page *dest_page, unsigned int len,
+				    unsigned int offs, unsigned int unit_size);
+extern int fscrypt_decrypt_pagecache_blocks_req(struct skcipher_request *req,
+						struct page *page,
+						unsigned int len,
+						unsigned int offs);
 extern int fscrypt_crypt_block(const struct inode *inode,
 			       fscrypt_direction_t rw, u64 lblk_num,
 			       struct page *src_page, struct page *dest_page,
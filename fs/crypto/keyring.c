@@ -218,6 +218,8 @@ void fscrypt_sb_free(struct super_block *sb)
 {
 	key_put(sb->s_master_keys);
 	sb->s_master_keys = NULL;
+	free_percpu(sb->s_crypt_stats);
+	sb->s_crypt_stats = NULL;
 }
 
 /*
@@ -113,6 +113,17 @@ struct crypto_skcipher *fscrypt_allocate_skcipher(struct fscrypt_mode *mode,
 	return ERR_PTR(err);
 }
 
+/*
+ * Whether requests on @tfm can live on the stack and be issued from atomic
+ * context: the algorithm must complete synchronously and have a small request
+ * context.
+ */
+static bool skcipher_is_sync(struct crypto_skcipher *tfm)
+{
+	return !(crypto_skcipher_alg(tfm)->base.cra_flags & CRYPTO_ALG_ASYNC) &&
+	       crypto_skcipher_reqsize(tfm) <= MAX_SYNC_SKCIPHER_REQSIZE;
+}
+
 static int derive_essiv_salt(const u8 *key, int keysize, u8 *salt)
 {
 	struct crypto_shash *tfm = READ_ONCE(essiv_hash_tfm);
@@ -499,6 +510,12 @@ int fscrypt_get_encryption_info(struct inode *inode)
 	if (res)
 		goto out;
 
+	crypt_info->ci_ctfm_sync = skcipher_is_sync(crypt_info->ci_ctfm);
+
+	res = fscrypt_init_sb_stats(inode->i_sb);
+	if (res)
+		goto out;
+
 	if (cmpxchg_release(&inode->i_crypt_info, NULL, crypt_info) == NULL) {
 		if (master_key) {
 			struct fscrypt_master_key *mk =
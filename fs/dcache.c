@@ -32,6 +32,8 @@
 #include <linux/bit_spinlock.h>
 #include <linux/rculist_bl.h>
 #include <linux/list_lru.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include "internal.h"
 #include "mount.h"
 
@@ -123,6 +125,43 @@ static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
 static DEFINE_PER_CPU(long, nr_dentry_negative);
 
+/*
+ * Maximum number of unused negative dentries per superblock, 0 for no limit.
+ * Going over it kicks negative_dentry_trim_work, which trims the oldest
+ * negative dentries off the LRU of every superblock that is over the limit,
+ * rather than waiting for memory pressure to do it.
+ */
+unsigned long sysctl_negative_dentry_limit __read_mostly;
+
+static void trim_negative_dentries(struct work_struct *work);
+static DECLARE_WORK(negative_dentry_trim_work, trim_negative_dentries);
+
+/*
+ * Bit 0 is set from the time the trim work is kicked until it has finished,
+ * so that every negative dentry created meanwhile doesn't hit the shared
+ * work->data with schedule_work().
+ */
+static unsigned long negative_dentry_trim_pending;
+
+static inline void d_negative_inc(struct dentry *dentry)
+{
+	struct percpu_counter *nr = &dentry->d_sb->s_nr_dentry_negative;
+	unsigned long limit = READ_ONCE(sysctl_negative_dentry_limit);
+
+	this_cpu_inc(nr_dentry_negative);
+	percpu_counter_inc(nr);
+	if (unlikely(limit) && percpu_counter_read_positive(nr) > limit &&
+	    !test_bit(0, &negative_dentry_trim_pending) &&
+	    !test_and_set_bit(0, &negative_dentry_trim_pending))
+		schedule_work(&negative_dentry_trim_work);
+}
+
+static inline void d_negative_dec(struct dentry *dentry)
+{
+	this_cpu_dec(nr_dentry_negative);
+	percpu_counter_dec(&dentry->d_sb->s_nr_dentry_negative);
+}
+
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 
 /*
@@ -330,7 +369,7 @@ static inline void __d_clear_type_and_inode(struct dentry *dentry)
 	WRITE_ONCE(dentry->d_flags, flags);
 	dentry->d_inode = NULL;
 	if (dentry->d_flags & DCACHE_LRU_LIST)
-		this_cpu_inc(nr_dentry_negative);
+		d_negative_inc(dentry);
 }
 
 static void dentry_free(struct dentry *dentry)
@@ -385,10 +424,11 @@ static void dentry_unlink_inode(struct dentry * dentry)
  * The per-cpu "nr_dentry_unused" counters are updated with
  * the DCACHE_LRU_LIST bit.
  *
- * The per-cpu "nr_dentry_negative" counters are only updated
- * when deleted from or added to the per-superblock LRU list, not
- * from/to the shrink list. That is to avoid an unneeded dec/inc
- * pair when moving from LRU to shrink list in select_collect().
+ * The per-cpu "nr_dentry_negative" counters and the per-superblock
+ * "s_nr_dentry_negative" counter are only updated when deleted from
+ * or added to the per-superblock LRU list, not from/to the shrink
+ * list. That is to avoid an unneeded dec/inc pair when moving from
+ * LRU to shrink list in select_collect().
  *
  * These helper functions make sure we always follow the
  * rules. d_lock must be held by the caller.
@@ -400,7 +440,7 @@ static void d_lru_add(struct dentry *dentry)
 	dentry->d_flags |= DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_inc(nr_dentry_negative);
+		d_negative_inc(dentry);
 	WARN_ON_ONCE(!list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -410,7 +450,7 @@ static void d_lru_del(struct dentry *dentry)
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	WARN_ON_ONCE(!list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -442,7 +482,7 @@ static void d_lru_isolate(struct list_lru_one *lru, struct dentry *dentry)
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	list_lru_isolate(lru, &dentry->d_lru);
 }
 
@@ -452,7 +492,7 @@ static void d_lru_shrink_move(struct list_lru_one *lru, struct dentry *dentry,
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags |= DCACHE_SHRINK_LIST;
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	list_lru_isolate_move(lru, &dentry->d_lru, list);
 }
 
@@ -1204,6 +1244,90 @@ long prune_dcache_sb(struct super_block *sb, struct shrink_control *sc)
 	return freed;
 }
 
+struct negative_trim {
+	struct list_head	dispose;
+	long			nr_to_trim;
+};
+
+/*
+ * Like dentry_lru_isolate(), but only takes negative dentries. Positive ones
+ * are rotated to the tail so that the next trim, which also starts at the
+ * head, gets past them rather than rescanning the same ones every time.
+ */
+static enum lru_status dentry_negative_lru_isolate(struct list_head *item,
+		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
+{
+	struct negative_trim *trim = arg;
+	struct dentry	*dentry = container_of(item, struct dentry, d_lru);
+
+	if (trim->nr_to_trim <= 0)
+		return LRU_SKIP;
+
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
+
+	if (dentry->d_lockref.count) {
+		d_lru_isolate(lru, dentry);
+		spin_unlock(&dentry->d_lock);
+		return LRU_REMOVED;
+	}
+
+	if (!d_is_negative(dentry)) {
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	if (dentry->d_flags & DCACHE_REFERENCED) {
+		dentry->d_flags &= ~DCACHE_REFERENCED;
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	d_lru_shrink_move(lru, dentry, &trim->dispose);
+	trim->nr_to_trim--;
+	spin_unlock(&dentry->d_lock);
+
+	return LRU_REMOVED;
+}
+
+static void trim_negative_dentries_sb(struct super_block *sb, void *arg)
+{
+	unsigned long limit = *(unsigned long *)arg;
+	struct negative_trim trim;
+	unsigned long nr_to_walk;
+	s64 nr;
+
+	nr = percpu_counter_sum_positive(&sb->s_nr_dentry_negative);
+	if (nr <= limit)
+		return;
+
+	/*
+	 * Go a bit below the limit so that the next few negative dentries
+	 * don't kick the work again straight away, and bound the walk in case
+	 * the negative dentries are spread thinly over a large LRU.  If the
+	 * walk runs out first, the next negative dentry over the limit kicks
+	 * the work again and it carries on past the rotated positive ones.
+	 */
+	INIT_LIST_HEAD(&trim.dispose);
+	trim.nr_to_trim = nr - limit + (limit >> 3);
+	nr_to_walk = min_t(unsigned long, list_lru_count(&sb->s_dentry_lru),
+			   trim.nr_to_trim * 4);
+	list_lru_walk(&sb->s_dentry_lru, dentry_negative_lru_isolate, &trim,
+		      nr_to_walk);
+	shrink_dentry_list(&trim.dispose);
+}
+
+static void trim_negative_dentries(struct work_struct *work)
+{
+	unsigned long limit = READ_ONCE(sysctl_negative_dentry_limit);
+
+	if (limit)
+		iterate_supers(trim_negative_dentries_sb, &limit);
+
+	smp_mb__before_atomic();
+	clear_bit(0, &negative_dentry_trim_pending);
+}
+
 static enum lru_status dentry_lru_isolate_shrink(struct list_head *item,
 		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
 {
@@ -1923,7 +2047,7 @@ static void __d_instantiate(struct dentry *dentry, struct inode *inode)
 	 * Decrement negative dentry count if it was in the LRU list.
 	 */
 	if (dentry->d_flags & DCACHE_LRU_LIST)
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	hlist_add_head(&dentry->d_u.d_alias, &inode->i_dentry);
 	raw_write_seqcount_begin(&dentry->d_seq);
 	__d_set_inode_and_type(dentry, inode, add_flags);
@@ -3129,6 +3253,70 @@ void d_tmpfile(struct dentry *dentry, struct inode *inode)
 }
 EXPORT_SYMBOL(d_tmpfile);
 
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Walk the whole dentry hash table and report how long the chains are, so
+ * that the effect of dhash_entries= and of negative dentry trimming on
+ * lookup cost can be observed.
+ */
+static int dentry_hash_stats_show(struct seq_file *m, void *v)
+{
+	unsigned long nr_buckets = 1UL << (32 - d_hash_shift);
+	unsigned long used = 0, entries = 0, negative = 0, longest = 0;
+	unsigned long hist[8] = { };
+	unsigned long i;
+
+	for (i = 0; i < nr_buckets; i++) {
+		struct hlist_bl_node *node;
+		struct dentry *dentry;
+		unsigned long len = 0;
+
+		rcu_read_lock();
+		hlist_bl_for_each_entry_rcu(dentry, node, &dentry_hashtable[i],
+					    d_hash) {
+			len++;
+			if (d_really_is_negative(dentry))
+				negative++;
+		}
+		rcu_read_unlock();
+
+		if (len)
+			used++;
+		entries += len;
+		longest = max(longest, len);
+		hist[min_t(unsigned long, fls_long(len), ARRAY_SIZE(hist) - 1)]++;
+		if (!(i & 1023))
+			cond_resched();
+	}
+
+	seq_printf(m, "buckets:          %lu\n", nr_buckets);
+	seq_printf(m, "used buckets:     %lu\n", used);
+	seq_printf(m, "entries:          %lu\n", entries);
+	seq_printf(m, "negative entries: %lu\n", negative);
+	seq_printf(m, "longest chain:    %lu\n", longest);
+	seq_puts(m, "chain length histogram:\n");
+	for (i = 0; i < ARRAY_SIZE(hist); i++) {
+		if (i < 2)
+			seq_printf(m, "  %lu: %lu\n", i, hist[i]);
+		else if (i < ARRAY_SIZE(hist) - 1)
+			seq_printf(m, "  %lu-%lu: %lu\n", 1UL << (i - 1),
+				   (1UL << i) - 1, hist[i]);
+		else
+			seq_printf(m, "  %lu+: %lu\n", 1UL << (i - 1), hist[i]);
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dentry_hash_stats);
+
+static int __init dcache_debugfs_init(void)
+{
+	debugfs_create_file("dentry_hash_stats", 0400, NULL, NULL,
+			    &dentry_hash_stats_fops);
+	return 0;
+}
+late_initcall(dcache_debugfs_init);
+#endif
+
 static __initdata unsigned long dhash_entries;
 static int __init set_dhash_entries(char *str)
 {
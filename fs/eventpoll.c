@@ -26,6 +26,7 @@
 #include <linux/eventpoll.h>
 #include <linux/mount.h>
 #include <linux/bitops.h>
+#include <linux/bitmap.h>
 #include <linux/mutex.h>
 #include <linux/anon_inodes.h>
 #include <linux/device.h>
@@ -37,6 +38,7 @@
 #include <linux/seq_file.h>
 #include <linux/compat.h>
 #include <linux/rculist.h>
+#include <linux/capability.h>
 #include <net/busy_poll.h>
 
 /*
@@ -45,10 +47,10 @@
  *
  * 1) epmutex (mutex)
  * 2) ep->mtx (mutex)
- * 3) ep->lock (rwlock)
+ * 3) rdl->lock (rwlock)
  *
  * The acquire order is the one listed above, from 1 to 3.
- * We need a rwlock (ep->lock) because we manipulate objects
+ * We need a rwlock (rdl->lock) because we manipulate objects
  * from inside the poll callback, that might be triggered from
  * a wake_up() that in turn might be called from IRQ context.
  * So we can't sleep inside the poll callback and hence we need
@@ -80,7 +82,7 @@
  * of epoll file descriptors, we use the current recursion depth as
  * the lockdep subkey.
  * It is possible to drop the "ep->mtx" and to use the global
- * mutex "epmutex" (together with "ep->lock") to have it working,
+ * mutex "epmutex" (together with "rdl->lock") to have it working,
  * but having "ep->mtx" will make the interface more scalable.
  * Events that require holding "epmutex" are very rare, while for
  * normal operations the epoll private "ep->mtx" will guarantee
@@ -157,6 +159,9 @@ struct epitem {
 	/* Number of active wait queue attached to poll operations */
 	int nwait;
 
+	/* Index of the "struct eventpoll" ready list this item is queued on */
+	unsigned int rdl;
+
 	/* List containing poll wait queues */
 	struct list_head pwqlist;
 
@@ -173,6 +178,32 @@ struct epitem {
 	struct epoll_event event;
 };
 
+/*
+ * Ready list of an eventpoll.  There is a single one by default; with
+ * EPOLL_PERCPU there is one per possible CPU, and each item is queued on
+ * the list of the CPU that added it to the set.  epoll_wait() callers sleep
+ * on the list of their own CPU and harvest it first, so events are both
+ * queued and woken up without touching other CPUs' cache lines as long as
+ * each thread handles the descriptors it added.
+ */
+struct ep_rdlist {
+	/* Lock which protects rdllist and ovflist */
+	rwlock_t lock;
+
+	/* List of ready file descriptors */
+	struct list_head rdllist;
+
+	/*
+	 * This is a single linked list that chains all the "struct epitem" that
+	 * happened while transferring ready events to userspace w/out
+	 * holding ->lock.
+	 */
+	struct epitem *ovflist;
+
+	/* Wait queue used by sys_epoll_wait() */
+	wait_queue_head_t wq;
+} ____cacheline_aligned_in_smp;
+
 /*
  * This structure is stored inside the "private_data" member of the file
  * structure and represents the main data structure for the eventpoll
@@ -187,28 +218,12 @@ struct eventpoll {
 	 */
 	struct mutex mtx;
 
-	/* Wait queue used by sys_epoll_wait() */
-	wait_queue_head_t wq;
-
 	/* Wait queue used by file->poll() */
 	wait_queue_head_t poll_wait;
 
-	/* List of ready file descriptors */
-	struct list_head rdllist;
-
-	/* Lock which protects rdllist and ovflist */
-	rwlock_t lock;
-
 	/* RB tree root used to store monitored fd structs */
 	struct rb_root_cached rbr;
 
-	/*
-	 * This is a single linked list that chains all the "struct epitem" that
-	 * happened while transferring ready events to userspace w/out
-	 * holding ->lock.
-	 */
-	struct epitem *ovflist;
-
 	/* wakeup_source used when ep_scan_ready_list is running */
 	struct wakeup_source *ws;
 
@@ -223,7 +238,24 @@ struct eventpoll {
 #ifdef CONFIG_NET_RX_BUSY_POLL
 	/* used to track busy poll napi_id */
 	unsigned int napi_id;
+	/* busy poll timeout, overrides net.core.busy_poll if non-zero */
+	u32 busy_poll_usecs;
+	/* busy poll packet budget */
+	u16 busy_poll_budget;
+	bool prefer_busy_poll;
 #endif
+
+	/*
+	 * Ready lists that may have waiters sleeping on them, only used with
+	 * more than one ready list.  Set under the write lock of the list,
+	 * cleared lazily by ep_wake_any().
+	 */
+	unsigned long *waitmask;
+
+	/* Number of ready lists, 1 or nr_cpu_ids */
+	unsigned int nr_rdl;
+
+	struct ep_rdlist rdl[];
 };
 
 /* Wait structure used by the poll hooks */
@@ -365,6 +397,23 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
 	spin_lock_init(&ncalls->lock);
 }
 
+static inline struct ep_rdlist *ep_item_rdl(struct epitem *epi)
+{
+	return &epi->ep->rdl[epi->rdl];
+}
+
+/* Index of the ready list of the current CPU */
+static inline unsigned int ep_rdl_this_cpu(struct eventpoll *ep)
+{
+	return ep->nr_rdl == 1 ? 0 : raw_smp_processor_id();
+}
+
+static inline int ep_rdl_events_available(struct ep_rdlist *rdl)
+{
+	return !list_empty_careful(&rdl->rdllist) ||
+		READ_ONCE(rdl->ovflist) != EP_UNACTIVE_PTR;
+}
+
 /**
  * ep_events_available - Checks if ready events might be available.
  *
@@ -375,30 +424,59 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
  */
 static inline int ep_events_available(struct eventpoll *ep)
 {
-	return !list_empty_careful(&ep->rdllist) ||
-		READ_ONCE(ep->ovflist) != EP_UNACTIVE_PTR;
+	unsigned int i;
+
+	for (i = 0; i < ep->nr_rdl; i++) {
+		if (ep_rdl_events_available(&ep->rdl[i]))
+			return 1;
+	}
+
+	return 0;
 }
 
 #ifdef CONFIG_NET_RX_BUSY_POLL
+static bool ep_busy_loop_on(struct eventpoll *ep)
+{
+	return READ_ONCE(ep->busy_poll_usecs) || net_busy_loop_on();
+}
+
+static bool ep_busy_loop_timeout(struct eventpoll *ep,
+				 unsigned long start_time)
+{
+	unsigned long bp_usec = READ_ONCE(ep->busy_poll_usecs);
+
+	if (bp_usec)
+		return time_after(busy_loop_current_time(),
+				  start_time + bp_usec);
+
+	return busy_loop_timeout(start_time);
+}
+
 static bool ep_busy_loop_end(void *p, unsigned long start_time)
 {
 	struct eventpoll *ep = p;
 
-	return ep_events_available(ep) || busy_loop_timeout(start_time);
+	return ep_events_available(ep) || ep_busy_loop_timeout(ep, start_time);
 }
 
 /*
- * Busy poll if globally on and supporting sockets found && no events,
- * busy loop will return if need_resched or ep_events_available.
+ * Busy poll if globally or per-instance on and supporting sockets found && no
+ * events, busy loop will return if need_resched or ep_events_available.
  *
  * we must do our busy polling with irqs enabled
  */
 static void ep_busy_loop(struct eventpoll *ep, int nonblock)
 {
 	unsigned int napi_id = READ_ONCE(ep->napi_id);
+	u16 budget = READ_ONCE(ep->busy_poll_budget);
+	bool prefer_busy_poll = READ_ONCE(ep->prefer_busy_poll);
+
+	if (!budget)
+		budget = BUSY_POLL_BUDGET;
 
-	if ((napi_id >= MIN_NAPI_ID) && net_busy_loop_on())
-		napi_busy_loop(napi_id, nonblock ? NULL : ep_busy_loop_end, ep);
+	if ((napi_id >= MIN_NAPI_ID) && ep_busy_loop_on(ep))
+		napi_busy_loop(napi_id, nonblock ? NULL : ep_busy_loop_end, ep,
+			       prefer_busy_poll, budget);
 }
 
 static inline void ep_reset_busy_poll_napi_id(struct eventpoll *ep)
@@ -418,7 +496,8 @@ static inline void ep_set_busy_poll_napi_id(struct epitem *epi)
 	struct sock *sk;
 	int err;
 
-	if (!net_busy_loop_on())
+	ep = epi->ep;
+	if (!ep_busy_loop_on(ep))
 		return;
 
 	sock = sock_from_file(epi->ffd.file, &err);
@@ -430,7 +509,6 @@ static inline void ep_set_busy_poll_napi_id(struct epitem *epi)
 		return;
 
 	napi_id = READ_ONCE(sk->sk_napi_id);
-	ep = epi->ep;
 
 	/* Non-NAPI IDs can be rejected
 	 *	or
@@ -459,6 +537,54 @@ static inline void ep_set_busy_poll_napi_id(struct epitem *epi)
 
 #endif /* CONFIG_NET_RX_BUSY_POLL */
 
+static long ep_eventpoll_ioctl(struct file *file, unsigned int cmd,
+			       unsigned long arg)
+{
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	struct eventpoll *ep = file->private_data;
+	void __user *uarg = (void __user *)arg;
+	struct epoll_params epoll_params;
+
+	switch (cmd) {
+	case EPIOCSPARAMS:
+		if (copy_from_user(&epoll_params, uarg, sizeof(epoll_params)))
+			return -EFAULT;
+
+		/* pad byte must be zero */
+		if (epoll_params.__pad)
+			return -EINVAL;
+
+		if (epoll_params.busy_poll_usecs > S32_MAX)
+			return -EINVAL;
+
+		if (epoll_params.prefer_busy_poll > 1)
+			return -EINVAL;
+
+		/* A larger budget than a regular NAPI poll is privileged */
+		if (epoll_params.busy_poll_budget > NAPI_POLL_WEIGHT &&
+		    !capable(CAP_NET_ADMIN))
+			return -EPERM;
+
+		WRITE_ONCE(ep->busy_poll_usecs, epoll_params.busy_poll_usecs);
+		WRITE_ONCE(ep->busy_poll_budget, epoll_params.busy_poll_budget);
+		WRITE_ONCE(ep->prefer_busy_poll, epoll_params.prefer_busy_poll);
+		return 0;
+	case EPIOCGPARAMS:
+		memset(&epoll_params, 0, sizeof(epoll_params));
+		epoll_params.busy_poll_usecs = READ_ONCE(ep->busy_poll_usecs);
+		epoll_params.busy_poll_budget = READ_ONCE(ep->busy_poll_budget);
+		epoll_params.prefer_busy_poll = READ_ONCE(ep->prefer_busy_poll);
+		if (copy_to_user(uarg, &epoll_params, sizeof(epoll_params)))
+			return -EFAULT;
+		return 0;
+	default:
+		return -ENOIOCTLCMD;
+	}
+#else
+	return -ENOIOCTLCMD;
+#endif
+}
+
 /**
  * ep_call_nested - Perform a bound (possibly) nested call, by checking
  *                  that the recursion limit is not exceeded, and that
@@ -582,6 +708,47 @@ static void ep_poll_safewake(wait_queue_head_t *wq)
 
 #endif
 
+/*
+ * Wakes up one epoll_wait() caller sleeping on any ready list, for events
+ * queued on a list that has no waiters of its own.  Must be called without
+ * any ready list lock held.  Returns true if a waiter was woken up.
+ */
+static bool ep_wake_any(struct eventpoll *ep)
+{
+	struct ep_rdlist *rdl;
+	unsigned long flags;
+	unsigned int idx;
+	bool woken = false;
+
+	if (ep->nr_rdl == 1)
+		return false;
+
+	/*
+	 * Order the queueing of the event before the waitmask test, pairs
+	 * with set_current_state() after the waiter sets its bit in ep_poll().
+	 */
+	smp_mb();
+
+	for_each_set_bit(idx, ep->waitmask, ep->nr_rdl) {
+		rdl = &ep->rdl[idx];
+
+		read_lock_irqsave(&rdl->lock, flags);
+		if (waitqueue_active(&rdl->wq)) {
+			wake_up(&rdl->wq);
+			woken = true;
+		} else {
+			/* Waiters are only added under the write lock */
+			clear_bit(idx, ep->waitmask);
+		}
+		read_unlock_irqrestore(&rdl->lock, flags);
+
+		if (woken)
+			break;
+	}
+
+	return woken;
+}
+
 static void ep_remove_wait_queue(struct eppoll_entry *pwq)
 {
 	wait_queue_head_t *whead;
@@ -650,64 +817,45 @@ static inline void ep_pm_stay_awake_rcu(struct epitem *epi)
 	rcu_read_unlock();
 }
 
-/**
- * ep_scan_ready_list - Scans the ready list in a way that makes possible for
- *                      the scan code, to call f_op->poll(). Also allows for
- *                      O(NumReady) performance.
- *
- * @ep: Pointer to the epoll private data structure.
- * @sproc: Pointer to the scan callback.
- * @priv: Private opaque data passed to the @sproc callback.
- * @depth: The current depth of recursive f_op->poll calls.
- * @ep_locked: caller already holds ep->mtx
- *
- * Returns: The same integer error code returned by the @sproc callback.
+/*
+ * Transfers the events of a single ready list with ep_scan_ready_list().
+ * Must be called with "mtx" held.
  */
-static __poll_t ep_scan_ready_list(struct eventpoll *ep,
-			      __poll_t (*sproc)(struct eventpoll *,
-					   struct list_head *, void *),
-			      void *priv, int depth, bool ep_locked)
+static __poll_t ep_scan_rdlist(struct eventpoll *ep, struct ep_rdlist *rdl,
+			       __poll_t (*sproc)(struct eventpoll *,
+						 struct list_head *, void *),
+			       void *priv, int *pwake)
 {
 	__poll_t res;
-	int pwake = 0;
+	bool wake_any = false;
 	struct epitem *epi, *nepi;
 	LIST_HEAD(txlist);
 
-	lockdep_assert_irqs_enabled();
-
-	/*
-	 * We need to lock this because we could be hit by
-	 * eventpoll_release_file() and epoll_ctl().
-	 */
-
-	if (!ep_locked)
-		mutex_lock_nested(&ep->mtx, depth);
-
 	/*
 	 * Steal the ready list, and re-init the original one to the
-	 * empty list. Also, set ep->ovflist to NULL so that events
+	 * empty list. Also, set rdl->ovflist to NULL so that events
 	 * happening while looping w/out locks, are not lost. We cannot
-	 * have the poll callback to queue directly on ep->rdllist,
+	 * have the poll callback to queue directly on rdl->rdllist,
 	 * because we want the "sproc" callback to be able to do it
 	 * in a lockless way.
 	 */
-	write_lock_irq(&ep->lock);
-	list_splice_init(&ep->rdllist, &txlist);
-	WRITE_ONCE(ep->ovflist, NULL);
-	write_unlock_irq(&ep->lock);
+	write_lock_irq(&rdl->lock);
+	list_splice_init(&rdl->rdllist, &txlist);
+	WRITE_ONCE(rdl->ovflist, NULL);
+	write_unlock_irq(&rdl->lock);
 
 	/*
 	 * Now call the callback function.
 	 */
 	res = (*sproc)(ep, &txlist, priv);
 
-	write_lock_irq(&ep->lock);
+	write_lock_irq(&rdl->lock);
 	/*
 	 * During the time we spent inside the "sproc" callback, some
 	 * other events might have been queued by the poll callback.
 	 * We re-insert them inside the main ready-list here.
 	 */
-	for (nepi = READ_ONCE(ep->ovflist); (epi = nepi) != NULL;
+	for (nepi = READ_ONCE(rdl->ovflist); (epi = nepi) != NULL;
 	     nepi = epi->next, epi->next = EP_UNACTIVE_PTR) {
 		/*
 		 * We need to check if the item is already in the list.
@@ -720,34 +868,89 @@ static __poll_t ep_scan_ready_list(struct eventpoll *ep,
 			 * ->ovflist is LIFO, so we have to reverse it in order
 			 * to keep in FIFO.
 			 */
-			list_add(&epi->rdllink, &ep->rdllist);
+			list_add(&epi->rdllink, &rdl->rdllist);
 			ep_pm_stay_awake(epi);
 		}
 	}
 	/*
-	 * We need to set back ep->ovflist to EP_UNACTIVE_PTR, so that after
+	 * We need to set back rdl->ovflist to EP_UNACTIVE_PTR, so that after
 	 * releasing the lock, events will be queued in the normal way inside
-	 * ep->rdllist.
+	 * rdl->rdllist.
 	 */
-	WRITE_ONCE(ep->ovflist, EP_UNACTIVE_PTR);
+	WRITE_ONCE(rdl->ovflist, EP_UNACTIVE_PTR);
 
 	/*
 	 * Quickly re-inject items left on "txlist".
 	 */
-	list_splice(&txlist, &ep->rdllist);
+	list_splice(&txlist, &rdl->rdllist);
 	__pm_relax(ep->ws);
 
-	if (!list_empty(&ep->rdllist)) {
+	if (!list_empty(&rdl->rdllist)) {
 		/*
 		 * Wake up (if active) both the eventpoll wait list and
 		 * the ->poll() wait list (delayed after we release the lock).
 		 */
-		if (waitqueue_active(&ep->wq))
-			wake_up(&ep->wq);
+		if (waitqueue_active(&rdl->wq))
+			wake_up(&rdl->wq);
+		else
+			wake_any = true;
 		if (waitqueue_active(&ep->poll_wait))
-			pwake++;
+			(*pwake)++;
+	}
+	write_unlock_irq(&rdl->lock);
+
+	if (wake_any)
+		ep_wake_any(ep);
+
+	return res;
+}
+
+/**
+ * ep_scan_ready_list - Scans the ready list in a way that makes possible for
+ *                      the scan code, to call f_op->poll(). Also allows for
+ *                      O(NumReady) performance.
+ *
+ * @ep: Pointer to the epoll private data structure.
+ * @sproc: Pointer to the scan callback.
+ * @priv: Private opaque data passed to the @sproc callback.
+ * @depth: The current depth of recursive f_op->poll calls.
+ * @ep_locked: caller already holds ep->mtx
+ *
+ * The ready list of the current CPU is scanned first, then the others in
+ * turn, until @sproc returns a non-zero value.
+ *
+ * Returns: The last value returned by the @sproc callback.
+ */
+static __poll_t ep_scan_ready_list(struct eventpoll *ep,
+			      __poll_t (*sproc)(struct eventpoll *,
+					   struct list_head *, void *),
+			      void *priv, int depth, bool ep_locked)
+{
+	__poll_t res = 0;
+	int pwake = 0;
+	unsigned int i, idx;
+
+	lockdep_assert_irqs_enabled();
+
+	/*
+	 * We need to lock this because we could be hit by
+	 * eventpoll_release_file() and epoll_ctl().
+	 */
+
+	if (!ep_locked)
+		mutex_lock_nested(&ep->mtx, depth);
+
+	idx = ep_rdl_this_cpu(ep);
+	for (i = 0; i < ep->nr_rdl && !res; i++) {
+		struct ep_rdlist *rdl = &ep->rdl[idx];
+
+		/* Only our own scans activate ->ovflist, and we hold "mtx" */
+		if (!list_empty_careful(&rdl->rdllist))
+			res = ep_scan_rdlist(ep, rdl, sproc, priv, &pwake);
+
+		if (++idx == ep->nr_rdl)
+			idx = 0;
 	}
-	write_unlock_irq(&ep->lock);
 
 	if (!ep_locked)
 		mutex_unlock(&ep->mtx);
@@ -772,6 +975,7 @@ static void epi_rcu_free(struct rcu_head *head)
 static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 {
 	struct file *file = epi->ffd.file;
+	struct ep_rdlist *rdl = ep_item_rdl(epi);
 
 	lockdep_assert_irqs_enabled();
 
@@ -787,10 +991,10 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 
 	rb_erase_cached(&epi->rbn, &ep->rbr);
 
-	write_lock_irq(&ep->lock);
+	write_lock_irq(&rdl->lock);
 	if (ep_is_linked(epi))
 		list_del_init(&epi->rdllink);
-	write_unlock_irq(&ep->lock);
+	write_unlock_irq(&rdl->lock);
 
 	wakeup_source_unregister(ep_wakeup_source(epi));
 	/*
@@ -840,7 +1044,7 @@ static void ep_free(struct eventpoll *ep)
 	 * Walks through the whole tree by freeing each "struct epitem". At this
 	 * point we are sure no poll callbacks will be lingering around, and also by
 	 * holding "epmutex" we can be sure that no file cleanup code will hit
-	 * us during this operation. So we can avoid the lock on "ep->lock".
+	 * us during this operation. So we can avoid the lock on "rdl->lock".
 	 * We do not need to lock ep->mtx, either, we only do it to prevent
 	 * a lockdep warning.
 	 */
@@ -856,7 +1060,8 @@ static void ep_free(struct eventpoll *ep)
 	mutex_destroy(&ep->mtx);
 	free_uid(ep->user);
 	wakeup_source_unregister(ep->ws);
-	kfree(ep);
+	bitmap_free(ep->waitmask);
+	kvfree(ep);
 }
 
 static int ep_eventpoll_release(struct inode *inode, struct file *file)
@@ -973,6 +1178,8 @@ static const struct file_operations eventpoll_fops = {
 	.release	= ep_eventpoll_release,
 	.poll		= ep_eventpoll_poll,
 	.llseek		= noop_llseek,
+	.unlocked_ioctl	= ep_eventpoll_ioctl,
+	.compat_ioctl	= compat_ptr_ioctl,
 };
 
 /*
@@ -1008,31 +1215,47 @@ void eventpoll_release_file(struct file *file)
 	mutex_unlock(&epmutex);
 }
 
-static int ep_alloc(struct eventpoll **pep)
+static int ep_alloc(struct eventpoll **pep, int flags)
 {
 	int error;
 	struct user_struct *user;
 	struct eventpoll *ep;
+	unsigned int i, nr_rdl;
+
+	nr_rdl = (flags & EPOLL_PERCPU) ? nr_cpu_ids : 1;
 
 	user = get_current_user();
 	error = -ENOMEM;
-	ep = kzalloc(sizeof(*ep), GFP_KERNEL);
+	ep = kvzalloc(struct_size(ep, rdl, nr_rdl), GFP_KERNEL);
 	if (unlikely(!ep))
 		goto free_uid;
 
+	if (nr_rdl > 1) {
+		ep->waitmask = bitmap_zalloc(nr_rdl, GFP_KERNEL);
+		if (unlikely(!ep->waitmask))
+			goto free_ep;
+	}
+
 	mutex_init(&ep->mtx);
-	rwlock_init(&ep->lock);
-	init_waitqueue_head(&ep->wq);
 	init_waitqueue_head(&ep->poll_wait);
-	INIT_LIST_HEAD(&ep->rdllist);
 	ep->rbr = RB_ROOT_CACHED;
-	ep->ovflist = EP_UNACTIVE_PTR;
 	ep->user = user;
+	ep->nr_rdl = nr_rdl;
+	for (i = 0; i < nr_rdl; i++) {
+		struct ep_rdlist *rdl = &ep->rdl[i];
+
+		rwlock_init(&rdl->lock);
+		INIT_LIST_HEAD(&rdl->rdllist);
+		rdl->ovflist = EP_UNACTIVE_PTR;
+		init_waitqueue_head(&rdl->wq);
+	}
 
 	*pep = ep;
 
 	return 0;
 
+free_ep:
+	kvfree(ep);
 free_uid:
 	free_uid(user);
 	return error;
@@ -1165,14 +1388,14 @@ static inline bool list_add_tail_lockless(struct list_head *new,
 }
 
 /**
- * Chains a new epi entry to the tail of the ep->ovflist in a lockless way,
+ * Chains a new epi entry to the tail of the rdl->ovflist in a lockless way,
  * i.e. multiple CPUs are allowed to call this function concurrently.
  *
  * Returns %false if epi element has been already chained, %true otherwise.
  */
 static inline bool chain_epi_lockless(struct epitem *epi)
 {
-	struct eventpoll *ep = epi->ep;
+	struct ep_rdlist *rdl = ep_item_rdl(epi);
 
 	/* Fast preliminary check */
 	if (epi->next != EP_UNACTIVE_PTR)
@@ -1183,7 +1406,7 @@ static inline bool chain_epi_lockless(struct epitem *epi)
 		return false;
 
 	/* Atomically exchange tail */
-	epi->next = xchg(&ep->ovflist, epi);
+	epi->next = xchg(&rdl->ovflist, epi);
 
 	return true;
 }
@@ -1211,11 +1434,13 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	int pwake = 0;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
+	struct ep_rdlist *rdl = ep_item_rdl(epi);
 	__poll_t pollflags = key_to_poll(key);
 	unsigned long flags;
+	bool woken = false, wake_any = false;
 	int ewake = 0;
 
-	read_lock_irqsave(&ep->lock, flags);
+	read_lock_irqsave(&rdl->lock, flags);
 
 	ep_set_busy_poll_napi_id(epi);
 
@@ -1241,50 +1466,58 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	 * If we are transferring events to userspace, we can hold no locks
 	 * (because we're accessing user memory, and because of linux f_op->poll()
 	 * semantics). All the events that happen during that period of time are
-	 * chained in ep->ovflist and requeued later on.
+	 * chained in rdl->ovflist and requeued later on.
 	 */
-	if (READ_ONCE(ep->ovflist) != EP_UNACTIVE_PTR) {
+	if (READ_ONCE(rdl->ovflist) != EP_UNACTIVE_PTR) {
 		if (chain_epi_lockless(epi))
 			ep_pm_stay_awake_rcu(epi);
 	} else if (!ep_is_linked(epi)) {
 		/* In the usual case, add event to ready list. */
-		if (list_add_tail_lockless(&epi->rdllink, &ep->rdllist))
+		if (list_add_tail_lockless(&epi->rdllink, &rdl->rdllist))
 			ep_pm_stay_awake_rcu(epi);
 	}
 
 	/*
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
-	 * wait list.
+	 * wait list.  Waiters of the item's ready list are preferred, as they
+	 * run on the CPU the item was added from; if there are none, one
+	 * waiter of another list is woken up to steal the event.
 	 */
-	if (waitqueue_active(&ep->wq)) {
-		if ((epi->event.events & EPOLLEXCLUSIVE) &&
-					!(pollflags & POLLFREE)) {
-			switch (pollflags & EPOLLINOUT_BITS) {
-			case EPOLLIN:
-				if (epi->event.events & EPOLLIN)
-					ewake = 1;
-				break;
-			case EPOLLOUT:
-				if (epi->event.events & EPOLLOUT)
-					ewake = 1;
-				break;
-			case 0:
-				ewake = 1;
-				break;
-			}
-		}
-		wake_up(&ep->wq);
+	if (waitqueue_active(&rdl->wq)) {
+		wake_up(&rdl->wq);
+		woken = true;
+	} else {
+		wake_any = true;
 	}
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
 
 out_unlock:
-	read_unlock_irqrestore(&ep->lock, flags);
+	read_unlock_irqrestore(&rdl->lock, flags);
 
-	/* We have to call this outside the lock */
+	/* We have to call these outside the lock */
+	if (wake_any)
+		woken = ep_wake_any(ep);
 	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
+	if (woken && (epi->event.events & EPOLLEXCLUSIVE) &&
+	    !(pollflags & POLLFREE)) {
+		switch (pollflags & EPOLLINOUT_BITS) {
+		case EPOLLIN:
+			if (epi->event.events & EPOLLIN)
+				ewake = 1;
+			break;
+		case EPOLLOUT:
+			if (epi->event.events & EPOLLOUT)
+				ewake = 1;
+			break;
+		case 0:
+			ewake = 1;
+			break;
+		}
+	}
+
 	if (!(epi->event.events & EPOLLEXCLUSIVE))
 		ewake = 1;
 
@@ -1499,7 +1732,9 @@ static int ep_insert(struct eventpoll *ep, const struct epoll_event *event,
 	__poll_t revents;
 	long user_watches;
 	struct epitem *epi;
+	struct ep_rdlist *rdl;
 	struct ep_pqueue epq;
+	bool wake_any = false;
 
 	lockdep_assert_irqs_enabled();
 
@@ -1517,6 +1752,7 @@ static int ep_insert(struct eventpoll *ep, const struct epoll_event *event,
 	ep_set_ffd(&epi->ffd, tfile, fd);
 	epi->event = *event;
 	epi->nwait = 0;
+	epi->rdl = ep_rdl_this_cpu(ep);
 	epi->next = EP_UNACTIVE_PTR;
 	if (epi->event.events & EPOLLWAKEUP) {
 		error = ep_create_wakeup_source(epi);
@@ -1565,28 +1801,33 @@ static int ep_insert(struct eventpoll *ep, const struct epoll_event *event,
 		goto error_unregister;
 
 	/* We have to drop the new item inside our item list to keep track of it */
-	write_lock_irq(&ep->lock);
+	rdl = ep_item_rdl(epi);
+	write_lock_irq(&rdl->lock);
 
 	/* record NAPI ID of new item if present */
 	ep_set_busy_poll_napi_id(epi);
 
 	/* If the file is already "ready" we drop it inside the ready list */
 	if (revents && !ep_is_linked(epi)) {
-		list_add_tail(&epi->rdllink, &ep->rdllist);
+		list_add_tail(&epi->rdllink, &rdl->rdllist);
 		ep_pm_stay_awake(epi);
 
 		/* Notify waiting tasks that events are available */
-		if (waitqueue_active(&ep->wq))
-			wake_up(&ep->wq);
+		if (waitqueue_active(&rdl->wq))
+			wake_up(&rdl->wq);
+		else
+			wake_any = true;
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
 
-	write_unlock_irq(&ep->lock);
+	write_unlock_irq(&rdl->lock);
 
 	atomic_long_inc(&ep->user->epoll_watches);
 
-	/* We have to call this outside the lock */
+	/* We have to call these outside the lock */
+	if (wake_any)
+		ep_wake_any(ep);
 	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
@@ -1603,14 +1844,15 @@ static int ep_insert(struct eventpoll *ep, const struct epoll_event *event,
 
 	/*
 	 * We need to do this because an event could have been arrived on some
-	 * allocated wait queue. Note that we don't care about the ep->ovflist
+	 * allocated wait queue. Note that we don't care about the rdl->ovflist
 	 * list, since that is used/cleaned only inside a section bound by "mtx".
 	 * And ep_insert() is called with "mtx" held.
 	 */
-	write_lock_irq(&ep->lock);
+	rdl = ep_item_rdl(epi);
+	write_lock_irq(&rdl->lock);
 	if (ep_is_linked(epi))
 		list_del_init(&epi->rdllink);
-	write_unlock_irq(&ep->lock);
+	write_unlock_irq(&rdl->lock);
 
 	wakeup_source_unregister(ep_wakeup_source(epi));
 
@@ -1628,6 +1870,8 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi,
 		     const struct epoll_event *event)
 {
 	int pwake = 0;
+	struct ep_rdlist *rdl = ep_item_rdl(epi);
+	bool wake_any = false;
 	poll_table pt;
 
 	lockdep_assert_irqs_enabled();
@@ -1654,9 +1898,9 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi,
 	 * 1) Flush epi changes above to other CPUs.  This ensures
 	 *    we do not miss events from ep_poll_callback if an
 	 *    event occurs immediately after we call f_op->poll().
-	 *    We need this because we did not take ep->lock while
+	 *    We need this because we did not take rdl->lock while
 	 *    changing epi above (but ep_poll_callback does take
-	 *    ep->lock).
+	 *    rdl->lock).
 	 *
 	 * 2) We also need to ensure we do not miss _past_ events
 	 *    when calling f_op->poll().  This barrier also
@@ -1675,21 +1919,25 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi,
 	 * list, push it inside.
 	 */
 	if (ep_item_poll(epi, &pt, 1)) {
-		write_lock_irq(&ep->lock);
+		write_lock_irq(&rdl->lock);
 		if (!ep_is_linked(epi)) {
-			list_add_tail(&epi->rdllink, &ep->rdllist);
+			list_add_tail(&epi->rdllink, &rdl->rdllist);
 			ep_pm_stay_awake(epi);
 
 			/* Notify waiting tasks that events are available */
-			if (waitqueue_active(&ep->wq))
-				wake_up(&ep->wq);
+			if (waitqueue_active(&rdl->wq))
+				wake_up(&rdl->wq);
+			else
+				wake_any = true;
 			if (waitqueue_active(&ep->poll_wait))
 				pwake++;
 		}
-		write_unlock_irq(&ep->lock);
+		write_unlock_irq(&rdl->lock);
 	}
 
-	/* We have to call this outside the lock */
+	/* We have to call these outside the lock */
+	if (wake_any)
+		ep_wake_any(ep);
 	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
@@ -1702,12 +1950,11 @@ static __poll_t ep_send_events_proc(struct eventpoll *ep, struct list_head *head
 	struct ep_send_events_data *esed = priv;
 	__poll_t revents;
 	struct epitem *epi, *tmp;
-	struct epoll_event __user *uevent = esed->events;
+	struct epoll_event __user *uevent = esed->events + esed->res;
 	struct wakeup_source *ws;
 	poll_table pt;
 
 	init_poll_funcptr(&pt, NULL);
-	esed->res = 0;
 
 	/*
 	 * We can loop without lock because we are passed a task private list.
@@ -1754,7 +2001,7 @@ static __poll_t ep_send_events_proc(struct eventpoll *ep, struct list_head *head
 			ep_pm_stay_awake(epi);
 			if (!esed->res)
 				esed->res = -EFAULT;
-			return 0;
+			return EPOLLERR;
 		}
 		esed->res++;
 		uevent++;
@@ -1767,17 +2014,18 @@ static __poll_t ep_send_events_proc(struct eventpoll *ep, struct list_head *head
 			 * the ready list, so that the next call to
 			 * epoll_wait() will check again the events
 			 * availability. At this point, no one can insert
-			 * into ep->rdllist besides us. The epoll_ctl()
+			 * into rdl->rdllist besides us. The epoll_ctl()
 			 * callers are locked out by
 			 * ep_scan_ready_list() holding "mtx" and the
-			 * poll callback will queue them in ep->ovflist.
+			 * poll callback will queue them in rdl->ovflist.
 			 */
-			list_add_tail(&epi->rdllink, &ep->rdllist);
+			list_add_tail(&epi->rdllink, &ep_item_rdl(epi)->rdllist);
 			ep_pm_stay_awake(epi);
 		}
 	}
 
-	return 0;
+	/* Stop the scan of further ready lists once the buffer is full */
+	return esed->res >= esed->maxevents ? EPOLLIN : 0;
 }
 
 static int ep_send_events(struct eventpoll *ep,
@@ -1787,6 +2035,7 @@ static int ep_send_events(struct eventpoll *ep,
 
 	esed.maxevents = maxevents;
 	esed.events = events;
+	esed.res = 0;
 
 	ep_scan_ready_list(ep, ep_send_events_proc, &esed, 0, false);
 	return esed.res;
@@ -1823,10 +2072,12 @@ static inline struct timespec64 ep_set_mstimeout(long ms)
 static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		   int maxevents, long timeout)
 {
-	int res = 0, eavail, timed_out = 0;
+	int res = 0, eavail = 0, timed_out = 0;
 	u64 slack = 0;
 	wait_queue_entry_t wait;
 	ktime_t expires, *to = NULL;
+	struct ep_rdlist *rdl;
+	unsigned int idx;
 
 	lockdep_assert_irqs_enabled();
 
@@ -1846,9 +2097,13 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 */
 		timed_out = 1;
 
-		write_lock_irq(&ep->lock);
-		eavail = ep_events_available(ep);
-		write_unlock_irq(&ep->lock);
+		for (idx = 0; idx < ep->nr_rdl && !eavail; idx++) {
+			rdl = &ep->rdl[idx];
+
+			write_lock_irq(&rdl->lock);
+			eavail = ep_rdl_events_available(rdl);
+			write_unlock_irq(&rdl->lock);
+		}
 
 		goto send_events;
 	}
@@ -1878,13 +2133,20 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * chance to harvest new event. Otherwise wakeup can be
 		 * lost. This is also good performance-wise, because on
 		 * normal wakeup path no need to call __remove_wait_queue()
-		 * explicitly, thus ep->lock is not taken, which halts the
+		 * explicitly, thus rdl->lock is not taken, which halts the
 		 * event delivery.
+		 *
+		 * We sleep on the ready list of the CPU we are running on, so
+		 * that events of the items added from this CPU wake us first.
 		 */
 		init_wait(&wait);
-		write_lock_irq(&ep->lock);
-		__add_wait_queue_exclusive(&ep->wq, &wait);
-		write_unlock_irq(&ep->lock);
+		idx = ep_rdl_this_cpu(ep);
+		rdl = &ep->rdl[idx];
+		write_lock_irq(&rdl->lock);
+		__add_wait_queue_exclusive(&rdl->wq, &wait);
+		if (ep->nr_rdl > 1)
+			set_bit(idx, ep->waitmask);
+		write_unlock_irq(&rdl->lock);
 
 		/*
 		 * We don't want to sleep if the ep_poll_callback() sends us
@@ -1924,9 +2186,9 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 	__set_current_state(TASK_RUNNING);
 
 	if (!list_empty_careful(&wait.entry)) {
-		write_lock_irq(&ep->lock);
-		__remove_wait_queue(&ep->wq, &wait);
-		write_unlock_irq(&ep->lock);
+		write_lock_irq(&rdl->lock);
+		__remove_wait_queue(&rdl->wq, &wait);
+		write_unlock_irq(&rdl->lock);
 	}
 
 send_events:
@@ -2042,13 +2304,14 @@ static int do_epoll_create(int flags)
 
 	/* Check the EPOLL_* constant for consistency.  */
 	BUILD_BUG_ON(EPOLL_CLOEXEC != O_CLOEXEC);
+	BUILD_BUG_ON(EPOLL_PERCPU & EPOLL_CLOEXEC);
 
-	if (flags & ~EPOLL_CLOEXEC)
+	if (flags & ~(EPOLL_CLOEXEC | EPOLL_PERCPU))
 		return -EINVAL;
 	/*
 	 * Create the internal data structure ("struct eventpoll").
 	 */
-	error = ep_alloc(&ep);
+	error = ep_alloc(&ep, flags);
 	if (error < 0)
 		return error;
 	/*
@@ -134,7 +134,9 @@ static void bio_post_read_processing(struct bio_post_read_ctx *ctx)
 	 */
 	switch (++ctx->cur_step) {
 	case STEP_DECRYPT:
-		if (ctx->enabled_steps & (1 << STEP_DECRYPT)) {
+		/* Small bios may be decrypted right away, without a workqueue */
+		if ((ctx->enabled_steps & (1 << STEP_DECRYPT)) &&
+		    !fscrypt_decrypt_bio_atomic(ctx->bio)) {
 			INIT_WORK(&ctx->work, decrypt_work);
 			fscrypt_enqueue_decrypt_work(&ctx->work);
 			return;
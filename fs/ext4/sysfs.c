@@ -32,6 +32,7 @@ typedef enum {
 	attr_pointer_ui,
 	attr_pointer_atomic,
 	attr_journal_task,
+	attr_crypto_stats,
 } attr_id_t;
 
 typedef enum {
@@ -200,6 +201,9 @@ EXT4_RO_ATTR_ES_UI(errors_count, s_error_count);
 EXT4_ATTR(first_error_time, 0444, first_error_time);
 EXT4_ATTR(last_error_time, 0444, last_error_time);
 EXT4_ATTR(journal_task, 0444, journal_task);
+#ifdef CONFIG_FS_ENCRYPTION
+EXT4_ATTR(crypto_stats, 0444, crypto_stats);
+#endif
 
 static unsigned int old_bump_val = 128;
 EXT4_ATTR_PTR(max_writeback_mb_bump, 0444, pointer_ui, &old_bump_val);
@@ -231,6 +235,9 @@ static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(first_error_time),
 	ATTR_LIST(last_error_time),
 	ATTR_LIST(journal_task),
+#ifdef CONFIG_FS_ENCRYPTION
+	ATTR_LIST(crypto_stats),
+#endif
 	NULL,
 };
 ATTRIBUTE_GROUPS(ext4);
@@ -338,6 +345,8 @@ static ssize_t ext4_attr_show(struct kobject *kobj,
 		return print_tstamp(buf, sbi->s_es, s_last_error_time);
 	case attr_journal_task:
 		return journal_task_show(sbi, buf);
+	case attr_crypto_stats:
+		return fscrypt_show_stats(sbi->s_sb, buf);
 	}
 
 	return 0;
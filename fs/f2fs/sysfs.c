@@ -96,6 +96,14 @@ static ssize_t encoding_show(struct f2fs_attr *a,
 	return snprintf(buf, PAGE_SIZE, "(none)");
 }
 
+#ifdef CONFIG_FS_ENCRYPTION
+static ssize_t crypto_stats_show(struct f2fs_attr *a,
+		struct f2fs_sb_info *sbi, char *buf)
+{
+	return fscrypt_show_stats(sbi->sb, buf);
+}
+#endif
+
 static ssize_t lifetime_write_kbytes_show(struct f2fs_attr *a,
 		struct f2fs_sb_info *sbi, char *buf)
 {
@@ -480,6 +488,9 @@ F2FS_GENERAL_RO_ATTR(features);
 F2FS_GENERAL_RO_ATTR(current_reserved_blocks);
 F2FS_GENERAL_RO_ATTR(unusable);
 F2FS_GENERAL_RO_ATTR(encoding);
+#ifdef CONFIG_FS_ENCRYPTION
+F2FS_GENERAL_RO_ATTR(crypto_stats);
+#endif
 
 #ifdef CONFIG_FS_ENCRYPTION
 F2FS_FEATURE_RO_ATTR(encryption, FEAT_CRYPTO);
@@ -545,6 +556,9 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(reserved_blocks),
 	ATTR_LIST(current_reserved_blocks),
 	ATTR_LIST(encoding),
+#ifdef CONFIG_FS_ENCRYPTION
+	ATTR_LIST(crypto_stats),
+#endif
 	NULL,
 };
 ATTRIBUTE_GROUPS(f2fs);
@@ -97,8 +97,10 @@ static bool wb_io_lists_populated(struct bdi_writeback *wb)
 
 static void wb_io_lists_depopulated(struct bdi_writeback *wb)
 {
-	if (wb_has_dirty_io(wb) && list_empty(&wb->b_dirty) &&
-	    list_empty(&wb->b_io) && list_empty(&wb->b_more_io)) {
+	/* inodes parked on the workers' slices of b_io still count as dirty */
+	if (wb_has_dirty_io(wb) && !wb->b_io_split &&
+	    list_empty(&wb->b_dirty) && list_empty(&wb->b_io) &&
+	    list_empty(&wb->b_more_io)) {
 		clear_bit(WB_has_dirty_io, &wb->state);
 		WARN_ON_ONCE(atomic_long_sub_return(wb->avg_write_bandwidth,
 					&wb->bdi->tot_write_bandwidth) < 0);
@@ -1620,7 +1622,8 @@ static long writeback_chunk_size(struct bdi_writeback *wb,
 }
 
 /*
- * Write a portion of b_io inodes which belong to @sb.
+ * Write a portion of the inodes on @io which belong to @sb.  @io is either
+ * @wb->b_io or one worker's slice of it, see wb_writeback_parallel().
  *
  * Return the number of pages and/or inodes written.
  *
@@ -1630,6 +1633,7 @@ static long writeback_chunk_size(struct bdi_writeback *wb,
  */
 static long writeback_sb_inodes(struct super_block *sb,
 				struct bdi_writeback *wb,
+				struct list_head *io,
 				struct wb_writeback_work *work)
 {
 	struct writeback_control wbc = {
@@ -1646,8 +1650,8 @@ static long writeback_sb_inodes(struct super_block *sb,
 	long write_chunk;
 	long wrote = 0;  /* count both pages and inodes */
 
-	while (!list_empty(&wb->b_io)) {
-		struct inode *inode = wb_inode(wb->b_io.prev);
+	while (!list_empty(io)) {
+		struct inode *inode = wb_inode(io->prev);
 		struct bdi_writeback *tmp_wb;
 
 		if (inode->i_sb != sb) {
@@ -1771,13 +1775,14 @@ static long writeback_sb_inodes(struct super_block *sb,
 }
 
 static long __writeback_inodes_wb(struct bdi_writeback *wb,
+				  struct list_head *io,
 				  struct wb_writeback_work *work)
 {
 	unsigned long start_time = jiffies;
 	long wrote = 0;
 
-	while (!list_empty(&wb->b_io)) {
-		struct inode *inode = wb_inode(wb->b_io.prev);
+	while (!list_empty(io)) {
+		struct inode *inode = wb_inode(io->prev);
 		struct super_block *sb = inode->i_sb;
 
 		if (!trylock_super(sb)) {
@@ -1789,7 +1794,7 @@ static long __writeback_inodes_wb(struct bdi_writeback *wb,
 			redirty_tail(inode, wb);
 			continue;
 		}
-		wrote += writeback_sb_inodes(sb, wb, work);
+		wrote += writeback_sb_inodes(sb, wb, io, work);
 		up_read(&sb->s_umount);
 
 		/* refer to the same tests at the end of writeback_sb_inodes */
@@ -1804,6 +1809,156 @@ static long __writeback_inodes_wb(struct bdi_writeback *wb,
 	return wrote;
 }
 
+static long writeback_io_list(struct bdi_writeback *wb, struct list_head *io,
+			      struct wb_writeback_work *work)
+{
+	if (work->sb)
+		return writeback_sb_inodes(work->sb, wb, io, work);
+	return __writeback_inodes_wb(wb, io, work);
+}
+
+/*
+ * One slice of b_io, written back by its own worker.  See
+ * wb_writeback_parallel().
+ */
+struct wb_io_worker {
+	struct work_struct work;
+	struct bdi_writeback *wb;
+	struct wb_writeback_work wb_work;	/* private copy of the work */
+	struct list_head io;			/* this worker's part of b_io */
+	unsigned int idx;
+	bool queued;
+	long wrote;
+};
+
+/* Called with wb->list_lock held, like writeback_sb_inodes() */
+static void wb_io_worker_run(struct wb_io_worker *worker)
+{
+	struct bdi_writeback *wb = worker->wb;
+	long nr_pages = worker->wb_work.nr_pages;
+	unsigned long start = jiffies;
+
+	worker->wrote = writeback_io_list(wb, &worker->io, &worker->wb_work);
+	wb->worker_written[worker->idx] += nr_pages - worker->wb_work.nr_pages;
+	wb->worker_time[worker->idx] += jiffies - start;
+}
+
+static void wb_io_worker_workfn(struct work_struct *work)
+{
+	struct wb_io_worker *worker = container_of(work, struct wb_io_worker,
+						   work);
+	struct bdi_writeback *wb = worker->wb;
+	struct blk_plug plug;
+
+	current->flags |= PF_SWAPWRITE;
+	blk_start_plug(&plug);
+	spin_lock(&wb->list_lock);
+	wb_io_worker_run(worker);
+	spin_unlock(&wb->list_lock);
+	blk_finish_plug(&plug);
+	current->flags &= ~PF_SWAPWRITE;
+}
+
+static struct wb_io_worker *wb_alloc_io_workers(struct bdi_writeback *wb,
+						unsigned int nr)
+{
+	struct wb_io_worker *workers;
+	unsigned int i;
+
+	workers = kcalloc(nr, sizeof(*workers), GFP_NOIO | __GFP_NOWARN);
+	if (!workers)
+		return NULL;
+
+	for (i = 0; i < nr; i++) {
+		INIT_WORK(&workers[i].work, wb_io_worker_workfn);
+		INIT_LIST_HEAD(&workers[i].io);
+		workers[i].wb = wb;
+		workers[i].idx = i;
+	}
+	return workers;
+}
+
+/*
+ * Write back b_io with @nr workers.  b_io is partitioned by inode number, so
+ * an inode is only ever on one worker's list and is written back by that
+ * worker alone, in the order it had on b_io.  The calling flusher handles
+ * the first slice itself and the others are queued on bdi_wq.  All slices are
+ * joined before returning, so the next queue_io() sees every inode the
+ * workers did not get to back on b_io.
+ *
+ * Returns the progress made, or -1 if b_io was too short to be worth
+ * splitting and has been left alone.  Called with wb->list_lock held.
+ */
+static long wb_writeback_parallel(struct bdi_writeback *wb,
+				  struct wb_writeback_work *work,
+				  struct wb_io_worker *workers, unsigned int nr)
+{
+	long share = max(work->nr_pages / nr, 1L);
+	struct inode *inode, *next;
+	unsigned int i, busy = 0;
+	long wrote = 0;
+
+	if (list_empty(&wb->b_io) || list_is_singular(&wb->b_io))
+		return -1;
+
+	list_for_each_entry_safe(inode, next, &wb->b_io, i_io_list)
+		list_move_tail(&inode->i_io_list, &workers[inode->i_ino % nr].io);
+
+	for (i = 0; i < nr; i++) {
+		workers[i].queued = !list_empty(&workers[i].io);
+		busy += workers[i].queued;
+	}
+	if (busy < 2) {
+		for (i = 0; i < nr; i++)
+			list_splice_tail_init(&workers[i].io, &wb->b_io);
+		return -1;
+	}
+
+	for (i = 0; i < nr; i++) {
+		workers[i].wb_work = *work;
+		workers[i].wb_work.nr_pages = share;
+		workers[i].wb_work.auto_free = 0;
+		workers[i].wb_work.done = NULL;
+		workers[i].wrote = 0;
+	}
+	wb->b_io_split = true;
+	spin_unlock(&wb->list_lock);
+
+	for (i = 1; i < nr; i++)
+		if (workers[i].queued)
+			queue_work(bdi_wq, &workers[i].work);
+
+	spin_lock(&wb->list_lock);
+	if (workers[0].queued)
+		wb_io_worker_run(&workers[0]);
+	spin_unlock(&wb->list_lock);
+
+	/*
+	 * Don't wait for a worker that has not started yet: bdi_wq may be
+	 * down to its rescuer, which is running us.  Take the slice back and
+	 * write it from here instead.
+	 */
+	for (i = 1; i < nr; i++) {
+		if (cancel_work_sync(&workers[i].work)) {
+			spin_lock(&wb->list_lock);
+			wb_io_worker_run(&workers[i]);
+			spin_unlock(&wb->list_lock);
+		}
+	}
+
+	spin_lock(&wb->list_lock);
+	for (i = 0; i < nr; i++) {
+		list_splice_tail_init(&workers[i].io, &wb->b_io);
+		if (!workers[i].queued)
+			continue;
+		work->nr_pages -= share - workers[i].wb_work.nr_pages;
+		wrote += workers[i].wrote;
+	}
+	wb->b_io_split = false;
+	wb_io_lists_depopulated(wb);
+	return wrote;
+}
+
 static long writeback_inodes_wb(struct bdi_writeback *wb, long nr_pages,
 				enum wb_reason reason)
 {
@@ -1819,7 +1974,7 @@ static long writeback_inodes_wb(struct bdi_writeback *wb, long nr_pages,
 	spin_lock(&wb->list_lock);
 	if (list_empty(&wb->b_io))
 		queue_io(wb, &work, jiffies);
-	__writeback_inodes_wb(wb, &work);
+	__writeback_inodes_wb(wb, &wb->b_io, &work);
 	spin_unlock(&wb->list_lock);
 	blk_finish_plug(&plug);
 
@@ -1847,10 +2002,16 @@ static long wb_writeback(struct bdi_writeback *wb,
 	unsigned long wb_start = jiffies;
 	long nr_pages = work->nr_pages;
 	unsigned long dirtied_before = jiffies;
+	unsigned int nr_workers = READ_ONCE(wb->bdi->writeback_workers);
+	struct wb_io_worker *workers = NULL;
 	struct inode *inode;
 	long progress;
 	struct blk_plug plug;
 
+	/* Parallel writeback is optional, fall back to one worker on failure */
+	if (nr_workers > 1)
+		workers = wb_alloc_io_workers(wb, nr_workers);
+
 	blk_start_plug(&plug);
 	spin_lock(&wb->list_lock);
 	for (;;) {
@@ -1892,10 +2053,12 @@ static long wb_writeback(struct bdi_writeback *wb,
 		trace_writeback_start(wb, work);
 		if (list_empty(&wb->b_io))
 			queue_io(wb, work, dirtied_before);
-		if (work->sb)
-			progress = writeback_sb_inodes(work->sb, wb, work);
-		else
-			progress = __writeback_inodes_wb(wb, work);
+		progress = -1;
+		if (workers)
+			progress = wb_writeback_parallel(wb, work, workers,
+							 nr_workers);
+		if (progress < 0)
+			progress = writeback_io_list(wb, &wb->b_io, work);
 		trace_writeback_written(wb, work);
 
 		wb_update_bandwidth(wb, wb_start);
@@ -1930,6 +2093,7 @@ static long wb_writeback(struct bdi_writeback *wb,
 	}
 	spin_unlock(&wb->list_lock);
 	blk_finish_plug(&plug);
+	kfree(workers);
 
 	return nr_pages - work->nr_pages;
 }
@@ -40,6 +40,15 @@ static struct fuse_dev *fuse_get_dev(struct file *file)
 	return READ_ONCE(file->private_data);
 }
 
+/* Input queue the device reads requests from */
+static struct fuse_iqueue *fuse_dev_iqueue(struct fuse_dev *fud)
+{
+	/* Pairs with smp_store_release() in fuse_dev_bind_cpu() */
+	struct fuse_iqueue *fiq = smp_load_acquire(&fud->iq);
+
+	return fiq ?: &fud->fc->iq;
+}
+
 static void fuse_request_init(struct fuse_req *req)
 {
 	INIT_LIST_HEAD(&req->list);
@@ -225,10 +234,56 @@ __releases(fiq->lock)
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		fuse_len_args(req->args->in_numargs,
 			      (struct fuse_arg *) req->args->in_args);
+	req->fiq = fiq;
 	list_add_tail(&req->list, &fiq->pending);
 	fiq->ops->wake_pending_and_unlock(fiq);
 }
 
+/*
+ * Pick and lock the input queue for a new request.  If a device has been
+ * bound to the current CPU's queue, the request goes there so that the
+ * server thread running on this CPU picks it up; otherwise it goes to the
+ * shared queue.  Interrupts, forgets and notify replies always use the
+ * shared queue.
+ */
+static struct fuse_iqueue *fuse_lock_dispatch_iqueue(struct fuse_conn *fc)
+{
+	struct fuse_iqueue **cpu_iqs = smp_load_acquire(&fc->cpu_iqs);
+	struct fuse_iqueue *fiq;
+
+	if (cpu_iqs) {
+		fiq = smp_load_acquire(&cpu_iqs[raw_smp_processor_id()]);
+		if (fiq) {
+			spin_lock(&fiq->lock);
+			if (fiq->connected && fiq->nr_readers)
+				return fiq;
+			spin_unlock(&fiq->lock);
+		}
+	}
+
+	fiq = &fc->iq;
+	spin_lock(&fiq->lock);
+	return fiq;
+}
+
+/*
+ * Lock the input queue a pending request sits on.  The request may be moved
+ * to the shared queue when the last device bound to a per-CPU queue goes
+ * away, so recheck after taking the lock.
+ */
+static struct fuse_iqueue *fuse_req_lock_iqueue(struct fuse_req *req)
+{
+	struct fuse_iqueue *fiq;
+
+	for (;;) {
+		fiq = READ_ONCE(req->fiq);
+		spin_lock(&fiq->lock);
+		if (fiq == req->fiq)
+			return fiq;
+		spin_unlock(&fiq->lock);
+	}
+}
+
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
@@ -250,7 +305,7 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 
 static void flush_bg_queue(struct fuse_conn *fc)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
@@ -259,7 +314,7 @@ static void flush_bg_queue(struct fuse_conn *fc)
 		req = list_first_entry(&fc->bg_queue, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->lock);
+		fiq = fuse_lock_dispatch_iqueue(fc);
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request_and_unlock(fiq, req);
 	}
@@ -383,7 +438,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->lock);
+		fiq = fuse_req_lock_iqueue(req);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
@@ -404,10 +459,10 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->lock);
+	fiq = fuse_lock_dispatch_iqueue(fc);
 	if (!fiq->connected) {
 		spin_unlock(&fiq->lock);
 		req->out.h.error = -ENOTCONN;
@@ -1186,7 +1241,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 {
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq = fuse_dev_iqueue(fud);
 	struct fuse_pqueue *fpq = &fud->pq;
 	struct fuse_req *req;
 	struct fuse_args *args;
@@ -1293,7 +1348,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	/* matches barrier in request_wait_answer() */
 	smp_mb__after_atomic();
 	if (test_bit(FR_INTERRUPTED, &req->flags))
-		queue_interrupt(fiq, req);
+		queue_interrupt(&fc->iq, req);
 	fuse_put_request(fc, req);
 
 	return reqsize;
@@ -2034,7 +2089,7 @@ static __poll_t fuse_dev_poll(struct file *file, poll_table *wait)
 	if (!fud)
 		return EPOLLERR;
 
-	fiq = &fud->fc->iq;
+	fiq = fuse_dev_iqueue(fud);
 	poll_wait(file, &fiq->waitq, wait);
 
 	spin_lock(&fiq->lock);
@@ -2047,6 +2102,23 @@ static __poll_t fuse_dev_poll(struct file *file, poll_table *wait)
 	return mask;
 }
 
+/* Disconnect an input queue and collect its pending requests on @to_end */
+static void fuse_iqueue_abort(struct fuse_iqueue *fiq, struct list_head *to_end)
+{
+	struct fuse_req *req;
+
+	spin_lock(&fiq->lock);
+	fiq->connected = 0;
+	list_for_each_entry(req, &fiq->pending, list)
+		clear_bit(FR_PENDING, &req->flags);
+	list_splice_tail_init(&fiq->pending, to_end);
+	while (forget_pending(fiq))
+		kfree(fuse_dequeue_forget(fiq, 1, NULL));
+	wake_up_all(&fiq->waitq);
+	spin_unlock(&fiq->lock);
+	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+}
+
 /* Abort all requests on the given list (pending or processing) */
 static void end_requests(struct fuse_conn *fc, struct list_head *head)
 {
@@ -2137,16 +2209,14 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		flush_bg_queue(fc);
 		spin_unlock(&fc->bg_lock);
 
-		spin_lock(&fiq->lock);
-		fiq->connected = 0;
-		list_for_each_entry(req, &fiq->pending, list)
-			clear_bit(FR_PENDING, &req->flags);
-		list_splice_tail_init(&fiq->pending, &to_end);
-		while (forget_pending(fiq))
-			kfree(fuse_dequeue_forget(fiq, 1, NULL));
-		wake_up_all(&fiq->waitq);
-		spin_unlock(&fiq->lock);
-		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+		fuse_iqueue_abort(fiq, &to_end);
+		if (fc->cpu_iqs) {
+			for (i = 0; i < nr_cpu_ids; i++) {
+				if (fc->cpu_iqs[i])
+					fuse_iqueue_abort(fc->cpu_iqs[i],
+							  &to_end);
+			}
+		}
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
 		spin_unlock(&fc->lock);
@@ -2165,6 +2235,65 @@ void fuse_wait_aborted(struct fuse_conn *fc)
 	wait_event(fc->blocked_waitq, atomic_read(&fc->num_waiting) == 0);
 }
 
+static int fuse_dev_bind_cpu(struct fuse_dev *fud, unsigned int cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *fiq;
+	int err;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	mutex_lock(&fuse_mutex);
+	err = -EBUSY;
+	if (fud->iq)
+		goto out_unlock;
+
+	err = -ENOMEM;
+	fiq = fuse_cpu_iqueue_get(fc, cpu);
+	if (!fiq)
+		goto out_unlock;
+
+	spin_lock(&fiq->lock);
+	err = -ENODEV;
+	if (fiq->connected) {
+		fiq->nr_readers++;
+		err = 0;
+	}
+	spin_unlock(&fiq->lock);
+
+	if (!err)
+		smp_store_release(&fud->iq, fiq);
+out_unlock:
+	mutex_unlock(&fuse_mutex);
+	return err;
+}
+
+/*
+ * Called when a device bound to a per-CPU queue is released.  If it was the
+ * last reader of the queue, hand the requests still pending on it to the
+ * shared queue, otherwise they would never be read.
+ */
+static void fuse_dev_unbind_cpu(struct fuse_dev *fud)
+{
+	struct fuse_iqueue *fiq = fud->iq;
+	struct fuse_iqueue *main_fiq = &fud->fc->iq;
+	struct fuse_req *req;
+
+	spin_lock(&fiq->lock);
+	if (--fiq->nr_readers || list_empty(&fiq->pending)) {
+		spin_unlock(&fiq->lock);
+		return;
+	}
+
+	spin_lock_nested(&main_fiq->lock, SINGLE_DEPTH_NESTING);
+	list_for_each_entry(req, &fiq->pending, list)
+		WRITE_ONCE(req->fiq, main_fiq);
+	list_splice_tail_init(&fiq->pending, &main_fiq->pending);
+	spin_unlock(&fiq->lock);
+	main_fiq->ops->wake_pending_and_unlock(main_fiq);
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2183,6 +2312,9 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 
 		end_requests(fc, &to_end);
 
+		if (fud->iq)
+			fuse_dev_unbind_cpu(fud);
+
 		/* Are we the last open device? */
 		if (atomic_dec_and_test(&fc->dev_count)) {
 			WARN_ON(fc->iq.fasync != NULL);
@@ -2202,7 +2334,7 @@ static int fuse_dev_fasync(int fd, struct file *file, int on)
 		return -EPERM;
 
 	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fud->fc->iq.fasync);
+	return fasync_helper(fd, file, on, &fuse_dev_iqueue(fud)->fasync);
 }
 
 static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
@@ -2222,11 +2354,61 @@ static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
 	return 0;
 }
 
+static long fuse_dev_ioctl_backing_open(struct file *file,
+					struct fuse_backing_map __user *argp)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_backing_map map;
+
+	if (!fud)
+		return -EPERM;
+
+	if (copy_from_user(&map, argp, sizeof(map)))
+		return -EFAULT;
+
+	return fuse_backing_open(fud->fc, &map);
+}
+
+static long fuse_dev_ioctl_backing_close(struct file *file, __u32 __user *argp)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	int backing_id;
+
+	if (!fud)
+		return -EPERM;
+
+	if (get_user(backing_id, argp))
+		return -EFAULT;
+
+	return fuse_backing_close(fud->fc, backing_id);
+}
+
 static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 			   unsigned long arg)
 {
 	int err = -ENOTTY;
 
+	/* CUSE shares this handler but has no backing files */
+	if (file->f_op == &fuse_dev_operations) {
+		if (cmd == FUSE_DEV_IOC_BACKING_OPEN)
+			return fuse_dev_ioctl_backing_open(file,
+				(struct fuse_backing_map __user *) arg);
+		if (cmd == FUSE_DEV_IOC_BACKING_CLOSE)
+			return fuse_dev_ioctl_backing_close(file,
+				(__u32 __user *) arg);
+	}
+
+	if (cmd == FUSE_DEV_IOC_BIND_CPU) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		__u32 cpu;
+
+		if (!fud)
+			return -EPERM;
+		if (get_user(cpu, (__u32 __user *) arg))
+			return -EFAULT;
+		return fuse_dev_bind_cpu(fud, cpu);
+	}
+
 	if (cmd == FUSE_DEV_IOC_CLONE) {
 		int oldfd;
 
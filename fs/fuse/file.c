@@ -130,6 +130,23 @@ static void fuse_file_put(struct fuse_file *ff, bool sync, bool isdir)
 	}
 }
 
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    struct fuse_open_out *openarg, unsigned int flags)
+{
+	int err;
+
+	if (!(ff->open_flags & FOPEN_PASSTHROUGH))
+		return;
+
+	/* Fall back to going through the server if the backing file is bad */
+	err = fuse_passthrough_open(fc, ff, openarg->backing_id, flags);
+	if (err) {
+		pr_warn_ratelimited("failed to set up passthrough to backing id %d: %i\n",
+				    openarg->backing_id, err);
+		ff->open_flags &= ~FOPEN_PASSTHROUGH;
+	}
+}
+
 int fuse_do_open(struct fuse_conn *fc, u64 nodeid, struct file *file,
 		 bool isdir)
 {
@@ -151,7 +168,9 @@ int fuse_do_open(struct fuse_conn *fc, u64 nodeid, struct file *file,
 		if (!err) {
 			ff->fh = outarg.fh;
 			ff->open_flags = outarg.open_flags;
-
+			if (!isdir)
+				fuse_passthrough_setup(fc, ff, &outarg,
+						       file->f_flags);
 		} else if (err != -ENOSYS) {
 			fuse_file_free(ff);
 			return err;
@@ -188,10 +207,15 @@ static void fuse_link_write_file(struct file *file)
 	spin_unlock(&fi->lock);
 }
 
-void fuse_finish_open(struct inode *inode, struct file *file)
+int fuse_finish_open(struct inode *inode, struct file *file)
 {
 	struct fuse_file *ff = file->private_data;
 	struct fuse_conn *fc = get_fuse_conn(inode);
+	int err;
+
+	err = fuse_file_io_open(file, inode);
+	if (err)
+		return err;
 
 	if (!(ff->open_flags & FOPEN_KEEP_CACHE))
 		invalidate_inode_pages2(inode->i_mapping);
@@ -212,6 +236,8 @@ void fuse_finish_open(struct inode *inode, struct file *file)
 	}
 	if ((file->f_mode & FMODE_WRITE) && fc->writeback_cache)
 		fuse_link_write_file(file);
+
+	return 0;
 }
 
 int fuse_open_common(struct inode *inode, struct file *file, bool isdir)
@@ -236,8 +262,12 @@ int fuse_open_common(struct inode *inode, struct file *file, bool isdir)
 
 	err = fuse_do_open(fc, get_node_id(inode), file, isdir);
 
-	if (!err)
-		fuse_finish_open(inode, file);
+	if (!err) {
+		err = fuse_finish_open(inode, file);
+		if (err)
+			fuse_sync_release(get_fuse_inode(inode),
+					  file->private_data, file->f_flags);
+	}
 
 	if (is_wb_truncate) {
 		fuse_release_nowrite(inode);
@@ -257,6 +287,7 @@ static void fuse_prepare_release(struct fuse_inode *fi, struct fuse_file *ff,
 	if (likely(fi)) {
 		spin_lock(&fi->lock);
 		list_del(&ff->write_entry);
+		fuse_file_io_release(ff, fi);
 		spin_unlock(&fi->lock);
 	}
 	spin_lock(&fc->lock);
@@ -266,6 +297,8 @@ static void fuse_prepare_release(struct fuse_inode *fi, struct fuse_file *ff,
 
 	wake_up_interruptible_all(&ff->poll_wait);
 
+	fuse_passthrough_release(ff);
+
 	ra->inarg.fh = ff->fh;
 	ra->inarg.flags = flags;
 	ra->args.in_numargs = 1;
@@ -1592,6 +1625,9 @@ static ssize_t fuse_file_read_iter(struct kiocb *iocb, struct iov_iter *to)
 	if (fuse_is_bad(file_inode(file)))
 		return -EIO;
 
+	if (ff->open_flags & FOPEN_PASSTHROUGH)
+		return fuse_passthrough_read_iter(iocb, to);
+
 	if (!(ff->open_flags & FOPEN_DIRECT_IO))
 		return fuse_cache_read_iter(iocb, to);
 	else
@@ -1606,6 +1642,9 @@ static ssize_t fuse_file_write_iter(struct kiocb *iocb, struct iov_iter *from)
 	if (fuse_is_bad(file_inode(file)))
 		return -EIO;
 
+	if (ff->open_flags & FOPEN_PASSTHROUGH)
+		return fuse_passthrough_write_iter(iocb, from);
+
 	if (!(ff->open_flags & FOPEN_DIRECT_IO))
 		return fuse_cache_write_iter(iocb, from);
 	else
@@ -2320,6 +2359,9 @@ static int fuse_file_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	struct fuse_file *ff = file->private_data;
 
+	if (ff->open_flags & FOPEN_PASSTHROUGH)
+		return fuse_passthrough_mmap(file, vma);
+
 	if (ff->open_flags & FOPEN_DIRECT_IO) {
 		/* Can't provide the coherency needed for MAP_SHARED */
 		if (vma->vm_flags & VM_MAYSHARE)
@@ -3442,4 +3484,5 @@ void fuse_init_file_inode(struct inode *inode)
 	fi->writectr = 0;
 	init_waitqueue_head(&fi->page_waitq);
 	INIT_LIST_HEAD(&fi->writepages);
+	fi->iocachectr = 0;
 }
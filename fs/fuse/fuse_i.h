@@ -31,6 +31,7 @@
 #include <linux/pid_namespace.h>
 #include <linux/refcount.h>
 #include <linux/user_namespace.h>
+#include <linux/idr.h>
 
 /** Default max number of pages that can be used in a single read request */
 #define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
@@ -112,6 +113,10 @@ struct fuse_inode {
 
 			/* List of writepage requestst (pending or sent) */
 			struct list_head writepages;
+
+			/* Number of cached opens if positive, passthrough
+			 * opens if negative.  Protected by fi->lock */
+			int iocachectr;
 		};
 
 		/* readdir cache (directory only) */
@@ -165,6 +170,34 @@ enum {
 struct fuse_conn;
 struct fuse_release_args;
 
+/** Backing file registered by the server with FUSE_DEV_IOC_BACKING_OPEN */
+struct fuse_backing {
+	/** File the server handed to the kernel */
+	struct file *file;
+
+	/** Credentials of the server at registration time */
+	const struct cred *cred;
+
+	/** Refcount */
+	refcount_t count;
+};
+
+/** Per open file state for FOPEN_PASSTHROUGH */
+struct fuse_passthrough {
+	/** Backing file opened with the same flags as the FUSE file */
+	struct file *filp;
+
+	/** Credentials used for I/O on filp */
+	const struct cred *cred;
+};
+
+/** How an open regular file is accounted in fi->iocachectr */
+enum fuse_iomode {
+	FUSE_IOMODE_NONE,
+	FUSE_IOMODE_CACHED,
+	FUSE_IOMODE_PASSTHROUGH,
+};
+
 /** FUSE specific file data */
 struct fuse_file {
 	/** Fuse connection for this file */
@@ -191,6 +224,12 @@ struct fuse_file {
 	/** Entry on inode's write_files list */
 	struct list_head write_entry;
 
+	/** Backing file for FOPEN_PASSTHROUGH, filp is NULL otherwise */
+	struct fuse_passthrough passthrough;
+
+	/** Accounting in fi->iocachectr, protected by fi->lock */
+	enum fuse_iomode iomode;
+
 	/* Readdir related */
 	struct {
 		/*
@@ -358,6 +397,9 @@ struct fuse_req {
 	/** Used to wake up the task waiting for completion of request*/
 	wait_queue_head_t waitq;
 
+	/** Input queue the request was queued on, see fuse_req_lock_iqueue() */
+	struct fuse_iqueue *fiq;
+
 #if IS_ENABLED(CONFIG_VIRTIO_FS)
 	/** virtio-fs's physically contiguous buffer for in and out args */
 	void *argbuf;
@@ -436,6 +478,9 @@ struct fuse_iqueue {
 
 	/** Device-specific state */
 	void *priv;
+
+	/** Number of devices bound to this queue (per-CPU queues only) */
+	unsigned int nr_readers;
 };
 
 #define FUSE_PQ_HASH_BITS 8
@@ -467,6 +512,9 @@ struct fuse_dev {
 
 	/** list entry on fc->devices */
 	struct list_head entry;
+
+	/** Per-CPU input queue this device reads from, NULL for fc->iq */
+	struct fuse_iqueue *iq;
 };
 
 struct fuse_fs_context {
@@ -536,6 +584,11 @@ struct fuse_conn {
 	/** Input queue */
 	struct fuse_iqueue iq;
 
+	/** Per-CPU input queues, indexed by CPU and allocated on demand when
+	    a device is bound with FUSE_DEV_IOC_BIND_CPU.  Protected by
+	    fuse_mutex for writing */
+	struct fuse_iqueue **cpu_iqs;
+
 	/** The next unique kernel file handle */
 	atomic64_t khctr;
 
@@ -722,6 +775,9 @@ struct fuse_conn {
 	/* Do not show mount options */
 	unsigned int no_mount_options:1;
 
+	/** Are FOPEN_PASSTHROUGH opens allowed?  Only set in INIT */
+	unsigned int passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -757,6 +813,9 @@ struct fuse_conn {
 
 	/** List of device instances belonging to this connection */
 	struct list_head devices;
+
+	/** Backing files registered for passthrough, protected by lock */
+	struct idr backing_files_map;
 };
 
 static inline struct fuse_conn *get_fuse_conn_super(struct super_block *sb)
@@ -864,7 +923,7 @@ int fuse_open_common(struct inode *inode, struct file *file, bool isdir);
 
 struct fuse_file *fuse_file_alloc(struct fuse_conn *fc);
 void fuse_file_free(struct fuse_file *ff);
-void fuse_finish_open(struct inode *inode, struct file *file);
+int fuse_finish_open(struct inode *inode, struct file *file);
 
 void fuse_sync_release(struct fuse_inode *fi, struct fuse_file *ff, int flags);
 
@@ -1046,6 +1105,12 @@ int fuse_reverse_inval_entry(struct super_block *sb, u64 parent_nodeid,
 int fuse_do_open(struct fuse_conn *fc, u64 nodeid, struct file *file,
 		 bool isdir);
 
+/**
+ * Attach the backing file named in an OPEN/CREATE reply to a fuse_file
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    struct fuse_open_out *openarg, unsigned int flags);
+
 /**
  * fuse_direct_io() flags
  */
@@ -1107,4 +1172,22 @@ unsigned int fuse_len_args(unsigned int numargs, struct fuse_arg *args);
 u64 fuse_get_unique(struct fuse_iqueue *fiq);
 void fuse_free_conn(struct fuse_conn *fc);
 
+/**
+ * Get the input queue for @cpu, allocating it if needed
+ */
+struct fuse_iqueue *fuse_cpu_iqueue_get(struct fuse_conn *fc, unsigned int cpu);
+
+/* passthrough.c */
+int fuse_backing_open(struct fuse_conn *fc, struct fuse_backing_map *map);
+int fuse_backing_close(struct fuse_conn *fc, int backing_id);
+void fuse_backing_files_free(struct fuse_conn *fc);
+int fuse_passthrough_open(struct fuse_conn *fc, struct fuse_file *ff,
+			  int backing_id, unsigned int flags);
+void fuse_passthrough_release(struct fuse_file *ff);
+int fuse_file_io_open(struct file *file, struct inode *inode);
+void fuse_file_io_release(struct fuse_file *ff, struct fuse_inode *fi);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *iter);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *iter);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
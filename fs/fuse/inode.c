@@ -605,6 +605,61 @@ static void fuse_iqueue_init(struct fuse_iqueue *fiq,
 	fiq->priv = priv;
 }
 
+/*
+ * Per-CPU queues tag the upper bits of their request IDs with the queue
+ * number, so that IDs stay unique across queues without sharing a counter.
+ */
+#define FUSE_CPU_IQ_UNIQUE_SHIFT 48
+
+struct fuse_iqueue *fuse_cpu_iqueue_get(struct fuse_conn *fc, unsigned int cpu)
+{
+	struct fuse_iqueue **cpu_iqs;
+	struct fuse_iqueue *fiq;
+
+	lockdep_assert_held(&fuse_mutex);
+
+	cpu_iqs = fc->cpu_iqs;
+	if (!cpu_iqs) {
+		cpu_iqs = kcalloc(nr_cpu_ids, sizeof(*cpu_iqs), GFP_KERNEL);
+		if (!cpu_iqs)
+			return NULL;
+		/* Pairs with smp_load_acquire() in fuse_lock_dispatch_iqueue() */
+		smp_store_release(&fc->cpu_iqs, cpu_iqs);
+	}
+
+	fiq = cpu_iqs[cpu];
+	if (!fiq) {
+		fiq = kmalloc_node(sizeof(*fiq), GFP_KERNEL, cpu_to_node(cpu));
+		if (!fiq)
+			return NULL;
+		fuse_iqueue_init(fiq, &fuse_dev_fiq_ops, NULL);
+		fiq->reqctr = (u64) (cpu + 1) << FUSE_CPU_IQ_UNIQUE_SHIFT;
+
+		/*
+		 * fuse_abort_conn() walks the per-CPU queues under fc->lock, so
+		 * a queue published after the abort must start out dead.
+		 */
+		spin_lock(&fc->lock);
+		fiq->connected = fc->connected;
+		smp_store_release(&cpu_iqs[cpu], fiq);
+		spin_unlock(&fc->lock);
+	}
+
+	return fiq;
+}
+
+static void fuse_cpu_iqueues_free(struct fuse_conn *fc)
+{
+	unsigned int cpu;
+
+	if (!fc->cpu_iqs)
+		return;
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+		kfree(fc->cpu_iqs[cpu]);
+	kfree(fc->cpu_iqs);
+}
+
 static void fuse_pqueue_init(struct fuse_pqueue *fpq)
 {
 	unsigned int i;
@@ -630,6 +685,7 @@ void fuse_conn_init(struct fuse_conn *fc, struct user_namespace *user_ns,
 	INIT_LIST_HEAD(&fc->bg_queue);
 	INIT_LIST_HEAD(&fc->entry);
 	INIT_LIST_HEAD(&fc->devices);
+	idr_init(&fc->backing_files_map);
 	atomic_set(&fc->num_waiting, 0);
 	fc->max_background = FUSE_DEFAULT_MAX_BACKGROUND;
 	fc->congestion_threshold = FUSE_DEFAULT_CONGESTION_THRESHOLD;
@@ -653,6 +709,8 @@ void fuse_conn_put(struct fuse_conn *fc)
 
 		if (fiq->ops->release)
 			fiq->ops->release(fiq);
+		fuse_backing_files_free(fc);
+		fuse_cpu_iqueues_free(fc);
 		put_pid_ns(fc->pid_ns);
 		put_user_ns(fc->user_ns);
 		fc->release(fc);
@@ -906,66 +964,72 @@ static void process_init_reply(struct fuse_conn *fc, struct fuse_args *args,
 		fc->conn_error = 1;
 	else {
 		unsigned long ra_pages;
+		u64 flags = arg->flags;
+
+		if (flags & FUSE_INIT_EXT)
+			flags |= (u64) arg->flags2 << 32;
 
 		process_init_limits(fc, arg);
 
 		if (arg->minor >= 6) {
 			ra_pages = arg->max_readahead / PAGE_SIZE;
-			if (arg->flags & FUSE_ASYNC_READ)
+			if (flags & FUSE_ASYNC_READ)
 				fc->async_read = 1;
-			if (!(arg->flags & FUSE_POSIX_LOCKS))
+			if (!(flags & FUSE_POSIX_LOCKS))
 				fc->no_lock = 1;
 			if (arg->minor >= 17) {
-				if (!(arg->flags & FUSE_FLOCK_LOCKS))
+				if (!(flags & FUSE_FLOCK_LOCKS))
 					fc->no_flock = 1;
 			} else {
-				if (!(arg->flags & FUSE_POSIX_LOCKS))
+				if (!(flags & FUSE_POSIX_LOCKS))
 					fc->no_flock = 1;
 			}
-			if (arg->flags & FUSE_ATOMIC_O_TRUNC)
+			if (flags & FUSE_ATOMIC_O_TRUNC)
 				fc->atomic_o_trunc = 1;
 			if (arg->minor >= 9) {
 				/* LOOKUP has dependency on proto version */
-				if (arg->flags & FUSE_EXPORT_SUPPORT)
+				if (flags & FUSE_EXPORT_SUPPORT)
 					fc->export_support = 1;
 			}
-			if (arg->flags & FUSE_BIG_WRITES)
+			if (flags & FUSE_BIG_WRITES)
 				fc->big_writes = 1;
-			if (arg->flags & FUSE_DONT_MASK)
+			if (flags & FUSE_DONT_MASK)
 				fc->dont_mask = 1;
-			if (arg->flags & FUSE_AUTO_INVAL_DATA)
+			if (flags & FUSE_AUTO_INVAL_DATA)
 				fc->auto_inval_data = 1;
-			else if (arg->flags & FUSE_EXPLICIT_INVAL_DATA)
+			else if (flags & FUSE_EXPLICIT_INVAL_DATA)
 				fc->explicit_inval_data = 1;
-			if (arg->flags & FUSE_DO_READDIRPLUS) {
+			if (flags & FUSE_DO_READDIRPLUS) {
 				fc->do_readdirplus = 1;
-				if (arg->flags & FUSE_READDIRPLUS_AUTO)
+				if (flags & FUSE_READDIRPLUS_AUTO)
 					fc->readdirplus_auto = 1;
 			}
-			if (arg->flags & FUSE_ASYNC_DIO)
+			if (flags & FUSE_ASYNC_DIO)
 				fc->async_dio = 1;
-			if (arg->flags & FUSE_WRITEBACK_CACHE)
+			if (flags & FUSE_WRITEBACK_CACHE)
 				fc->writeback_cache = 1;
-			if (arg->flags & FUSE_PARALLEL_DIROPS)
+			if (flags & FUSE_PARALLEL_DIROPS)
 				fc->parallel_dirops = 1;
-			if (arg->flags & FUSE_HANDLE_KILLPRIV)
+			if (flags & FUSE_HANDLE_KILLPRIV)
 				fc->handle_killpriv = 1;
 			if (arg->time_gran && arg->time_gran <= 1000000000)
 				fc->sb->s_time_gran = arg->time_gran;
-			if ((arg->flags & FUSE_POSIX_ACL)) {
+			if ((flags & FUSE_POSIX_ACL)) {
 				fc->default_permissions = 1;
 				fc->posix_acl = 1;
 				fc->sb->s_xattr = fuse_acl_xattr_handlers;
 			}
-			if (arg->flags & FUSE_CACHE_SYMLINKS)
+			if (flags & FUSE_CACHE_SYMLINKS)
 				fc->cache_symlinks = 1;
-			if (arg->flags & FUSE_ABORT_ERROR)
+			if (flags & FUSE_ABORT_ERROR)
 				fc->abort_err = 1;
-			if (arg->flags & FUSE_MAX_PAGES) {
+			if (flags & FUSE_MAX_PAGES) {
 				fc->max_pages =
 					min_t(unsigned int, FUSE_MAX_MAX_PAGES,
 					max_t(unsigned int, arg->max_pages, 1));
 			}
+			if (flags & FUSE_PASSTHROUGH)
+				fc->passthrough = 1;
 		} else {
 			ra_pages = fc->max_read / PAGE_SIZE;
 			fc->no_lock = 1;
@@ -988,13 +1052,14 @@ static void process_init_reply(struct fuse_conn *fc, struct fuse_args *args,
 void fuse_send_init(struct fuse_conn *fc)
 {
 	struct fuse_init_args *ia;
+	u64 flags;
 
 	ia = kzalloc(sizeof(*ia), GFP_KERNEL | __GFP_NOFAIL);
 
 	ia->in.major = FUSE_KERNEL_VERSION;
 	ia->in.minor = FUSE_KERNEL_MINOR_VERSION;
 	ia->in.max_readahead = fc->sb->s_bdi->ra_pages * PAGE_SIZE;
-	ia->in.flags |=
+	flags =
 		FUSE_ASYNC_READ | FUSE_POSIX_LOCKS | FUSE_ATOMIC_O_TRUNC |
 		FUSE_EXPORT_SUPPORT | FUSE_BIG_WRITES | FUSE_DONT_MASK |
 		FUSE_SPLICE_WRITE | FUSE_SPLICE_MOVE | FUSE_SPLICE_READ |
@@ -1003,7 +1068,13 @@ void fuse_send_init(struct fuse_conn *fc)
 		FUSE_WRITEBACK_CACHE | FUSE_NO_OPEN_SUPPORT |
 		FUSE_PARALLEL_DIROPS | FUSE_HANDLE_KILLPRIV | FUSE_POSIX_ACL |
 		FUSE_ABORT_ERROR | FUSE_MAX_PAGES | FUSE_CACHE_SYMLINKS |
-		FUSE_NO_OPENDIR_SUPPORT | FUSE_EXPLICIT_INVAL_DATA;
+		FUSE_NO_OPENDIR_SUPPORT | FUSE_EXPLICIT_INVAL_DATA |
+		FUSE_INIT_EXT;
+	/* Only offered where the superblock was set up to stack */
+	if (fc->sb->s_stack_depth)
+		flags |= FUSE_PASSTHROUGH;
+	ia->in.flags = flags;
+	ia->in.flags2 = flags >> 32;
 	ia->args.opcode = FUSE_INIT;
 	ia->args.in_numargs = 1;
 	ia->args.in_args[0].size = sizeof(ia->in);
@@ -1264,6 +1335,14 @@ static int fuse_fill_super(struct super_block *sb, struct fs_context *fsc)
 	fc->release = fuse_free_conn;
 	sb->s_fs_info = fc;
 
+	/*
+	 * Passthrough I/O is stacked on top of the backing files.  It is
+	 * only negotiated once the mount is live, when stacking
+	 * filesystems may already have looked at s_stack_depth, so
+	 * account for it up front.
+	 */
+	sb->s_stack_depth = 1;
+
 	err = fuse_fill_super_common(sb, ctx);
 	if (err)
 		goto err_put_conn;
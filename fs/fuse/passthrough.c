@@ -0,0 +1,347 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2001-2008  Miklos Szeredi <miklos@szeredi.hu>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Passthrough of read/write/mmap to a backing file
+ *
+ * The server registers an open file with FUSE_DEV_IOC_BACKING_OPEN and gets
+ * back a backing id.  Replying to OPEN or CREATE with FOPEN_PASSTHROUGH and
+ * that id makes the kernel open the backing file with the flags of the FUSE
+ * file and the credentials of the server, and route I/O on the FUSE file
+ * straight to it without a round trip to userspace.
+ */
+
+#include "fuse_i.h"
+
+#include <linux/cred.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/idr.h>
+#include <linux/uio.h>
+
+static struct fuse_backing *fuse_backing_get(struct fuse_backing *fb)
+{
+	if (fb && refcount_inc_not_zero(&fb->count))
+		return fb;
+	return NULL;
+}
+
+static void fuse_backing_put(struct fuse_backing *fb)
+{
+	if (fb && refcount_dec_and_test(&fb->count)) {
+		fput(fb->file);
+		put_cred(fb->cred);
+		kfree(fb);
+	}
+}
+
+int fuse_backing_open(struct fuse_conn *fc, struct fuse_backing_map *map)
+{
+	struct fuse_backing *fb;
+	struct file *file;
+	struct super_block *backing_sb;
+	int res;
+
+	res = -EPERM;
+	if (!fc->passthrough || !capable(CAP_SYS_ADMIN))
+		goto out;
+
+	res = -EINVAL;
+	if (map->flags || map->padding)
+		goto out;
+
+	res = -EBADF;
+	file = fget(map->fd);
+	if (!file)
+		goto out;
+
+	res = -EOPNOTSUPP;
+	if (!file->f_op->read_iter || !file->f_op->write_iter)
+		goto out_fput;
+
+	/*
+	 * A passthrough mount counts as a stacking filesystem, so refuse
+	 * backing files that live on another stacking filesystem (including
+	 * another passthrough FUSE mount) to keep the stack depth bounded.
+	 */
+	backing_sb = file_inode(file)->i_sb;
+	res = -ELOOP;
+	if (backing_sb->s_stack_depth)
+		goto out_fput;
+
+	res = -ENOMEM;
+	fb = kmalloc(sizeof(*fb), GFP_KERNEL);
+	if (!fb)
+		goto out_fput;
+
+	fb->file = file;
+	fb->cred = prepare_creds();
+	if (!fb->cred) {
+		kfree(fb);
+		goto out_fput;
+	}
+	refcount_set(&fb->count, 1);
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&fc->lock);
+	res = idr_alloc_cyclic(&fc->backing_files_map, fb, 1, 0, GFP_ATOMIC);
+	spin_unlock(&fc->lock);
+	idr_preload_end();
+
+	if (res < 0)
+		fuse_backing_put(fb);
+
+	return res;
+
+out_fput:
+	fput(file);
+out:
+	return res;
+}
+
+int fuse_backing_close(struct fuse_conn *fc, int backing_id)
+{
+	struct fuse_backing *fb;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (backing_id <= 0)
+		return -EINVAL;
+
+	spin_lock(&fc->lock);
+	fb = idr_remove(&fc->backing_files_map, backing_id);
+	spin_unlock(&fc->lock);
+
+	if (!fb)
+		return -ENOENT;
+
+	fuse_backing_put(fb);
+	return 0;
+}
+
+static int fuse_backing_id_free(int id, void *p, void *data)
+{
+	fuse_backing_put(p);
+	return 0;
+}
+
+void fuse_backing_files_free(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->backing_files_map, fuse_backing_id_free, NULL);
+	idr_destroy(&fc->backing_files_map);
+}
+
+int fuse_passthrough_open(struct fuse_conn *fc, struct fuse_file *ff,
+			  int backing_id, unsigned int flags)
+{
+	struct fuse_backing *fb;
+	struct file *backing_file;
+	int err;
+
+	if (!fc->passthrough)
+		return -EINVAL;
+
+	spin_lock(&fc->lock);
+	fb = fuse_backing_get(idr_find(&fc->backing_files_map, backing_id));
+	spin_unlock(&fc->lock);
+	if (!fb)
+		return -ENOENT;
+
+	/*
+	 * The server must not hand out more access than it has itself: the
+	 * backing file is reopened with the FUSE file's flags, so require the
+	 * registered file to allow the same access mode.
+	 */
+	err = -EACCES;
+	if (((flags & O_ACCMODE) != O_WRONLY &&
+	     !(fb->file->f_mode & FMODE_READ)) ||
+	    ((flags & O_ACCMODE) != O_RDONLY &&
+	     !(fb->file->f_mode & FMODE_WRITE)))
+		goto out;
+
+	flags &= ~(O_CREAT | O_EXCL | O_NOCTTY | O_TRUNC);
+	backing_file = dentry_open(&fb->file->f_path, flags, fb->cred);
+	if (IS_ERR(backing_file)) {
+		err = PTR_ERR(backing_file);
+		goto out;
+	}
+
+	ff->passthrough.filp = backing_file;
+	ff->passthrough.cred = get_cred(fb->cred);
+	err = 0;
+out:
+	fuse_backing_put(fb);
+	return err;
+}
+
+void fuse_passthrough_release(struct fuse_file *ff)
+{
+	if (!ff->passthrough.filp)
+		return;
+
+	fput(ff->passthrough.filp);
+	put_cred(ff->passthrough.cred);
+	ff->passthrough.filp = NULL;
+	ff->passthrough.cred = NULL;
+}
+
+/*
+ * Passthrough and cached opens of the same inode are mutually exclusive:
+ * writes through the backing file would leave stale pages in the FUSE page
+ * cache, and writes through the page cache would not reach the backing file
+ * until writeback.  A passthrough open that races with cached opens falls
+ * back to going through the server; a cached open while passthrough opens
+ * exist fails.  FOPEN_DIRECT_IO opens don't use the page cache and are not
+ * accounted.
+ */
+int fuse_file_io_open(struct file *file, struct inode *inode)
+{
+	struct fuse_file *ff = file->private_data;
+	struct fuse_inode *fi = get_fuse_inode(inode);
+	bool fallback = false;
+	int err = 0;
+
+	if (!S_ISREG(inode->i_mode))
+		return 0;
+
+	spin_lock(&fi->lock);
+	if (ff->open_flags & FOPEN_PASSTHROUGH) {
+		if (fi->iocachectr > 0) {
+			ff->open_flags &= ~FOPEN_PASSTHROUGH;
+			fallback = true;
+		} else {
+			fi->iocachectr--;
+			ff->iomode = FUSE_IOMODE_PASSTHROUGH;
+		}
+	}
+	if (!(ff->open_flags & (FOPEN_PASSTHROUGH | FOPEN_DIRECT_IO))) {
+		if (fi->iocachectr < 0) {
+			err = -ETXTBSY;
+		} else {
+			fi->iocachectr++;
+			ff->iomode = FUSE_IOMODE_CACHED;
+		}
+	}
+	spin_unlock(&fi->lock);
+
+	if (fallback)
+		fuse_passthrough_release(ff);
+	else if (ff->iomode == FUSE_IOMODE_PASSTHROUGH)
+		invalidate_inode_pages2(inode->i_mapping);
+
+	return err;
+}
+
+void fuse_file_io_release(struct fuse_file *ff, struct fuse_inode *fi)
+{
+	lockdep_assert_held(&fi->lock);
+
+	if (ff->iomode == FUSE_IOMODE_CACHED)
+		fi->iocachectr--;
+	else if (ff->iomode == FUSE_IOMODE_PASSTHROUGH)
+		fi->iocachectr++;
+	ff->iomode = FUSE_IOMODE_NONE;
+}
+
+static rwf_t fuse_iocb_to_rwf(struct kiocb *iocb)
+{
+	int ifl = iocb->ki_flags;
+	rwf_t flags = 0;
+
+	if (ifl & IOCB_NOWAIT)
+		flags |= RWF_NOWAIT;
+	if (ifl & IOCB_HIPRI)
+		flags |= RWF_HIPRI;
+	if (ifl & IOCB_DSYNC)
+		flags |= RWF_DSYNC;
+	if (ifl & IOCB_SYNC)
+		flags |= RWF_SYNC;
+
+	return flags;
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(iter))
+		return 0;
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = vfs_iter_read(ff->passthrough.filp, iter, &iocb->ki_pos,
+			    fuse_iocb_to_rwf(iocb));
+	revert_creds(old_cred);
+
+	fuse_invalidate_atime(file_inode(file));
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file_inode(file);
+	struct fuse_file *ff = file->private_data;
+	struct file *backing_file = ff->passthrough.filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(iter))
+		return 0;
+
+	inode_lock(inode);
+	old_cred = override_creds(ff->passthrough.cred);
+	file_start_write(backing_file);
+	ret = vfs_iter_write(backing_file, iter, &iocb->ki_pos,
+			     fuse_iocb_to_rwf(iocb));
+	file_end_write(backing_file);
+	revert_creds(old_cred);
+
+	if (ret > 0)
+		fuse_write_update_size(inode, iocb->ki_pos);
+	fuse_invalidate_attr(inode);
+	inode_unlock(inode);
+
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing_file = ff->passthrough.filp;
+	const struct cred *old_cred;
+	int ret;
+
+	if (!backing_file->f_op->mmap)
+		return -ENODEV;
+
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+
+	vma->vm_file = get_file(backing_file);
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = call_mmap(vma->vm_file, vma);
+	revert_creds(old_cred);
+
+	if (ret) {
+		/* Drop reference count from new vm_file value */
+		fput(backing_file);
+	} else {
+		/* Drop reference count from previous vm_file value */
+		fput(file);
+	}
+
+	fuse_invalidate_atime(file_inode(file));
+
+	return ret;
+}
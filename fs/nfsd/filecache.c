@@ -9,6 +9,7 @@
 #include <linux/file.h>
 #include <linux/sched.h>
 #include <linux/list_lru.h>
+#include <linux/log2.h>
 #include <linux/fsnotify_backend.h>
 #include <linux/fsnotify.h>
 #include <linux/seq_file.h>
@@ -27,11 +28,19 @@
 #define NFSD_FILE_HASH_SIZE                  (1 << NFSD_FILE_HASH_BITS)
 #define NFSD_LAUNDRETTE_DELAY		     (2 * HZ)
 
-#define NFSD_FILE_LRU_RESCAN		     (0)
 #define NFSD_FILE_SHUTDOWN		     (1)
 #define NFSD_FILE_LRU_THRESHOLD		     (4096UL)
 #define NFSD_FILE_LRU_LIMIT		     (NFSD_FILE_LRU_THRESHOLD << 2)
 
+/*
+ * The LRU is split into shards selected by hash bucket, so that inserts,
+ * unhashes and GC walks on unrelated files don't serialise on one lock.
+ * Each laundrette pass looks at no more than NFSD_FILE_GC_BATCH entries
+ * per shard and drops the shard lock in between.
+ */
+#define NFSD_FILE_LRU_SHARDS_MAX	     (64U)
+#define NFSD_FILE_GC_BATCH		     (1024UL)
+
 /* We only care about NFSD_MAY_READ/WRITE for this cache */
 #define NFSD_FILE_MAY_MASK	(NFSD_MAY_READ|NFSD_MAY_WRITE)
 
@@ -43,11 +52,15 @@ struct nfsd_fcache_bucket {
 };
 
 static DEFINE_PER_CPU(unsigned long, nfsd_file_cache_hits);
+static DEFINE_PER_CPU(unsigned long, nfsd_file_acquisitions);
+static DEFINE_PER_CPU(unsigned long, nfsd_file_evictions);
 
 static struct kmem_cache		*nfsd_file_slab;
 static struct kmem_cache		*nfsd_file_mark_slab;
 static struct nfsd_fcache_bucket	*nfsd_file_hashtbl;
-static struct list_lru			nfsd_file_lru;
+static struct list_lru			*nfsd_file_lru;
+static unsigned int			nfsd_file_lru_shards;
+static unsigned int			nfsd_file_lru_cursor;
 static long				nfsd_file_lru_flags;
 static struct fsnotify_group		*nfsd_file_fsnotify_group;
 static atomic_long_t			nfsd_filecache_count;
@@ -58,6 +71,23 @@ enum nfsd_file_laundrette_ctl {
 	NFSD_FILE_LAUNDRETTE_MAY_FLUSH
 };
 
+static struct list_lru *
+nfsd_file_lru_shard(unsigned int hashval)
+{
+	return &nfsd_file_lru[hashval & (nfsd_file_lru_shards - 1)];
+}
+
+static unsigned long
+nfsd_file_lru_total(void)
+{
+	unsigned long count = 0;
+	unsigned int i;
+
+	for (i = 0; i < nfsd_file_lru_shards; i++)
+		count += list_lru_count(&nfsd_file_lru[i]);
+	return count;
+}
+
 static void
 nfsd_file_schedule_laundrette(enum nfsd_file_laundrette_ctl ctl)
 {
@@ -261,7 +291,7 @@ nfsd_file_do_unhash(struct nfsd_file *nf)
 	--nfsd_file_hashtbl[nf->nf_hashval].nfb_count;
 	hlist_del_rcu(&nf->nf_node);
 	if (!list_empty(&nf->nf_lru))
-		list_lru_del(&nfsd_file_lru, &nf->nf_lru);
+		list_lru_del(nfsd_file_lru_shard(nf->nf_hashval), &nf->nf_lru);
 	atomic_long_dec(&nfsd_filecache_count);
 }
 
@@ -308,14 +338,22 @@ nfsd_file_put_noref(struct nfsd_file *nf)
 	return count;
 }
 
+/*
+ * The periodic laundrette is armed when an entry is hashed and rearms itself
+ * while the cache is populated, so the put path only needs to kick it when the
+ * cache has grown past the threshold. Everything else is left to the shrinker
+ * and to fsnotify/lease driven closes.
+ */
 void
 nfsd_file_put(struct nfsd_file *nf)
 {
 	bool is_hashed = test_bit(NFSD_FILE_HASHED, &nf->nf_flags) != 0;
-	bool unused = !nfsd_file_in_use(nf);
 
-	set_bit(NFSD_FILE_REFERENCED, &nf->nf_flags);
-	if (nfsd_file_put_noref(nf) == 1 && is_hashed && unused)
+	if (!test_bit(NFSD_FILE_REFERENCED, &nf->nf_flags))
+		set_bit(NFSD_FILE_REFERENCED, &nf->nf_flags);
+	if (nfsd_file_put_noref(nf) == 1 && is_hashed &&
+	    atomic_long_read(&nfsd_filecache_count) > NFSD_FILE_LRU_THRESHOLD &&
+	    !nfsd_file_in_use(nf))
 		nfsd_file_schedule_laundrette(NFSD_FILE_LAUNDRETTE_MAY_FLUSH);
 }
 
@@ -378,34 +416,36 @@ nfsd_file_lru_cb(struct list_head *item, struct list_lru_one *lru,
 	 * Note that in the put path, we set the flag and then decrement the
 	 * counter. Here we check the counter and then test and clear the flag.
 	 * That order is deliberate to ensure that we can do this locklessly.
+	 *
+	 * Busy entries are rotated rather than skipped. Walks are bounded, and
+	 * files pinned by NFSv4 stateids would otherwise collect at the head
+	 * of the list and stop the walk from ever reaching idle entries.
 	 */
 	if (atomic_read(&nf->nf_ref) > 1)
-		goto out_skip;
+		return LRU_ROTATE;
 
 	/*
 	 * Don't throw out files that are still undergoing I/O or
 	 * that have uncleared errors pending.
 	 */
 	if (nfsd_file_check_writeback(nf))
-		goto out_skip;
+		return LRU_ROTATE;
 
 	if (test_and_clear_bit(NFSD_FILE_REFERENCED, &nf->nf_flags))
-		goto out_rescan;
+		return LRU_ROTATE;
 
 	if (!test_and_clear_bit(NFSD_FILE_HASHED, &nf->nf_flags))
-		goto out_skip;
+		return LRU_SKIP;
 
 	list_lru_isolate_move(lru, &nf->nf_lru, head);
 	return LRU_REMOVED;
-out_rescan:
-	set_bit(NFSD_FILE_LRU_RESCAN, &nfsd_file_lru_flags);
-out_skip:
-	return LRU_SKIP;
 }
 
 static void
 nfsd_file_lru_dispose(struct list_head *head)
 {
+	unsigned long evicted = 0;
+
 	while(!list_empty(head)) {
 		struct nfsd_file *nf = list_first_entry(head,
 				struct nfsd_file, nf_lru);
@@ -414,22 +454,38 @@ nfsd_file_lru_dispose(struct list_head *head)
 		nfsd_file_do_unhash(nf);
 		spin_unlock(&nfsd_file_hashtbl[nf->nf_hashval].nfb_lock);
 		nfsd_file_put_noref(nf);
+		evicted++;
 	}
+	this_cpu_add(nfsd_file_evictions, evicted);
 }
 
 static unsigned long
 nfsd_file_lru_count(struct shrinker *s, struct shrink_control *sc)
 {
-	return list_lru_count(&nfsd_file_lru);
+	unsigned long count = 0;
+	unsigned int i;
+
+	for (i = 0; i < nfsd_file_lru_shards; i++)
+		count += list_lru_shrink_count(&nfsd_file_lru[i], sc);
+	return count;
 }
 
+/*
+ * Spread the scan over the shards, starting at a different one each time so
+ * that the first few shards don't take all of the reclaim.
+ */
 static unsigned long
 nfsd_file_lru_scan(struct shrinker *s, struct shrink_control *sc)
 {
+	unsigned int i, start;
 	LIST_HEAD(head);
-	unsigned long ret;
+	unsigned long ret = 0;
 
-	ret = list_lru_shrink_walk(&nfsd_file_lru, sc, nfsd_file_lru_cb, &head);
+	start = READ_ONCE(nfsd_file_lru_cursor);
+	WRITE_ONCE(nfsd_file_lru_cursor, start + 1);
+	for (i = 0; i < nfsd_file_lru_shards && sc->nr_to_scan; i++)
+		ret += list_lru_shrink_walk(nfsd_file_lru_shard(start + i), sc,
+					    nfsd_file_lru_cb, &head);
 	nfsd_file_lru_dispose(&head);
 	return ret;
 }
@@ -438,6 +494,7 @@ static struct shrinker	nfsd_file_shrinker = {
 	.scan_objects = nfsd_file_lru_scan,
 	.count_objects = nfsd_file_lru_count,
 	.seeks = 1,
+	.flags = SHRINKER_NUMA_AWARE,
 };
 
 static void
@@ -500,25 +557,44 @@ nfsd_file_close_inode(struct inode *inode)
  * nfsd_file_delayed_close - close unused nfsd_files
  * @work: dummy
  *
- * Walk the LRU list and close any entries that have not been used since
- * the last scan.
+ * Walk each LRU shard and close any entries that have not been used since
+ * the last scan. At most NFSD_FILE_GC_BATCH entries are looked at per shard,
+ * so a large cache is aged over several passes rather than in one long walk
+ * with the shard locks held. The work rearms itself while anything is left
+ * on the LRU, immediately if the cache is over the threshold and this pass
+ * made progress.
  *
  * Note this can deadlock with nfsd_file_cache_purge.
  */
 static void
 nfsd_file_delayed_close(struct work_struct *work)
 {
+	bool flush = false;
 	LIST_HEAD(head);
+	unsigned int i;
 
-	list_lru_walk(&nfsd_file_lru, nfsd_file_lru_cb, &head, LONG_MAX);
+	for (i = 0; i < nfsd_file_lru_shards; i++) {
+		list_lru_walk(&nfsd_file_lru[i], nfsd_file_lru_cb, &head,
+			      NFSD_FILE_GC_BATCH);
+		if (!list_empty(&head)) {
+			nfsd_file_lru_dispose(&head);
+			flush = true;
+		}
+		cond_resched();
+	}
 
-	if (test_and_clear_bit(NFSD_FILE_LRU_RESCAN, &nfsd_file_lru_flags))
-		nfsd_file_schedule_laundrette(NFSD_FILE_LAUNDRETTE_NOFLUSH);
+	if (nfsd_file_lru_total() &&
+	    !test_bit(NFSD_FILE_SHUTDOWN, &nfsd_file_lru_flags)) {
+		unsigned long delay = NFSD_LAUNDRETTE_DELAY;
 
-	if (!list_empty(&head)) {
-		nfsd_file_lru_dispose(&head);
-		flush_delayed_fput();
+		if (flush && atomic_long_read(&nfsd_filecache_count) >
+			     NFSD_FILE_LRU_THRESHOLD)
+			delay = 0;
+		queue_delayed_work(system_wq, &nfsd_filecache_laundrette, delay);
 	}
+
+	if (flush)
+		flush_delayed_fput();
 }
 
 static int
@@ -601,12 +677,23 @@ nfsd_file_cache_init(void)
 	}
 
 
-	ret = list_lru_init(&nfsd_file_lru);
-	if (ret) {
-		pr_err("nfsd: failed to init nfsd_file_lru: %d\n", ret);
+	nfsd_file_lru_shards = min_t(unsigned int, NFSD_FILE_LRU_SHARDS_MAX,
+				     roundup_pow_of_two(num_possible_cpus()));
+	nfsd_file_lru = kcalloc(nfsd_file_lru_shards, sizeof(*nfsd_file_lru),
+				GFP_KERNEL);
+	if (!nfsd_file_lru) {
+		pr_err("nfsd: unable to allocate nfsd_file_lru\n");
 		goto out_err;
 	}
 
+	for (i = 0; i < nfsd_file_lru_shards; i++) {
+		ret = list_lru_init(&nfsd_file_lru[i]);
+		if (ret) {
+			pr_err("nfsd: failed to init nfsd_file_lru: %d\n", ret);
+			goto out_lru;
+		}
+	}
+
 	ret = register_shrinker(&nfsd_file_shrinker);
 	if (ret) {
 		pr_err("nfsd: failed to register nfsd_file_shrinker: %d\n", ret);
@@ -639,8 +726,12 @@ nfsd_file_cache_init(void)
 	lease_unregister_notifier(&nfsd_file_lease_notifier);
 out_shrinker:
 	unregister_shrinker(&nfsd_file_shrinker);
+	i = nfsd_file_lru_shards;
 out_lru:
-	list_lru_destroy(&nfsd_file_lru);
+	while (i--)
+		list_lru_destroy(&nfsd_file_lru[i]);
+	kfree(nfsd_file_lru);
+	nfsd_file_lru = NULL;
 out_err:
 	kmem_cache_destroy(nfsd_file_slab);
 	nfsd_file_slab = NULL;
@@ -690,6 +781,7 @@ void
 nfsd_file_cache_shutdown(void)
 {
 	LIST_HEAD(dispose);
+	unsigned int i;
 
 	set_bit(NFSD_FILE_SHUTDOWN, &nfsd_file_lru_flags);
 
@@ -701,7 +793,10 @@ nfsd_file_cache_shutdown(void)
 	 */
 	cancel_delayed_work_sync(&nfsd_filecache_laundrette);
 	nfsd_file_cache_purge(NULL);
-	list_lru_destroy(&nfsd_file_lru);
+	for (i = 0; i < nfsd_file_lru_shards; i++)
+		list_lru_destroy(&nfsd_file_lru[i]);
+	kfree(nfsd_file_lru);
+	nfsd_file_lru = NULL;
 	rcu_barrier();
 	fsnotify_put_group(nfsd_file_fsnotify_group);
 	nfsd_file_fsnotify_group = NULL;
@@ -805,6 +900,7 @@ nfsd_file_acquire(struct svc_rqst *rqstp, struct svc_fh *fhp,
 	if (status != nfs_ok)
 		return status;
 
+	this_cpu_inc(nfsd_file_acquisitions);
 	inode = d_inode(fhp->fh_dentry);
 	hashval = (unsigned int)hash_long(inode->i_ino, NFSD_FILE_HASH_BITS);
 retry:
@@ -875,13 +971,14 @@ nfsd_file_acquire(struct svc_rqst *rqstp, struct svc_fh *fhp,
 	atomic_inc(&nf->nf_ref);
 	__set_bit(NFSD_FILE_HASHED, &nf->nf_flags);
 	__set_bit(NFSD_FILE_PENDING, &nf->nf_flags);
-	list_lru_add(&nfsd_file_lru, &nf->nf_lru);
+	list_lru_add(nfsd_file_lru_shard(hashval), &nf->nf_lru);
 	hlist_add_head_rcu(&nf->nf_node, &nfsd_file_hashtbl[hashval].nfb_head);
 	++nfsd_file_hashtbl[hashval].nfb_count;
 	nfsd_file_hashtbl[hashval].nfb_maxcount = max(nfsd_file_hashtbl[hashval].nfb_maxcount,
 			nfsd_file_hashtbl[hashval].nfb_count);
 	spin_unlock(&nfsd_file_hashtbl[hashval].nfb_lock);
 	atomic_long_inc(&nfsd_filecache_count);
+	nfsd_file_schedule_laundrette(NFSD_FILE_LAUNDRETTE_NOFLUSH);
 
 	nf->nf_mark = nfsd_file_mark_find_or_create(nf);
 	if (nf->nf_mark)
@@ -915,7 +1012,7 @@ nfsd_file_acquire(struct svc_rqst *rqstp, struct svc_fh *fhp,
 static int nfsd_file_cache_stats_show(struct seq_file *m, void *v)
 {
 	unsigned int i, count = 0, longest = 0;
-	unsigned long hits = 0;
+	unsigned long hits = 0, acquisitions = 0, evictions = 0;
 
 	/*
 	 * No need for spinlocks here since we're not terribly interested in
@@ -931,12 +1028,18 @@ static int nfsd_file_cache_stats_show(struct seq_file *m, void *v)
 	}
 	mutex_unlock(&nfsd_mutex);
 
-	for_each_possible_cpu(i)
+	for_each_possible_cpu(i) {
 		hits += per_cpu(nfsd_file_cache_hits, i);
+		acquisitions += per_cpu(nfsd_file_acquisitions, i);
+		evictions += per_cpu(nfsd_file_evictions, i);
+	}
 
 	seq_printf(m, "total entries: %u\n", count);
 	seq_printf(m, "longest chain: %u\n", longest);
+	seq_printf(m, "lru shards:    %u\n", nfsd_file_lru_shards);
+	seq_printf(m, "acquisitions:  %lu\n", acquisitions);
 	seq_printf(m, "cache hits:    %lu\n", hits);
+	seq_printf(m, "evictions:     %lu\n", evictions);
 	return 0;
 }
 
@@ -30,11 +30,22 @@
  */
 #define TARGET_BUCKET_SIZE	64
 
+/*
+ * Each bucket has its own lock and LRU list, so threads handling calls that
+ * hash to different buckets never share a cache line.
+ */
 struct nfsd_drc_bucket {
 	struct rb_root rb_head;
 	struct list_head lru_head;
 	spinlock_t cache_lock;
-};
+} ____cacheline_aligned_in_smp;
+
+/*
+ * The number of expired entries nfsd_cache_lookup() reclaims from a bucket
+ * each time it inserts a new one.  Anything beyond that is left to the
+ * shrinker, so that a lookup never holds the bucket lock for long.
+ */
+#define NFSD_DRC_PRUNE_MAX	3
 
 static struct kmem_cache	*drc_slab;
 
@@ -118,20 +129,35 @@ nfsd_reply_cache_alloc(struct svc_rqst *rqstp, __wsum csum,
 }
 
 static void
-nfsd_reply_cache_free_locked(struct nfsd_drc_bucket *b, struct svc_cacherep *rp,
-				struct nfsd_net *nn)
+nfsd_cacherep_free(struct svc_cacherep *rp)
 {
-	if (rp->c_type == RC_REPLBUFF && rp->c_replvec.iov_base) {
-		nn->drc_mem_usage -= rp->c_replvec.iov_len;
+	if (rp->c_type == RC_REPLBUFF)
 		kfree(rp->c_replvec.iov_base);
-	}
+	kmem_cache_free(drc_slab, rp);
+}
+
+static void
+nfsd_cacherep_unlink_locked(struct nfsd_net *nn, struct nfsd_drc_bucket *b,
+			    struct svc_cacherep *rp)
+{
+	if (rp->c_type == RC_REPLBUFF && rp->c_replvec.iov_base)
+		percpu_counter_sub(&nn->counter[NFSD_NET_DRC_MEM_USAGE],
+				   rp->c_replvec.iov_len);
 	if (rp->c_state != RC_UNUSED) {
 		rb_erase(&rp->c_node, &b->rb_head);
 		list_del(&rp->c_lru);
 		atomic_dec(&nn->num_drc_entries);
-		nn->drc_mem_usage -= sizeof(*rp);
+		percpu_counter_sub(&nn->counter[NFSD_NET_DRC_MEM_USAGE],
+				   sizeof(*rp));
 	}
-	kmem_cache_free(drc_slab, rp);
+}
+
+static void
+nfsd_reply_cache_free_locked(struct nfsd_drc_bucket *b, struct svc_cacherep *rp,
+				struct nfsd_net *nn)
+{
+	nfsd_cacherep_unlink_locked(nn, b, rp);
+	nfsd_cacherep_free(rp);
 }
 
 static void
@@ -139,8 +165,22 @@ nfsd_reply_cache_free(struct nfsd_drc_bucket *b, struct svc_cacherep *rp,
 			struct nfsd_net *nn)
 {
 	spin_lock(&b->cache_lock);
-	nfsd_reply_cache_free_locked(b, rp, nn);
+	nfsd_cacherep_unlink_locked(nn, b, rp);
 	spin_unlock(&b->cache_lock);
+	nfsd_cacherep_free(rp);
+}
+
+/* Free entries unlinked by nfsd_prune_bucket_locked(), without the lock */
+static void
+nfsd_cacherep_dispose(struct list_head *dispose)
+{
+	struct svc_cacherep *rp;
+
+	while (!list_empty(dispose)) {
+		rp = list_first_entry(dispose, struct svc_cacherep, c_lru);
+		list_del(&rp->c_lru);
+		nfsd_cacherep_free(rp);
+	}
 }
 
 int nfsd_drc_slab_create(void)
@@ -166,12 +206,18 @@ int nfsd_reply_cache_init(struct nfsd_net *nn)
 	hashsize = nfsd_hashsize(nn->max_drc_entries);
 	nn->maskbits = ilog2(hashsize);
 
+	for (i = 0; i < NFSD_NET_COUNTERS_NUM; i++) {
+		status = percpu_counter_init(&nn->counter[i], 0, GFP_KERNEL);
+		if (status)
+			goto out_counters;
+	}
+
 	nn->nfsd_reply_cache_shrinker.scan_objects = nfsd_reply_cache_scan;
 	nn->nfsd_reply_cache_shrinker.count_objects = nfsd_reply_cache_count;
 	nn->nfsd_reply_cache_shrinker.seeks = 1;
 	status = register_shrinker(&nn->nfsd_reply_cache_shrinker);
 	if (status)
-		goto out_nomem;
+		goto out_counters;
 
 	nn->drc_hashtbl = kcalloc(hashsize,
 				sizeof(*nn->drc_hashtbl), GFP_KERNEL);
@@ -191,7 +237,10 @@ int nfsd_reply_cache_init(struct nfsd_net *nn)
 	return 0;
 out_shrinker:
 	unregister_shrinker(&nn->nfsd_reply_cache_shrinker);
-out_nomem:
+	i = NFSD_NET_COUNTERS_NUM;
+out_counters:
+	while (i-- > 0)
+		percpu_counter_destroy(&nn->counter[i]);
 	printk(KERN_ERR "nfsd: failed to allocate reply cache\n");
 	return -ENOMEM;
 }
@@ -216,6 +265,8 @@ void nfsd_reply_cache_shutdown(struct nfsd_net *nn)
 	nn->drc_hashtbl = NULL;
 	nn->drc_hashsize = 0;
 
+	for (i = 0; i < NFSD_NET_COUNTERS_NUM; i++)
+		percpu_counter_destroy(&nn->counter[i]);
 }
 
 /*
@@ -229,13 +280,24 @@ lru_put_end(struct nfsd_drc_bucket *b, struct svc_cacherep *rp)
 	list_move_tail(&rp->c_lru, &b->lru_head);
 }
 
+/*
+ * Unlink up to @max entries that are older than RC_EXPIRE, or the oldest ones
+ * when the cache is over its size limit, and put them on @dispose to be freed
+ * by nfsd_cacherep_dispose() once the bucket lock has been dropped.
+ */
 static long
-prune_bucket(struct nfsd_drc_bucket *b, struct nfsd_net *nn)
+nfsd_prune_bucket_locked(struct nfsd_net *nn, struct nfsd_drc_bucket *b,
+			 unsigned long max, struct list_head *dispose)
 {
 	struct svc_cacherep *rp, *tmp;
 	long freed = 0;
 
+	lockdep_assert_held(&b->cache_lock);
+
+	/* The bucket LRU is ordered oldest-first */
 	list_for_each_entry_safe(rp, tmp, &b->lru_head, c_lru) {
+		if (freed >= max)
+			break;
 		/*
 		 * Don't free entries attached to calls that are still
 		 * in-progress, but do keep scanning the list.
@@ -245,34 +307,13 @@ prune_bucket(struct nfsd_drc_bucket *b, struct nfsd_net *nn)
 		if (atomic_read(&nn->num_drc_entries) <= nn->max_drc_entries &&
 		    time_before(jiffies, rp->c_timestamp + RC_EXPIRE))
 			break;
-		nfsd_reply_cache_free_locked(b, rp, nn);
+		nfsd_cacherep_unlink_locked(nn, b, rp);
+		list_add(&rp->c_lru, dispose);
 		freed++;
 	}
 	return freed;
 }
 
-/*
- * Walk the LRU list and prune off entries that are older than RC_EXPIRE.
- * Also prune the oldest ones when the total exceeds the max number of entries.
- */
-static long
-prune_cache_entries(struct nfsd_net *nn)
-{
-	unsigned int i;
-	long freed = 0;
-
-	for (i = 0; i < nn->drc_hashsize; i++) {
-		struct nfsd_drc_bucket *b = &nn->drc_hashtbl[i];
-
-		if (list_empty(&b->lru_head))
-			continue;
-		spin_lock(&b->cache_lock);
-		freed += prune_bucket(b, nn);
-		spin_unlock(&b->cache_lock);
-	}
-	return freed;
-}
-
 static unsigned long
 nfsd_reply_cache_count(struct shrinker *shrink, struct shrink_control *sc)
 {
@@ -282,14 +323,35 @@ nfsd_reply_cache_count(struct shrinker *shrink, struct shrink_control *sc)
 	return atomic_read(&nn->num_drc_entries);
 }
 
+/*
+ * Walk the bucket LRU lists and prune off entries that are older than
+ * RC_EXPIRE, and the oldest ones when the total exceeds the max number of
+ * entries, until sc->nr_to_scan entries have been freed.
+ */
 static unsigned long
 nfsd_reply_cache_scan(struct shrinker *shrink, struct shrink_control *sc)
 {
 	struct nfsd_net *nn = container_of(shrink,
 				struct nfsd_net, nfsd_reply_cache_shrinker);
+	unsigned long freed = 0;
+	LIST_HEAD(dispose);
+	unsigned int i;
 
-	return prune_cache_entries(nn);
+	for (i = 0; i < nn->drc_hashsize && freed < sc->nr_to_scan; i++) {
+		struct nfsd_drc_bucket *b = &nn->drc_hashtbl[i];
+
+		if (list_empty(&b->lru_head))
+			continue;
+		spin_lock(&b->cache_lock);
+		freed += nfsd_prune_bucket_locked(nn, b,
+						  sc->nr_to_scan - freed,
+						  &dispose);
+		spin_unlock(&b->cache_lock);
+		nfsd_cacherep_dispose(&dispose);
+	}
+	return freed;
 }
+
 /*
  * Walk an xdr_buf and get a CRC for at most the first RC_CSUMLEN bytes
  */
@@ -329,7 +391,7 @@ nfsd_cache_key_cmp(const struct svc_cacherep *key,
 {
 	if (key->c_key.k_xid == rp->c_key.k_xid &&
 	    key->c_key.k_csum != rp->c_key.k_csum)
-		++nn->payload_misses;
+		percpu_counter_inc(&nn->counter[NFSD_NET_PAYLOAD_MISSES]);
 
 	return memcmp(&key->c_key, &rp->c_key, sizeof(key->c_key));
 }
@@ -367,15 +429,22 @@ nfsd_cache_insert(struct nfsd_drc_bucket *b, struct svc_cacherep *key,
 	rb_link_node(&key->c_node, parent, p);
 	rb_insert_color(&key->c_node, &b->rb_head);
 out:
+	percpu_counter_inc(&nn->counter[NFSD_NET_DRC_LOOKUPS]);
+	percpu_counter_add(&nn->counter[NFSD_NET_DRC_COMPARES], entries);
+
 	/* tally hash chain length stats */
 	if (entries > nn->longest_chain) {
 		nn->longest_chain = entries;
 		nn->longest_chain_cachesize = atomic_read(&nn->num_drc_entries);
 	} else if (entries == nn->longest_chain) {
-		/* prefer to keep the smallest cachesize possible here */
-		nn->longest_chain_cachesize = min_t(unsigned int,
-				nn->longest_chain_cachesize,
-				atomic_read(&nn->num_drc_entries));
+		unsigned int cachesize = atomic_read(&nn->num_drc_entries);
+
+		/*
+		 * Prefer to keep the smallest cachesize possible here, but
+		 * don't dirty the shared cache line when nothing changes.
+		 */
+		if (cachesize < nn->longest_chain_cachesize)
+			nn->longest_chain_cachesize = cachesize;
 	}
 
 	lru_put_end(b, ret);
@@ -384,10 +453,9 @@ nfsd_cache_insert(struct nfsd_drc_bucket *b, struct svc_cacherep *key,
 
 /*
  * Try to find an entry matching the current call in the cache. When none
- * is found, we try to grab the oldest expired entry off the LRU list. If
- * a suitable one isn't there, then drop the cache_lock and allocate a
- * new one, then search again in case one got inserted while this thread
- * didn't hold the lock.
+ * is found, the preallocated entry is inserted in its place, and a few
+ * expired entries are reclaimed from the bucket. Allocation and freeing of
+ * entries happen outside the bucket lock.
  */
 int
 nfsd_cache_lookup(struct svc_rqst *rqstp)
@@ -400,6 +468,7 @@ nfsd_cache_lookup(struct svc_rqst *rqstp)
 	struct nfsd_drc_bucket *b = &nn->drc_hashtbl[hash];
 	int type = rqstp->rq_cachetype;
 	int rtn = RC_DOIT;
+	LIST_HEAD(dispose);
 
 	rqstp->rq_cacherep = NULL;
 	if (type == RC_NOCACHE) {
@@ -421,26 +490,28 @@ nfsd_cache_lookup(struct svc_rqst *rqstp)
 
 	spin_lock(&b->cache_lock);
 	found = nfsd_cache_insert(b, rp, nn);
-	if (found != rp) {
-		nfsd_reply_cache_free_locked(NULL, rp, nn);
-		rp = found;
+	if (found != rp)
 		goto found_entry;
-	}
 
 	nfsdstats.rcmisses++;
 	rqstp->rq_cacherep = rp;
 	rp->c_state = RC_INPROG;
 
 	atomic_inc(&nn->num_drc_entries);
-	nn->drc_mem_usage += sizeof(*rp);
+	percpu_counter_add(&nn->counter[NFSD_NET_DRC_MEM_USAGE], sizeof(*rp));
 
 	/* go ahead and prune the cache */
-	prune_bucket(b, nn);
+	nfsd_prune_bucket_locked(nn, b, NFSD_DRC_PRUNE_MAX, &dispose);
  out:
 	spin_unlock(&b->cache_lock);
+	nfsd_cacherep_dispose(&dispose);
 	return rtn;
 
 found_entry:
+	/* The preallocated entry was never linked in; toss it */
+	list_add(&rp->c_lru, &dispose);
+	rp = found;
+
 	/* We found a matching entry which is either in progress or done. */
 	nfsdstats.rchits++;
 	rtn = RC_DROPIT;
@@ -539,7 +610,7 @@ nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, __be32 *statp)
 		return;
 	}
 	spin_lock(&b->cache_lock);
-	nn->drc_mem_usage += bufsize;
+	percpu_counter_add(&nn->counter[NFSD_NET_DRC_MEM_USAGE], bufsize);
 	lru_put_end(b, rp);
 	rp->c_secure = test_bit(RQ_SECURE, &rqstp->rq_flags);
 	rp->c_type = cachetype;
@@ -581,13 +652,19 @@ static int nfsd_reply_cache_stats_show(struct seq_file *m, void *v)
 	seq_printf(m, "num entries:           %u\n",
 			atomic_read(&nn->num_drc_entries));
 	seq_printf(m, "hash buckets:          %u\n", 1 << nn->maskbits);
-	seq_printf(m, "mem usage:             %u\n", nn->drc_mem_usage);
+	seq_printf(m, "mem usage:             %lld\n",
+		   percpu_counter_sum_positive(&nn->counter[NFSD_NET_DRC_MEM_USAGE]));
 	seq_printf(m, "cache hits:            %u\n", nfsdstats.rchits);
 	seq_printf(m, "cache misses:          %u\n", nfsdstats.rcmisses);
 	seq_printf(m, "not cached:            %u\n", nfsdstats.rcnocache);
-	seq_printf(m, "payload misses:        %u\n", nn->payload_misses);
+	seq_printf(m, "payload misses:        %lld\n",
+		   percpu_counter_sum_positive(&nn->counter[NFSD_NET_PAYLOAD_MISSES]));
 	seq_printf(m, "longest chain len:     %u\n", nn->longest_chain);
 	seq_printf(m, "cachesize at longest:  %u\n", nn->longest_chain_cachesize);
+	seq_printf(m, "lookups:               %lld\n",
+		   percpu_counter_sum_positive(&nn->counter[NFSD_NET_DRC_LOOKUPS]));
+	seq_printf(m, "entries compared:      %lld\n",
+		   percpu_counter_sum_positive(&nn->counter[NFSD_NET_DRC_COMPARES]));
 	return 0;
 }
 
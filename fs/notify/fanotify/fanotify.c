@@ -50,13 +50,18 @@ static bool should_merge(struct fsnotify_event *old_fsn,
 	return false;
 }
 
-/* and the list better be locked by something too! */
-static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
+/*
+ * Look for a queued event to merge with among the most recently queued events
+ * in the same hash bucket. Called with group->notification_lock held.
+ */
+static int fanotify_merge(struct fsnotify_group *group,
+			  struct fsnotify_event *event)
 {
-	struct fsnotify_event *test_event;
-	struct fanotify_event *new;
+	struct fanotify_event *old, *new;
+	struct hlist_head *hlist;
+	int i = 0;
 
-	pr_debug("%s: list=%p event=%p\n", __func__, list, event);
+	pr_debug("%s: group=%p event=%p\n", __func__, group, event);
 	new = FANOTIFY_E(event);
 
 	/*
@@ -67,9 +72,12 @@ static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 	if (fanotify_is_perm_event(new->mask))
 		return 0;
 
-	list_for_each_entry_reverse(test_event, list, list) {
-		if (should_merge(test_event, event)) {
-			FANOTIFY_E(test_event)->mask |= new->mask;
+	hlist = &group->fanotify_data.merge_hash[new->hash];
+	hlist_for_each_entry(old, hlist, merge_list) {
+		if (++i > FANOTIFY_MAX_MERGE_EVENTS)
+			break;
+		if (should_merge(&old->fse, event)) {
+			old->mask |= new->mask;
 			return 1;
 		}
 	}
@@ -77,6 +85,24 @@ static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 	return 0;
 }
 
+/*
+ * Add a newly queued event to the merge hash. Permission events are never
+ * merged, so they are not hashed. Called with group->notification_lock held.
+ */
+void fanotify_insert_event(struct fsnotify_group *group,
+			   struct fsnotify_event *fsn_event)
+{
+	struct fanotify_event *event = FANOTIFY_E(fsn_event);
+
+	assert_spin_locked(&group->notification_lock);
+
+	if (fanotify_is_perm_event(event->mask))
+		return;
+
+	hlist_add_head(&event->merge_list,
+		       &group->fanotify_data.merge_hash[event->hash]);
+}
+
 /*
  * Wait for response to permission event. The function also takes care of
  * freeing the permission event (or offloads that in case the wait is canceled
@@ -326,11 +352,13 @@ init: __maybe_unused
 	 * reported on child when both directory and child watches exist.
 	 */
 	fsnotify_init_event(&event->fse, (unsigned long)id);
+	INIT_HLIST_NODE(&event->merge_list);
 	event->mask = mask;
 	if (FAN_GROUP_FLAG(group, FAN_REPORT_TID))
 		event->pid = get_pid(task_pid(current));
 	else
 		event->pid = get_pid(task_tgid(current));
+	event->hash = fanotify_event_hash(event);
 	event->fh_len = 0;
 	if (id && FAN_GROUP_FLAG(group, FAN_REPORT_FID)) {
 		/* Report the event without a file identifier on encode error */
@@ -453,7 +481,8 @@ static int fanotify_handle_event(struct fsnotify_group *group,
 	}
 
 	fsn_event = &event->fse;
-	ret = fsnotify_add_event(group, fsn_event, fanotify_merge);
+	ret = fsnotify_add_event(group, fsn_event, fanotify_merge,
+				 fanotify_insert_event);
 	if (ret) {
 		/* Permission events shouldn't be merged */
 		BUG_ON(ret == 1 && mask & FANOTIFY_PERM_EVENTS);
@@ -476,6 +505,7 @@ static void fanotify_free_group_priv(struct fsnotify_group *group)
 {
 	struct user_struct *user;
 
+	kfree(group->fanotify_data.merge_hash);
 	user = group->fanotify_data.user;
 	atomic_dec(&user->fanotify_listeners);
 	free_uid(user);
@@ -3,11 +3,22 @@
 #include <linux/path.h>
 #include <linux/slab.h>
 #include <linux/exportfs.h>
+#include <linux/hash.h>
 
 extern struct kmem_cache *fanotify_mark_cache;
 extern struct kmem_cache *fanotify_event_cachep;
 extern struct kmem_cache *fanotify_perm_event_cachep;
 
+/*
+ * Queued events are also hashed by object and pid, so that merging a new
+ * event does not have to walk the whole notification queue. The walk of a
+ * single bucket is capped so that an event storm on one object can't make
+ * queueing quadratic either.
+ */
+#define FANOTIFY_HTABLE_BITS		(7)
+#define FANOTIFY_HTABLE_SIZE		(1 << FANOTIFY_HTABLE_BITS)
+#define FANOTIFY_MAX_MERGE_EVENTS	128
+
 /* Possible states of the permission event */
 enum {
 	FAN_EVENT_INIT,
@@ -60,6 +71,7 @@ static inline bool fanotify_fid_equal(struct fanotify_fid *fid1,
  */
 struct fanotify_event {
 	struct fsnotify_event fse;
+	struct hlist_node merge_list;	/* in fanotify_data.merge_hash */
 	u32 mask;
 	/*
 	 * Those fields are outside fanotify_fid to pack fanotify_event nicely
@@ -69,7 +81,7 @@ struct fanotify_event {
 	 */
 	u8 fh_type;
 	u8 fh_len;
-	u16 pad;
+	u16 hash;
 	union {
 		/*
 		 * We hold ref to this path so it may be dereferenced at any
@@ -139,6 +151,23 @@ static inline struct fanotify_event *FANOTIFY_E(struct fsnotify_event *fse)
 	return container_of(fse, struct fanotify_event, fse);
 }
 
+static inline unsigned int fanotify_event_hash(struct fanotify_event *event)
+{
+	return hash_long(event->fse.objectid ^ (unsigned long)event->pid,
+			 FANOTIFY_HTABLE_BITS);
+}
+
+static inline void fanotify_unhash_event(struct fsnotify_group *group,
+					 struct fanotify_event *event)
+{
+	assert_spin_locked(&group->notification_lock);
+	if (!hlist_unhashed(&event->merge_list))
+		hlist_del_init(&event->merge_list);
+}
+
+void fanotify_insert_event(struct fsnotify_group *group,
+			   struct fsnotify_event *fsn_event);
+
 struct fanotify_event *fanotify_alloc_event(struct fsnotify_group *group,
 					    struct inode *inode, u32 mask,
 					    const void *data, int data_type,
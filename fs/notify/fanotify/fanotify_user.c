@@ -51,6 +51,9 @@ struct kmem_cache *fanotify_perm_event_cachep __read_mostly;
 
 #define FANOTIFY_EVENT_ALIGN 4
 
+/* Max events taken off the queue per notification_lock round trip in read */
+#define FANOTIFY_READ_BATCH 32
+
 static int fanotify_event_info_len(struct fanotify_event *event)
 {
 	if (!fanotify_event_has_fid(event))
@@ -62,38 +65,73 @@ static int fanotify_event_info_len(struct fanotify_event *event)
 }
 
 /*
- * Get an fsnotify notification event if one exists and is small
- * enough to fit in "count". Return an error pointer if the count
- * is not large enough. When permission event is dequeued, its state is
- * updated accordingly.
+ * Move as many queued events as fit in "count", up to FANOTIFY_READ_BATCH,
+ * onto @events in one go. A permission event is only ever dequeued on its
+ * own, and its state is updated accordingly. Return the number of events
+ * dequeued, or -EINVAL if the first queued event does not fit in "count".
  */
-static struct fsnotify_event *get_one_event(struct fsnotify_group *group,
-					    size_t count)
+static int get_events(struct fsnotify_group *group, size_t count,
+		      struct list_head *events)
 {
-	size_t event_size = FAN_EVENT_METADATA_LEN;
-	struct fsnotify_event *fsn_event = NULL;
+	struct fsnotify_event *fsn_event;
+	struct fanotify_event *event;
+	size_t event_size;
+	bool perm;
+	int nr = 0;
 
 	pr_debug("%s: group=%p count=%zd\n", __func__, group, count);
 
 	spin_lock(&group->notification_lock);
-	if (fsnotify_notify_queue_is_empty(group))
-		goto out;
+	while (nr < FANOTIFY_READ_BATCH &&
+	       !fsnotify_notify_queue_is_empty(group)) {
+		fsn_event = fsnotify_peek_first_event(group);
+		event = FANOTIFY_E(fsn_event);
+
+		event_size = FAN_EVENT_METADATA_LEN;
+		if (FAN_GROUP_FLAG(group, FAN_REPORT_FID))
+			event_size += fanotify_event_info_len(event);
+		if (event_size > count) {
+			if (!nr)
+				nr = -EINVAL;
+			break;
+		}
 
-	if (FAN_GROUP_FLAG(group, FAN_REPORT_FID)) {
-		event_size += fanotify_event_info_len(
-			FANOTIFY_E(fsnotify_peek_first_event(group)));
+		perm = fanotify_is_perm_event(event->mask);
+		if (perm && nr)
+			break;
+
+		fsnotify_remove_first_event(group);
+		fanotify_unhash_event(group, event);
+		list_add_tail(&fsn_event->list, events);
+		count -= event_size;
+		nr++;
+
+		if (perm) {
+			FANOTIFY_PE(fsn_event)->state = FAN_EVENT_REPORTED;
+			break;
+		}
 	}
+	spin_unlock(&group->notification_lock);
+	return nr;
+}
 
-	if (event_size > count) {
-		fsn_event = ERR_PTR(-EINVAL);
-		goto out;
+/*
+ * Put events dequeued by get_events() but not reported back at the head of
+ * the queue, in their original order. These are never permission events.
+ */
+static void requeue_events(struct fsnotify_group *group,
+			   struct list_head *events)
+{
+	struct fsnotify_event *fsn_event, *next;
+
+	spin_lock(&group->notification_lock);
+	list_for_each_entry_safe_reverse(fsn_event, next, events, list) {
+		list_move(&fsn_event->list, &group->notification_list);
+		group->q_len++;
+		if (fsn_event != group->overflow_event)
+			fanotify_insert_event(group, fsn_event);
 	}
-	fsn_event = fsnotify_remove_first_event(group);
-	if (fanotify_is_perm_event(FANOTIFY_E(fsn_event)->mask))
-		FANOTIFY_PE(fsn_event)->state = FAN_EVENT_REPORTED;
-out:
 	spin_unlock(&group->notification_lock);
-	return fsn_event;
 }
 
 static int create_fd(struct fsnotify_group *group,
@@ -208,42 +246,47 @@ static int copy_fid_to_user(struct fanotify_event *event, char __user *buf)
 {
 	struct fanotify_event_info_fid info = { };
 	struct file_handle handle = { };
-	unsigned char bounce[FANOTIFY_INLINE_FH_LEN], *fh;
+	unsigned char bounce[sizeof(info) + sizeof(handle) +
+			     FANOTIFY_INLINE_FH_LEN + FANOTIFY_EVENT_ALIGN] = { };
+	size_t hdr_len = sizeof(info) + sizeof(handle);
 	size_t fh_len = event->fh_len;
 	size_t len = fanotify_event_info_len(event);
 
 	if (!len)
 		return 0;
 
-	if (WARN_ON_ONCE(len < sizeof(info) + sizeof(handle) + fh_len))
+	if (WARN_ON_ONCE(len < hdr_len + fh_len))
 		return -EFAULT;
 
-	/* Copy event info fid header followed by vaiable sized file handle */
+	/* Event info fid header followed by vaiable sized file handle */
 	info.hdr.info_type = FAN_EVENT_INFO_TYPE_FID;
 	info.hdr.len = len;
 	info.fsid = event->fid.fsid;
-	if (copy_to_user(buf, &info, sizeof(info)))
-		return -EFAULT;
-
-	buf += sizeof(info);
-	len -= sizeof(info);
 	handle.handle_type = event->fh_type;
 	handle.handle_bytes = fh_len;
-	if (copy_to_user(buf, &handle, sizeof(handle)))
-		return -EFAULT;
+	memcpy(bounce, &info, sizeof(info));
+	memcpy(bounce + sizeof(info), &handle, sizeof(handle));
 
-	buf += sizeof(handle);
-	len -= sizeof(handle);
 	/*
-	 * For an inline fh, copy through stack to exclude the copy from
-	 * usercopy hardening protections.
+	 * An inline fh is assembled with the header and zero padding on the
+	 * stack and copied out at once. Copying through the stack also
+	 * excludes the copy from usercopy hardening protections.
 	 */
-	fh = fanotify_event_fh(event);
 	if (fh_len <= FANOTIFY_INLINE_FH_LEN) {
-		memcpy(bounce, fh, fh_len);
-		fh = bounce;
+		if (WARN_ON_ONCE(len > sizeof(bounce)))
+			return -EFAULT;
+		memcpy(bounce + hdr_len, fanotify_event_fh(event), fh_len);
+		if (copy_to_user(buf, bounce, len))
+			return -EFAULT;
+		return 0;
 	}
-	if (copy_to_user(buf, fh, fh_len))
+
+	if (copy_to_user(buf, bounce, hdr_len))
+		return -EFAULT;
+
+	buf += hdr_len;
+	len -= hdr_len;
+	if (copy_to_user(buf, fanotify_event_fh(event), fh_len))
 		return -EFAULT;
 
 	/* Pad with 0's */
@@ -337,6 +380,7 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 	struct fsnotify_group *group;
 	struct fsnotify_event *kevent;
 	char __user *start;
+	LIST_HEAD(events);
 	int ret;
 	DEFINE_WAIT_FUNC(wait, woken_wake_function);
 
@@ -347,13 +391,13 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 
 	add_wait_queue(&group->notification_waitq, &wait);
 	while (1) {
-		kevent = get_one_event(group, count);
-		if (IS_ERR(kevent)) {
-			ret = PTR_ERR(kevent);
-			break;
+		if (list_empty(&events)) {
+			ret = get_events(group, count, &events);
+			if (ret < 0)
+				break;
 		}
 
-		if (!kevent) {
+		if (list_empty(&events)) {
 			ret = -EAGAIN;
 			if (file->f_flags & O_NONBLOCK)
 				break;
@@ -369,6 +413,9 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 			continue;
 		}
 
+		kevent = list_first_entry(&events, struct fsnotify_event, list);
+		list_del_init(&kevent->list);
+
 		ret = copy_event_to_user(group, kevent, buf, count);
 		if (unlikely(ret == -EOPENSTALE)) {
 			/*
@@ -406,6 +453,9 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 	}
 	remove_wait_queue(&group->notification_waitq, &wait);
 
+	if (!list_empty(&events))
+		requeue_events(group, &events);
+
 	if (start != buf && ret != -EFAULT)
 		ret = buf - start;
 	return ret;
@@ -470,6 +520,7 @@ static int fanotify_release(struct inode *ignored, struct file *file)
 	 */
 	while (!fsnotify_notify_queue_is_empty(group)) {
 		fsn_event = fsnotify_remove_first_event(group);
+		fanotify_unhash_event(group, FANOTIFY_E(fsn_event));
 		if (!(FANOTIFY_E(fsn_event)->mask & FANOTIFY_PERM_EVENTS)) {
 			spin_unlock(&group->notification_lock);
 			fsnotify_destroy_event(group, fsn_event);
@@ -763,6 +814,22 @@ static int fanotify_add_inode_mark(struct fsnotify_group *group,
 }
 
 /* fanotify syscalls */
+static struct hlist_head *fanotify_alloc_merge_hash(void)
+{
+	struct hlist_head *hash;
+	int i;
+
+	hash = kmalloc_array(FANOTIFY_HTABLE_SIZE, sizeof(*hash),
+			     GFP_KERNEL_ACCOUNT);
+	if (!hash)
+		return NULL;
+
+	for (i = 0; i < FANOTIFY_HTABLE_SIZE; i++)
+		INIT_HLIST_HEAD(&hash[i]);
+
+	return hash;
+}
+
 SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 {
 	struct fsnotify_group *group;
@@ -823,6 +890,12 @@ SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 	atomic_inc(&user->fanotify_listeners);
 	group->memcg = get_mem_cgroup_from_mm(current->mm);
 
+	group->fanotify_data.merge_hash = fanotify_alloc_merge_hash();
+	if (!group->fanotify_data.merge_hash) {
+		fd = -ENOMEM;
+		goto out_destroy_group;
+	}
+
 	oevent = fanotify_alloc_event(group, NULL, FS_Q_OVERFLOW, NULL,
 				      FSNOTIFY_EVENT_NONE, NULL);
 	if (unlikely(!oevent)) {
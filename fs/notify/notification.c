@@ -80,11 +80,19 @@ void fsnotify_destroy_event(struct fsnotify_group *group,
  * added to the queue, 1 if the event was merged with some other queued event,
  * 2 if the event was not queued - either the queue of events has overflown
  * or the group is shutting down.
+ *
+ * Merging is tried before the queue length is checked, so once the queue is
+ * full, events for objects that already have an event queued are still folded
+ * into that event and only events that would need a new queue entry are lost.
+ * @insert is called under the notification lock for every newly queued event
+ * other than the overflow event.
  */
 int fsnotify_add_event(struct fsnotify_group *group,
 		       struct fsnotify_event *event,
-		       int (*merge)(struct list_head *,
-				    struct fsnotify_event *))
+		       int (*merge)(struct fsnotify_group *,
+				    struct fsnotify_event *),
+		       void (*insert)(struct fsnotify_group *,
+				      struct fsnotify_event *))
 {
 	int ret = 0;
 	struct list_head *list = &group->notification_list;
@@ -98,6 +106,14 @@ int fsnotify_add_event(struct fsnotify_group *group,
 		return 2;
 	}
 
+	if (event != group->overflow_event && !list_empty(list) && merge) {
+		ret = merge(group, event);
+		if (ret) {
+			spin_unlock(&group->notification_lock);
+			return ret;
+		}
+	}
+
 	if (event == group->overflow_event ||
 	    group->q_len >= group->max_events) {
 		ret = 2;
@@ -110,14 +126,8 @@ int fsnotify_add_event(struct fsnotify_group *group,
 		goto queue;
 	}
 
-	if (!list_empty(list) && merge) {
-		ret = merge(list, event);
-		if (ret) {
-			spin_unlock(&group->notification_lock);
-			return ret;
-		}
-	}
-
+	if (insert)
+		insert(group, event);
 queue:
 	group->q_len++;
 	list_add_tail(&event->list, list);
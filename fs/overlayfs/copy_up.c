@@ -117,7 +117,50 @@ int ovl_copy_xattr(struct dentry *old, struct dentry *new)
 	return error;
 }
 
-static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
+/*
+ * Offload the copy to the filesystem's ->copy_file_range() method, which
+ * lets e.g. NFS do a server side copy.  The method is called directly rather
+ * than through vfs_copy_file_range(), because copy up already holds freeze
+ * protection on the upper fs.  Returns -EOPNOTSUPP if the caller should fall
+ * back to splicing the remaining data.
+ */
+static int ovl_copy_up_offload(struct file *old_file, loff_t *old_pos,
+			       struct file *new_file, loff_t *new_pos,
+			       loff_t *len)
+{
+	ssize_t bytes;
+
+	if (!new_file->f_op->copy_file_range ||
+	    new_file->f_op->copy_file_range != old_file->f_op->copy_file_range)
+		return -EOPNOTSUPP;
+
+	while (*len) {
+		size_t this_len = min_t(loff_t, *len, MAX_RW_COUNT);
+
+		if (signal_pending_state(TASK_KILLABLE, current))
+			return -EINTR;
+
+		bytes = new_file->f_op->copy_file_range(old_file, *old_pos,
+							new_file, *new_pos,
+							this_len, 0);
+		if (bytes <= 0) {
+			/* Let splice take over from here */
+			if (bytes == 0 || bytes == -EOPNOTSUPP ||
+			    bytes == -EXDEV || bytes == -EINVAL)
+				return -EOPNOTSUPP;
+			return bytes;
+		}
+
+		*old_pos += bytes;
+		*new_pos += bytes;
+		*len -= bytes;
+	}
+
+	return 0;
+}
+
+static int ovl_copy_up_data(struct ovl_fs *ofs, struct path *old,
+			    struct path *new, loff_t len)
 {
 	struct file *old_file;
 	struct file *new_file;
@@ -145,6 +188,12 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 		goto out;
 	/* Couldn't clone, so now we try to copy the data */
 
+	error = ovl_copy_up_offload(old_file, &old_pos, new_file, &new_pos,
+				    &len);
+	if (error != -EOPNOTSUPP)
+		goto out;
+	error = 0;
+
 	/* FIXME: copy up sparse files efficiently */
 	while (len) {
 		size_t this_len = OVL_COPY_UP_CHUNK_SIZE;
@@ -170,7 +219,7 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 		len -= bytes;
 	}
 out:
-	if (!error)
+	if (!error && ovl_should_sync(ofs))
 		error = vfs_fsync(new_file, 0);
 	fput(new_file);
 out_fput:
@@ -439,6 +488,7 @@ static int ovl_link_up(struct ovl_copy_up_ctx *c)
 
 static int ovl_copy_up_inode(struct ovl_copy_up_ctx *c, struct dentry *temp)
 {
+	struct ovl_fs *ofs = c->dentry->d_sb->s_fs_info;
 	int err;
 
 	/*
@@ -454,7 +504,8 @@ static int ovl_copy_up_inode(struct ovl_copy_up_ctx *c, struct dentry *temp)
 		upperpath.dentry = temp;
 
 		ovl_path_lowerdata(c->dentry, &datapath);
-		err = ovl_copy_up_data(&datapath, &upperpath, c->stat.size);
+		err = ovl_copy_up_data(ofs, &datapath, &upperpath,
+				       c->stat.size);
 		if (err)
 			return err;
 	}
@@ -738,6 +789,7 @@ static bool ovl_need_meta_copy_up(struct dentry *dentry, umode_t mode,
 /* Copy up data of an inode which was copied up metadata only in the past. */
 static int ovl_copy_up_meta_inode_data(struct ovl_copy_up_ctx *c)
 {
+	struct ovl_fs *ofs = c->dentry->d_sb->s_fs_info;
 	struct path upperpath, datapath;
 	int err;
 	char *capability = NULL;
@@ -758,7 +810,7 @@ static int ovl_copy_up_meta_inode_data(struct ovl_copy_up_ctx *c)
 			goto out;
 	}
 
-	err = ovl_copy_up_data(&datapath, &upperpath, c->stat.size);
+	err = ovl_copy_up_data(ofs, &datapath, &upperpath, c->stat.size);
 	if (err)
 		goto out_free;
 
@@ -24,13 +24,28 @@ static char ovl_whatisit(struct inode *inode, struct inode *realinode)
 /* No atime modificaton nor notify on underlying */
 #define OVL_OPEN_FLAGS (O_NOATIME | FMODE_NONOTIFY)
 
+/*
+ * Flags for the real file.  A volatile overlay keeps O_SYNC/O_DSYNC on the
+ * overlay file, but does not pass them on to the upper fs.
+ */
+static unsigned int ovl_real_flags(const struct file *file)
+{
+	struct ovl_fs *ofs = file_inode(file)->i_sb->s_fs_info;
+	unsigned int flags = file->f_flags;
+
+	if (!ovl_should_sync(ofs))
+		flags &= ~(__O_SYNC | O_DSYNC);
+
+	return flags;
+}
+
 static struct file *ovl_open_realfile(const struct file *file,
 				      struct inode *realinode)
 {
 	struct inode *inode = file_inode(file);
 	struct file *realfile;
 	const struct cred *old_cred;
-	int flags = file->f_flags | OVL_OPEN_FLAGS;
+	int flags = ovl_real_flags(file) | OVL_OPEN_FLAGS;
 
 	old_cred = ovl_override_creds(inode->i_sb);
 	realfile = open_with_fake_path(&file->f_path, flags, realinode,
@@ -86,6 +101,7 @@ static int ovl_real_fdget_meta(const struct file *file, struct fd *real,
 {
 	struct inode *inode = file_inode(file);
 	struct inode *realinode;
+	unsigned int flags = ovl_real_flags(file);
 
 	real->flags = 0;
 	real->file = file->private_data;
@@ -104,8 +120,8 @@ static int ovl_real_fdget_meta(const struct file *file, struct fd *real,
 	}
 
 	/* Did the flags change since open? */
-	if (unlikely((file->f_flags ^ real->file->f_flags) & ~OVL_OPEN_FLAGS))
-		return ovl_change_flags(real->file, file->f_flags);
+	if (unlikely((flags ^ real->file->f_flags) & ~OVL_OPEN_FLAGS))
+		return ovl_change_flags(real->file, flags);
 
 	return 0;
 }
@@ -210,9 +226,8 @@ static void ovl_file_accessed(struct file *file)
 	touch_atime(&file->f_path);
 }
 
-static rwf_t ovl_iocb_to_rwf(struct kiocb *iocb)
+static rwf_t ovl_iocb_to_rwf(int ifl)
 {
-	int ifl = iocb->ki_flags;
 	rwf_t flags = 0;
 
 	if (ifl & IOCB_NOWAIT)
@@ -243,7 +258,7 @@ static ssize_t ovl_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 
 	old_cred = ovl_override_creds(file_inode(file)->i_sb);
 	ret = vfs_iter_read(real.file, iter, &iocb->ki_pos,
-			    ovl_iocb_to_rwf(iocb));
+			    ovl_iocb_to_rwf(iocb->ki_flags));
 	revert_creds(old_cred);
 
 	ovl_file_accessed(file);
@@ -257,8 +272,10 @@ static ssize_t ovl_write_iter(struct kiocb *iocb, struct iov_iter *iter)
 {
 	struct file *file = iocb->ki_filp;
 	struct inode *inode = file_inode(file);
+	struct ovl_fs *ofs = inode->i_sb->s_fs_info;
 	struct fd real;
 	const struct cred *old_cred;
+	int ifl = iocb->ki_flags;
 	ssize_t ret;
 
 	if (!iov_iter_count(iter))
@@ -275,10 +292,14 @@ static ssize_t ovl_write_iter(struct kiocb *iocb, struct iov_iter *iter)
 	if (ret)
 		goto out_unlock;
 
+	/* Volatile overlay does not pass sync semantics down to upper fs */
+	if (!ovl_should_sync(ofs))
+		ifl &= ~(IOCB_DSYNC | IOCB_SYNC);
+
 	old_cred = ovl_override_creds(file_inode(file)->i_sb);
 	file_start_write(real.file);
 	ret = vfs_iter_write(real.file, iter, &iocb->ki_pos,
-			     ovl_iocb_to_rwf(iocb));
+			     ovl_iocb_to_rwf(ifl));
 	file_end_write(real.file);
 	revert_creds(old_cred);
 
@@ -295,10 +316,14 @@ static ssize_t ovl_write_iter(struct kiocb *iocb, struct iov_iter *iter)
 
 static int ovl_fsync(struct file *file, loff_t start, loff_t end, int datasync)
 {
+	struct ovl_fs *ofs = file_inode(file)->i_sb->s_fs_info;
 	struct fd real;
 	const struct cred *old_cred;
 	int ret;
 
+	if (!ovl_should_sync(ofs))
+		return 0;
+
 	ret = ovl_real_fdget_meta(file, &real, !datasync);
 	if (ret)
 		return ret;
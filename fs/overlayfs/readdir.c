@@ -826,6 +826,10 @@ static int ovl_dir_fsync(struct file *file, loff_t start, loff_t end,
 	struct ovl_dir_file *od = file->private_data;
 	struct dentry *dentry = file->f_path.dentry;
 	struct file *realfile = od->realfile;
+	struct ovl_fs *ofs = dentry->d_sb->s_fs_info;
+
+	if (!ovl_should_sync(ofs))
+		return 0;
 
 	/* Nothing to sync for lower */
 	if (!OVL_TYPE_UPPER(ovl_path_type(dentry)))
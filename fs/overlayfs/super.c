@@ -219,6 +219,7 @@ static void ovl_free_fs(struct ovl_fs *ofs)
 	iput(ofs->indexdir_trap);
 	iput(ofs->workdir_trap);
 	iput(ofs->upperdir_trap);
+	dput(ofs->volatiledir);
 	dput(ofs->indexdir);
 	dput(ofs->workdir);
 	if (ofs->workdir_locked)
@@ -245,10 +246,57 @@ static void ovl_free_fs(struct ovl_fs *ofs)
 	kfree(ofs);
 }
 
+#define OVL_VOLATILEDIR_NAME "volatile"
+
+static void ovl_volatile_remove(struct ovl_fs *ofs)
+{
+	struct inode *dir = ofs->workbasedir->d_inode;
+	int err;
+
+	err = mnt_want_write(ofs->upper_mnt);
+	if (!err) {
+		inode_lock_nested(dir, I_MUTEX_PARENT);
+		err = ovl_do_rmdir(dir, ofs->volatiledir);
+		inode_unlock(dir);
+		mnt_drop_write(ofs->upper_mnt);
+	}
+	if (err)
+		pr_warn("overlayfs: failed to remove %s/%s (errno: %i)\n",
+			ofs->config.workdir, OVL_VOLATILEDIR_NAME, -err);
+}
+
+/*
+ * On clean unmount of a volatile overlay, write back the upper fs and
+ * remove the dirty marker only if no writeback error was seen since mount.
+ * Otherwise leave the marker behind so the next mount refuses to reuse the
+ * upper and work dirs, whose contents can no longer be trusted.
+ */
+static void ovl_volatile_cleanup(struct ovl_fs *ofs)
+{
+	struct super_block *upper_sb = ofs->upper_mnt->mnt_sb;
+	int err;
+
+	down_read(&upper_sb->s_umount);
+	err = sync_filesystem(upper_sb);
+	up_read(&upper_sb->s_umount);
+	if (!err)
+		err = errseq_check(&upper_sb->s_wb_err, ofs->errseq);
+	if (err) {
+		pr_warn("overlayfs: volatile overlay not synced (errno: %i), leaving %s/%s\n",
+			-err, ofs->config.workdir, OVL_VOLATILEDIR_NAME);
+		return;
+	}
+
+	ovl_volatile_remove(ofs);
+}
+
 static void ovl_put_super(struct super_block *sb)
 {
 	struct ovl_fs *ofs = sb->s_fs_info;
 
+	if (ofs->volatiledir)
+		ovl_volatile_cleanup(ofs);
+
 	ovl_free_fs(ofs);
 }
 
@@ -262,6 +310,15 @@ static int ovl_sync_fs(struct super_block *sb, int wait)
 	if (!ofs->upper_mnt)
 		return 0;
 
+	/*
+	 * A volatile overlay does not sync the upper fs, but still reports
+	 * writeback errors that hit the upper fs since mount.
+	 */
+	if (!ovl_should_sync(ofs)) {
+		upper_sb = ofs->upper_mnt->mnt_sb;
+		return errseq_check(&upper_sb->s_wb_err, ofs->errseq);
+	}
+
 	/*
 	 * If this is a sync(2) call or an emergency sync, all the super blocks
 	 * will be iterated, including upper_sb, so no need to do anything.
@@ -366,6 +423,8 @@ static int ovl_show_options(struct seq_file *m, struct dentry *dentry)
 	if (ofs->config.metacopy != ovl_metacopy_def)
 		seq_printf(m, ",metacopy=%s",
 			   ofs->config.metacopy ? "on" : "off");
+	if (ofs->config.ovl_volatile)
+		seq_puts(m, ",volatile");
 	return 0;
 }
 
@@ -406,6 +465,7 @@ enum {
 	OPT_XINO_AUTO,
 	OPT_METACOPY_ON,
 	OPT_METACOPY_OFF,
+	OPT_VOLATILE,
 	OPT_ERR,
 };
 
@@ -424,6 +484,7 @@ static const match_table_t ovl_tokens = {
 	{OPT_XINO_AUTO,			"xino=auto"},
 	{OPT_METACOPY_ON,		"metacopy=on"},
 	{OPT_METACOPY_OFF,		"metacopy=off"},
+	{OPT_VOLATILE,			"volatile"},
 	{OPT_ERR,			NULL}
 };
 
@@ -562,6 +623,10 @@ static int ovl_parse_opt(char *opt, struct ovl_config *config)
 			config->metacopy = false;
 			break;
 
+		case OPT_VOLATILE:
+			config->ovl_volatile = true;
+			break;
+
 		default:
 			pr_err("overlayfs: unrecognized mount option \"%s\" or missing value\n", p);
 			return -EINVAL;
@@ -576,6 +641,12 @@ static int ovl_parse_opt(char *opt, struct ovl_config *config)
 		config->workdir = NULL;
 	}
 
+	/* Volatile is meaningless in non-upper mount */
+	if (!config->upperdir && config->ovl_volatile) {
+		pr_info("overlayfs: option \"volatile\" is meaningless in a non-upper mount, ignoring it.\n");
+		config->ovl_volatile = false;
+	}
+
 	err = ovl_parse_redirect_mode(config, config->redirect_mode);
 	if (err)
 		return err;
@@ -1076,6 +1147,53 @@ static int ovl_get_upper(struct super_block *sb, struct ovl_fs *ofs,
 	return err;
 }
 
+/*
+ * A volatile mount leaves a "volatile" dirty marker in workdir for as long
+ * as it is mounted.  If the marker is found at mount time, a previous
+ * volatile mount was not cleanly unmounted (or hit writeback errors) and
+ * the layers may be inconsistent, so refuse to mount until the user has
+ * removed the upper and work dirs (or just the marker).
+ */
+static int ovl_check_volatile(struct ovl_fs *ofs)
+{
+	struct inode *dir = ofs->workbasedir->d_inode;
+	struct dentry *dentry;
+	int err = 0;
+
+	inode_lock_nested(dir, I_MUTEX_PARENT);
+	dentry = lookup_one_len(OVL_VOLATILEDIR_NAME, ofs->workbasedir,
+				strlen(OVL_VOLATILEDIR_NAME));
+	if (IS_ERR(dentry)) {
+		err = PTR_ERR(dentry);
+		goto out_unlock;
+	}
+
+	if (dentry->d_inode) {
+		pr_err("overlayfs: found %s/%s left by an unclean volatile mount; upper and work dirs may be inconsistent\n",
+		       ofs->config.workdir, OVL_VOLATILEDIR_NAME);
+		err = -EINVAL;
+		goto out_dput;
+	}
+
+	if (!ofs->config.ovl_volatile)
+		goto out_dput;
+
+	dentry = ovl_create_real(dir, dentry, OVL_CATTR(S_IFDIR | 0));
+	if (IS_ERR(dentry)) {
+		err = PTR_ERR(dentry);
+		goto out_unlock;
+	}
+	ofs->volatiledir = dentry;
+	ofs->errseq = errseq_sample(&ofs->upper_mnt->mnt_sb->s_wb_err);
+	goto out_unlock;
+
+out_dput:
+	dput(dentry);
+out_unlock:
+	inode_unlock(dir);
+	return err;
+}
+
 static int ovl_make_workdir(struct super_block *sb, struct ovl_fs *ofs,
 			    struct path *workpath)
 {
@@ -1096,6 +1214,10 @@ static int ovl_make_workdir(struct super_block *sb, struct ovl_fs *ofs,
 	if (err)
 		goto out;
 
+	err = ovl_check_volatile(ofs);
+	if (err)
+		goto out;
+
 	/*
 	 * Upper should support d_type, else whiteouts are visible.  Given
 	 * workdir and upper are on same fs, we can do iterate_dir() on
@@ -1736,6 +1858,9 @@ static int ovl_fill_super(struct super_block *sb, void *data, int silent)
 	ovl_entry_stack_free(oe);
 	kfree(oe);
 out_err:
+	/* Nothing was written through a mount that never went live */
+	if (ofs->volatiledir)
+		ovl_volatile_remove(ofs);
 	path_put(&upperpath);
 	ovl_free_fs(ofs);
 out:
@@ -119,18 +119,66 @@ void pipe_wait(struct pipe_inode_info *pipe)
 	pipe_lock(pipe);
 }
 
+/*
+ * Each pipe keeps a small pool of released pages for pipe_write() to reuse,
+ * so that a pipe streaming data doesn't go back to the page allocator for
+ * every page. The pool scales with the pipe: a quarter of its capacity is
+ * enough to cover the pages a reader frees while the writer refills.
+ * The pool is protected by the pipe mutex.
+ */
+static inline unsigned int pipe_max_tmp_pages(struct pipe_inode_info *pipe)
+{
+	return max(pipe->buffers >> 2, 1U);
+}
+
+static struct page *pipe_get_tmp_page(struct pipe_inode_info *pipe)
+{
+	struct page *page;
+
+	if (list_empty(&pipe->tmp_pages))
+		return alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
+
+	page = list_first_entry(&pipe->tmp_pages, struct page, lru);
+	list_del(&page->lru);
+	pipe->nr_tmp_pages--;
+	return page;
+}
+
+static void pipe_put_tmp_page(struct pipe_inode_info *pipe, struct page *page)
+{
+	if (pipe->nr_tmp_pages < pipe_max_tmp_pages(pipe)) {
+		list_add(&page->lru, &pipe->tmp_pages);
+		pipe->nr_tmp_pages++;
+	} else {
+		put_page(page);
+	}
+}
+
+static void pipe_trim_tmp_pages(struct pipe_inode_info *pipe,
+				unsigned int max)
+{
+	struct page *page;
+
+	while (pipe->nr_tmp_pages > max) {
+		page = list_first_entry(&pipe->tmp_pages, struct page, lru);
+		list_del(&page->lru);
+		pipe->nr_tmp_pages--;
+		put_page(page);
+	}
+}
+
 static void anon_pipe_buf_release(struct pipe_inode_info *pipe,
 				  struct pipe_buffer *buf)
 {
 	struct page *page = buf->page;
 
 	/*
-	 * If nobody else uses this page, and we don't already have a
-	 * temporary page, let's keep track of it as a one-deep
-	 * allocation cache. (Otherwise just release our reference to it)
+	 * If nobody else uses this page, e.g. a socket that it was spliced
+	 * to, keep it in the pipe's pool. (Otherwise just release our
+	 * reference to it)
 	 */
-	if (page_count(page) == 1 && !pipe->tmp_page)
-		pipe->tmp_page = page;
+	if (page_count(page) == 1)
+		pipe_put_tmp_page(pipe, page);
 	else
 		put_page(page);
 }
@@ -435,16 +483,13 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		if (bufs < pipe->buffers) {
 			int newbuf = (pipe->curbuf + bufs) & (pipe->buffers-1);
 			struct pipe_buffer *buf = pipe->bufs + newbuf;
-			struct page *page = pipe->tmp_page;
+			struct page *page;
 			int copied;
 
-			if (!page) {
-				page = alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
-				if (unlikely(!page)) {
-					ret = ret ? : -ENOMEM;
-					break;
-				}
-				pipe->tmp_page = page;
+			page = pipe_get_tmp_page(pipe);
+			if (unlikely(!page)) {
+				ret = ret ? : -ENOMEM;
+				break;
 			}
 			/* Always wake up, even if the copy fails. Otherwise
 			 * we lock up (O_NONBLOCK-)readers that sleep due to
@@ -454,6 +499,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			do_wakeup = 1;
 			copied = copy_page_from_iter(page, 0, PAGE_SIZE, from);
 			if (unlikely(copied < PAGE_SIZE && iov_iter_count(from))) {
+				pipe_put_tmp_page(pipe, page);
 				if (!ret)
 					ret = -EFAULT;
 				break;
@@ -471,7 +517,6 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 				buf->flags = PIPE_BUF_FLAG_PACKET;
 			}
 			pipe->nrbufs = ++bufs;
-			pipe->tmp_page = NULL;
 
 			if (!iov_iter_count(from))
 				break;
@@ -678,6 +723,7 @@ struct pipe_inode_info *alloc_pipe_info(void)
 
 	if (pipe->bufs) {
 		init_waitqueue_head(&pipe->wait);
+		INIT_LIST_HEAD(&pipe->tmp_pages);
 		pipe->r_counter = pipe->w_counter = 1;
 		pipe->buffers = pipe_bufs;
 		pipe->user = user;
@@ -704,8 +750,7 @@ void free_pipe_info(struct pipe_inode_info *pipe)
 		if (buf->ops)
 			pipe_buf_release(pipe, buf);
 	}
-	if (pipe->tmp_page)
-		__free_page(pipe->tmp_page);
+	pipe_trim_tmp_pages(pipe, 0);
 	kfree(pipe->bufs);
 	kfree(pipe);
 }
@@ -1128,6 +1173,7 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
 	kfree(pipe->bufs);
 	pipe->bufs = bufs;
 	pipe->buffers = nr_pages;
+	pipe_trim_tmp_pages(pipe, pipe_max_tmp_pages(pipe));
 	return nr_pages * PAGE_SIZE;
 
 out_revert_acct:
@@ -1234,6 +1234,14 @@ static int iter_to_pipe(struct iov_iter *from,
 				buf.page = pages[n];
 				buf.offset = start;
 				buf.len = size;
+				/*
+				 * Only a whole page can be gifted. Stealing a
+				 * partial one would hand over user memory that
+				 * was never passed in.
+				 */
+				buf.flags = flags;
+				if (size != PAGE_SIZE)
+					buf.flags &= ~PIPE_BUF_FLAG_GIFT;
 				ret = add_to_pipe(pipe, &buf);
 				if (unlikely(ret < 0)) {
 					failed = true;
@@ -162,6 +162,7 @@ static void destroy_super_work(struct work_struct *work)
 
 	for (i = 0; i < SB_FREEZE_LEVELS; i++)
 		percpu_free_rwsem(&s->s_writers.rw_sem[i]);
+	percpu_counter_destroy(&s->s_nr_dentry_negative);
 	kfree(s);
 }
 
@@ -238,6 +239,8 @@ static struct super_block *alloc_super(struct file_system_type *type, int flags,
 			goto fail;
 	}
 	init_waitqueue_head(&s->s_writers.wait_unfrozen);
+	if (percpu_counter_init(&s->s_nr_dentry_negative, 0, GFP_USER))
+		goto fail;
 	s->s_bdi = &noop_backing_dev_info;
 	s->s_flags = flags;
 	if (s->s_user_ns != &init_user_ns)
@@ -13,6 +13,30 @@
 #include <linux/sched/signal.h>
 #include <linux/uaccess.h>
 
+static struct page *read_src_page(struct inode *inode, unsigned int level,
+				  const struct merkle_tree_params *params,
+				  pgoff_t index)
+{
+	const struct fsverity_operations *vops = inode->i_sb->s_vop;
+	struct page *page;
+
+	if (level == 0) {
+		/* Leaf: hashing data blocks */
+		page = read_mapping_page(inode->i_mapping, index, NULL);
+		if (IS_ERR(page))
+			fsverity_err(inode, "Error %ld reading data page %lu",
+				     PTR_ERR(page), index);
+	} else {
+		/* Non-leaf: hashing hash blocks from level below */
+		page = vops->read_merkle_tree_page(inode, index);
+		if (IS_ERR(page))
+			fsverity_err(inode,
+				     "Error %ld reading Merkle tree page %lu",
+				     PTR_ERR(page), index);
+	}
+	return page;
+}
+
 static int build_merkle_tree_level(struct inode *inode, unsigned int level,
 				   u64 num_blocks_to_hash,
 				   const struct merkle_tree_params *params,
@@ -20,13 +44,13 @@ static int build_merkle_tree_level(struct inode *inode, unsigned int level,
 				   struct ahash_request *req)
 {
 	const struct fsverity_operations *vops = inode->i_sb->s_vop;
+	struct page *src_page = NULL;
+	pgoff_t src_index = 0;
 	unsigned int pending_size = 0;
+	u64 src_block_num;
 	u64 dst_block_num;
 	u64 i;
-	int err;
-
-	if (WARN_ON(params->block_size != PAGE_SIZE)) /* checked earlier too */
-		return -EINVAL;
+	int err = 0;
 
 	if (level < params->num_levels) {
 		dst_block_num = params->level_start[level];
@@ -35,46 +59,39 @@ static int build_merkle_tree_level(struct inode *inode, unsigned int level,
 			return -EINVAL;
 		dst_block_num = 0; /* unused */
 	}
+	src_block_num = level ? params->level_start[level - 1] : 0;
 
-	for (i = 0; i < num_blocks_to_hash; i++) {
-		struct page *src_page;
+	for (i = 0; i < num_blocks_to_hash; i++, src_block_num++) {
+		pgoff_t index = src_block_num >> params->log_blocks_per_page;
+		unsigned int offset = (src_block_num &
+				       (params->blocks_per_page - 1)) <<
+				      params->log_blocksize;
 
 		if ((pgoff_t)i % 10000 == 0 || i + 1 == num_blocks_to_hash)
 			pr_debug("Hashing block %llu of %llu for level %u\n",
 				 i + 1, num_blocks_to_hash, level);
 
-		if (level == 0) {
-			/* Leaf: hashing a data block */
-			src_page = read_mapping_page(inode->i_mapping, i, NULL);
-			if (IS_ERR(src_page)) {
-				err = PTR_ERR(src_page);
-				fsverity_err(inode,
-					     "Error %d reading data page %llu",
-					     err, i);
-				return err;
-			}
-		} else {
-			/* Non-leaf: hashing hash block from level below */
-			src_page = vops->read_merkle_tree_page(inode,
-					params->level_start[level - 1] + i);
+		/* Blocks sharing a page are hashed out of a single read */
+		if (!src_page || index != src_index) {
+			if (src_page)
+				put_page(src_page);
+			src_page = read_src_page(inode, level, params, index);
 			if (IS_ERR(src_page)) {
 				err = PTR_ERR(src_page);
-				fsverity_err(inode,
-					     "Error %d reading Merkle tree page %llu",
-					     err, params->level_start[level - 1] + i);
-				return err;
+				src_page = NULL;
+				goto out;
 			}
+			src_index = index;
 		}
 
-		err = fsverity_hash_page(params, inode, req, src_page,
-					 &pending_hashes[pending_size]);
-		put_page(src_page);
+		err = fsverity_hash_block(params, inode, req, src_page, offset,
+					  &pending_hashes[pending_size]);
 		if (err)
-			return err;
+			goto out;
 		pending_size += params->digest_size;
 
 		if (level == params->num_levels) /* Root hash? */
-			return 0;
+			goto out;
 
 		if (pending_size + params->digest_size > params->block_size ||
 		    i + 1 == num_blocks_to_hash) {
@@ -89,17 +106,22 @@ static int build_merkle_tree_level(struct inode *inode, unsigned int level,
 				fsverity_err(inode,
 					     "Error %d writing Merkle tree block %llu",
 					     err, dst_block_num);
-				return err;
+				goto out;
 			}
 			dst_block_num++;
 			pending_size = 0;
 		}
 
-		if (fatal_signal_pending(current))
-			return -EINTR;
+		if (fatal_signal_pending(current)) {
+			err = -EINTR;
+			goto out;
+		}
 		cond_resched();
 	}
-	return 0;
+out:
+	if (src_page)
+		put_page(src_page);
+	return err;
 }
 
 /*
@@ -312,7 +334,8 @@ int fsverity_ioctl_enable(struct file *filp, const void __user *uarg)
 	    memchr_inv(arg.__reserved2, 0, sizeof(arg.__reserved2)))
 		return -EINVAL;
 
-	if (arg.block_size != PAGE_SIZE)
+	/* The exact range is checked by fsverity_init_merkle_tree_params() */
+	if (!is_power_of_2(arg.block_size))
 		return -EINVAL;
 
 	if (arg.salt_size > FIELD_SIZEOF(struct fsverity_descriptor, salt))
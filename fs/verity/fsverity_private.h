@@ -15,7 +15,9 @@
 #define pr_fmt(fmt) "fs-verity: " fmt
 
 #include <crypto/sha.h>
+#include <linux/crypto.h>
 #include <linux/fsverity.h>
+#include <linux/scatterlist.h>
 
 struct ahash_request;
 
@@ -31,6 +33,12 @@ struct ahash_request;
  */
 #define FS_VERITY_MAX_DIGEST_SIZE	SHA512_DIGEST_SIZE
 
+/*
+ * Maximum number of data blocks hashed concurrently when verifying a bio, see
+ * fsverity_hash_blocks().
+ */
+#define FS_VERITY_MAX_PENDING_BLOCKS	16
+
 /* A hash algorithm supported by fs-verity */
 struct fsverity_hash_alg {
 	struct crypto_ahash *tfm; /* hash tfm, allocated on demand */
@@ -48,8 +56,11 @@ struct merkle_tree_params {
 	unsigned int hashes_per_block;	/* number of hashes per tree block */
 	unsigned int log_blocksize;	/* log2(block_size) */
 	unsigned int log_arity;		/* log2(hashes_per_block) */
+	unsigned int log_blocks_per_page; /* log2(blocks_per_page) */
+	unsigned int blocks_per_page;	/* PAGE_SIZE / block_size */
 	unsigned int num_levels;	/* number of levels in Merkle tree */
 	u64 tree_size;			/* Merkle tree size in bytes */
+	unsigned long tree_blocks;	/* Merkle tree size in blocks */
 
 	/*
 	 * Starting block index for each tree level, ordered from leaf level (0)
@@ -66,12 +77,34 @@ struct merkle_tree_params {
  * caches information about the Merkle tree that's needed to efficiently verify
  * data read from the file.  It also caches the file measurement.  The Merkle
  * tree pages themselves are not cached here, but the filesystem may cache them.
+ *
+ * When the Merkle tree block size is smaller than PAGE_SIZE, whether a hash
+ * block has been verified is tracked in ->hash_block_verified, one bit per
+ * tree block, rather than with the PG_checked bit of the hash page.
  */
 struct fsverity_info {
 	struct merkle_tree_params tree_params;
 	u8 root_hash[FS_VERITY_MAX_DIGEST_SIZE];
 	u8 measurement[FS_VERITY_MAX_DIGEST_SIZE];
 	const struct inode *inode;
+	unsigned long *hash_block_verified;
+	spinlock_t hash_page_init_lock;
+};
+
+/*
+ * A data or hash block queued for hashing by fsverity_hash_blocks().  The hash
+ * is computed into @real_hash; @want_hash and @index are for the caller.
+ */
+struct fsverity_pending_block {
+	struct page *page;
+	unsigned int offset;
+	u64 index;
+	struct ahash_request *req;
+	struct scatterlist sg;
+	struct crypto_wait wait;
+	int err;
+	u8 want_hash[FS_VERITY_MAX_DIGEST_SIZE];
+	u8 real_hash[FS_VERITY_MAX_DIGEST_SIZE];
 };
 
 /*
@@ -118,9 +151,13 @@ const struct fsverity_hash_alg *fsverity_get_hash_alg(const struct inode *inode,
 						      unsigned int num);
 const u8 *fsverity_prepare_hash_state(const struct fsverity_hash_alg *alg,
 				      const u8 *salt, size_t salt_size);
-int fsverity_hash_page(const struct merkle_tree_params *params,
-		       const struct inode *inode,
-		       struct ahash_request *req, struct page *page, u8 *out);
+int fsverity_hash_block(const struct merkle_tree_params *params,
+			const struct inode *inode, struct ahash_request *req,
+			struct page *page, unsigned int offset, u8 *out);
+int fsverity_hash_blocks(const struct merkle_tree_params *params,
+			 const struct inode *inode,
+			 struct fsverity_pending_block *blocks,
+			 unsigned int num_blocks);
 int fsverity_hash_buffer(const struct fsverity_hash_alg *alg,
 			 const void *data, size_t size, u8 *out);
 void __init fsverity_check_hash_algs(void);
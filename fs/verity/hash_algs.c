@@ -168,52 +168,120 @@ const u8 *fsverity_prepare_hash_state(const struct fsverity_hash_alg *alg,
 	goto out;
 }
 
+/*
+ * Start hashing the block at @offset in @page into @out.  The request completes
+ * asynchronously if the hash implementation is asynchronous; the caller must
+ * wait for it with crypto_wait_req() on @wait.
+ */
+static int fsverity_start_hash(const struct merkle_tree_params *params,
+			       const struct inode *inode,
+			       struct ahash_request *req,
+			       struct scatterlist *sg, struct crypto_wait *wait,
+			       struct page *page, unsigned int offset, u8 *out)
+{
+	int err;
+
+	sg_init_table(sg, 1);
+	sg_set_page(sg, page, params->block_size, offset);
+	ahash_request_set_callback(req, CRYPTO_TFM_REQ_MAY_SLEEP |
+					CRYPTO_TFM_REQ_MAY_BACKLOG,
+				   crypto_req_done, wait);
+	ahash_request_set_crypt(req, sg, out, params->block_size);
+
+	if (params->hashstate) {
+		err = crypto_ahash_import(req, params->hashstate);
+		if (err) {
+			fsverity_err(inode,
+				     "Error %d importing hash state", err);
+			return err;
+		}
+		return crypto_ahash_finup(req);
+	}
+	return crypto_ahash_digest(req);
+}
+
 /**
- * fsverity_hash_page() - hash a single data or hash page
+ * fsverity_hash_block() - hash a single data or hash block
  * @params: the Merkle tree's parameters
  * @inode: inode for which the hashing is being done
  * @req: preallocated hash request
- * @page: the page to hash
+ * @page: the page containing the block to hash
+ * @offset: the offset of the block within @page
  * @out: output digest, size 'params->digest_size' bytes
  *
- * Hash a single data or hash block, assuming block_size == PAGE_SIZE.
- * The hash is salted if a salt is specified in the Merkle tree parameters.
+ * Hash a single data or hash block.  The hash is salted if a salt is specified
+ * in the Merkle tree parameters.
  *
  * Return: 0 on success, -errno on failure
  */
-int fsverity_hash_page(const struct merkle_tree_params *params,
-		       const struct inode *inode,
-		       struct ahash_request *req, struct page *page, u8 *out)
+int fsverity_hash_block(const struct merkle_tree_params *params,
+			const struct inode *inode, struct ahash_request *req,
+			struct page *page, unsigned int offset, u8 *out)
 {
 	struct scatterlist sg;
 	DECLARE_CRYPTO_WAIT(wait);
 	int err;
 
-	if (WARN_ON(params->block_size != PAGE_SIZE))
+	if (WARN_ON(offset + params->block_size > PAGE_SIZE))
 		return -EINVAL;
 
-	sg_init_table(&sg, 1);
-	sg_set_page(&sg, page, PAGE_SIZE, 0);
-	ahash_request_set_callback(req, CRYPTO_TFM_REQ_MAY_SLEEP |
-					CRYPTO_TFM_REQ_MAY_BACKLOG,
-				   crypto_req_done, &wait);
-	ahash_request_set_crypt(req, &sg, out, PAGE_SIZE);
+	err = fsverity_start_hash(params, inode, req, &sg, &wait,
+				  page, offset, out);
+	err = crypto_wait_req(err, &wait);
+	if (err)
+		fsverity_err(inode, "Error %d computing block hash", err);
+	return err;
+}
 
-	if (params->hashstate) {
-		err = crypto_ahash_import(req, params->hashstate);
-		if (err) {
-			fsverity_err(inode,
-				     "Error %d importing hash state", err);
-			return err;
+/**
+ * fsverity_hash_blocks() - hash several data or hash blocks
+ * @params: the Merkle tree's parameters
+ * @inode: inode for which the hashing is being done
+ * @blocks: the blocks to hash, each with a preallocated ->req
+ * @num_blocks: number of entries in @blocks
+ *
+ * Like fsverity_hash_block(), but submit the hash requests for all the blocks
+ * before waiting for any of them.  With an asynchronous hash implementation
+ * (e.g. a crypto accelerator) this lets the blocks be hashed concurrently
+ * rather than paying the full request latency once per block; with a
+ * synchronous one it is equivalent to hashing the blocks in turn.  The result
+ * of each block is left in ->real_hash and ->err.
+ *
+ * Return: 0 if all blocks were hashed, else the first error encountered
+ */
+int fsverity_hash_blocks(const struct merkle_tree_params *params,
+			 const struct inode *inode,
+			 struct fsverity_pending_block *blocks,
+			 unsigned int num_blocks)
+{
+	unsigned int i;
+	int err = 0;
+
+	for (i = 0; i < num_blocks; i++) {
+		struct fsverity_pending_block *block = &blocks[i];
+
+		if (WARN_ON(block->offset + params->block_size > PAGE_SIZE)) {
+			block->err = -EINVAL;
+			continue;
 		}
-		err = crypto_ahash_finup(req);
-	} else {
-		err = crypto_ahash_digest(req);
+		crypto_init_wait(&block->wait);
+		block->err = fsverity_start_hash(params, inode, block->req,
+						 &block->sg, &block->wait,
+						 block->page, block->offset,
+						 block->real_hash);
 	}
 
-	err = crypto_wait_req(err, &wait);
-	if (err)
-		fsverity_err(inode, "Error %d computing page hash", err);
+	for (i = 0; i < num_blocks; i++) {
+		struct fsverity_pending_block *block = &blocks[i];
+
+		block->err = crypto_wait_req(block->err, &block->wait);
+		if (block->err) {
+			fsverity_err(inode, "Error %d computing block hash",
+				     block->err);
+			if (!err)
+				err = block->err;
+		}
+	}
 	return err;
 }
 
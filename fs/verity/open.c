@@ -7,6 +7,7 @@
 
 #include "fsverity_private.h"
 
+#include <linux/mm.h>
 #include <linux/slab.h>
 
 static struct kmem_cache *fsverity_info_cachep;
@@ -54,7 +55,13 @@ int fsverity_init_merkle_tree_params(struct merkle_tree_params *params,
 		goto out_err;
 	}
 
-	if (log_blocksize != PAGE_SHIFT) {
+	/*
+	 * Merkle tree blocks may be smaller than a page, in which case each
+	 * page of data or of the Merkle tree holds several blocks.  They may
+	 * not be larger than a page since they are hashed out of the page
+	 * cache one page at a time.
+	 */
+	if (log_blocksize < SECTOR_SHIFT || log_blocksize > PAGE_SHIFT) {
 		fsverity_warn(inode, "Unsupported log_blocksize: %u",
 			      log_blocksize);
 		err = -EINVAL;
@@ -62,6 +69,8 @@ int fsverity_init_merkle_tree_params(struct merkle_tree_params *params,
 	}
 	params->log_blocksize = log_blocksize;
 	params->block_size = 1 << log_blocksize;
+	params->log_blocks_per_page = PAGE_SHIFT - log_blocksize;
+	params->blocks_per_page = 1 << params->log_blocks_per_page;
 
 	if (WARN_ON(!is_power_of_2(params->digest_size))) {
 		err = -EINVAL;
@@ -113,6 +122,7 @@ int fsverity_init_merkle_tree_params(struct merkle_tree_params *params,
 		offset += blocks;
 	}
 
+	params->tree_blocks = offset;
 	params->tree_size = offset << log_blocksize;
 	return 0;
 
@@ -198,6 +208,22 @@ struct fsverity_info *fsverity_create_info(const struct inode *inode,
 
 	memcpy(vi->root_hash, desc->root_hash, vi->tree_params.digest_size);
 
+	/*
+	 * With one block per page, PG_checked on the hash page is enough to
+	 * remember that a hash block has been verified.  Otherwise track each
+	 * hash block individually.
+	 */
+	spin_lock_init(&vi->hash_page_init_lock);
+	if (vi->tree_params.blocks_per_page > 1) {
+		vi->hash_block_verified =
+			kvcalloc(BITS_TO_LONGS(vi->tree_params.tree_blocks),
+				 sizeof(unsigned long), GFP_KERNEL);
+		if (!vi->hash_block_verified) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+
 	err = compute_file_measurement(vi->tree_params.hash_alg, desc,
 				       vi->measurement);
 	if (err) {
@@ -232,6 +258,7 @@ void fsverity_free_info(struct fsverity_info *vi)
 	if (!vi)
 		return;
 	kfree(vi->tree_params.hashstate);
+	kvfree(vi->hash_block_verified);
 	kmem_cache_free(fsverity_info_cachep, vi);
 }
 
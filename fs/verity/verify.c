@@ -11,8 +11,28 @@
 #include <linux/bio.h>
 #include <linux/ratelimit.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/fsverity.h>
+
 static struct workqueue_struct *fsverity_read_workqueue;
 
+/*
+ * State for verifying the data blocks of a bio or page.  Data blocks are queued
+ * in ->pending once their wanted hash is known, then hashed together by
+ * fsverity_hash_blocks() when the queue fills up or the caller is done.
+ */
+struct verify_ctx {
+	struct inode *inode;
+	struct fsverity_info *vi;
+	struct ahash_request *req;	/* for hash blocks */
+	bool set_page_error;		/* mark failed pages with PG_error */
+	int err;			/* first error seen */
+	unsigned int data_blocks;	/* data blocks hashed */
+	unsigned int hash_blocks;	/* hash blocks hashed */
+	unsigned int num_pending;
+	struct fsverity_pending_block pending[FS_VERITY_MAX_PENDING_BLOCKS];
+};
+
 /**
  * hash_at_level() - compute the location of the block's hash at the given level
  *
@@ -23,10 +43,10 @@ static struct workqueue_struct *fsverity_read_workqueue;
  * @hoffset:	(out) the byte offset to the wanted hash within the hash block
  */
 static void hash_at_level(const struct merkle_tree_params *params,
-			  pgoff_t dindex, unsigned int level, pgoff_t *hindex,
+			  u64 dindex, unsigned int level, unsigned long *hindex,
 			  unsigned int *hoffset)
 {
-	pgoff_t position;
+	u64 position;
 
 	/* Offset of the hash within the level's region, in hashes */
 	position = dindex >> (level * params->log_arity);
@@ -51,7 +71,7 @@ static void extract_hash(struct page *hpage, unsigned int hoffset,
 
 static inline int cmp_hashes(const struct fsverity_info *vi,
 			     const u8 *want_hash, const u8 *real_hash,
-			     pgoff_t index, int level)
+			     u64 index, int level)
 {
 	const unsigned int hsize = vi->tree_params.digest_size;
 
@@ -59,7 +79,7 @@ static inline int cmp_hashes(const struct fsverity_info *vi,
 		return 0;
 
 	fsverity_err(vi->inode,
-		     "FILE CORRUPTED! index=%lu, level=%d, want_hash=%s:%*phN, real_hash=%s:%*phN",
+		     "FILE CORRUPTED! index=%llu, level=%d, want_hash=%s:%*phN, real_hash=%s:%*phN",
 		     index, level,
 		     vi->tree_params.hash_alg->name, hsize, want_hash,
 		     vi->tree_params.hash_alg->name, hsize, real_hash);
@@ -67,113 +87,321 @@ static inline int cmp_hashes(const struct fsverity_info *vi,
 }
 
 /*
- * Verify a single data page against the file's Merkle tree.
+ * Return true if the hash block with index @hblock_idx in the tree, located in
+ * @hpage, has already been verified.
+ *
+ * With one block per page this is simply PG_checked on the hash page.
+ * Otherwise each block has a bit in ->hash_block_verified, and PG_checked
+ * instead means that the page's bits are valid for the page currently in the
+ * page cache: a hash page may be evicted and read back in, at which point the
+ * stale bits of its blocks must be cleared before they can be trusted again.
+ * The first user of a newly instantiated page does that, under
+ * ->hash_page_init_lock to serialize with other users of the same page.
+ */
+static bool is_hash_block_verified(struct fsverity_info *vi,
+				   struct page *hpage,
+				   unsigned long hblock_idx)
+{
+	unsigned int blocks_per_page;
+	unsigned int i;
+	bool verified;
+
+	if (!vi->hash_block_verified)
+		return PageChecked(hpage);
+
+	if (PageChecked(hpage)) {
+		/* Pairs with the smp_wmb() below */
+		smp_rmb();
+		return test_bit(hblock_idx, vi->hash_block_verified);
+	}
+
+	spin_lock(&vi->hash_page_init_lock);
+	if (PageChecked(hpage)) {
+		verified = test_bit(hblock_idx, vi->hash_block_verified);
+	} else {
+		blocks_per_page = vi->tree_params.blocks_per_page;
+		hblock_idx = round_down(hblock_idx, blocks_per_page);
+		for (i = 0; i < blocks_per_page; i++)
+			clear_bit(hblock_idx + i, vi->hash_block_verified);
+		/* Order the bit clears before setting PG_checked */
+		smp_wmb();
+		SetPageChecked(hpage);
+		verified = false;
+	}
+	spin_unlock(&vi->hash_page_init_lock);
+	return verified;
+}
+
+static void set_hash_block_verified(struct fsverity_info *vi,
+				    struct page *hpage,
+				    unsigned long hblock_idx)
+{
+	if (vi->hash_block_verified)
+		set_bit(hblock_idx, vi->hash_block_verified);
+	else
+		SetPageChecked(hpage);
+}
+
+/*
+ * Find the hash that data block @dindex must have, verifying the hash blocks on
+ * the path from it to the root as needed.
  *
  * In principle, we need to verify the entire path to the root node.  However,
  * for efficiency the filesystem may cache the hash pages.  Therefore we need
- * only ascend the tree until an already-verified page is seen, as indicated by
- * the PageChecked bit being set; then verify the path to that page.
- *
- * This code currently only supports the case where the verity block size is
- * equal to PAGE_SIZE.  Doing otherwise would be possible but tricky, since we
- * wouldn't be able to use the PageChecked bit.
+ * only ascend the tree until an already-verified hash block is seen, as
+ * indicated by is_hash_block_verified(); then verify the path to that block.
  *
- * Note that multiple processes may race to verify a hash page and mark it
- * Checked, but it doesn't matter; the result will be the same either way.
+ * Note that multiple processes may race to verify a hash block and mark it
+ * verified, but it doesn't matter; the result will be the same either way.
  *
- * Return: true if the page is valid, else false.
+ * Return: 0 with the hash in @out on success, else -errno.
  */
-static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
-			struct ahash_request *req, struct page *data_page)
+static int get_data_block_hash(struct verify_ctx *ctx, u64 dindex, u8 *out)
 {
+	struct inode *inode = ctx->inode;
+	struct fsverity_info *vi = ctx->vi;
 	const struct merkle_tree_params *params = &vi->tree_params;
 	const unsigned int hsize = params->digest_size;
-	const pgoff_t index = data_page->index;
 	int level;
 	u8 _want_hash[FS_VERITY_MAX_DIGEST_SIZE];
 	const u8 *want_hash;
 	u8 real_hash[FS_VERITY_MAX_DIGEST_SIZE];
-	struct page *hpages[FS_VERITY_MAX_LEVELS];
-	unsigned int hoffsets[FS_VERITY_MAX_LEVELS];
-	int err;
-
-	if (WARN_ON_ONCE(!PageLocked(data_page) || PageUptodate(data_page)))
-		return false;
-
-	pr_debug_ratelimited("Verifying data page %lu...\n", index);
+	struct {
+		struct page *page;	/* page containing the hash block */
+		unsigned long index;	/* index of the block in the tree */
+		unsigned int offset;	/* offset of the block in the page */
+		unsigned int hoffset;	/* offset of the hash in the block */
+	} hblocks[FS_VERITY_MAX_LEVELS];
+	int err = 0;
 
 	/*
-	 * Starting at the leaf level, ascend the tree saving hash pages along
-	 * the way until we find a verified hash page, indicated by PageChecked;
-	 * or until we reach the root.
+	 * Starting at the leaf level, ascend the tree saving hash blocks along
+	 * the way until we find a verified hash block, or until we reach the
+	 * root.
 	 */
 	for (level = 0; level < params->num_levels; level++) {
-		pgoff_t hindex;
+		unsigned long hblock_idx;
 		unsigned int hoffset;
+		unsigned int offset;
+		pgoff_t hpage_idx;
 		struct page *hpage;
 
-		hash_at_level(params, index, level, &hindex, &hoffset);
+		hash_at_level(params, dindex, level, &hblock_idx, &hoffset);
+		hpage_idx = hblock_idx >> params->log_blocks_per_page;
+		offset = (hblock_idx & (params->blocks_per_page - 1)) <<
+			 params->log_blocksize;
 
 		pr_debug_ratelimited("Level %d: hindex=%lu, hoffset=%u\n",
-				     level, hindex, hoffset);
+				     level, hblock_idx, hoffset);
 
 		hpage = inode->i_sb->s_vop->read_merkle_tree_page(inode,
-								  hindex);
+								  hpage_idx);
 		if (IS_ERR(hpage)) {
 			err = PTR_ERR(hpage);
 			fsverity_err(inode,
 				     "Error %d reading Merkle tree page %lu",
-				     err, hindex);
+				     err, hpage_idx);
 			goto out;
 		}
 
-		if (PageChecked(hpage)) {
-			extract_hash(hpage, hoffset, hsize, _want_hash);
+		if (is_hash_block_verified(vi, hpage, hblock_idx)) {
+			extract_hash(hpage, offset + hoffset, hsize,
+				     _want_hash);
 			want_hash = _want_hash;
 			put_page(hpage);
-			pr_debug_ratelimited("Hash page already checked, want %s:%*phN\n",
+			pr_debug_ratelimited("Hash block already checked, want %s:%*phN\n",
 					     params->hash_alg->name,
 					     hsize, want_hash);
 			goto descend;
 		}
-		pr_debug_ratelimited("Hash page not yet checked\n");
-		hpages[level] = hpage;
-		hoffsets[level] = hoffset;
+		pr_debug_ratelimited("Hash block not yet checked\n");
+		hblocks[level].page = hpage;
+		hblocks[level].index = hblock_idx;
+		hblocks[level].offset = offset;
+		hblocks[level].hoffset = hoffset;
 	}
 
 	want_hash = vi->root_hash;
 	pr_debug("Want root hash: %s:%*phN\n",
 		 params->hash_alg->name, hsize, want_hash);
 descend:
-	/* Descend the tree verifying hash pages */
+	/* Descend the tree verifying hash blocks */
 	for (; level > 0; level--) {
-		struct page *hpage = hpages[level - 1];
-		unsigned int hoffset = hoffsets[level - 1];
+		struct page *hpage = hblocks[level - 1].page;
+		unsigned long hblock_idx = hblocks[level - 1].index;
+		unsigned int offset = hblocks[level - 1].offset;
 
-		err = fsverity_hash_page(params, inode, req, hpage, real_hash);
+		err = fsverity_hash_block(params, inode, ctx->req, hpage,
+					  offset, real_hash);
 		if (err)
 			goto out;
-		err = cmp_hashes(vi, want_hash, real_hash, index, level - 1);
+		ctx->hash_blocks++;
+		err = cmp_hashes(vi, want_hash, real_hash, hblock_idx,
+				 level - 1);
 		if (err)
 			goto out;
-		SetPageChecked(hpage);
-		extract_hash(hpage, hoffset, hsize, _want_hash);
+		set_hash_block_verified(vi, hpage, hblock_idx);
+		extract_hash(hpage, offset + hblocks[level - 1].hoffset, hsize,
+			     _want_hash);
 		want_hash = _want_hash;
 		put_page(hpage);
-		pr_debug("Verified hash page at level %d, now want %s:%*phN\n",
+		pr_debug("Verified hash block at level %d, now want %s:%*phN\n",
 			 level - 1, params->hash_alg->name, hsize, want_hash);
 	}
-
-	/* Finally, verify the data page */
-	err = fsverity_hash_page(params, inode, req, data_page, real_hash);
-	if (err)
-		goto out;
-	err = cmp_hashes(vi, want_hash, real_hash, index, -1);
+	memcpy(out, want_hash, hsize);
 out:
 	for (; level > 0; level--)
-		put_page(hpages[level - 1]);
+		put_page(hblocks[level - 1].page);
+	return err;
+}
+
+static void verify_fail(struct verify_ctx *ctx, struct page *page, int err)
+{
+	if (ctx->set_page_error)
+		SetPageError(page);
+	if (!ctx->err)
+		ctx->err = err;
+}
+
+/* Hash the queued data blocks and check them against their wanted hashes */
+static void verify_pending_blocks(struct verify_ctx *ctx)
+{
+	const struct merkle_tree_params *params = &ctx->vi->tree_params;
+	unsigned int i;
+
+	if (!ctx->num_pending)
+		return;
+
+	fsverity_hash_blocks(params, ctx->inode, ctx->pending,
+			     ctx->num_pending);
+
+	for (i = 0; i < ctx->num_pending; i++) {
+		struct fsverity_pending_block *block = &ctx->pending[i];
+		int err = block->err;
+
+		if (!err)
+			err = cmp_hashes(ctx->vi, block->want_hash,
+					 block->real_hash, block->index, -1);
+		if (err)
+			verify_fail(ctx, block->page, err);
+	}
+	ctx->data_blocks += ctx->num_pending;
+	ctx->num_pending = 0;
+}
 
-	return err == 0;
+/*
+ * Queue the data block at @offset in @data_page for verification, hashing the
+ * queue once it is full.
+ */
+static void verify_data_block(struct verify_ctx *ctx, struct page *data_page,
+			      unsigned int offset)
+{
+	const struct merkle_tree_params *params = &ctx->vi->tree_params;
+	struct fsverity_pending_block *block;
+	u64 pos = ((u64)data_page->index << PAGE_SHIFT) + offset;
+	int err;
+
+	/*
+	 * A block entirely beyond EOF has no hash in the tree.  It can only be
+	 * part of the page containing EOF and must be all zeroes.
+	 */
+	if (pos >= ctx->inode->i_size) {
+		void *virt = kmap_atomic(data_page);
+
+		if (memchr_inv(virt + offset, 0, params->block_size)) {
+			fsverity_err(ctx->inode,
+				     "FILE CORRUPTED! Data past EOF is not zeroed");
+			err = -EBADMSG;
+		} else {
+			err = 0;
+		}
+		kunmap_atomic(virt);
+		if (err)
+			verify_fail(ctx, data_page, err);
+		return;
+	}
+
+	block = &ctx->pending[ctx->num_pending];
+	if (!block->req) {
+		block->req = ahash_request_alloc(params->hash_alg->tfm,
+						 GFP_NOFS);
+		if (unlikely(!block->req)) {
+			verify_fail(ctx, data_page, -ENOMEM);
+			return;
+		}
+	}
+
+	block->page = data_page;
+	block->offset = offset;
+	block->index = pos >> params->log_blocksize;
+	err = get_data_block_hash(ctx, block->index, block->want_hash);
+	if (err) {
+		verify_fail(ctx, data_page, err);
+		return;
+	}
+
+	if (++ctx->num_pending == FS_VERITY_MAX_PENDING_BLOCKS)
+		verify_pending_blocks(ctx);
+}
+
+/* Queue the data blocks in bytes [@offset, @offset + @len) of @data_page */
+static void verify_data_blocks(struct verify_ctx *ctx, struct page *data_page,
+			       unsigned int offset, unsigned int len)
+{
+	const unsigned int block_size = ctx->vi->tree_params.block_size;
+
+	if (WARN_ON_ONCE(!PageLocked(data_page) || PageUptodate(data_page) ||
+			 !IS_ALIGNED(offset | len, block_size))) {
+		verify_fail(ctx, data_page, -EINVAL);
+		return;
+	}
+
+	pr_debug_ratelimited("Verifying data page %lu...\n", data_page->index);
+
+	for (; len; offset += block_size, len -= block_size)
+		verify_data_block(ctx, data_page, offset);
+}
+
+static struct verify_ctx *verify_ctx_alloc(struct inode *inode,
+					   bool set_page_error)
+{
+	struct fsverity_info *vi = inode->i_verity_info;
+	struct verify_ctx *ctx;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_NOFS);
+	if (unlikely(!ctx))
+		return NULL;
+
+	ctx->req = ahash_request_alloc(vi->tree_params.hash_alg->tfm,
+				       GFP_NOFS);
+	if (unlikely(!ctx->req)) {
+		kfree(ctx);
+		return NULL;
+	}
+	ctx->inode = inode;
+	ctx->vi = vi;
+	ctx->set_page_error = set_page_error;
+	return ctx;
+}
+
+/* Verify whatever is still queued and free @ctx; return the first error */
+static int verify_ctx_finish(struct verify_ctx *ctx)
+{
+	int err;
+	int i;
+
+	verify_pending_blocks(ctx);
+	err = ctx->err;
+
+	trace_fsverity_verify_end(ctx->inode, ctx->data_blocks,
+				  ctx->hash_blocks,
+				  ctx->vi->tree_params.block_size, err);
+
+	for (i = 0; i < FS_VERITY_MAX_PENDING_BLOCKS; i++)
+		ahash_request_free(ctx->pending[i].req);
+	ahash_request_free(ctx->req);
+	kfree(ctx);
+	return err;
 }
 
 /**
@@ -187,19 +415,18 @@ static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
 bool fsverity_verify_page(struct page *page)
 {
 	struct inode *inode = page->mapping->host;
-	const struct fsverity_info *vi = inode->i_verity_info;
-	struct ahash_request *req;
-	bool valid;
+	struct verify_ctx *ctx;
 
-	req = ahash_request_alloc(vi->tree_params.hash_alg->tfm, GFP_NOFS);
-	if (unlikely(!req))
+	ctx = verify_ctx_alloc(inode, false);
+	if (unlikely(!ctx))
 		return false;
 
-	valid = verify_page(inode, vi, req, page);
+	trace_fsverity_verify_start(inode, (u64)page->index << PAGE_SHIFT,
+				    PAGE_SIZE);
 
-	ahash_request_free(req);
+	verify_data_blocks(ctx, page, 0, PAGE_SIZE);
 
-	return valid;
+	return verify_ctx_finish(ctx) == 0;
 }
 EXPORT_SYMBOL_GPL(fsverity_verify_page);
 
@@ -212,6 +439,10 @@ EXPORT_SYMBOL_GPL(fsverity_verify_page);
  * that fail verification are set to the Error state.  Verification is skipped
  * for pages already in the Error state, e.g. due to fscrypt decryption failure.
  *
+ * The data blocks of the bio are hashed in batches of up to
+ * FS_VERITY_MAX_PENDING_BLOCKS rather than one at a time; see
+ * fsverity_hash_blocks().
+ *
  * This is a helper function for use by the ->readpages() method of filesystems
  * that issue bios to read data directly into the page cache.  Filesystems that
  * populate the page cache without issuing bios (e.g. non block-based
@@ -220,27 +451,38 @@ EXPORT_SYMBOL_GPL(fsverity_verify_page);
  */
 void fsverity_verify_bio(struct bio *bio)
 {
-	struct inode *inode = bio_first_page_all(bio)->mapping->host;
-	const struct fsverity_info *vi = inode->i_verity_info;
-	struct ahash_request *req;
+	struct page *first_page = bio_first_page_all(bio);
+	struct inode *inode = first_page->mapping->host;
+	struct verify_ctx *ctx;
 	struct bio_vec *bv;
 	struct bvec_iter_all iter_all;
 
-	req = ahash_request_alloc(vi->tree_params.hash_alg->tfm, GFP_NOFS);
-	if (unlikely(!req)) {
+	ctx = verify_ctx_alloc(inode, true);
+	if (unlikely(!ctx)) {
 		bio_for_each_segment_all(bv, bio, iter_all)
 			SetPageError(bv->bv_page);
 		return;
 	}
 
+	if (trace_fsverity_verify_start_enabled()) {
+		unsigned int len = 0;
+
+		bio_for_each_segment_all(bv, bio, iter_all)
+			len += bv->bv_len;
+		trace_fsverity_verify_start(inode,
+				((u64)first_page->index << PAGE_SHIFT) +
+				bio_first_bvec_all(bio)->bv_offset, len);
+	}
+
 	bio_for_each_segment_all(bv, bio, iter_all) {
 		struct page *page = bv->bv_page;
 
-		if (!PageError(page) && !verify_page(inode, vi, req, page))
-			SetPageError(page);
+		if (!PageError(page))
+			verify_data_blocks(ctx, page, bv->bv_offset,
+					   bv->bv_len);
 	}
 
-	ahash_request_free(req);
+	verify_ctx_finish(ctx);
 }
 EXPORT_SYMBOL_GPL(fsverity_verify_bio);
 #endif /* CONFIG_BLOCK */
@@ -45,6 +45,9 @@ enum wb_stat_item {
 
 #define WB_STAT_BATCH (8*(1+ilog2(nr_cpu_ids)))
 
+/* upper limit for bdi->writeback_workers */
+#define WB_MAX_WRITEBACK_WORKERS	8
+
 /*
  * why some writeback work was initiated
  */
@@ -168,6 +171,14 @@ struct bdi_writeback {
 
 	unsigned long dirty_sleep;	/* last wait */
 
+	/*
+	 * Parallel writeback, see bdi->writeback_workers.  Protected by
+	 * list_lock.  @worker_time is in jiffies.
+	 */
+	bool b_io_split;		/* b_io is handed out to workers */
+	unsigned long worker_written[WB_MAX_WRITEBACK_WORKERS];
+	unsigned long worker_time[WB_MAX_WRITEBACK_WORKERS];
+
 	struct list_head bdi_node;	/* anchored at bdi->wb_list */
 
 #ifdef CONFIG_CGROUP_WRITEBACK
@@ -200,6 +211,7 @@ struct backing_dev_info {
 	unsigned int capabilities; /* Device capabilities */
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
+	unsigned int writeback_workers; /* workers sharing each wb's b_io */
 
 	/*
 	 * Sum of avg_write_bw of wbs with dirty inodes.  > 0 if there are
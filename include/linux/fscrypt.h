@@ -160,6 +160,7 @@ static inline struct page *fscrypt_pagecache_page(struct page *bounce_page)
 }
 
 extern void fscrypt_free_bounce_page(struct page *bounce_page);
+extern ssize_t fscrypt_show_stats(struct super_block *sb, char *buf);
 
 /* policy.c */
 extern int fscrypt_ioctl_set_policy(struct file *, const void __user *);
@@ -273,6 +274,7 @@ static inline bool fscrypt_match_name(const struct fscrypt_name *fname,
 
 /* bio.c */
 extern void fscrypt_decrypt_bio(struct bio *);
+extern bool fscrypt_decrypt_bio_atomic(struct bio *bio);
 extern void fscrypt_enqueue_decrypt_bio(struct fscrypt_ctx *ctx,
 					struct bio *bio);
 extern int fscrypt_zeroout_range(const struct inode *, pgoff_t, sector_t,
@@ -386,6 +388,11 @@ static inline void fscrypt_free_bounce_page(struct page *bounce_page)
 {
 }
 
+static inline ssize_t fscrypt_show_stats(struct super_block *sb, char *buf)
+{
+	return -EOPNOTSUPP;
+}
+
 /* policy.c */
 static inline int fscrypt_ioctl_set_policy(struct file *filp,
 					   const void __user *arg)
@@ -518,6 +525,11 @@ static inline void fscrypt_decrypt_bio(struct bio *bio)
 {
 }
 
+static inline bool fscrypt_decrypt_bio_atomic(struct bio *bio)
+{
+	return false;
+}
+
 static inline void fscrypt_enqueue_decrypt_bio(struct fscrypt_ctx *ctx,
 					       struct bio *bio)
 {
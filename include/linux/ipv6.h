@@ -136,6 +136,7 @@ struct inet6_skb_parm {
 #define IP6SKB_HOPBYHOP        32
 #define IP6SKB_L3SLAVE         64
 #define IP6SKB_JUMBOGRAM      128
+#define IP6SKB_FAKEJUMBO      256
 };
 
 #if defined(CONFIG_NET_L3_MASTER_DEV)
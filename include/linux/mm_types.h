@@ -94,6 +94,15 @@ struct page {
 			unsigned long private;
 		};
 		struct {	/* page_pool used by netstack */
+			/**
+			 * @pp_magic: PP_SIGNATURE while the page belongs to
+			 * a page_pool, so that skbs only ever recycle pages
+			 * that really came from one.  Bit 0 must stay clear
+			 * (see PageTail()).
+			 */
+			unsigned long pp_magic;
+			struct page_pool *pp;
+			unsigned long _pp_mapping_pad;
 			/**
 			 * @dma_addr: might require a 64-bit value on
 			 * 32-bit architectures.
@@ -326,6 +326,7 @@ struct napi_struct {
 
 	unsigned long		state;
 	int			weight;
+	int			defer_hard_irqs_count;
 	unsigned long		gro_bitmask;
 	int			(*poll)(struct napi_struct *, int);
 #ifdef CONFIG_NETPOLL
@@ -340,6 +341,7 @@ struct napi_struct {
 	struct list_head	dev_list;
 	struct hlist_node	napi_hash_node;
 	unsigned int		napi_id;
+	struct task_struct	*thread;
 };
 
 enum {
@@ -350,6 +352,9 @@ enum {
 	NAPI_STATE_HASHED,	/* In NAPI hash (busy polling possible) */
 	NAPI_STATE_NO_BUSY_POLL,/* Do not add in napi_hash, no busy polling */
 	NAPI_STATE_IN_BUSY_POLL,/* sk_busy_loop() owns this NAPI */
+	NAPI_STATE_PREFER_BUSY_POLL,/* prefer busy-polling over softirq */
+	NAPI_STATE_THREADED,	/* Poll is performed in its own kthread */
+	NAPI_STATE_SCHED_THREADED,/* kthread owns the scheduled NAPI */
 };
 
 enum {
@@ -360,6 +365,9 @@ enum {
 	NAPIF_STATE_HASHED	 = BIT(NAPI_STATE_HASHED),
 	NAPIF_STATE_NO_BUSY_POLL = BIT(NAPI_STATE_NO_BUSY_POLL),
 	NAPIF_STATE_IN_BUSY_POLL = BIT(NAPI_STATE_IN_BUSY_POLL),
+	NAPIF_STATE_PREFER_BUSY_POLL = BIT(NAPI_STATE_PREFER_BUSY_POLL),
+	NAPIF_STATE_THREADED	 = BIT(NAPI_STATE_THREADED),
+	NAPIF_STATE_SCHED_THREADED = BIT(NAPI_STATE_SCHED_THREADED),
 };
 
 enum gro_result {
@@ -430,6 +438,11 @@ static inline bool napi_disable_pending(struct napi_struct *n)
 	return test_bit(NAPI_STATE_DISABLE, &n->state);
 }
 
+static inline bool napi_prefer_busy_poll(struct napi_struct *n)
+{
+	return test_bit(NAPI_STATE_PREFER_BUSY_POLL, &n->state);
+}
+
 bool napi_schedule_prep(struct napi_struct *n);
 
 /**
@@ -511,13 +524,7 @@ void napi_disable(struct napi_struct *n);
  * Resume NAPI from being scheduled on this context.
  * Must be paired with napi_disable.
  */
-static inline void napi_enable(struct napi_struct *n)
-{
-	BUG_ON(!test_bit(NAPI_STATE_SCHED, &n->state));
-	smp_mb__before_atomic();
-	clear_bit(NAPI_STATE_SCHED, &n->state);
-	clear_bit(NAPI_STATE_NPSVC, &n->state);
-}
+void napi_enable(struct napi_struct *n);
 
 /**
  *	napi_synchronize - wait until NAPI is not running
@@ -1755,6 +1762,8 @@ enum netdev_ml_priv_type {
  *	@rtnl_link_ops:	Rtnl_link_ops
  *
  *	@gso_max_size:	Maximum size of generic segmentation offload
+ *	@tso_max_size:	Device (as in, GSO/TSO engine) limit on the size of
+ *			@gso_max_size
  *	@gso_max_segs:	Maximum number of segments that can be passed to the
  *			NIC for GSO
  *
@@ -1782,6 +1791,7 @@ enum netdev_ml_priv_type {
  *			switch port.
  *
  *	@wol_enabled:	Wake-on-LAN is enabled
+ *	@threaded:	napi threaded mode is enabled
  *
  *	FIXME: cleanup struct net_device such that network protocol info
  *	moves out.
@@ -1954,6 +1964,13 @@ struct net_device {
 
 	struct bpf_prog __rcu	*xdp_prog;
 	unsigned long		gro_flush_timeout;
+	int			napi_defer_hard_irqs;
+#define GRO_LEGACY_MAX_SIZE	65536u
+/* TCP minimal MSS is 8 (TCP_MIN_GSO_SIZE),
+ * and shinfo->gso_segs is a 16bit field.
+ */
+#define GRO_MAX_SIZE		(8 * 65535u)
+	unsigned int		gro_max_size;
 	rx_handler_func_t __rcu	*rx_handler;
 	void __rcu		*rx_handler_data;
 
@@ -2049,9 +2066,16 @@ struct net_device {
 	const struct rtnl_link_ops *rtnl_link_ops;
 
 	/* for setting kernel sock attribute on TCP connection setup */
-#define GSO_MAX_SIZE		65536
+#define GSO_LEGACY_MAX_SIZE	65536u
+/* Beyond the legacy size, IPv6 packets carry a hop-by-hop jumbo payload
+ * option (RFC 2675) in place of the 16bit payload_len.
+ * TCP minimal MSS is 8 (TCP_MIN_GSO_SIZE), and shinfo->gso_segs is a
+ * 16bit field.
+ */
+#define GSO_MAX_SIZE		(8 * GSO_MAX_SEGS)
 	unsigned int		gso_max_size;
-#define GSO_MAX_SEGS		65535
+	unsigned int		tso_max_size;
+#define GSO_MAX_SEGS		65535u
 	u16			gso_max_segs;
 
 #ifdef CONFIG_DCB
@@ -2075,6 +2099,7 @@ struct net_device {
 	struct lock_class_key	addr_list_lock_key;
 	bool			proto_down;
 	unsigned		wol_enabled:1;
+	unsigned		threaded:1;
 };
 #define to_net_dev(d) container_of(d, struct net_device, dev)
 
@@ -2339,7 +2364,8 @@ struct napi_gro_cb {
 	/* Number of gro_receive callbacks this packet already went through */
 	u8 recursion_counter:4;
 
-	/* 1 bit hole */
+	/* GRO is done by frag_list pointer chaining. */
+	u8	is_flist:1;
 
 	/* used to support CHECKSUM_COMPLETE for tunneling protocols */
 	__wsum	csum;
@@ -2689,6 +2715,7 @@ struct net_device *dev_get_by_napi_id(unsigned int napi_id);
 int netdev_get_name(struct net *net, char *name, int ifindex);
 int dev_restart(struct net_device *dev);
 int skb_gro_receive(struct sk_buff *p, struct sk_buff *skb);
+int skb_gro_receive_list(struct sk_buff *p, struct sk_buff *skb);
 
 static inline unsigned int skb_gro_offset(const struct sk_buff *skb)
 {
@@ -3018,8 +3045,17 @@ struct softnet_data {
 	unsigned int		processed;
 	unsigned int		time_squeeze;
 	unsigned int		received_rps;
+	/* NAPI skb head cache: heads handed out, pulled from and
+	 * returned to skbuff_head_cache
+	 */
+	unsigned int		skb_cache_alloc;
+	unsigned int		skb_cache_refill;
+	unsigned int		skb_cache_spill;
 #ifdef CONFIG_RPS
 	struct softnet_data	*rps_ipi_list;
+	/* IPIs left in this net_rx_action() run, see netdev_rps_ipi_max */
+	unsigned int		rps_ipi_budget;
+	unsigned int		rps_ipi_deferred;
 #endif
 #ifdef CONFIG_NET_FLOW_LIMIT
 	struct sd_flow_limit __rcu *flow_limit;
@@ -3045,10 +3081,16 @@ struct softnet_data {
 	call_single_data_t	csd ____cacheline_aligned_in_smp;
 	struct softnet_data	*rps_ipi_next;
 	unsigned int		cpu;
-	unsigned int		input_queue_tail;
+	atomic_t		input_queue_tail;
 #endif
-	unsigned int		dropped;
-	struct sk_buff_head	input_pkt_queue;
+	atomic_t		dropped;
+	/* Lockless MPSC input queue: any cpu adds to it from
+	 * enqueue_to_backlog(), only the owning cpu takes packets off in
+	 * process_backlog().  Packets come off in LIFO order and are
+	 * reversed into process_queue.
+	 */
+	struct llist_head	input_llist;
+	atomic_t		input_llist_len;
 	struct napi_struct	backlog;
 
 };
@@ -3064,7 +3106,7 @@ static inline void input_queue_tail_incr_save(struct softnet_data *sd,
 					      unsigned int *qtail)
 {
 #ifdef CONFIG_RPS
-	*qtail = ++sd->input_queue_tail;
+	*qtail = atomic_inc_return(&sd->input_queue_tail);
 #endif
 }
 
@@ -3723,6 +3765,7 @@ int dev_get_port_parent_id(struct net_device *dev,
 			   struct netdev_phys_item_id *ppid, bool recurse);
 bool netdev_port_same_parent_id(struct net_device *a, struct net_device *b);
 int dev_change_proto_down(struct net_device *dev, bool proto_down);
+int dev_set_threaded(struct net_device *dev, bool threaded);
 int dev_change_proto_down_generic(struct net_device *dev, bool proto_down);
 struct sk_buff *validate_xmit_skb_list(struct sk_buff *skb, struct net_device *dev, bool *again);
 struct sk_buff *dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev,
@@ -4276,6 +4319,7 @@ void netdev_stats_to_stats64(struct rtnl_link_stats64 *stats64,
 			     const struct net_device_stats *netdev_stats);
 
 extern int		netdev_max_backlog;
+extern int		netdev_rps_ipi_max;
 extern int		netdev_tstamp_prequeue;
 extern int		weight_p;
 extern int		dev_weight_rx_bias;
@@ -4561,6 +4605,7 @@ static inline bool net_gso_ok(netdev_features_t features, int gso_type)
 	BUILD_BUG_ON(SKB_GSO_ESP != (NETIF_F_GSO_ESP >> NETIF_F_GSO_SHIFT));
 	BUILD_BUG_ON(SKB_GSO_UDP != (NETIF_F_GSO_UDP >> NETIF_F_GSO_SHIFT));
 	BUILD_BUG_ON(SKB_GSO_UDP_L4 != (NETIF_F_GSO_UDP_L4 >> NETIF_F_GSO_SHIFT));
+	BUILD_BUG_ON(SKB_GSO_FRAGLIST != (NETIF_F_GSO_FRAGLIST >> NETIF_F_GSO_SHIFT));
 
 	return (features & feature) == feature;
 }
@@ -4582,7 +4627,33 @@ static inline bool netif_needs_gso(struct sk_buff *skb,
 static inline void netif_set_gso_max_size(struct net_device *dev,
 					  unsigned int size)
 {
-	dev->gso_max_size = size;
+	/* dev->gso_max_size is read locklessly from sk_setup_caps() */
+	WRITE_ONCE(dev->gso_max_size, size);
+}
+
+/**
+ *	netif_set_tso_max_size - set the device's TSO size limit
+ *	@dev:	netdevice to update
+ *	@size:	largest super-packet the device can segment
+ *
+ *	Drivers able to handle IPv6 packets larger than %GSO_LEGACY_MAX_SIZE
+ *	(they must strip the hop-by-hop jumbo header with
+ *	ipv6_hopopt_jumbo_remove() in their xmit path) raise this up to
+ *	%GSO_MAX_SIZE.  The admin can then raise gso_max_size up to it.
+ */
+static inline void netif_set_tso_max_size(struct net_device *dev,
+					  unsigned int size)
+{
+	dev->tso_max_size = min(size, GSO_MAX_SIZE);
+	if (size < READ_ONCE(dev->gso_max_size))
+		netif_set_gso_max_size(dev, size);
+}
+
+static inline void netif_set_gro_max_size(struct net_device *dev,
+					  unsigned int size)
+{
+	/* This pairs with the READ_ONCE() in skb_gro_receive() */
+	WRITE_ONCE(dev->gro_max_size, size);
 }
 
 static inline void skb_gso_error_unwind(struct sk_buff *skb, __be16 protocol,
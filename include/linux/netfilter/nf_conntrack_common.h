@@ -18,6 +18,9 @@ struct ip_conntrack_stat {
 	unsigned int expect_create;
 	unsigned int expect_delete;
 	unsigned int search_restart;
+	unsigned int lock_contended;
+	unsigned int gc_scanned;
+	unsigned int gc_expired;
 };
 
 #define NFCT_INFOMASK	7UL
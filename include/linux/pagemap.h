@@ -53,6 +53,10 @@ static inline void mapping_set_error(struct address_space *mapping, int error)
 	/* Record in wb_err for checkers using errseq_t based tracking */
 	filemap_set_wb_err(mapping, error);
 
+	/* Record it in superblock */
+	if (mapping->host)
+		errseq_set(&mapping->host->i_sb->s_wb_err, error);
+
 	/* Record it in flags for now, for legacy callers */
 	if (error == -ENOSPC)
 		set_bit(AS_ENOSPC, &mapping->flags);
@@ -25,6 +25,8 @@
 
 #ifdef CONFIG_NET_RX_BUSY_POLL
 
+#define BUSY_POLL_BUDGET 8
+
 struct napi_struct;
 extern unsigned int sysctl_net_busy_read __read_mostly;
 extern unsigned int sysctl_net_busy_poll __read_mostly;
@@ -43,7 +45,7 @@ bool sk_busy_loop_end(void *p, unsigned long start_time);
 
 void napi_busy_loop(unsigned int napi_id,
 		    bool (*loop_end)(void *, unsigned long),
-		    void *loop_end_arg);
+		    void *loop_end_arg, bool prefer_busy_poll, u16 budget);
 
 #else /* CONFIG_NET_RX_BUSY_POLL */
 static inline unsigned long net_busy_loop_on(void)
@@ -103,9 +105,17 @@ static inline void sk_busy_loop(struct sock *sk, int nonblock)
 {
 #ifdef CONFIG_NET_RX_BUSY_POLL
 	unsigned int napi_id = READ_ONCE(sk->sk_napi_id);
+	u16 budget = READ_ONCE(sk->sk_busy_poll_budget);
+
+	if (napi_id < MIN_NAPI_ID) {
+		/* Nothing received through a NAPI context yet */
+		NET_INC_STATS(sock_net(sk), LINUX_MIB_BUSYPOLLNONAPI);
+		return;
+	}
 
-	if (napi_id >= MIN_NAPI_ID)
-		napi_busy_loop(napi_id, nonblock ? NULL : sk_busy_loop_end, sk);
+	napi_busy_loop(napi_id, nonblock ? NULL : sk_busy_loop_end, sk,
+		       READ_ONCE(sk->sk_prefer_busy_poll),
+		       budget ?: BUSY_POLL_BUDGET);
 #endif
 }
 
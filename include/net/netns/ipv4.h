@@ -100,6 +100,11 @@ struct netns_ipv4 {
 	int sysctl_ip_no_pmtu_disc;
 	int sysctl_ip_fwd_use_pmtu;
 	int sysctl_ip_fwd_update_priority;
+#ifdef CONFIG_IP_ROUTE_FLOW_CACHE
+	int sysctl_ip_fwd_flow_cache;
+	int sysctl_ip_fwd_flow_cache_size;
+	struct ip_flow_cache __rcu *flow_cache;
+#endif
 	int sysctl_ip_nonlocal_bind;
 	/* Shall we try to damage output packets if routing dev changes? */
 	int sysctl_ip_dynaddr;
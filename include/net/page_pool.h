@@ -58,6 +58,44 @@ struct pp_alloc_cache {
 	void *cache[PP_ALLOC_CACHE_SIZE];
 };
 
+#ifdef CONFIG_PAGE_POOL_STATS
+/* Where pages handed back to the pool ended up */
+struct page_pool_recycle_stats {
+	u64 cached;	/* recycled into the alloc side cache */
+	u64 cache_full;	/* alloc side cache was full */
+	u64 ring;	/* recycled into the ptr_ring */
+	u64 ring_full;	/* ptr_ring was full, page released */
+	u64 released_refcnt; /* elevated refcnt, page released */
+	u64 skb;	/* returned from an skb freed by the stack */
+};
+
+/* Summed over all CPUs, see page_pool_get_stats() */
+struct page_pool_stats {
+	struct page_pool_recycle_stats recycle_stats;
+};
+
+bool page_pool_get_stats(struct page_pool *pool,
+			 struct page_pool_stats *stats);
+int page_pool_ethtool_stats_get_count(void);
+u8 *page_pool_ethtool_stats_get_strings(u8 *data);
+u64 *page_pool_ethtool_stats_get(u64 *data, void *stats);
+#else
+static inline int page_pool_ethtool_stats_get_count(void)
+{
+	return 0;
+}
+
+static inline u8 *page_pool_ethtool_stats_get_strings(u8 *data)
+{
+	return data;
+}
+
+static inline u64 *page_pool_ethtool_stats_get(u64 *data, void *stats)
+{
+	return data;
+}
+#endif
+
 struct page_pool_params {
 	unsigned int	flags;
 	unsigned int	order;
@@ -112,6 +150,11 @@ struct page_pool {
 	 * refcnt serves purpose is to simplify drivers error handling.
 	 */
 	refcount_t user_cnt;
+
+#ifdef CONFIG_PAGE_POOL_STATS
+	/* Pages are returned from any CPU, so these are per-cpu */
+	struct page_pool_recycle_stats __percpu *recycle_stats;
+#endif
 };
 
 struct page *page_pool_alloc_pages(struct page_pool *pool, gfp_t gfp);
@@ -137,6 +180,7 @@ struct page_pool *page_pool_create(const struct page_pool_params *params);
 #ifdef CONFIG_PAGE_POOL
 void page_pool_destroy(struct page_pool *pool);
 void page_pool_use_xdp_mem(struct page_pool *pool, void (*disconnect)(void *));
+bool page_pool_return_skb_page(struct page *page);
 #else
 static inline void page_pool_destroy(struct page_pool *pool)
 {
@@ -146,6 +190,11 @@ static inline void page_pool_use_xdp_mem(struct page_pool *pool,
 					 void (*disconnect)(void *))
 {
 }
+
+static inline bool page_pool_return_skb_page(struct page *page)
+{
+	return false;
+}
 #endif
 
 /* Never call this directly, use helpers below */
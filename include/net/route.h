@@ -185,6 +185,21 @@ int ip_route_input_rcu(struct sk_buff *skb, __be32 dst, __be32 src,
 		       u8 tos, struct net_device *devin,
 		       struct fib_result *res);
 
+#ifdef CONFIG_IP_ROUTE_FLOW_CACHE
+int ip_route_input_cached(struct sk_buff *skb, const struct iphdr *iph,
+			  struct net_device *devin);
+void ip_route_flow_cache_purge(struct net *net);
+int ip_route_flow_cache_update(struct net *net);
+#else
+static inline int ip_route_input_cached(struct sk_buff *skb,
+					const struct iphdr *iph,
+					struct net_device *devin)
+{
+	return ip_route_input_noref(skb, iph->daddr, iph->saddr, iph->tos,
+				    devin);
+}
+#endif
+
 static inline int ip_route_input(struct sk_buff *skb, __be32 dst, __be32 src,
 				 u8 tos, struct net_device *devin)
 {
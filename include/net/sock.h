@@ -255,6 +255,8 @@ struct bpf_sk_storage;
   *	@sk_forward_alloc: space allocated forward
   *	@sk_napi_id: id of the last napi context to receive data for sk
   *	@sk_ll_usec: usecs to busypoll when there is no data
+  *	@sk_prefer_busy_poll: prefer busypolling over softirq processing
+  *	@sk_busy_poll_budget: napi processing budget when busypolling
   *	@sk_allocation: allocation mode
   *	@sk_pacing_rate: Pacing rate (if supported by transport/packet scheduler)
   *	@sk_pacing_status: Pacing status (requested, handled by sch_fq)
@@ -388,6 +390,8 @@ struct sock {
 	unsigned int		sk_ll_usec;
 	/* ===== mostly read cache line ===== */
 	unsigned int		sk_napi_id;
+	u8			sk_prefer_busy_poll;
+	u16			sk_busy_poll_budget;
 #endif
 	int			sk_rcvbuf;
 
@@ -477,7 +481,7 @@ struct sock {
 #if BITS_PER_LONG==32
 	seqlock_t		sk_stamp_seq;
 #endif
-	u16			sk_tsflags;
+	u32			sk_tsflags;
 	u8			sk_shutdown;
 	u32			sk_tskey;
 	atomic_t		sk_zckey;
@@ -2173,8 +2177,13 @@ int __sk_queue_drop_skb(struct sock *sk, struct sk_buff_head *sk_queue,
 int __sock_queue_rcv_skb(struct sock *sk, struct sk_buff *skb);
 int sock_queue_rcv_skb(struct sock *sk, struct sk_buff *skb);
 
+struct scm_ts_batch_entry;
+
 int sock_queue_err_skb(struct sock *sk, struct sk_buff *skb);
 struct sk_buff *sock_dequeue_err_skb(struct sock *sk);
+bool skb_is_tstamp_batchable(const struct sk_buff *skb);
+int sock_dequeue_tstamp_batch(struct sock *sk, struct scm_ts_batch_entry *ents,
+			      int max);
 
 /*
  *	Recover an error report and clear atomically
@@ -2548,6 +2557,8 @@ static inline bool sk_listener(const struct sock *sk)
 }
 
 void sock_enable_timestamp(struct sock *sk, int flag);
+void sock_recv_tstamp_batch(struct sock *sk, struct msghdr *msg,
+			    const struct sk_buff *skb);
 int sock_recv_errqueue(struct sock *sk, struct msghdr *msg, int len, int level,
 		       int type);
 
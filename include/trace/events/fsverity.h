@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM fsverity
+
+#if !defined(_TRACE_FSVERITY_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_FSVERITY_H
+
+#include <linux/tracepoint.h>
+
+struct inode;
+
+TRACE_EVENT(fsverity_verify_start,
+	TP_PROTO(const struct inode *inode, u64 pos, unsigned int len),
+
+	TP_ARGS(inode, pos, len),
+
+	TP_STRUCT__entry(
+		__field(dev_t,		dev)
+		__field(ino_t,		ino)
+		__field(u64,		pos)
+		__field(unsigned int,	len)
+	),
+
+	TP_fast_assign(
+		__entry->dev	= inode->i_sb->s_dev;
+		__entry->ino	= inode->i_ino;
+		__entry->pos	= pos;
+		__entry->len	= len;
+	),
+
+	TP_printk("dev %d,%d ino %lu pos %llu len %u",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  (unsigned long)__entry->ino, __entry->pos, __entry->len)
+);
+
+/*
+ * Emitted once per verified bio or page.  Together with fsverity_verify_start
+ * this gives the verification latency and, from @data_blocks, @block_size and
+ * @hash_blocks, the throughput and the Merkle tree overhead.
+ */
+TRACE_EVENT(fsverity_verify_end,
+	TP_PROTO(const struct inode *inode, unsigned int data_blocks,
+		 unsigned int hash_blocks, unsigned int block_size, int err),
+
+	TP_ARGS(inode, data_blocks, hash_blocks, block_size, err),
+
+	TP_STRUCT__entry(
+		__field(dev_t,		dev)
+		__field(ino_t,		ino)
+		__field(unsigned int,	data_blocks)
+		__field(unsigned int,	hash_blocks)
+		__field(unsigned int,	block_size)
+		__field(int,		err)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= inode->i_sb->s_dev;
+		__entry->ino		= inode->i_ino;
+		__entry->data_blocks	= data_blocks;
+		__entry->hash_blocks	= hash_blocks;
+		__entry->block_size	= block_size;
+		__entry->err		= err;
+	),
+
+	TP_printk("dev %d,%d ino %lu data_blocks %u hash_blocks %u block_size %u err %d",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  (unsigned long)__entry->ino, __entry->data_blocks,
+		  __entry->hash_blocks, __entry->block_size, __entry->err)
+);
+
+#endif /* _TRACE_FSVERITY_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
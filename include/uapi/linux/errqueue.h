@@ -46,6 +46,21 @@ struct scm_timestamping64 {
 	struct __kernel_timespec ts[3];
 };
 
+/**
+ *	struct scm_ts_batch_entry - one tx timestamp in SCM_TIMESTAMPING_BATCH
+ *
+ *	With SOF_TIMESTAMPING_OPT_TX_BATCH, timestamps queued behind the one
+ *	returned by recvmsg(MSG_ERRQUEUE) are passed as an array of these in
+ *	a single SCM_TIMESTAMPING_BATCH cmsg, as many as the control buffer
+ *	holds.  @tskey and @tstype are the ee_data and ee_info fields the
+ *	timestamp would have had in its own sock_extended_err.
+ */
+struct scm_ts_batch_entry {
+	__u32 tskey;
+	__u32 tstype;
+	struct scm_timestamping64 tss;
+};
+
 /* The type of scm_timestamping, passed in sock_extended_err ee_info.
  * This defines the type of ts[0]. For SCM_TSTAMP_SND only, if ts[0]
  * is zero, then this is a hardware timestamp and recorded in ts[2].
@@ -18,9 +18,12 @@
 /* For O_CLOEXEC */
 #include <linux/fcntl.h>
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /* Flags for epoll_create1.  */
 #define EPOLL_CLOEXEC O_CLOEXEC
+/* Use per-CPU ready lists and wake up waiters on the CPU of the item */
+#define EPOLL_PERCPU 1
 
 /* Valid opcodes to issue to sys_epoll_ctl() */
 #define EPOLL_CTL_ADD 1
@@ -79,6 +82,26 @@ struct epoll_event {
 	__u64 data;
 } EPOLL_PACKED;
 
+/*
+ * Per-instance busy poll parameters.  A non-zero busy_poll_usecs enables
+ * busy polling for this epoll instance regardless of net.core.busy_poll.
+ * busy_poll_budget is the NAPI budget of each busy poll round (0 for the
+ * default), and prefer_busy_poll keeps device interrupts deferred while the
+ * application keeps polling, see napi_defer_hard_irqs.
+ */
+struct epoll_params {
+	__u32 busy_poll_usecs;
+	__u16 busy_poll_budget;
+	__u8 prefer_busy_poll;
+
+	/* pad the struct to a multiple of 64bits */
+	__u8 __pad;
+};
+
+#define EPOLL_IOC_TYPE 0x8A
+#define EPIOCSPARAMS _IOW(EPOLL_IOC_TYPE, 0x01, struct epoll_params)
+#define EPIOCGPARAMS _IOR(EPOLL_IOC_TYPE, 0x02, struct epoll_params)
+
 #ifdef CONFIG_PM_SLEEP
 static inline void ep_take_care_of_epollwakeup(struct epoll_event *epev)
 {
@@ -30,10 +30,12 @@ enum {
 	SOF_TIMESTAMPING_OPT_STATS = (1<<12),
 	SOF_TIMESTAMPING_OPT_PKTINFO = (1<<13),
 	SOF_TIMESTAMPING_OPT_TX_SWHW = (1<<14),
+	/* bits 15 to 23 are left for upstream flags */
+	SOF_TIMESTAMPING_OPT_TX_BATCH = (1<<24),
 
-	SOF_TIMESTAMPING_LAST = SOF_TIMESTAMPING_OPT_TX_SWHW,
-	SOF_TIMESTAMPING_MASK = (SOF_TIMESTAMPING_LAST - 1) |
-				 SOF_TIMESTAMPING_LAST
+	SOF_TIMESTAMPING_LAST = SOF_TIMESTAMPING_OPT_TX_BATCH,
+	SOF_TIMESTAMPING_MASK = ((SOF_TIMESTAMPING_OPT_TX_SWHW << 1) - 1) |
+				 SOF_TIMESTAMPING_OPT_TX_BATCH
 };
 
 /*
@@ -255,6 +255,11 @@ enum ctattr_stats_cpu {
 	CTA_STATS_EARLY_DROP,
 	CTA_STATS_ERROR,
 	CTA_STATS_SEARCH_RESTART,
+	CTA_STATS_CLASH_RESOLVE,	/* not reported */
+	CTA_STATS_CHAIN_TOOLONG,	/* not reported */
+	CTA_STATS_LOCK_CONTENDED,
+	CTA_STATS_GC_SCANNED,
+	CTA_STATS_GC_EXPIRED,
 	__CTA_STATS_MAX,
 };
 #define CTA_STATS_MAX (__CTA_STATS_MAX - 1)
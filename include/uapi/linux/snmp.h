@@ -285,6 +285,11 @@ enum
 	LINUX_MIB_TCPRCVQDROP,			/* TCPRcvQDrop */
 	LINUX_MIB_TCPWQUEUETOOBIG,		/* TCPWqueueTooBig */
 	LINUX_MIB_TCPFASTOPENPASSIVEALTKEY,	/* TCPFastOpenPassiveAltKey */
+	LINUX_MIB_UDPGROFRAGLIST,		/* UDPGROFraglist */
+	LINUX_MIB_UDPGSOFRAGLIST,		/* UDPGSOFraglist */
+	LINUX_MIB_BUSYPOLLHIT,			/* BusyPollHit */
+	LINUX_MIB_BUSYPOLLFALLBACK,		/* BusyPollFallback */
+	LINUX_MIB_BUSYPOLLNONAPI,		/* BusyPollNoNapi */
 	__LINUX_MIB_MAX
 };
 
@@ -101,6 +101,29 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   nr_more_io,
 		   nr_dirty_time,
 		   !list_empty(&bdi->bdi_list), bdi->wb.state);
+
+	if (bdi->writeback_workers > 1) {
+		unsigned long written[WB_MAX_WRITEBACK_WORKERS];
+		unsigned long msecs[WB_MAX_WRITEBACK_WORKERS];
+		unsigned int i, nr = bdi->writeback_workers;
+
+		spin_lock(&wb->list_lock);
+		for (i = 0; i < nr; i++) {
+			written[i] = wb->worker_written[i];
+			msecs[i] = jiffies_to_msecs(wb->worker_time[i]);
+		}
+		spin_unlock(&wb->list_lock);
+
+		for (i = 0; i < nr; i++) {
+			unsigned long kb = K(written[i]);
+
+			seq_printf(m,
+				   "worker%u_written:    %10lu kB\n"
+				   "worker%u_bandwidth:  %10lu kBps\n",
+				   i, kb, i,
+				   msecs[i] ? kb * MSEC_PER_SEC / msecs[i] : 0);
+		}
+	}
 #undef K
 
 	return 0;
@@ -201,6 +224,26 @@ static ssize_t max_ratio_store(struct device *dev,
 }
 BDI_SHOW(max_ratio, bdi->max_ratio)
 
+static ssize_t writeback_workers_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);
+	unsigned int nr;
+	ssize_t ret;
+
+	ret = kstrtouint(buf, 10, &nr);
+	if (ret < 0)
+		return ret;
+
+	if (!nr || nr > WB_MAX_WRITEBACK_WORKERS)
+		return -EINVAL;
+
+	WRITE_ONCE(bdi->writeback_workers, nr);
+
+	return count;
+}
+BDI_SHOW(writeback_workers, bdi->writeback_workers)
+
 static ssize_t stable_pages_required_show(struct device *dev,
 					  struct device_attribute *attr,
 					  char *page)
@@ -216,6 +259,7 @@ static struct attribute *bdi_dev_attrs[] = {
 	&dev_attr_read_ahead_kb.attr,
 	&dev_attr_min_ratio.attr,
 	&dev_attr_max_ratio.attr,
+	&dev_attr_writeback_workers.attr,
 	&dev_attr_stable_pages_required.attr,
 	NULL,
 };
@@ -856,6 +900,7 @@ static int bdi_init(struct backing_dev_info *bdi)
 	bdi->min_ratio = 0;
 	bdi->max_ratio = 100;
 	bdi->max_prop_frac = FPROP_FRAC_BASE;
+	bdi->writeback_workers = 1;
 	INIT_LIST_HEAD(&bdi->bdi_list);
 	INIT_LIST_HEAD(&bdi->wb_list);
 	init_waitqueue_head(&bdi->wb_waitq);
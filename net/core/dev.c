@@ -78,6 +78,7 @@
 #include <linux/slab.h>
 #include <linux/sched.h>
 #include <linux/sched/mm.h>
+#include <linux/kthread.h>
 #include <linux/mutex.h>
 #include <linux/rwsem.h>
 #include <linux/string.h>
@@ -215,20 +216,6 @@ static inline struct hlist_head *dev_index_hash(struct net *net, int ifindex)
 	return &net->dev_index_head[ifindex & (NETDEV_HASHENTRIES - 1)];
 }
 
-static inline void rps_lock(struct softnet_data *sd)
-{
-#ifdef CONFIG_RPS
-	spin_lock(&sd->input_pkt_queue.lock);
-#endif
-}
-
-static inline void rps_unlock(struct softnet_data *sd)
-{
-#ifdef CONFIG_RPS
-	spin_unlock(&sd->input_pkt_queue.lock);
-#endif
-}
-
 /* Device list insertion */
 static void list_netdevice(struct net_device *dev)
 {
@@ -3860,6 +3847,9 @@ EXPORT_SYMBOL(dev_direct_xmit);
 int netdev_max_backlog __read_mostly = 1000;
 EXPORT_SYMBOL(netdev_max_backlog);
 
+/* Max RPS IPIs sent per net_rx_action() run, 0 means no limit */
+int netdev_rps_ipi_max __read_mostly;
+
 int netdev_tstamp_prequeue __read_mostly = 1;
 int netdev_budget __read_mostly = 300;
 /* Must be at least 2 jiffes to guarantee 1 jiffy timeout */
@@ -3872,10 +3862,54 @@ int dev_tx_weight __read_mostly = 64;
 /* Maximum number of GRO_NORMAL skbs to batch up for list-RX */
 int gro_normal_batch __read_mostly = 8;
 
+static int napi_threaded_poll(void *data);
+
+static int napi_kthread_create(struct napi_struct *n)
+{
+	int err = 0;
+
+	/* Create and wake up the kthread once to put it in
+	 * TASK_INTERRUPTIBLE mode to avoid the blocked task
+	 * warning and work with loadavg.
+	 */
+	n->thread = kthread_run(napi_threaded_poll, n, "napi/%s-%d",
+				n->dev->name, n->napi_id);
+	if (IS_ERR(n->thread)) {
+		err = PTR_ERR(n->thread);
+		pr_err("kthread_run failed with err %d\n", err);
+		n->thread = NULL;
+	}
+
+	return err;
+}
+
 /* Called with irq disabled */
 static inline void ____napi_schedule(struct softnet_data *sd,
 				     struct napi_struct *napi)
 {
+	struct task_struct *thread;
+
+	if (test_bit(NAPI_STATE_THREADED, &napi->state)) {
+		/* Paired with smp_mb__before_atomic() in
+		 * napi_enable()/dev_set_threaded().
+		 * Use READ_ONCE() to guarantee a complete
+		 * read on napi->thread. Only call
+		 * wake_up_process() when it's not NULL.
+		 */
+		thread = READ_ONCE(napi->thread);
+		if (thread) {
+			/* Avoid doing set_bit() if the thread is in
+			 * INTERRUPTIBLE state, cause napi_thread_wait()
+			 * makes sure to proceed with napi polling
+			 * if the thread is explicitly woken from here.
+			 */
+			if (READ_ONCE(thread->state) != TASK_INTERRUPTIBLE)
+				set_bit(NAPI_STATE_SCHED_THREADED, &napi->state);
+			wake_up_process(thread);
+			return;
+		}
+	}
+
 	list_add_tail(&napi->poll_list, &sd->poll_list);
 	__raise_softirq_irqoff(NET_RX_SOFTIRQ);
 }
@@ -4163,35 +4197,35 @@ static int enqueue_to_backlog(struct sk_buff *skb, int cpu,
 
 	sd = &per_cpu(softnet_data, cpu);
 
+	/* The remote backlog is lockless, irqs are only disabled for our
+	 * own flow limit table and rps_ipi_list.
+	 */
 	local_irq_save(flags);
 
-	rps_lock(sd);
 	if (!netif_running(skb->dev))
 		goto drop;
-	qlen = skb_queue_len(&sd->input_pkt_queue);
+	qlen = atomic_read(&sd->input_llist_len);
 	if (qlen <= netdev_max_backlog && !skb_flow_limit(skb, qlen)) {
-		if (qlen) {
-enqueue:
-			__skb_queue_tail(&sd->input_pkt_queue, skb);
-			input_queue_tail_incr_save(sd, qtail);
-			rps_unlock(sd);
-			local_irq_restore(flags);
-			return NET_RX_SUCCESS;
-		}
-
-		/* Schedule NAPI for backlog device
-		 * We can use non atomic operation since we own the queue lock
+		atomic_inc(&sd->input_llist_len);
+		input_queue_tail_incr_save(sd, qtail);
+		llist_add(&skb->ll_node, &sd->input_llist);
+
+		/* Schedule NAPI for backlog device.  Whoever finds it idle
+		 * kicks it; llist_add() orders the enqueue before the test,
+		 * pairing with process_backlog() clearing the bit before
+		 * looking at the list again.
 		 */
-		if (!__test_and_set_bit(NAPI_STATE_SCHED, &sd->backlog.state)) {
+		if (!test_bit(NAPI_STATE_SCHED, &sd->backlog.state) &&
+		    !test_and_set_bit(NAPI_STATE_SCHED, &sd->backlog.state)) {
 			if (!rps_ipi_queued(sd))
 				____napi_schedule(sd, &sd->backlog);
 		}
-		goto enqueue;
+		local_irq_restore(flags);
+		return NET_RX_SUCCESS;
 	}
 
 drop:
-	sd->dropped++;
-	rps_unlock(sd);
+	atomic_inc(&sd->dropped);
 
 	local_irq_restore(flags);
 
@@ -4503,8 +4537,6 @@ static __latent_entropy void net_tx_action(struct softirq_action *h)
 			else
 				__kfree_skb_defer(skb);
 		}
-
-		__kfree_skb_flush();
 	}
 
 	if (sd->output_queue) {
@@ -5179,6 +5211,44 @@ static void netif_receive_skb_list_internal(struct list_head *head)
 	rcu_read_unlock();
 }
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/* NAPI instance whose ->poll() this cpu is currently running */
+static DEFINE_PER_CPU(struct napi_struct *, napi_polling);
+
+static int napi_call_poll(struct napi_struct *n, int budget)
+{
+	struct napi_struct *prev = __this_cpu_read(napi_polling);
+	int work;
+
+	__this_cpu_write(napi_polling, n);
+	work = n->poll(n, budget);
+	__this_cpu_write(napi_polling, prev);
+
+	return work;
+}
+
+/* Drivers feeding netif_receive_skb() from their poll routine instead of
+ * GRO never mark the skb; tag it with the polling instance so that its
+ * socket can busy poll all the same.
+ */
+static void skb_mark_polling_napi_id(struct sk_buff *skb)
+{
+	struct napi_struct *napi = this_cpu_read(napi_polling);
+
+	if (napi && skb->napi_id < MIN_NAPI_ID)
+		skb_mark_napi_id(skb, napi);
+}
+#else
+static int napi_call_poll(struct napi_struct *n, int budget)
+{
+	return n->poll(n, budget);
+}
+
+static void skb_mark_polling_napi_id(struct sk_buff *skb)
+{
+}
+#endif
+
 /**
  *	netif_receive_skb - process receive buffer from network
  *	@skb: buffer to process
@@ -5200,6 +5270,7 @@ int netif_receive_skb(struct sk_buff *skb)
 
 	trace_netif_receive_skb_entry(skb);
 
+	skb_mark_polling_napi_id(skb);
 	ret = netif_receive_skb_internal(skb);
 	trace_netif_receive_skb_exit(ret);
 
@@ -5223,9 +5294,9 @@ void netif_receive_skb_list(struct list_head *head)
 
 	if (list_empty(head))
 		return;
-	if (trace_netif_receive_skb_list_entry_enabled()) {
-		list_for_each_entry(skb, head, list)
-			trace_netif_receive_skb_list_entry(skb);
+	list_for_each_entry(skb, head, list) {
+		trace_netif_receive_skb_list_entry(skb);
+		skb_mark_polling_napi_id(skb);
 	}
 	netif_receive_skb_list_internal(head);
 	trace_netif_receive_skb_list_exit(0);
@@ -5234,6 +5305,28 @@ EXPORT_SYMBOL(netif_receive_skb_list);
 
 DEFINE_PER_CPU(struct work_struct, flush_works);
 
+/* Move everything enqueued to @sd's backlog so far onto its process_queue,
+ * in arrival order.  Only the cpu owning @sd may call this, with BH
+ * disabled, or anyone once that cpu is dead.
+ */
+static void backlog_splice_input(struct softnet_data *sd)
+{
+	struct llist_node *first;
+	struct sk_buff *skb, *next;
+	unsigned int n = 0;
+
+	first = llist_del_all(&sd->input_llist);
+	if (!first)
+		return;
+
+	first = llist_reverse_order(first);
+	llist_for_each_entry_safe(skb, next, first, ll_node) {
+		__skb_queue_tail(&sd->process_queue, skb);
+		n++;
+	}
+	atomic_sub(n, &sd->input_llist_len);
+}
+
 /* Network device is going away, flush any packets still pending */
 static void flush_backlog(struct work_struct *work)
 {
@@ -5243,17 +5336,8 @@ static void flush_backlog(struct work_struct *work)
 	local_bh_disable();
 	sd = this_cpu_ptr(&softnet_data);
 
-	local_irq_disable();
-	rps_lock(sd);
-	skb_queue_walk_safe(&sd->input_pkt_queue, skb, tmp) {
-		if (skb->dev->reg_state == NETREG_UNREGISTERING) {
-			__skb_unlink(skb, &sd->input_pkt_queue);
-			dev_kfree_skb_irq(skb);
-			input_queue_head_incr(sd);
-		}
-	}
-	rps_unlock(sd);
-	local_irq_enable();
+	/* The backlog NAPI is still scheduled for anything we move here */
+	backlog_splice_input(sd);
 
 	skb_queue_walk_safe(&sd->process_queue, skb, tmp) {
 		if (skb->dev->reg_state == NETREG_UNREGISTERING) {
@@ -5510,6 +5594,7 @@ static enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff
 		NAPI_GRO_CB(skb)->is_fou = 0;
 		NAPI_GRO_CB(skb)->is_atomic = 1;
 		NAPI_GRO_CB(skb)->gro_remcsum_start = 0;
+		NAPI_GRO_CB(skb)->is_flist = 0;
 
 		/* Setup for GRO checksum validation */
 		switch (skb->ip_summed) {
@@ -5616,13 +5701,6 @@ struct packet_offload *gro_find_complete_by_type(__be16 type)
 }
 EXPORT_SYMBOL(gro_find_complete_by_type);
 
-static void napi_skb_free_stolen_head(struct sk_buff *skb)
-{
-	skb_dst_drop(skb);
-	skb_ext_put(skb);
-	kmem_cache_free(skbuff_head_cache, skb);
-}
-
 static gro_result_t napi_skb_finish(struct napi_struct *napi,
 				    struct sk_buff *skb,
 				    gro_result_t ret)
@@ -5836,6 +5914,44 @@ static void net_rps_send_ipi(struct softnet_data *remsd)
 #endif
 }
 
+#ifdef CONFIG_RPS
+/*
+ * Take at most sd->rps_ipi_budget entries off @remsd, oldest first, and put
+ * the rest back on sd->rps_ipi_list for the next net_rx_action() run.
+ * Called with local irq disabled.
+ */
+static struct softnet_data *net_rps_ipi_trim(struct softnet_data *sd,
+					     struct softnet_data *remsd)
+{
+	struct softnet_data *send = NULL, *prev = NULL, *next;
+
+	/* rps_ipi_queued() pushes at the head, newest first */
+	while (remsd) {
+		next = remsd->rps_ipi_next;
+		remsd->rps_ipi_next = prev;
+		prev = remsd;
+		remsd = next;
+	}
+
+	for (remsd = prev; remsd; remsd = next) {
+		next = remsd->rps_ipi_next;
+		if (sd->rps_ipi_budget) {
+			sd->rps_ipi_budget--;
+			remsd->rps_ipi_next = send;
+			send = remsd;
+		} else {
+			remsd->rps_ipi_next = sd->rps_ipi_list;
+			sd->rps_ipi_list = remsd;
+			sd->rps_ipi_deferred++;
+		}
+	}
+
+	if (sd->rps_ipi_list)
+		__raise_softirq_irqoff(NET_RX_SOFTIRQ);
+	return send;
+}
+#endif
+
 /*
  * net_rps_action_and_irq_enable sends any pending IPI's for rps.
  * Note: called with local irq disabled, but exits with local irq enabled.
@@ -5847,6 +5963,8 @@ static void net_rps_action_and_irq_enable(struct softnet_data *sd)
 
 	if (remsd) {
 		sd->rps_ipi_list = NULL;
+		if (READ_ONCE(netdev_rps_ipi_max))
+			remsd = net_rps_ipi_trim(sd, remsd);
 
 		local_irq_enable();
 
@@ -5894,25 +6012,24 @@ static int process_backlog(struct napi_struct *napi, int quota)
 
 		}
 
-		local_irq_disable();
-		rps_lock(sd);
-		if (skb_queue_empty(&sd->input_pkt_queue)) {
-			/*
-			 * Inline a custom version of __napi_complete().
-			 * only current cpu owns and manipulates this napi,
-			 * and NAPI_STATE_SCHED is the only possible flag set
-			 * on backlog.
-			 * We can use a plain write instead of clear_bit(),
-			 * and we dont need an smp_mb() memory barrier.
-			 */
-			napi->state = 0;
-			again = false;
-		} else {
-			skb_queue_splice_tail_init(&sd->input_pkt_queue,
-						   &sd->process_queue);
+		if (!llist_empty(&sd->input_llist)) {
+			backlog_splice_input(sd);
+			continue;
 		}
-		rps_unlock(sd);
-		local_irq_enable();
+
+		/*
+		 * Inline a custom version of __napi_complete().
+		 * NAPI_STATE_SCHED is the only possible flag set on backlog,
+		 * but other cpus set it from enqueue_to_backlog() as soon as
+		 * it is clear, so look at the list once more afterwards: a
+		 * packet added in between is either seen here or its
+		 * producer finds the bit clear and reschedules us.
+		 */
+		clear_bit(NAPI_STATE_SCHED, &napi->state);
+		smp_mb__after_atomic();
+		if (llist_empty(&sd->input_llist) ||
+		    test_and_set_bit(NAPI_STATE_SCHED, &napi->state))
+			again = false;
 	}
 
 	return work;
@@ -5982,7 +6099,8 @@ EXPORT_SYMBOL(__napi_schedule_irqoff);
 
 bool napi_complete_done(struct napi_struct *n, int work_done)
 {
-	unsigned long flags, val, new;
+	unsigned long flags, val, new, timeout = 0;
+	bool ret = true;
 
 	/*
 	 * 1) Don't let napi dequeue from the cpu poll list
@@ -5994,20 +6112,26 @@ bool napi_complete_done(struct napi_struct *n, int work_done)
 				 NAPIF_STATE_IN_BUSY_POLL)))
 		return false;
 
+	if (work_done) {
+		if (n->gro_bitmask)
+			timeout = READ_ONCE(n->dev->gro_flush_timeout);
+		n->defer_hard_irqs_count = READ_ONCE(n->dev->napi_defer_hard_irqs);
+	}
+	/* Keep device interrupts masked and let the watchdog timer poll
+	 * again, for up to napi_defer_hard_irqs empty rounds.
+	 */
+	if (n->defer_hard_irqs_count > 0) {
+		n->defer_hard_irqs_count--;
+		timeout = READ_ONCE(n->dev->gro_flush_timeout);
+		if (timeout)
+			ret = false;
+	}
 	if (n->gro_bitmask) {
-		unsigned long timeout = 0;
-
-		if (work_done)
-			timeout = n->dev->gro_flush_timeout;
-
 		/* When the NAPI instance uses a timeout and keeps postponing
 		 * it, we need to bound somehow the time packets are kept in
 		 * the GRO layer
 		 */
 		napi_gro_flush(n, !!timeout);
-		if (timeout)
-			hrtimer_start(&n->timer, ns_to_ktime(timeout),
-				      HRTIMER_MODE_REL_PINNED);
 	}
 
 	gro_normal_list(n);
@@ -6024,7 +6148,9 @@ bool napi_complete_done(struct napi_struct *n, int work_done)
 
 		WARN_ON_ONCE(!(val & NAPIF_STATE_SCHED));
 
-		new = val & ~(NAPIF_STATE_MISSED | NAPIF_STATE_SCHED);
+		new = val & ~(NAPIF_STATE_MISSED | NAPIF_STATE_SCHED |
+			      NAPIF_STATE_SCHED_THREADED |
+			      NAPIF_STATE_PREFER_BUSY_POLL);
 
 		/* If STATE_MISSED was set, leave STATE_SCHED set,
 		 * because we will call napi->poll() one more time.
@@ -6039,7 +6165,10 @@ bool napi_complete_done(struct napi_struct *n, int work_done)
 		return false;
 	}
 
-	return true;
+	if (timeout)
+		hrtimer_start(&n->timer, ns_to_ktime(timeout),
+			      HRTIMER_MODE_REL_PINNED);
+	return ret;
 }
 EXPORT_SYMBOL(napi_complete_done);
 
@@ -6058,10 +6187,27 @@ static struct napi_struct *napi_by_id(unsigned int napi_id)
 
 #if defined(CONFIG_NET_RX_BUSY_POLL)
 
-#define BUSY_POLL_BUDGET 8
+static void __busy_poll_stop(struct napi_struct *napi, bool skip_schedule)
+{
+	if (!skip_schedule) {
+		gro_normal_list(napi);
+		__napi_schedule(napi);
+		return;
+	}
+
+	/* The watchdog timer will poll again, leave device IRQs masked */
+	if (napi->gro_bitmask)
+		napi_gro_flush(napi, HZ >= 1000);
 
-static void busy_poll_stop(struct napi_struct *napi, void *have_poll_lock)
+	gro_normal_list(napi);
+	clear_bit(NAPI_STATE_SCHED, &napi->state);
+}
+
+static void busy_poll_stop(struct napi_struct *napi, void *have_poll_lock,
+			   bool prefer_busy_poll, u16 budget)
 {
+	bool skip_schedule = false;
+	unsigned long timeout;
 	int rc;
 
 	/* Busy polling means there is a high chance device driver hard irq
@@ -6078,29 +6224,42 @@ static void busy_poll_stop(struct napi_struct *napi, void *have_poll_lock)
 
 	local_bh_disable();
 
+	/* With preferred busy polling the application is expected to come
+	 * back soon, so rather than re-enabling device interrupts, arm the
+	 * watchdog timer to take over if it does not.
+	 */
+	if (prefer_busy_poll) {
+		napi->defer_hard_irqs_count =
+			READ_ONCE(napi->dev->napi_defer_hard_irqs);
+		timeout = READ_ONCE(napi->dev->gro_flush_timeout);
+		if (napi->defer_hard_irqs_count && timeout) {
+			hrtimer_start(&napi->timer, ns_to_ktime(timeout),
+				      HRTIMER_MODE_REL_PINNED);
+			skip_schedule = true;
+		}
+	}
+
 	/* All we really want here is to re-enable device interrupts.
 	 * Ideally, a new ndo_busy_poll_stop() could avoid another round.
 	 */
-	rc = napi->poll(napi, BUSY_POLL_BUDGET);
+	rc = napi_call_poll(napi, budget);
 	/* We can't gro_normal_list() here, because napi->poll() might have
 	 * rearmed the napi (napi_complete_done()) in which case it could
 	 * already be running on another CPU.
 	 */
-	trace_napi_poll(napi, rc, BUSY_POLL_BUDGET);
+	trace_napi_poll(napi, rc, budget);
 	netpoll_poll_unlock(have_poll_lock);
-	if (rc == BUSY_POLL_BUDGET) {
-		/* As the whole budget was spent, we still own the napi so can
-		 * safely handle the rx_list.
-		 */
-		gro_normal_list(napi);
-		__napi_schedule(napi);
-	}
+	/* As the whole budget was spent, we still own the napi so can
+	 * safely handle the rx_list.
+	 */
+	if (rc == budget)
+		__busy_poll_stop(napi, skip_schedule);
 	local_bh_enable();
 }
 
 void napi_busy_loop(unsigned int napi_id,
 		    bool (*loop_end)(void *, unsigned long),
-		    void *loop_end_arg)
+		    void *loop_end_arg, bool prefer_busy_poll, u16 budget)
 {
 	unsigned long start_time = loop_end ? busy_loop_current_time() : 0;
 	int (*napi_poll)(struct napi_struct *napi, int budget);
@@ -6127,23 +6286,33 @@ void napi_busy_loop(unsigned int napi_id,
 			/* If multiple threads are competing for this napi,
 			 * we avoid dirtying napi->state as much as we can.
 			 */
-			if (val & (NAPIF_STATE_DISABLE | NAPIF_STATE_SCHED |
-				   NAPIF_STATE_IN_BUSY_POLL))
-				goto count;
-			if (cmpxchg(&napi->state, val,
+			if ((val & (NAPIF_STATE_DISABLE | NAPIF_STATE_SCHED |
+				    NAPIF_STATE_IN_BUSY_POLL)) ||
+			    cmpxchg(&napi->state, val,
 				    val | NAPIF_STATE_IN_BUSY_POLL |
-					  NAPIF_STATE_SCHED) != val)
+					  NAPIF_STATE_SCHED) != val) {
+				/* Ask softirq processing to back off */
+				if (prefer_busy_poll)
+					set_bit(NAPI_STATE_PREFER_BUSY_POLL,
+						&napi->state);
+				/* ... and leave this round to its owner */
+				__NET_INC_STATS(dev_net(napi->dev),
+						LINUX_MIB_BUSYPOLLFALLBACK);
 				goto count;
+			}
 			have_poll_lock = netpoll_poll_lock(napi);
 			napi_poll = napi->poll;
 		}
-		work = napi_poll(napi, BUSY_POLL_BUDGET);
-		trace_napi_poll(napi, work, BUSY_POLL_BUDGET);
+		work = napi_call_poll(napi, budget);
+		trace_napi_poll(napi, work, budget);
 		gro_normal_list(napi);
 count:
-		if (work > 0)
+		if (work > 0) {
+			__NET_INC_STATS(dev_net(napi->dev),
+					LINUX_MIB_BUSYPOLLHIT);
 			__NET_ADD_STATS(dev_net(napi->dev),
 					LINUX_MIB_BUSYPOLLRXPACKETS, work);
+		}
 		local_bh_enable();
 
 		if (!loop_end || loop_end(loop_end_arg, start_time))
@@ -6151,7 +6320,8 @@ void napi_busy_loop(unsigned int napi_id,
 
 		if (unlikely(need_resched())) {
 			if (napi_poll)
-				busy_poll_stop(napi, have_poll_lock);
+				busy_poll_stop(napi, have_poll_lock,
+					       prefer_busy_poll, budget);
 			preempt_enable();
 			rcu_read_unlock();
 			cond_resched();
@@ -6162,7 +6332,7 @@ void napi_busy_loop(unsigned int napi_id,
 		cpu_relax();
 	}
 	if (napi_poll)
-		busy_poll_stop(napi, have_poll_lock);
+		busy_poll_stop(napi, have_poll_lock, prefer_busy_poll, budget);
 	preempt_enable();
 out:
 	rcu_read_unlock();
@@ -6219,9 +6389,11 @@ static enum hrtimer_restart napi_watchdog(struct hrtimer *timer)
 	/* Note : we use a relaxed variant of napi_schedule_prep() not setting
 	 * NAPI_STATE_MISSED, since we do not react to a device IRQ.
 	 */
-	if (napi->gro_bitmask && !napi_disable_pending(napi) &&
-	    !test_and_set_bit(NAPI_STATE_SCHED, &napi->state))
+	if (!napi_disable_pending(napi) &&
+	    !test_and_set_bit(NAPI_STATE_SCHED, &napi->state)) {
+		clear_bit(NAPI_STATE_PREFER_BUSY_POLL, &napi->state);
 		__napi_schedule_irqoff(napi);
+	}
 
 	return HRTIMER_NORESTART;
 }
@@ -6237,6 +6409,59 @@ static void init_gro_hash(struct napi_struct *napi)
 	napi->gro_bitmask = 0;
 }
 
+/**
+ *	dev_set_threaded - switch a device's NAPI instances to kthread polling
+ *	@dev: device
+ *	@threaded: poll from per-napi kthreads instead of NET_RX_SOFTIRQ
+ *
+ *	Each napi gets a "napi/<dev>-<napi_id>" kthread that can be given a
+ *	scheduling policy, priority and CPU affinity like any other task.
+ *	Caller must hold the rtnl lock.
+ */
+int dev_set_threaded(struct net_device *dev, bool threaded)
+{
+	struct napi_struct *napi;
+	int err = 0;
+
+	if (dev->threaded == threaded)
+		return 0;
+
+	if (threaded) {
+		list_for_each_entry(napi, &dev->napi_list, dev_list) {
+			if (!napi->thread) {
+				err = napi_kthread_create(napi);
+				if (err) {
+					threaded = false;
+					break;
+				}
+			}
+		}
+	}
+
+	dev->threaded = threaded;
+
+	/* Make sure kthread is created before THREADED bit
+	 * is set.
+	 */
+	smp_mb__before_atomic();
+
+	/* Setting/unsetting threaded mode on a napi might not immediately
+	 * take effect, if the current napi instance is actively being
+	 * polled. In this case, the switch between threaded mode and
+	 * softirq mode will happen in the next round of napi_schedule().
+	 * This should not cause hiccups/stalls to the live traffic.
+	 */
+	list_for_each_entry(napi, &dev->napi_list, dev_list) {
+		if (threaded)
+			set_bit(NAPI_STATE_THREADED, &napi->state);
+		else
+			clear_bit(NAPI_STATE_THREADED, &napi->state);
+	}
+
+	return err;
+}
+EXPORT_SYMBOL(dev_set_threaded);
+
 void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 		    int (*poll)(struct napi_struct *, int), int weight)
 {
@@ -6260,6 +6485,12 @@ void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 	set_bit(NAPI_STATE_NPSVC, &napi->state);
 	list_add_rcu(&napi->dev_list, &dev->napi_list);
 	napi_hash_add(napi);
+	/* Create kthread for this napi if dev->threaded is set.
+	 * Clear dev->threaded if kthread creation failed so that
+	 * threaded mode will not be enabled in napi_enable().
+	 */
+	if (dev->threaded && napi_kthread_create(napi))
+		dev->threaded = 0;
 }
 EXPORT_SYMBOL(netif_napi_add);
 
@@ -6275,10 +6506,23 @@ void napi_disable(struct napi_struct *n)
 
 	hrtimer_cancel(&n->timer);
 
+	clear_bit(NAPI_STATE_PREFER_BUSY_POLL, &n->state);
 	clear_bit(NAPI_STATE_DISABLE, &n->state);
+	clear_bit(NAPI_STATE_THREADED, &n->state);
 }
 EXPORT_SYMBOL(napi_disable);
 
+void napi_enable(struct napi_struct *n)
+{
+	BUG_ON(!test_bit(NAPI_STATE_SCHED, &n->state));
+	smp_mb__before_atomic();
+	clear_bit(NAPI_STATE_SCHED, &n->state);
+	clear_bit(NAPI_STATE_NPSVC, &n->state);
+	if (n->dev->threaded && n->thread)
+		set_bit(NAPI_STATE_THREADED, &n->state);
+}
+EXPORT_SYMBOL(napi_enable);
+
 static void flush_gro_hash(struct napi_struct *napi)
 {
 	int i;
@@ -6303,18 +6547,18 @@ void netif_napi_del(struct napi_struct *napi)
 
 	flush_gro_hash(napi);
 	napi->gro_bitmask = 0;
+
+	if (napi->thread) {
+		kthread_stop(napi->thread);
+		napi->thread = NULL;
+	}
 }
 EXPORT_SYMBOL(netif_napi_del);
 
-static int napi_poll(struct napi_struct *n, struct list_head *repoll)
+static int __napi_poll(struct napi_struct *n, bool *repoll)
 {
-	void *have;
 	int work, weight;
 
-	list_del_init(&n->poll_list);
-
-	have = netpoll_poll_lock(n);
-
 	weight = n->weight;
 
 	/* This NAPI_STATE_SCHED test is for avoiding a race
@@ -6325,14 +6569,14 @@ static int napi_poll(struct napi_struct *n, struct list_head *repoll)
 	 */
 	work = 0;
 	if (test_bit(NAPI_STATE_SCHED, &n->state)) {
-		work = n->poll(n, weight);
+		work = napi_call_poll(n, weight);
 		trace_napi_poll(n, work, weight);
 	}
 
 	WARN_ON_ONCE(work > weight);
 
 	if (likely(work < weight))
-		goto out_unlock;
+		return work;
 
 	/* Drivers must not modify the NAPI state if they
 	 * consume the entire weight.  In such cases this code
@@ -6341,7 +6585,20 @@ static int napi_poll(struct napi_struct *n, struct list_head *repoll)
 	 */
 	if (unlikely(napi_disable_pending(n))) {
 		napi_complete(n);
-		goto out_unlock;
+		return work;
+	}
+
+	/* The NAPI context has more processing work, but busy-polling
+	 * is preferred. Exit early.
+	 */
+	if (napi_prefer_busy_poll(n)) {
+		if (napi_complete_done(n, work)) {
+			/* If timeout is not set, we need to make sure
+			 * that the NAPI is re-scheduled.
+			 */
+			napi_schedule(n);
+		}
+		return work;
 	}
 
 	if (n->gro_bitmask) {
@@ -6359,17 +6616,89 @@ static int napi_poll(struct napi_struct *n, struct list_head *repoll)
 	if (unlikely(!list_empty(&n->poll_list))) {
 		pr_warn_once("%s: Budget exhausted after napi rescheduled\n",
 			     n->dev ? n->dev->name : "backlog");
-		goto out_unlock;
+		return work;
 	}
 
-	list_add_tail(&n->poll_list, repoll);
+	*repoll = true;
+
+	return work;
+}
+
+static int napi_poll(struct napi_struct *n, struct list_head *repoll)
+{
+	bool do_repoll = false;
+	void *have;
+	int work;
+
+	list_del_init(&n->poll_list);
+
+	have = netpoll_poll_lock(n);
+
+	work = __napi_poll(n, &do_repoll);
+
+	if (do_repoll)
+		list_add_tail(&n->poll_list, repoll);
 
-out_unlock:
 	netpoll_poll_unlock(have);
 
 	return work;
 }
 
+static int napi_thread_wait(struct napi_struct *napi)
+{
+	bool woken = false;
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	while (!kthread_should_stop()) {
+		/* Testing SCHED_THREADED bit here to make sure the current
+		 * kthread owns this napi and could poll on this napi.
+		 * Testing SCHED bit is not enough because SCHED bit might be
+		 * set by some other busy poll thread or by napi_disable().
+		 */
+		if (test_bit(NAPI_STATE_SCHED_THREADED, &napi->state) || woken) {
+			WARN_ON(!list_empty(&napi->poll_list));
+			__set_current_state(TASK_RUNNING);
+			return 0;
+		}
+
+		schedule();
+		/* woken being true indicates this thread owns this napi. */
+		woken = true;
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return -1;
+}
+
+/* Same budget and accounting as net_rx_action(), one napi per thread */
+static int napi_threaded_poll(void *data)
+{
+	struct napi_struct *napi = data;
+	void *have;
+
+	while (!napi_thread_wait(napi)) {
+		for (;;) {
+			bool repoll = false;
+
+			local_bh_disable();
+
+			have = netpoll_poll_lock(napi);
+			__napi_poll(napi, &repoll);
+			netpoll_poll_unlock(have);
+
+			local_bh_enable();
+
+			if (!repoll)
+				break;
+
+			cond_resched();
+		}
+	}
+	return 0;
+}
+
 static __latent_entropy void net_rx_action(struct softirq_action *h)
 {
 	struct softnet_data *sd = this_cpu_ptr(&softnet_data);
@@ -6379,6 +6708,9 @@ static __latent_entropy void net_rx_action(struct softirq_action *h)
 	LIST_HEAD(list);
 	LIST_HEAD(repoll);
 
+#ifdef CONFIG_RPS
+	sd->rps_ipi_budget = READ_ONCE(netdev_rps_ipi_max);
+#endif
 	local_irq_disable();
 	list_splice_init(&sd->poll_list, &list);
 	local_irq_enable();
@@ -6388,7 +6720,7 @@ static __latent_entropy void net_rx_action(struct softirq_action *h)
 
 		if (list_empty(&list)) {
 			if (!sd_has_rps_ipi_waiting(sd) && list_empty(&repoll))
-				goto out;
+				return;
 			break;
 		}
 
@@ -6415,8 +6747,6 @@ static __latent_entropy void net_rx_action(struct softirq_action *h)
 		__raise_softirq_irqoff(NET_RX_SOFTIRQ);
 
 	net_rps_action_and_irq_enable(sd);
-out:
-	__kfree_skb_flush();
 }
 
 struct netdev_adjacent {
@@ -8760,6 +9090,12 @@ static netdev_features_t netdev_fix_features(struct net_device *dev,
 		features &= ~NETIF_F_HW_TLS_RX;
 	}
 
+	/* Fraglist GRO is a mode of software GRO */
+	if ((features & NETIF_F_GRO_FRAGLIST) && !(features & NETIF_F_GRO)) {
+		netdev_dbg(dev, "Dropping fraglist GRO since no GRO feature.\n");
+		features &= ~NETIF_F_GRO_FRAGLIST;
+	}
+
 	return features;
 }
 
@@ -9102,9 +9438,10 @@ int register_netdevice(struct net_device *dev)
 		goto err_uninit;
 
 	/* Transfer changeable features to wanted_features and enable
-	 * software offloads (GSO and GRO).
+	 * software offloads (GSO and GRO).  Fraglist GRO is available
+	 * but off by default.
 	 */
-	dev->hw_features |= NETIF_F_SOFT_FEATURES;
+	dev->hw_features |= NETIF_F_SOFT_FEATURES | NETIF_F_SOFT_FEATURES_OFF;
 	dev->features |= NETIF_F_SOFT_FEATURES;
 
 	if (dev->netdev_ops->ndo_udp_tunnel_add) {
@@ -9591,8 +9928,10 @@ struct net_device *alloc_netdev_mqs(int sizeof_priv, const char *name,
 
 	netdev_register_lockdep_key(dev);
 
-	dev->gso_max_size = GSO_MAX_SIZE;
+	dev->gso_max_size = GSO_LEGACY_MAX_SIZE;
+	dev->tso_max_size = GSO_LEGACY_MAX_SIZE;
 	dev->gso_max_segs = GSO_MAX_SEGS;
+	dev->gro_max_size = GRO_LEGACY_MAX_SIZE;
 	dev->upper_level = 1;
 	dev->lower_level = 1;
 
@@ -9925,7 +10264,7 @@ static int dev_cpu_dead(unsigned int oldcpu)
 	}
 	/* Append NAPI poll list from offline CPU, with one exception :
 	 * process_backlog() must be called by cpu owning percpu backlog.
-	 * We properly handle process_queue & input_pkt_queue later.
+	 * We properly handle process_queue & input_llist later.
 	 */
 	while (!list_empty(&oldsd->poll_list)) {
 		struct napi_struct *napi = list_first_entry(&oldsd->poll_list,
@@ -9949,15 +10288,12 @@ static int dev_cpu_dead(unsigned int oldcpu)
 	/* send out pending IPI's on offline CPU */
 	net_rps_send_ipi(remsd);
 
-	/* Process offline CPU's input_pkt_queue */
+	/* Process offline CPU's backlog */
+	backlog_splice_input(oldsd);
 	while ((skb = __skb_dequeue(&oldsd->process_queue))) {
 		netif_rx_ni(skb);
 		input_queue_head_incr(oldsd);
 	}
-	while ((skb = skb_dequeue(&oldsd->input_pkt_queue))) {
-		netif_rx_ni(skb);
-		input_queue_head_incr(oldsd);
-	}
 
 	return 0;
 }
@@ -10268,7 +10604,7 @@ static int __init net_dev_init(void)
 
 		INIT_WORK(flush, flush_backlog);
 
-		skb_queue_head_init(&sd->input_pkt_queue);
+		init_llist_head(&sd->input_llist);
 		skb_queue_head_init(&sd->process_queue);
 #ifdef CONFIG_XFRM_OFFLOAD
 		skb_queue_head_init(&sd->xfrm_backlog);
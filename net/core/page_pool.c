@@ -15,12 +15,93 @@
 #include <linux/dma-mapping.h>
 #include <linux/page-flags.h>
 #include <linux/mm.h> /* for __put_page() */
+#include <linux/poison.h>
+#include <linux/ethtool.h>
 
 #include <trace/events/page_pool.h>
 
 #define DEFER_TIME (msecs_to_jiffies(1000))
 #define DEFER_WARN_INTERVAL (60 * HZ)
 
+#ifdef CONFIG_PAGE_POOL_STATS
+/* recycle_stats are per-cpu, pages can be returned from any CPU */
+#define recycle_stat_inc(pool, __stat)					\
+	do {								\
+		struct page_pool_recycle_stats __percpu *s = pool->recycle_stats; \
+		this_cpu_inc(s->__stat);				\
+	} while (0)
+
+static const char pp_stats[][ETH_GSTRING_LEN] = {
+	"rx_pp_recycle_cached",
+	"rx_pp_recycle_cache_full",
+	"rx_pp_recycle_ring",
+	"rx_pp_recycle_ring_full",
+	"rx_pp_recycle_released_ref",
+	"rx_pp_recycle_skb",
+};
+
+/* Add @pool's counters to @stats, so drivers can sum over their queues */
+bool page_pool_get_stats(struct page_pool *pool,
+			 struct page_pool_stats *stats)
+{
+	int cpu;
+
+	if (!stats)
+		return false;
+
+	for_each_possible_cpu(cpu) {
+		const struct page_pool_recycle_stats *pcpu =
+			per_cpu_ptr(pool->recycle_stats, cpu);
+
+		stats->recycle_stats.cached += pcpu->cached;
+		stats->recycle_stats.cache_full += pcpu->cache_full;
+		stats->recycle_stats.ring += pcpu->ring;
+		stats->recycle_stats.ring_full += pcpu->ring_full;
+		stats->recycle_stats.released_refcnt += pcpu->released_refcnt;
+		stats->recycle_stats.skb += pcpu->skb;
+	}
+
+	return true;
+}
+EXPORT_SYMBOL(page_pool_get_stats);
+
+u8 *page_pool_ethtool_stats_get_strings(u8 *data)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(pp_stats); i++) {
+		memcpy(data, pp_stats[i], ETH_GSTRING_LEN);
+		data += ETH_GSTRING_LEN;
+	}
+
+	return data;
+}
+EXPORT_SYMBOL(page_pool_ethtool_stats_get_strings);
+
+int page_pool_ethtool_stats_get_count(void)
+{
+	return ARRAY_SIZE(pp_stats);
+}
+EXPORT_SYMBOL(page_pool_ethtool_stats_get_count);
+
+u64 *page_pool_ethtool_stats_get(u64 *data, void *stats)
+{
+	struct page_pool_stats *pool_stats = stats;
+
+	*data++ = pool_stats->recycle_stats.cached;
+	*data++ = pool_stats->recycle_stats.cache_full;
+	*data++ = pool_stats->recycle_stats.ring;
+	*data++ = pool_stats->recycle_stats.ring_full;
+	*data++ = pool_stats->recycle_stats.released_refcnt;
+	*data++ = pool_stats->recycle_stats.skb;
+
+	return data;
+}
+EXPORT_SYMBOL(page_pool_ethtool_stats_get);
+#else
+#define recycle_stat_inc(pool, __stat)
+#endif
+
 static int page_pool_init(struct page_pool *pool,
 			  const struct page_pool_params *params)
 {
@@ -47,8 +128,18 @@ static int page_pool_init(struct page_pool *pool,
 	    (pool->p.dma_dir != DMA_BIDIRECTIONAL))
 		return -EINVAL;
 
-	if (ptr_ring_init(&pool->ring, ring_qsize, GFP_KERNEL) < 0)
+#ifdef CONFIG_PAGE_POOL_STATS
+	pool->recycle_stats = alloc_percpu(struct page_pool_recycle_stats);
+	if (!pool->recycle_stats)
 		return -ENOMEM;
+#endif
+
+	if (ptr_ring_init(&pool->ring, ring_qsize, GFP_KERNEL) < 0) {
+#ifdef CONFIG_PAGE_POOL_STATS
+		free_percpu(pool->recycle_stats);
+#endif
+		return -ENOMEM;
+	}
 
 	atomic_set(&pool->pages_state_release_cnt, 0);
 
@@ -160,6 +251,10 @@ static struct page *__page_pool_alloc_pages_slow(struct page_pool *pool,
 	page_pool_set_dma_addr(page, dma);
 
 skip_dma_map:
+	/* Let skbs carrying this page find their way back to us */
+	page->pp_magic = PP_SIGNATURE;
+	page->pp = pool;
+
 	/* Track how many pages are held 'in-flight' */
 	pool->pages_state_hold_cnt++;
 
@@ -223,6 +318,9 @@ static void __page_pool_clean_page(struct page_pool *pool,
 			     DMA_ATTR_SKIP_CPU_SYNC);
 	page_pool_set_dma_addr(page, 0);
 skip_dma_unmap:
+	page->pp_magic = 0;
+	page->pp = NULL;
+
 	/* This may be the last page returned, releasing the pool, so
 	 * it is not safe to reference pool afterwards.
 	 */
@@ -293,14 +391,21 @@ void __page_pool_put_page(struct page_pool *pool,
 	if (likely(page_ref_count(page) == 1)) {
 		/* Read barrier done in page_ref_count / READ_ONCE */
 
-		if (allow_direct && in_serving_softirq())
-			if (__page_pool_recycle_direct(page, pool))
+		if (allow_direct && in_serving_softirq()) {
+			if (__page_pool_recycle_direct(page, pool)) {
+				recycle_stat_inc(pool, cached);
 				return;
+			}
+			recycle_stat_inc(pool, cache_full);
+		}
 
 		if (!__page_pool_recycle_into_ring(pool, page)) {
 			/* Cache full, fallback to free pages */
+			recycle_stat_inc(pool, ring_full);
 			__page_pool_return_page(pool, page);
+			return;
 		}
+		recycle_stat_inc(pool, ring);
 		return;
 	}
 	/* Fallback/non-XDP mode: API user have elevated refcnt.
@@ -316,11 +421,42 @@ void __page_pool_put_page(struct page_pool *pool,
 	 * doing refcnt based recycle tricks, meaning another process
 	 * will be invoking put_page.
 	 */
+	recycle_stat_inc(pool, released_refcnt);
 	__page_pool_clean_page(pool, page);
 	put_page(page);
 }
 EXPORT_SYMBOL(__page_pool_put_page);
 
+/**
+ * page_pool_return_skb_page - recycle a page freed along with an skb
+ * @page: head page or frag page of an skb marked with skb_mark_for_recycle()
+ *
+ * Called by the stack when it drops the last reference of an skb built
+ * from page_pool pages, wherever that happens.  Returns false if @page
+ * does not belong to a page_pool, in which case the caller releases it
+ * with put_page() as usual.
+ */
+bool page_pool_return_skb_page(struct page *page)
+{
+	struct page_pool *pool;
+
+	page = compound_head(page);
+	if (unlikely(page->pp_magic != PP_SIGNATURE))
+		return false;
+
+	pool = page->pp;
+	recycle_stat_inc(pool, skb);
+
+	/* Not from NAPI context in general (TCP recvmsg, TX completion
+	 * of a forwarded packet, ...), so never recycle direct.  A page
+	 * whose refcount was elevated, e.g. by skb_clone() users copying
+	 * frags, simply leaves the pool here.
+	 */
+	__page_pool_put_page(pool, page, false);
+	return true;
+}
+EXPORT_SYMBOL(page_pool_return_skb_page);
+
 static void __page_pool_empty_ring(struct page_pool *pool)
 {
 	struct page *page;
@@ -346,6 +482,9 @@ static void page_pool_free(struct page_pool *pool)
 	if (pool->p.flags & PP_FLAG_DMA_MAP)
 		put_device(pool->p.dev);
 
+#ifdef CONFIG_PAGE_POOL_STATS
+	free_percpu(pool->recycle_stats);
+#endif
 	kfree(pool);
 }
 
@@ -66,6 +66,7 @@
 #include <net/sock.h>
 #include <net/checksum.h>
 #include <net/ip6_checksum.h>
+#include <net/ipv6.h>
 #include <net/xfrm.h>
 #include <net/mpls.h>
 
@@ -358,7 +359,14 @@ struct sk_buff *build_skb_around(struct sk_buff *skb,
 EXPORT_SYMBOL(build_skb_around);
 
 #define NAPI_SKB_CACHE_SIZE	64
+#define NAPI_SKB_CACHE_BULK	16
+#define NAPI_SKB_CACHE_HALF	(NAPI_SKB_CACHE_SIZE / 2)
 
+/* Per-CPU caches only touched from softirq context.  skb_cache holds
+ * sk_buff heads freed by NAPI so they can be handed straight back to NAPI
+ * Rx allocations; it is refilled from and spilled to skbuff_head_cache in
+ * bulk.
+ */
 struct napi_alloc_cache {
 	struct page_frag_cache page;
 	unsigned int skb_count;
@@ -368,6 +376,76 @@ struct napi_alloc_cache {
 static DEFINE_PER_CPU(struct page_frag_cache, netdev_alloc_cache);
 static DEFINE_PER_CPU(struct napi_alloc_cache, napi_alloc_cache);
 
+static struct sk_buff *napi_skb_cache_get(void)
+{
+	struct napi_alloc_cache *nc = this_cpu_ptr(&napi_alloc_cache);
+
+	if (unlikely(!nc->skb_count)) {
+		nc->skb_count = kmem_cache_alloc_bulk(skbuff_head_cache,
+						      GFP_ATOMIC,
+						      NAPI_SKB_CACHE_BULK,
+						      nc->skb_cache);
+		if (unlikely(!nc->skb_count))
+			return NULL;
+		__this_cpu_add(softnet_data.skb_cache_refill, nc->skb_count);
+	}
+
+	__this_cpu_inc(softnet_data.skb_cache_alloc);
+	return nc->skb_cache[--nc->skb_count];
+}
+
+static void napi_skb_cache_put(struct sk_buff *skb)
+{
+	struct napi_alloc_cache *nc = this_cpu_ptr(&napi_alloc_cache);
+
+	nc->skb_cache[nc->skb_count++] = skb;
+
+	/* give half of a full cache back so Rx still finds heads there */
+	if (unlikely(nc->skb_count == NAPI_SKB_CACHE_SIZE)) {
+		kmem_cache_free_bulk(skbuff_head_cache, NAPI_SKB_CACHE_HALF,
+				     nc->skb_cache + NAPI_SKB_CACHE_HALF);
+		nc->skb_count = NAPI_SKB_CACHE_HALF;
+		__this_cpu_add(softnet_data.skb_cache_spill,
+			       NAPI_SKB_CACHE_HALF);
+	}
+}
+
+/* Same as __build_skb(), but takes the head from the NAPI skb cache */
+static struct sk_buff *__napi_build_skb(void *data, unsigned int frag_size)
+{
+	struct sk_buff *skb;
+
+	skb = napi_skb_cache_get();
+	if (unlikely(!skb))
+		return NULL;
+
+	memset(skb, 0, offsetof(struct sk_buff, tail));
+
+	return __build_skb_around(skb, data, frag_size);
+}
+
+/**
+ * napi_build_skb - build a network buffer
+ * @data: data buffer provided by caller
+ * @frag_size: size of data, or 0 if head was kmalloced
+ *
+ * Version of build_skb() for use from NAPI poll, where the sk_buff head
+ * is taken from the per-CPU NAPI skb cache instead of the slab.
+ * Must be called from softirq context.
+ */
+struct sk_buff *napi_build_skb(void *data, unsigned int frag_size)
+{
+	struct sk_buff *skb = __napi_build_skb(data, frag_size);
+
+	if (likely(skb) && frag_size) {
+		skb->head_frag = 1;
+		if (page_is_pfmemalloc(virt_to_head_page(data)))
+			skb->pfmemalloc = 1;
+	}
+	return skb;
+}
+EXPORT_SYMBOL(napi_build_skb);
+
 static void *__napi_alloc_frag(unsigned int fragsz, gfp_t gfp_mask)
 {
 	struct napi_alloc_cache *nc = this_cpu_ptr(&napi_alloc_cache);
@@ -529,7 +607,7 @@ struct sk_buff *__napi_alloc_skb(struct napi_struct *napi, unsigned int len,
 	if (unlikely(!data))
 		return NULL;
 
-	skb = __build_skb(data, len);
+	skb = __napi_build_skb(data, len);
 	if (unlikely(!skb)) {
 		skb_free_frag(data);
 		return NULL;
@@ -594,10 +672,13 @@ static void skb_free_head(struct sk_buff *skb)
 {
 	unsigned char *head = skb->head;
 
-	if (skb->head_frag)
+	if (skb->head_frag) {
+		if (skb_pp_recycle(skb, head))
+			return;
 		skb_free_frag(head);
-	else
+	} else {
 		kfree(head);
+	}
 }
 
 static void skb_release_data(struct sk_buff *skb)
@@ -611,7 +692,7 @@ static void skb_release_data(struct sk_buff *skb)
 		return;
 
 	for (i = 0; i < shinfo->nr_frags; i++)
-		__skb_frag_unref(&shinfo->frags[i]);
+		__skb_frag_unref(&shinfo->frags[i], skb->pp_recycle);
 
 	if (shinfo->frag_list)
 		kfree_skb_list(shinfo->frag_list);
@@ -862,45 +943,28 @@ void __consume_stateless_skb(struct sk_buff *skb)
 	kfree_skbmem(skb);
 }
 
-void __kfree_skb_flush(void)
-{
-	struct napi_alloc_cache *nc = this_cpu_ptr(&napi_alloc_cache);
-
-	/* flush skb_cache if containing objects */
-	if (nc->skb_count) {
-		kmem_cache_free_bulk(skbuff_head_cache, nc->skb_count,
-				     nc->skb_cache);
-		nc->skb_count = 0;
-	}
-}
-
 static inline void _kfree_skb_defer(struct sk_buff *skb)
 {
-	struct napi_alloc_cache *nc = this_cpu_ptr(&napi_alloc_cache);
-
 	/* drop skb->head and call any destructors for packet */
 	skb_release_all(skb);
 
-	/* record skb to CPU local list */
-	nc->skb_cache[nc->skb_count++] = skb;
-
-#ifdef CONFIG_SLUB
-	/* SLUB writes into objects when freeing */
-	prefetchw(skb);
-#endif
-
-	/* flush skb_cache if it is filled */
-	if (unlikely(nc->skb_count == NAPI_SKB_CACHE_SIZE)) {
-		kmem_cache_free_bulk(skbuff_head_cache, NAPI_SKB_CACHE_SIZE,
-				     nc->skb_cache);
-		nc->skb_count = 0;
-	}
+	/* recycle the sk_buff head for the next NAPI Rx allocation */
+	napi_skb_cache_put(skb);
 }
+
 void __kfree_skb_defer(struct sk_buff *skb)
 {
 	_kfree_skb_defer(skb);
 }
 
+void napi_skb_free_stolen_head(struct sk_buff *skb)
+{
+	nf_reset_ct(skb);
+	skb_dst_drop(skb);
+	skb_ext_put(skb);
+	napi_skb_cache_put(skb);
+}
+
 void napi_consume_skb(struct sk_buff *skb, int budget)
 {
 	if (unlikely(!skb))
@@ -1008,6 +1072,7 @@ static struct sk_buff *__skb_clone(struct sk_buff *n, struct sk_buff *skb)
 	C(end);
 	C(head);
 	C(head_frag);
+	C(pp_recycle);
 	C(data);
 	C(truesize);
 	refcount_set(&n->users, 1);
@@ -1666,6 +1731,10 @@ int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail,
 			skb_clone_fraglist(skb);
 
 		skb_release_data(skb);
+		/* The clone still owns the old shinfo and will return any
+		 * page_pool pages; we only hold plain page references now.
+		 */
+		skb->pp_recycle = 0;
 	} else {
 		skb_free_head(skb);
 	}
@@ -3414,7 +3483,7 @@ int skb_shift(struct sk_buff *tgt, struct sk_buff *skb, int shiftlen)
 		fragto = &skb_shinfo(tgt)->frags[merge];
 
 		skb_frag_size_add(fragto, skb_frag_size(fragfrom));
-		__skb_frag_unref(fragfrom);
+		__skb_frag_unref(fragfrom, skb->pp_recycle);
 	}
 
 	/* Reposition in the original skb */
@@ -3665,6 +3734,103 @@ static inline skb_frag_t skb_head_frag_to_page_desc(struct sk_buff *frag_skb)
 	return head_frag;
 }
 
+/**
+ *	skb_segment_list - split a fraglist GRO packet back into its segments
+ *	@skb: buffer built by skb_gro_receive_list()
+ *	@features: features for the output path (see dev->features)
+ *	@offset: length of the headers in front of the network header
+ *
+ *	The members of the frag_list still carry their own network and
+ *	transport headers, so only the first @offset bytes (the link layer
+ *	header) are copied from @skb; no payload is touched.  Returns @skb
+ *	with the segments linked through ->next, or an ERR_PTR.
+ */
+struct sk_buff *skb_segment_list(struct sk_buff *skb,
+				 netdev_features_t features,
+				 unsigned int offset)
+{
+	struct sk_buff *list_skb = skb_shinfo(skb)->frag_list;
+	unsigned int tnl_hlen = skb_tnl_header_len(skb);
+	unsigned int delta_truesize = 0;
+	unsigned int delta_len = 0;
+	struct sk_buff *tail = NULL;
+	struct sk_buff *nskb, *tmp;
+	int err;
+
+	skb_push(skb, -skb_network_offset(skb) + offset);
+
+	skb_shinfo(skb)->frag_list = NULL;
+
+	do {
+		nskb = list_skb;
+		list_skb = list_skb->next;
+
+		err = 0;
+		delta_truesize += nskb->truesize;
+		if (skb_shared(nskb)) {
+			tmp = skb_clone(nskb, GFP_ATOMIC);
+			if (tmp) {
+				consume_skb(nskb);
+				nskb = tmp;
+				err = skb_unclone(nskb, GFP_ATOMIC);
+			} else {
+				err = -ENOMEM;
+			}
+		}
+
+		if (!tail)
+			skb->next = nskb;
+		else
+			tail->next = nskb;
+
+		if (unlikely(err)) {
+			nskb->next = list_skb;
+			goto err_linearize;
+		}
+
+		tail = nskb;
+
+		delta_len += nskb->len;
+
+		skb_push(nskb, skb_headroom(nskb) - skb_headroom(skb));
+
+		skb_release_head_state(nskb);
+		__copy_skb_header(nskb, skb);
+
+		skb_headers_offset_update(nskb, skb_headroom(nskb) - skb_headroom(skb));
+		skb_copy_from_linear_data_offset(skb, -tnl_hlen,
+						 nskb->data - tnl_hlen,
+						 offset + tnl_hlen);
+
+		if (skb_needs_linearize(nskb, features) &&
+		    __skb_linearize(nskb))
+			goto err_linearize;
+
+	} while (list_skb);
+
+	skb->truesize = skb->truesize - delta_truesize;
+	skb->data_len = skb->data_len - delta_len;
+	skb->len = skb->len - delta_len;
+
+	skb_gso_reset(skb);
+
+	skb->prev = tail;
+
+	if (skb_needs_linearize(skb, features) &&
+	    __skb_linearize(skb))
+		goto err_linearize;
+
+	skb_get(skb);
+
+	return skb;
+
+err_linearize:
+	kfree_skb_list(skb->next);
+	skb->next = NULL;
+	return ERR_PTR(-ENOMEM);
+}
+EXPORT_SYMBOL_GPL(skb_segment_list);
+
 /**
  *	skb_segment - Perform protocol segmentation on skb.
  *	@head_skb: buffer to segment
@@ -4017,11 +4183,30 @@ int skb_gro_receive(struct sk_buff *p, struct sk_buff *skb)
 	unsigned int headlen = skb_headlen(skb);
 	unsigned int len = skb_gro_len(skb);
 	unsigned int delta_truesize;
+	unsigned int gro_max_size;
 	struct sk_buff *lp;
 
-	if (unlikely(p->len + len >= 65536 || NAPI_GRO_CB(skb)->flush))
+	/* pairs with WRITE_ONCE() in netif_set_gro_max_size() */
+	gro_max_size = READ_ONCE(p->dev->gro_max_size);
+
+	if (unlikely(p->len + len >= gro_max_size || NAPI_GRO_CB(skb)->flush))
 		return -E2BIG;
 
+	/* Frags of page_pool marked and unmarked skbs must not mix */
+	if (unlikely(p->pp_recycle != skb->pp_recycle))
+		return -ETOOMANYREFS;
+
+	/* Beyond 64KB only plain IPv6 TCP can be aggregated: ipv6_gro_complete()
+	 * inserts a hop-by-hop jumbo header in front of the TCP header.
+	 */
+	if (unlikely(p->len + len >= GRO_LEGACY_MAX_SIZE)) {
+		if (p->protocol != htons(ETH_P_IPV6) ||
+		    skb_headroom(p) < sizeof(struct hop_jumbo_hdr) ||
+		    ipv6_hdr(p)->nexthdr != IPPROTO_TCP ||
+		    p->encapsulation)
+			return -E2BIG;
+	}
+
 	lp = NAPI_GRO_CB(p)->last;
 	pinfo = skb_shinfo(lp);
 
@@ -4122,6 +4307,36 @@ int skb_gro_receive(struct sk_buff *p, struct sk_buff *skb)
 }
 EXPORT_SYMBOL_GPL(skb_gro_receive);
 
+/* Chain @skb to @p's frag_list instead of merging its payload into @p.
+ * The headers of @skb stay in its headroom for skb_segment_list().
+ */
+int skb_gro_receive_list(struct sk_buff *p, struct sk_buff *skb)
+{
+	if (unlikely(p->len + skb->len >= 65536))
+		return -E2BIG;
+
+	if (NAPI_GRO_CB(p)->last == p)
+		skb_shinfo(p)->frag_list = skb;
+	else
+		NAPI_GRO_CB(p)->last->next = skb;
+
+	skb_pull(skb, skb_gro_offset(skb));
+
+	NAPI_GRO_CB(p)->last = skb;
+	NAPI_GRO_CB(p)->count++;
+	p->data_len += skb->len;
+
+	/* sk ownership - if any - completely transferred to the aggregated packet */
+	skb->destructor = NULL;
+	skb->sk = NULL;
+	p->truesize += skb->truesize;
+	p->len += skb->len;
+
+	NAPI_GRO_CB(skb)->same_flow = 1;
+
+	return 0;
+}
+
 #ifdef CONFIG_SKB_EXTENSIONS
 #define SKB_EXT_ALIGN_VALUE	8
 #define SKB_EXT_CHUNKSIZEOF(x)	(ALIGN((sizeof(x)), SKB_EXT_ALIGN_VALUE) / SKB_EXT_ALIGN_VALUE)
@@ -4493,6 +4708,84 @@ struct sk_buff *sock_dequeue_err_skb(struct sock *sk)
 }
 EXPORT_SYMBOL(sock_dequeue_err_skb);
 
+/* A timestamp only notification, see SOF_TIMESTAMPING_OPT_TSONLY */
+bool skb_is_tstamp_batchable(const struct sk_buff *skb)
+{
+	const struct sock_exterr_skb *serr = SKB_EXT_ERR(skb);
+
+	return serr->ee.ee_errno == ENOMSG &&
+	       serr->ee.ee_origin == SO_EE_ORIGIN_TIMESTAMPING &&
+	       !skb->len;
+}
+
+static void skb_tstamp_batch_fill(const struct sock *sk,
+				  struct sk_buff *skb,
+				  struct scm_ts_batch_entry *ent)
+{
+	struct skb_shared_hwtstamps *shhwtstamps = skb_hwtstamps(skb);
+	const struct sock_exterr_skb *serr = SKB_EXT_ERR(skb);
+	struct timespec64 ts;
+
+	memset(ent, 0, sizeof(*ent));
+	ent->tskey = serr->ee.ee_data;
+	ent->tstype = serr->ee.ee_info;
+
+	if ((sk->sk_tsflags & SOF_TIMESTAMPING_SOFTWARE) &&
+	    ktime_to_timespec64_cond(skb->tstamp, &ts)) {
+		ent->tss.ts[0].tv_sec = ts.tv_sec;
+		ent->tss.ts[0].tv_nsec = ts.tv_nsec;
+	}
+	/* as in __sock_recv_timestamp(), software tx timestamps win */
+	if ((sk->sk_tsflags & SOF_TIMESTAMPING_RAW_HARDWARE) &&
+	    !skb->tstamp &&
+	    ktime_to_timespec64_cond(shhwtstamps->hwtstamp, &ts)) {
+		ent->tss.ts[2].tv_sec = ts.tv_sec;
+		ent->tss.ts[2].tv_nsec = ts.tv_nsec;
+	}
+}
+
+/* Dequeue up to @max timestamp notifications from the head of the error
+ * queue into @ents, stopping at the first other kind of message.
+ */
+int sock_dequeue_tstamp_batch(struct sock *sk, struct scm_ts_batch_entry *ents,
+			      int max)
+{
+	struct sk_buff_head *q = &sk->sk_error_queue;
+	struct sk_buff *skb, *skb_next;
+	struct sk_buff_head list;
+	unsigned long flags;
+	int n = 0;
+
+	__skb_queue_head_init(&list);
+
+	spin_lock_irqsave(&q->lock, flags);
+	while (n < max && (skb = skb_peek(q)) &&
+	       skb_is_tstamp_batchable(skb)) {
+		__skb_unlink(skb, q);
+		__skb_queue_tail(&list, skb);
+		n++;
+	}
+	skb_next = skb_peek(q);
+	if (n && skb_next && is_icmp_err_skb(skb_next))
+		sk->sk_err = SKB_EXT_ERR(skb_next)->ee.ee_errno;
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	if (!n)
+		return 0;
+
+	n = 0;
+	while ((skb = __skb_dequeue(&list))) {
+		skb_tstamp_batch_fill(sk, skb, &ents[n++]);
+		consume_skb(skb);
+	}
+
+	if (skb_next)
+		sk->sk_error_report(sk);
+
+	return n;
+}
+EXPORT_SYMBOL(sock_dequeue_tstamp_batch);
+
 /**
  * skb_clone_sk - create clone of skb, and take reference to socket
  * @skb: the skb to clone
@@ -5068,6 +5361,15 @@ bool skb_try_coalesce(struct sk_buff *to, struct sk_buff *from,
 		return true;
 	}
 
+	/* The page pool signature of a page tells whether it can be
+	 * recycled, but only skbs marked for recycling may do so: never
+	 * move frags between a marked and an unmarked skb, nor steal from
+	 * a cloned marked one.
+	 */
+	if (to->pp_recycle != from->pp_recycle ||
+	    (from->pp_recycle && skb_cloned(from)))
+		return false;
+
 	to_shinfo = skb_shinfo(to);
 	from_shinfo = skb_shinfo(from);
 	if (to_shinfo->frag_list || from_shinfo->frag_list)
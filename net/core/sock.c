@@ -137,6 +137,7 @@
 
 #include <net/tcp.h>
 #include <net/busy_poll.h>
+#include <net/ipv6.h>
 
 static DEFINE_MUTEX(proto_list_mutex);
 static LIST_HEAD(proto_list);
@@ -954,6 +955,15 @@ int sock_setsockopt(struct socket *sock, int level, int optname,
 			break;
 		}
 
+		/* batched entries carry neither payload nor a separate key */
+		if (val & SOF_TIMESTAMPING_OPT_TX_BATCH &&
+		    (val & (SOF_TIMESTAMPING_OPT_ID |
+			    SOF_TIMESTAMPING_OPT_TSONLY)) !=
+		    (SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY)) {
+			ret = -EINVAL;
+			break;
+		}
+
 		sk->sk_tsflags = val;
 		sock_valbool_flag(sk, SOCK_TSTAMP_NEW, optname == SO_TIMESTAMPING_NEW);
 
@@ -1101,6 +1111,20 @@ int sock_setsockopt(struct socket *sock, int level, int optname,
 				sk->sk_ll_usec = val;
 		}
 		break;
+
+	case SO_PREFER_BUSY_POLL:
+		WRITE_ONCE(sk->sk_prefer_busy_poll, valbool);
+		break;
+
+	case SO_BUSY_POLL_BUDGET:
+		/* A larger budget than a regular NAPI poll is privileged */
+		if (val > NAPI_POLL_WEIGHT && !capable(CAP_NET_ADMIN))
+			ret = -EPERM;
+		else if (val < 0 || val > U16_MAX)
+			ret = -EINVAL;
+		else
+			WRITE_ONCE(sk->sk_busy_poll_budget, val);
+		break;
 #endif
 
 	case SO_MAX_PACING_RATE:
@@ -1458,6 +1482,14 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 	case SO_BUSY_POLL:
 		v.val = sk->sk_ll_usec;
 		break;
+
+	case SO_PREFER_BUSY_POLL:
+		v.val = READ_ONCE(sk->sk_prefer_busy_poll);
+		break;
+
+	case SO_BUSY_POLL_BUDGET:
+		v.val = READ_ONCE(sk->sk_busy_poll_budget);
+		break;
 #endif
 
 	case SO_MAX_PACING_RATE:
@@ -1916,6 +1948,23 @@ void sk_free_unlock_clone(struct sock *sk)
 }
 EXPORT_SYMBOL_GPL(sk_free_unlock_clone);
 
+/* Only IPv6 TCP knows how to build packets above GSO_LEGACY_MAX_SIZE:
+ * everybody else still needs a 16bit length field in the network header.
+ */
+static u32 sk_dst_gso_max_size(struct sock *sk, struct dst_entry *dst)
+{
+	u32 max_size = READ_ONCE(dst->dev->gso_max_size);
+
+	if (max_size <= GSO_LEGACY_MAX_SIZE)
+		return max_size;
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6 && sk->sk_protocol == IPPROTO_TCP &&
+	    !ipv6_addr_v4mapped(&sk->sk_v6_rcv_saddr))
+		return max_size;
+#endif
+	return GSO_LEGACY_MAX_SIZE;
+}
+
 void sk_setup_caps(struct sock *sk, struct dst_entry *dst)
 {
 	u32 max_segs = 1;
@@ -1930,7 +1979,7 @@ void sk_setup_caps(struct sock *sk, struct dst_entry *dst)
 			sk->sk_route_caps &= ~NETIF_F_GSO_MASK;
 		} else {
 			sk->sk_route_caps |= NETIF_F_SG | NETIF_F_HW_CSUM;
-			sk->sk_gso_max_size = dst->dev->gso_max_size;
+			sk->sk_gso_max_size = sk_dst_gso_max_size(sk, dst);
 			max_segs = max_t(u32, dst->dev->gso_max_segs, 1);
 		}
 	}
@@ -2929,6 +2978,8 @@ void sock_init_data(struct socket *sock, struct sock *sk)
 #ifdef CONFIG_NET_RX_BUSY_POLL
 	sk->sk_napi_id		=	0;
 	sk->sk_ll_usec		=	sysctl_net_busy_read;
+	sk->sk_prefer_busy_poll	=	0;
+	sk->sk_busy_poll_budget	=	0;
 #endif
 
 	sk->sk_max_pacing_rate = ~0UL;
@@ -3074,6 +3125,45 @@ void sock_enable_timestamp(struct sock *sk, int flag)
 	}
 }
 
+#define SCM_TS_BATCH_MAX	64
+
+/*
+ * With SOF_TIMESTAMPING_OPT_TX_BATCH, follow the tx timestamp @skb that
+ * recvmsg(MSG_ERRQUEUE) is returning with the timestamps queued behind
+ * it, in one SCM_TIMESTAMPING_BATCH cmsg sized to the control buffer.
+ */
+void sock_recv_tstamp_batch(struct sock *sk, struct msghdr *msg,
+			    const struct sk_buff *skb)
+{
+	struct scm_ts_batch_entry *ents;
+	size_t space;
+	int max, n;
+
+	if (!(sk->sk_tsflags & SOF_TIMESTAMPING_OPT_TX_BATCH) ||
+	    !skb_is_tstamp_batchable(skb) ||
+	    (msg->msg_flags & MSG_CMSG_COMPAT))
+		return;
+
+	space = msg->msg_controllen;
+	if (space <= CMSG_LEN(0))
+		return;
+	max = min_t(size_t, SCM_TS_BATCH_MAX,
+		    (space - CMSG_LEN(0)) / sizeof(*ents));
+	if (!max || !skb_queue_len(&sk->sk_error_queue))
+		return;
+
+	ents = kmalloc_array(max, sizeof(*ents), GFP_KERNEL);
+	if (!ents)
+		return;
+
+	n = sock_dequeue_tstamp_batch(sk, ents, max);
+	if (n)
+		put_cmsg(msg, SOL_SOCKET, SCM_TIMESTAMPING_BATCH,
+			 n * sizeof(*ents), ents);
+	kfree(ents);
+}
+EXPORT_SYMBOL(sock_recv_tstamp_batch);
+
 int sock_recv_errqueue(struct sock *sk, struct msghdr *msg, int len,
 		       int level, int type)
 {
@@ -3099,6 +3189,7 @@ int sock_recv_errqueue(struct sock *sk, struct msghdr *msg, int len,
 
 	serr = SKB_EXT_ERR(skb);
 	put_cmsg(msg, level, type, sizeof(serr->ee), &serr->ee);
+	sock_recv_tstamp_batch(sk, msg, skb);
 
 	msg->msg_flags |= MSG_ERRQUEUE;
 	err = copied;
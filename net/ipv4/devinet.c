@@ -1983,6 +1983,7 @@ static int inet_set_link_af(struct net_device *dev, const struct nlattr *nla)
 {
 	struct in_device *in_dev = __in_dev_get_rcu(dev);
 	struct nlattr *a, *tb[IFLA_INET_MAX+1];
+	bool flush = false;
 	int rem;
 
 	if (!in_dev)
@@ -1992,10 +1993,18 @@ static int inet_set_link_af(struct net_device *dev, const struct nlattr *nla)
 		BUG();
 
 	if (tb[IFLA_INET_CONF]) {
-		nla_for_each_nested(a, tb[IFLA_INET_CONF], rem)
+		nla_for_each_nested(a, tb[IFLA_INET_CONF], rem) {
+			if (nla_type(a) == IPV4_DEVCONF_RP_FILTER &&
+			    IN_DEV_CONF_GET(in_dev, RP_FILTER) != nla_get_u32(a))
+				flush = true;
 			ipv4_devconf_set(in_dev, nla_type(a), nla_get_u32(a));
+		}
 	}
 
+	/* Cached input routes skip source validation */
+	if (flush)
+		rt_cache_flush(dev_net(dev));
+
 	return 0;
 }
 
@@ -2395,6 +2404,8 @@ static int devinet_conf_proc(struct ctl_table *ctl, int write,
 
 		if (i == IPV4_DEVCONF_RP_FILTER - 1 &&
 		    new_value != old_value) {
+			/* Cached input routes skip source validation */
+			rt_cache_flush(net);
 			ifindex = devinet_conf_ifindex(net, cnf);
 			inet_netconf_notify_devconf(net, RTM_NEWNETCONF,
 						    NETCONFA_RP_FILTER,
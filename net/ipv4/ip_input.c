@@ -335,8 +335,7 @@ static int ip_rcv_finish_core(struct net *net, struct sock *sk,
 	 *	how the packet travels inside Linux networking.
 	 */
 	if (!skb_valid_dst(skb)) {
-		err = ip_route_input_noref(skb, iph->daddr, iph->saddr,
-					   iph->tos, dev);
+		err = ip_route_input_cached(skb, iph, dev);
 		if (unlikely(err))
 			goto drop_error;
 	}
@@ -549,6 +549,7 @@ int ip_recv_error(struct sock *sk, struct msghdr *msg, int len, int *addr_len)
 	}
 
 	put_cmsg(msg, SOL_IP, IP_RECVERR, sizeof(errhdr), &errhdr);
+	sock_recv_tstamp_batch(sk, msg, skb);
 
 	/* Now we could try to dump offended packet options */
 
@@ -289,6 +289,11 @@ static const struct snmp_mib snmp4_net_list[] = {
 	SNMP_MIB_ITEM("TCPRcvQDrop", LINUX_MIB_TCPRCVQDROP),
 	SNMP_MIB_ITEM("TCPWqueueTooBig", LINUX_MIB_TCPWQUEUETOOBIG),
 	SNMP_MIB_ITEM("TCPFastOpenPassiveAltKey", LINUX_MIB_TCPFASTOPENPASSIVEALTKEY),
+	SNMP_MIB_ITEM("UDPGROFraglist", LINUX_MIB_UDPGROFRAGLIST),
+	SNMP_MIB_ITEM("UDPGSOFraglist", LINUX_MIB_UDPGSOFRAGLIST),
+	SNMP_MIB_ITEM("BusyPollHit", LINUX_MIB_BUSYPOLLHIT),
+	SNMP_MIB_ITEM("BusyPollFallback", LINUX_MIB_BUSYPOLLFALLBACK),
+	SNMP_MIB_ITEM("BusyPollNoNapi", LINUX_MIB_BUSYPOLLNONAPI),
 	SNMP_MIB_SENTINEL
 };
 
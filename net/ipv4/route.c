@@ -2271,6 +2271,306 @@ int ip_route_input_noref(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 }
 EXPORT_SYMBOL(ip_route_input_noref);
 
+#ifdef CONFIG_IP_ROUTE_FLOW_CACHE
+/*
+ * Forwarding flow cache: a direct mapped table of recently forwarded
+ * 5-tuples and the input route the full lookup gave them, so that
+ * further packets of the flow skip fib_lookup() and source validation.
+ *
+ * The table is allocated when net.ipv4.ip_forward_flow_cache is enabled,
+ * with net.ipv4.ip_forward_flow_cache_size slots, and is swapped under
+ * RTNL and RCU when either changes.  Slots are embedded in the table and
+ * rewritten in place under a per-slot lock, readers use the per-slot
+ * seqcount, so a miss never allocates.
+ *
+ * Entries hold a reference on their route and are checked against
+ * rt_genid on use, which every FIB, device and address change bumps.
+ * The old route of a rewritten slot is released right away: dst_release()
+ * defers the free past an RCU grace period, as for nhc_rth_input.
+ * A slot only changes flow once its entry is stale, at the latest after
+ * ip_rt_flow_cache_timeout, so colliding flows do not evict each other.
+ */
+struct ip_flow_key {
+	__be64			tun_id;
+	__be32			saddr;
+	__be32			daddr;
+	__be16			sport;
+	__be16			dport;
+	int			iif;
+	u32			mark;
+	u8			tos;
+	u8			proto;
+};
+
+struct ip_flow_entry {
+	seqcount_t		seq;
+	spinlock_t		lock;
+	struct ip_flow_key	key;
+	struct rtable		*rt;
+	unsigned long		expires;
+	int			genid;
+};
+
+struct ip_flow_cache {
+	atomic_t		genid;
+	u32			hash_rnd;
+	u32			mask;
+	struct ip_flow_entry	entries[];
+};
+
+static int ip_rt_flow_cache_timeout __read_mostly = 30 * HZ;
+
+/* Returns false for packets the cache does not handle.  @established
+ * tells whether the flow may be added: TCP flows only past their SYN.
+ */
+static bool ip_flow_key_init(struct ip_flow_key *key, bool *established,
+			     const struct sk_buff *skb,
+			     const struct iphdr *iph,
+			     const struct net_device *dev)
+{
+	struct ip_tunnel_info *tun_info;
+	__be16 _ports[2];
+	const __be16 *ports;
+	u8 _flags;
+	const u8 *flags;
+
+	if (iph->ihl != 5 || ip_is_fragment(iph))
+		return false;
+	if (iph->protocol != IPPROTO_TCP && iph->protocol != IPPROTO_UDP)
+		return false;
+
+	ports = skb_header_pointer(skb, sizeof(*iph), sizeof(_ports), _ports);
+	if (!ports)
+		return false;
+
+	*established = true;
+	if (iph->protocol == IPPROTO_TCP) {
+		flags = skb_header_pointer(skb, sizeof(*iph) + 13,
+					   sizeof(_flags), &_flags);
+		if (!flags)
+			return false;
+		*established = !(*flags & TCPHDR_SYN);
+	}
+
+	memset(key, 0, sizeof(*key));
+	/* fib rules can match on the tunnel id, as in ip_route_input_slow() */
+	tun_info = skb_tunnel_info(skb);
+	if (tun_info && !(tun_info->mode & IP_TUNNEL_INFO_TX))
+		key->tun_id = tun_info->key.tun_id;
+	key->saddr = iph->saddr;
+	key->daddr = iph->daddr;
+	key->sport = ports[0];
+	key->dport = ports[1];
+	key->iif = dev->ifindex;
+	key->mark = skb->mark;
+	key->tos = iph->tos & IPTOS_RT_MASK;
+	key->proto = iph->protocol;
+	return true;
+}
+
+static struct ip_flow_entry *ip_flow_slot(struct ip_flow_cache *fc,
+					  const struct ip_flow_key *key)
+{
+	u32 hash = jhash(key, sizeof(*key), fc->hash_rnd);
+
+	return &fc->entries[hash & fc->mask];
+}
+
+/* called with e->lock held */
+static bool ip_flow_entry_stale(struct ip_flow_cache *fc,
+				const struct ip_flow_entry *e)
+{
+	return !e->rt || e->genid != atomic_read(&fc->genid) ||
+	       !time_before(jiffies, e->expires) ||
+	       !rt_cache_valid(e->rt);
+}
+
+/* Empty a slot and drop its route reference */
+static void ip_flow_entry_clear(struct ip_flow_entry *e)
+{
+	struct rtable *rt;
+
+	spin_lock_bh(&e->lock);
+	rt = e->rt;
+	if (rt) {
+		write_seqcount_begin(&e->seq);
+		e->rt = NULL;
+		write_seqcount_end(&e->seq);
+	}
+	spin_unlock_bh(&e->lock);
+
+	if (rt)
+		dst_release(&rt->dst);
+}
+
+/* called with rcu_read_lock held */
+static struct rtable *ip_flow_cache_lookup(struct ip_flow_cache *fc,
+					   const struct ip_flow_key *key)
+{
+	struct ip_flow_entry *e = ip_flow_slot(fc, key);
+	struct rtable *rt;
+	unsigned int seq;
+	bool hit;
+
+	do {
+		seq = read_seqcount_begin(&e->seq);
+		rt = e->rt;
+		hit = rt && !memcmp(&e->key, key, sizeof(*key)) &&
+		      e->genid == atomic_read(&fc->genid) &&
+		      time_before(jiffies, e->expires);
+	} while (read_seqcount_retry(&e->seq, seq));
+
+	/* rt is not freed before an RCU grace period, even if replaced */
+	if (!hit || !rt_cache_valid(rt))
+		return NULL;
+	return rt;
+}
+
+static void ip_flow_cache_insert(struct ip_flow_cache *fc,
+				 const struct ip_flow_key *key,
+				 struct sk_buff *skb)
+{
+	struct rtable *rt = skb_rtable(skb);
+	struct ip_flow_entry *e;
+	struct rtable *old;
+
+	/* Only plain forwarding; redirects are decided per packet */
+	if (rt->rt_type != RTN_UNICAST || rt->dst.input != ip_forward ||
+	    (IPCB(skb)->flags & IPSKB_DOREDIRECT))
+		return;
+
+	e = ip_flow_slot(fc, key);
+	spin_lock_bh(&e->lock);
+	/* A live entry keeps its slot until it goes stale */
+	if (!ip_flow_entry_stale(fc, e) || !dst_hold_safe(&rt->dst)) {
+		spin_unlock_bh(&e->lock);
+		return;
+	}
+
+	old = e->rt;
+	write_seqcount_begin(&e->seq);
+	/* Copy the padding too, lookups memcmp() the whole key */
+	memcpy(&e->key, key, sizeof(*key));
+	e->rt = rt;
+	e->expires = jiffies + READ_ONCE(ip_rt_flow_cache_timeout);
+	e->genid = atomic_read(&fc->genid);
+	write_seqcount_end(&e->seq);
+	spin_unlock_bh(&e->lock);
+
+	if (old)
+		dst_release(&old->dst);
+}
+
+/* @size must be a power of two */
+static struct ip_flow_cache *ip_flow_cache_alloc(unsigned int size)
+{
+	struct ip_flow_cache *fc;
+	unsigned int i;
+
+	fc = kvzalloc(struct_size(fc, entries, size), GFP_KERNEL);
+	if (!fc)
+		return NULL;
+
+	fc->hash_rnd = get_random_u32();
+	fc->mask = size - 1;
+	for (i = 0; i < size; i++) {
+		seqcount_init(&fc->entries[i].seq);
+		spin_lock_init(&fc->entries[i].lock);
+	}
+	return fc;
+}
+
+/* Must not be reachable by readers anymore */
+static void ip_flow_cache_free(struct ip_flow_cache *fc)
+{
+	unsigned int i;
+
+	if (!fc)
+		return;
+
+	for (i = 0; i <= fc->mask; i++) {
+		if (fc->entries[i].rt)
+			dst_release(&fc->entries[i].rt->dst);
+	}
+	kvfree(fc);
+}
+
+/* Drop all entries, releasing the routes (and devices) they hold.
+ * Called with RTNL held.
+ */
+void ip_route_flow_cache_purge(struct net *net)
+{
+	struct ip_flow_cache *fc = rtnl_dereference(net->ipv4.flow_cache);
+	unsigned int i;
+
+	if (!fc)
+		return;
+
+	atomic_inc(&fc->genid);
+	for (i = 0; i <= fc->mask; i++)
+		ip_flow_entry_clear(&fc->entries[i]);
+}
+
+/* Allocate, resize or free the table to match the sysctls.
+ * Called with RTNL held.
+ */
+int ip_route_flow_cache_update(struct net *net)
+{
+	struct ip_flow_cache *old = rtnl_dereference(net->ipv4.flow_cache);
+	struct ip_flow_cache *fc = NULL;
+	unsigned int size;
+
+	if (net->ipv4.sysctl_ip_fwd_flow_cache) {
+		size = roundup_pow_of_two(net->ipv4.sysctl_ip_fwd_flow_cache_size);
+		if (old && old->mask == size - 1)
+			return 0;
+		fc = ip_flow_cache_alloc(size);
+		if (!fc)
+			return -ENOMEM;
+	} else if (!old) {
+		return 0;
+	}
+
+	rcu_assign_pointer(net->ipv4.flow_cache, fc);
+	if (old) {
+		synchronize_net();
+		ip_flow_cache_free(old);
+	}
+	return 0;
+}
+
+/* Route an incoming packet like ip_route_input_noref(), using the
+ * forwarding flow cache when it is enabled.  Called with rcu_read_lock.
+ */
+int ip_route_input_cached(struct sk_buff *skb, const struct iphdr *iph,
+			  struct net_device *dev)
+{
+	struct ip_flow_cache *fc = rcu_dereference(dev_net(dev)->ipv4.flow_cache);
+	struct ip_flow_key key;
+	bool established;
+	struct rtable *rt;
+	int err;
+
+	/* A metadata dst only carries the rx tunnel info, see the key */
+	if (!fc || skb_valid_dst(skb) ||
+	    !ip_flow_key_init(&key, &established, skb, iph, dev))
+		return ip_route_input_noref(skb, iph->daddr, iph->saddr,
+					    iph->tos, dev);
+
+	rt = ip_flow_cache_lookup(fc, &key);
+	if (rt) {
+		skb_dst_drop(skb);
+		skb_dst_set_noref(skb, &rt->dst);
+		return 0;
+	}
+
+	err = ip_route_input_noref(skb, iph->daddr, iph->saddr, iph->tos, dev);
+	if (!err && established)
+		ip_flow_cache_insert(fc, &key, skb);
+	return err;
+}
+#endif
+
 /* called with rcu_read_lock held */
 int ip_route_input_rcu(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 		       u8 tos, struct net_device *dev, struct fib_result *res)
@@ -3362,6 +3662,15 @@ static struct ctl_table ipv4_route_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec,
 	},
+#ifdef CONFIG_IP_ROUTE_FLOW_CACHE
+	{
+		.procname	= "flow_cache_timeout",
+		.data		= &ip_rt_flow_cache_timeout,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_jiffies,
+	},
+#endif
 	{ }
 };
 
@@ -3460,6 +3769,76 @@ static __net_initdata struct pernet_operations ipv4_inetpeer_ops = {
 	.exit	=	ipv4_inetpeer_exit,
 };
 
+#ifdef CONFIG_IP_ROUTE_FLOW_CACHE
+static int __net_init ip_flow_cache_net_init(struct net *net)
+{
+	net->ipv4.sysctl_ip_fwd_flow_cache_size = 4096;
+	return 0;
+}
+
+static void __net_exit ip_flow_cache_net_exit(struct net *net)
+{
+	ip_flow_cache_free(rcu_dereference_protected(net->ipv4.flow_cache, 1));
+	RCU_INIT_POINTER(net->ipv4.flow_cache, NULL);
+}
+
+static __net_initdata struct pernet_operations ip_flow_cache_ops = {
+	.init	=	ip_flow_cache_net_init,
+	.exit	=	ip_flow_cache_net_exit,
+};
+
+/* Entries pin their output device through the route; release them so
+ * unregistration is not held up.  NETDEV_UNREGISTER is rebroadcast until
+ * the device is free, which also catches entries added meanwhile.
+ */
+static int ip_flow_cache_netdev_event(struct notifier_block *this,
+				      unsigned long event, void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+
+	if (event == NETDEV_UNREGISTER)
+		ip_route_flow_cache_purge(dev_net(dev));
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block ip_flow_cache_netdev_notifier = {
+	.notifier_call = ip_flow_cache_netdev_event,
+};
+
+#ifdef CONFIG_IP_ROUTE_MULTIPATH
+/* With fib_multipath_use_neigh, multipath next hop selection avoids
+ * gateways whose neighbour entry is not valid, so forget cached choices
+ * when one fails.  Without it neighbour state does not affect routing.
+ */
+static int ip_flow_cache_netevent(struct notifier_block *this,
+				  unsigned long event, void *ptr)
+{
+	struct neighbour *n = ptr;
+	struct ip_flow_cache *fc;
+	struct net *net;
+
+	if (event != NETEVENT_NEIGH_UPDATE || n->tbl != &arp_tbl ||
+	    (n->nud_state & NUD_VALID))
+		return NOTIFY_DONE;
+
+	net = dev_net(n->dev);
+	if (!READ_ONCE(net->ipv4.sysctl_fib_multipath_use_neigh))
+		return NOTIFY_DONE;
+
+	rcu_read_lock();
+	fc = rcu_dereference(net->ipv4.flow_cache);
+	if (fc)
+		atomic_inc(&fc->genid);
+	rcu_read_unlock();
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block ip_flow_cache_netevent_notifier = {
+	.notifier_call = ip_flow_cache_netevent,
+};
+#endif
+#endif
+
 #ifdef CONFIG_IP_ROUTE_CLASSID
 struct ip_rt_acct __percpu *ip_rt_acct __read_mostly;
 #endif /* CONFIG_IP_ROUTE_CLASSID */
@@ -3530,6 +3909,13 @@ int __init ip_rt_init(void)
 #endif
 	register_pernet_subsys(&rt_genid_ops);
 	register_pernet_subsys(&ipv4_inetpeer_ops);
+#ifdef CONFIG_IP_ROUTE_FLOW_CACHE
+	register_pernet_subsys(&ip_flow_cache_ops);
+	register_netdevice_notifier(&ip_flow_cache_netdev_notifier);
+#ifdef CONFIG_IP_ROUTE_MULTIPATH
+	register_netevent_notifier(&ip_flow_cache_netevent_notifier);
+#endif
+#endif
 	return 0;
 }
 
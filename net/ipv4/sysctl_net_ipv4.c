@@ -48,6 +48,9 @@ static int tcp_syn_retries_max = MAX_TCP_SYNCNT;
 static int ip_ping_group_range_min[] = { 0, 0 };
 static int ip_ping_group_range_max[] = { GID_T_MAX, GID_T_MAX };
 static int comp_sack_nr_max = 255;
+#ifdef CONFIG_IP_ROUTE_FLOW_CACHE
+static int ip_fwd_flow_cache_size_max = 1 << 20;
+#endif
 static u32 u32_max_div_HZ = UINT_MAX / HZ;
 static int one_day_secs = 24 * 3600;
 
@@ -220,6 +223,52 @@ static int ipv4_fwd_update_priority(struct ctl_table *table, int write,
 	return ret;
 }
 
+#ifdef CONFIG_IP_ROUTE_FLOW_CACHE
+static int ipv4_fwd_flow_cache_update(struct net *net, struct ctl_table *table,
+				      int write, void __user *buffer,
+				      size_t *lenp, loff_t *ppos)
+{
+	int *valp = table->data;
+	int old, ret;
+
+	rtnl_lock();
+	old = *valp;
+	ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
+	if (write && ret == 0 && *valp != old) {
+		ret = ip_route_flow_cache_update(net);
+		if (ret)
+			*valp = old;
+	}
+	rtnl_unlock();
+
+	return ret;
+}
+
+static int ipv4_fwd_flow_cache(struct ctl_table *table, int write,
+			       void __user *buffer,
+			       size_t *lenp, loff_t *ppos)
+{
+	struct net *net;
+
+	net = container_of(table->data, struct net,
+			   ipv4.sysctl_ip_fwd_flow_cache);
+	return ipv4_fwd_flow_cache_update(net, table, write, buffer, lenp,
+					  ppos);
+}
+
+static int ipv4_fwd_flow_cache_size(struct ctl_table *table, int write,
+				    void __user *buffer,
+				    size_t *lenp, loff_t *ppos)
+{
+	struct net *net;
+
+	net = container_of(table->data, struct net,
+			   ipv4.sysctl_ip_fwd_flow_cache_size);
+	return ipv4_fwd_flow_cache_update(net, table, write, buffer, lenp,
+					  ppos);
+}
+#endif
+
 static int proc_tcp_congestion_control(struct ctl_table *ctl, int write,
 				       void __user *buffer, size_t *lenp, loff_t *ppos)
 {
@@ -756,6 +805,26 @@ static struct ctl_table ipv4_net_table[] = {
 		.extra1		= SYSCTL_ZERO,
 		.extra2		= SYSCTL_ONE,
 	},
+#ifdef CONFIG_IP_ROUTE_FLOW_CACHE
+	{
+		.procname	= "ip_forward_flow_cache",
+		.data		= &init_net.ipv4.sysctl_ip_fwd_flow_cache,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= ipv4_fwd_flow_cache,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= SYSCTL_ONE,
+	},
+	{
+		.procname	= "ip_forward_flow_cache_size",
+		.data		= &init_net.ipv4.sysctl_ip_fwd_flow_cache_size,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= ipv4_fwd_flow_cache_size,
+		.extra1		= SYSCTL_ONE,
+		.extra2		= &ip_fwd_flow_cache_size_max,
+	},
+#endif
 	{
 		.procname	= "ip_nonlocal_bind",
 		.data		= &init_net.ipv4.sysctl_ip_nonlocal_bind,
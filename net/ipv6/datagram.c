@@ -507,6 +507,7 @@ int ipv6_recv_error(struct sock *sk, struct msghdr *msg, int len, int *addr_len)
 	}
 
 	put_cmsg(msg, SOL_IPV6, IPV6_RECVERR, sizeof(errhdr), &errhdr);
+	sock_recv_tstamp_batch(sk, msg, skb);
 
 	/* Now we could try to dump offended packet options */
 
@@ -427,12 +427,13 @@ static int ct_cpu_seq_show(struct seq_file *seq, void *v)
 	const struct ip_conntrack_stat *st = v;
 
 	if (v == SEQ_START_TOKEN) {
-		seq_puts(seq, "entries  searched found new invalid ignore delete delete_list insert insert_failed drop early_drop icmp_error  expect_new expect_create expect_delete search_restart\n");
+		seq_puts(seq, "entries  searched found new invalid ignore delete delete_list insert insert_failed drop early_drop icmp_error  expect_new expect_create expect_delete search_restart lock_contended gc_scanned gc_expired\n");
 		return 0;
 	}
 
 	seq_printf(seq, "%08x  %08x %08x %08x %08x %08x %08x %08x "
-			"%08x %08x %08x %08x %08x  %08x %08x %08x %08x\n",
+			"%08x %08x %08x %08x %08x  %08x %08x %08x %08x "
+			"%08x %08x %08x\n",
 		   nr_conntracks,
 		   0,
 		   st->found,
@@ -450,7 +451,10 @@ static int ct_cpu_seq_show(struct seq_file *seq, void *v)
 		   st->expect_new,
 		   st->expect_create,
 		   st->expect_delete,
-		   st->search_restart
+		   st->search_restart,
+		   st->lock_contended,
+		   st->gc_scanned,
+		   st->gc_expired
 		);
 	return 0;
 }
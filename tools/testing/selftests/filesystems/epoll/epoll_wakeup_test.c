@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Multi-threaded epoll_wait() on a single epoll instance, with and without
+ * EPOLL_PERCPU ready lists: checks that no wakeup is lost when events are
+ * queued on one CPU and harvested on another, and reports the event rate.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "../../kselftest_harness.h"
+
+#ifndef EPOLL_PERCPU
+#define EPOLL_PERCPU 1
+#endif
+
+#define MAX_THREADS	64
+#define ITERATIONS	20000
+/* Far longer than any wakeup latency, only hit if a wakeup is lost */
+#define WAIT_TIMEOUT_MS	5000
+
+struct ctx {
+	int epfd;
+	int nr_threads;
+	int efd[MAX_THREADS];
+	/* Add each eventfd from its own thread, i.e. its own CPU */
+	int add_from_thread;
+	pthread_barrier_t barrier;
+};
+
+struct worker {
+	struct ctx *ctx;
+	int id;
+	int cpu;
+	long timeouts;
+	long events;
+	int err;
+};
+
+static int online_cpus(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n < 2)
+		return 2;
+	return n > MAX_THREADS ? MAX_THREADS : n;
+}
+
+static void pin_to_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	/* Best effort, the test is still valid without affinity */
+	sched_setaffinity(0, sizeof(set), &set);
+}
+
+static int add_efd(struct ctx *ctx, int id)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.u32 = id,
+	};
+
+	return epoll_ctl(ctx->epfd, EPOLL_CTL_ADD, ctx->efd[id], &ev);
+}
+
+/*
+ * Each iteration posts one unit to the thread's own eventfd and then waits
+ * for one unit from any eventfd.  Semaphore eventfds make units conserved,
+ * so there is always at least one pending unit per waiter and a wait can
+ * only time out if a wakeup was lost.
+ */
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	struct ctx *ctx = w->ctx;
+	struct epoll_event ev;
+	uint64_t val = 1;
+	int i, n;
+
+	pin_to_cpu(w->cpu);
+
+	if (ctx->add_from_thread && add_efd(ctx, w->id)) {
+		w->err = errno;
+		return NULL;
+	}
+
+	pthread_barrier_wait(&ctx->barrier);
+
+	for (i = 0; i < ITERATIONS; i++) {
+		if (write(ctx->efd[w->id], &val, sizeof(val)) != sizeof(val)) {
+			w->err = errno;
+			break;
+		}
+
+		for (;;) {
+			n = epoll_wait(ctx->epfd, &ev, 1, WAIT_TIMEOUT_MS);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0) {
+				w->err = errno;
+				return NULL;
+			}
+			if (n == 0) {
+				w->timeouts++;
+				break;
+			}
+			/* Level triggered: another waiter may have won it */
+			if (read(ctx->efd[ev.data.u32], &val,
+				 sizeof(val)) == sizeof(val)) {
+				w->events++;
+				break;
+			}
+			if (errno != EAGAIN) {
+				w->err = errno;
+				return NULL;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(struct __test_metadata *_metadata, int flags,
+		int add_from_thread)
+{
+	struct worker workers[MAX_THREADS] = {};
+	pthread_t threads[MAX_THREADS];
+	struct ctx ctx = {};
+	long events = 0, timeouts = 0;
+	double start, elapsed;
+	int i;
+
+	ctx.nr_threads = online_cpus();
+	ctx.add_from_thread = add_from_thread;
+	ctx.epfd = epoll_create1(flags);
+	ASSERT_GE(ctx.epfd, 0);
+	ASSERT_EQ(0, pthread_barrier_init(&ctx.barrier, NULL,
+					  ctx.nr_threads + 1));
+
+	for (i = 0; i < ctx.nr_threads; i++) {
+		ctx.efd[i] = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE);
+		ASSERT_GE(ctx.efd[i], 0);
+		/* Otherwise all items are homed on the main thread's CPU */
+		if (!add_from_thread)
+			ASSERT_EQ(0, add_efd(&ctx, i));
+	}
+
+	for (i = 0; i < ctx.nr_threads; i++) {
+		workers[i].ctx = &ctx;
+		workers[i].id = i;
+		workers[i].cpu = i;
+		ASSERT_EQ(0, pthread_create(&threads[i], NULL, worker_fn,
+					    &workers[i]));
+	}
+
+	pthread_barrier_wait(&ctx.barrier);
+	start = now_sec();
+
+	for (i = 0; i < ctx.nr_threads; i++) {
+		pthread_join(threads[i], NULL);
+		EXPECT_EQ(0, workers[i].err);
+		events += workers[i].events;
+		timeouts += workers[i].timeouts;
+	}
+	elapsed = now_sec() - start;
+
+	EXPECT_EQ(0, timeouts);
+	EXPECT_EQ((long)ctx.nr_threads * ITERATIONS, events + timeouts);
+
+	TH_LOG("%s, %d threads: %ld events in %.3fs, %.0f events/s",
+	       flags & EPOLL_PERCPU ? "percpu" : "shared", ctx.nr_threads,
+	       events, elapsed, events / elapsed);
+
+	for (i = 0; i < ctx.nr_threads; i++)
+		close(ctx.efd[i]);
+	close(ctx.epfd);
+	pthread_barrier_destroy(&ctx.barrier);
+}
+
+TEST(percpu_create)
+{
+	int fd;
+
+	fd = epoll_create1(EPOLL_PERCPU | EPOLL_CLOEXEC);
+	ASSERT_GE(fd, 0);
+	close(fd);
+
+	EXPECT_EQ(-1, epoll_create1(~(EPOLL_PERCPU | EPOLL_CLOEXEC)));
+	EXPECT_EQ(EINVAL, errno);
+}
+
+TEST(shared_wakeup)
+{
+	run(_metadata, 0, 1);
+}
+
+TEST(percpu_local_wakeup)
+{
+	run(_metadata, EPOLL_PERCPU, 1);
+}
+
+/* All events are queued on one CPU's list and must be stolen by the rest */
+TEST(percpu_remote_wakeup)
+{
+	run(_metadata, EPOLL_PERCPU, 0);
+}
+
+TEST_HARNESS_MAIN
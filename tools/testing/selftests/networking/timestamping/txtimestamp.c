@@ -9,6 +9,7 @@
  * - RAW, UDP and TCP
  * - IPv4 and IPv6
  * - various packet sizes (to test GSO and TSO)
+ * - timestamps batched into one SCM_TIMESTAMPING_BATCH cmsg
  *
  * Consult the command line arguments for help on running
  * the various testcases.
@@ -62,6 +63,7 @@ static int cfg_delay_ack;
 static bool cfg_show_payload;
 static bool cfg_do_pktinfo;
 static bool cfg_loop_nodata;
+static bool cfg_batch;
 static bool cfg_no_delay;
 static bool cfg_use_cmsg;
 static bool cfg_use_pf_packet;
@@ -210,6 +212,24 @@ static void __poll(int fd)
 		error(1, errno, "poll");
 }
 
+static int print_timestamp_batch(struct cmsghdr *cm)
+{
+	struct scm_ts_batch_entry *ent = (void *) CMSG_DATA(cm);
+	int i, num;
+
+	num = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(*ent);
+	for (i = 0; i < num; i++, ent++) {
+		struct scm_timestamping tss;
+
+		memset(&tss, 0, sizeof(tss));
+		tss.ts[0].tv_sec = ent->tss.ts[0].tv_sec;
+		tss.ts[0].tv_nsec = ent->tss.ts[0].tv_nsec;
+		print_timestamp(&tss, ent->tstype, ent->tskey, 0);
+	}
+
+	return num;
+}
+
 static void __recv_errmsg_cmsg(struct msghdr *msg, int payload_len)
 {
 	struct sock_extended_err *serr = NULL;
@@ -223,6 +243,13 @@ static void __recv_errmsg_cmsg(struct msghdr *msg, int payload_len)
 		if (cm->cmsg_level == SOL_SOCKET &&
 		    cm->cmsg_type == SCM_TIMESTAMPING) {
 			tss = (void *) CMSG_DATA(cm);
+		} else if (cm->cmsg_level == SOL_SOCKET &&
+			   cm->cmsg_type == SCM_TIMESTAMPING_BATCH) {
+			if (!cfg_batch) {
+				fprintf(stderr, "ERROR: unexpected batch\n");
+				test_failed = true;
+			}
+			batch += print_timestamp_batch(cm);
 		} else if ((cm->cmsg_level == SOL_IP &&
 			    cm->cmsg_type == IP_RECVERR) ||
 			   (cm->cmsg_level == SOL_IPV6 &&
@@ -457,6 +484,9 @@ static void do_test(int family, unsigned int report_opt)
 	if (cfg_loop_nodata)
 		sock_opt |= SOF_TIMESTAMPING_OPT_TSONLY;
 
+	if (cfg_batch)
+		sock_opt |= SOF_TIMESTAMPING_OPT_TX_BATCH;
+
 	if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING,
 		       (char *) &sock_opt, sizeof(sock_opt)))
 		error(1, 0, "setsockopt timestamping");
@@ -546,6 +576,7 @@ static void __attribute__((noreturn)) usage(const char *filepath)
 			"\nwhere options are:\n"
 			"  -4:   only IPv4\n"
 			"  -6:   only IPv6\n"
+			"  -b:   batch timestamps into one cmsg (implies -n)\n"
 			"  -h:   show this message\n"
 			"  -c N: number of packets for each test\n"
 			"  -C:   use cmsg to set tstamp recording options\n"
@@ -572,7 +603,7 @@ static void parse_opt(int argc, char **argv)
 	int proto_count = 0;
 	int c;
 
-	while ((c = getopt(argc, argv, "46c:CDFhIl:Lnp:PrRuv:V:x")) != -1) {
+	while ((c = getopt(argc, argv, "46bc:CDFhIl:Lnp:PrRuv:V:x")) != -1) {
 		switch (c) {
 		case '4':
 			do_ipv6 = 0;
@@ -580,6 +611,10 @@ static void parse_opt(int argc, char **argv)
 		case '6':
 			do_ipv4 = 0;
 			break;
+		case 'b':
+			cfg_batch = true;
+			cfg_loop_nodata = true;
+			break;
 		case 'c':
 			cfg_num_pkts = strtoul(optarg, NULL, 10);
 			break;
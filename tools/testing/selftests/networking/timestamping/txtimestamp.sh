@@ -46,6 +46,7 @@ run_test_all() {
 	run_test_tcpudpraw		# setsockopt
 	run_test_tcpudpraw -C		# cmsg
 	run_test_tcpudpraw -n		# timestamp w/o data
+	run_test_tcpudpraw -b		# batched timestamps w/o data
 }
 
 if [[ "$(ip netns identify)" == "root" ]]; then
@@ -0,0 +1,238 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Splice from pipes to sockets.
+ *
+ * Checks that pipe pages recycled by the pipe's page pool are never reused
+ * while a socket still holds them, that vmsplice(SPLICE_F_GIFT) data reaches
+ * the socket intact for both whole and partial pages, and reports the
+ * write()+splice() throughput of a large pipe feeding a socket.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include "../kselftest.h"
+
+#define CHUNK		4096
+#define ROUNDS		256
+#define BIG_PIPE	(1 << 20)
+#define STREAM_BYTES	(64UL << 20)
+
+static int read_full(int fd, char *buf, size_t len)
+{
+	while (len) {
+		ssize_t n = read(fd, buf, len);
+
+		if (n <= 0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int splice_full(int in, int out, size_t len)
+{
+	while (len) {
+		ssize_t n = splice(in, NULL, out, NULL, len, SPLICE_F_MOVE);
+
+		if (n <= 0)
+			return -1;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * Queue a page worth of data on the socket through the pipe, then write
+ * something else into the pipe before the socket is read. If the pipe handed
+ * a page still referenced by the socket back to pipe_write(), the first
+ * chunk would read back with the second chunk's contents.
+ */
+static int test_recycle_in_flight(void)
+{
+	static char buf[2 * CHUNK], expect[2 * CHUNK];
+	int pfd[2], sfd[2];
+	int i, ret = -1;
+
+	if (pipe(pfd) || socketpair(AF_UNIX, SOCK_STREAM, 0, sfd))
+		ksft_exit_fail_msg("pipe/socketpair: %s\n", strerror(errno));
+
+	for (i = 0; i < ROUNDS; i++) {
+		memset(expect, 'a' + (i % 26), CHUNK);
+		memset(expect + CHUNK, 'A' + (i % 26), CHUNK);
+
+		if (write(pfd[1], expect, CHUNK) != CHUNK ||
+		    splice_full(pfd[0], sfd[0], CHUNK))
+			goto out;
+		if (write(pfd[1], expect + CHUNK, CHUNK) != CHUNK ||
+		    splice_full(pfd[0], sfd[0], CHUNK))
+			goto out;
+		if (read_full(sfd[1], buf, sizeof(buf)))
+			goto out;
+		if (memcmp(buf, expect, sizeof(buf))) {
+			ksft_print_msg("data mismatch in round %d\n", i);
+			goto out;
+		}
+	}
+	ret = 0;
+out:
+	close(pfd[0]);
+	close(pfd[1]);
+	close(sfd[0]);
+	close(sfd[1]);
+	return ret;
+}
+
+/* vmsplice() @len bytes at @off into a fresh mapping, splice to a socket */
+static int test_gift(size_t off, size_t len)
+{
+	size_t map_len = 16 * CHUNK;
+	struct iovec iov;
+	int pfd[2], sfd[2];
+	char *map, *buf;
+	size_t i, done;
+	int ret = -1;
+
+	if (pipe(pfd) || socketpair(AF_UNIX, SOCK_STREAM, 0, sfd))
+		ksft_exit_fail_msg("pipe/socketpair: %s\n", strerror(errno));
+
+	map = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	buf = malloc(len);
+	if (map == MAP_FAILED || !buf)
+		ksft_exit_fail_msg("mmap/malloc: %s\n", strerror(errno));
+
+	for (i = 0; i < map_len; i++)
+		map[i] = i * 7 + 3;
+
+	for (done = 0; done < len; ) {
+		ssize_t n;
+
+		iov.iov_base = map + off + done;
+		iov.iov_len = len - done;
+		n = vmsplice(pfd[1], &iov, 1, SPLICE_F_GIFT);
+		if (n <= 0)
+			goto out;
+		if (splice_full(pfd[0], sfd[0], n))
+			goto out;
+		if (read_full(sfd[1], buf + done, n))
+			goto out;
+		done += n;
+	}
+
+	if (memcmp(buf, map + off, len)) {
+		ksft_print_msg("gifted data mismatch (off %zu len %zu)\n",
+			       off, len);
+		goto out;
+	}
+	ret = 0;
+out:
+	munmap(map, map_len);
+	free(buf);
+	close(pfd[0]);
+	close(pfd[1]);
+	close(sfd[0]);
+	close(sfd[1]);
+	return ret;
+}
+
+/* Stream through a 1M pipe into a socket and report the rate */
+static int test_stream(void)
+{
+	static char buf[64 * 1024];
+	struct timespec start, end;
+	unsigned long sent = 0;
+	int pfd[2], sfd[2];
+	int status;
+	double secs;
+	pid_t pid;
+
+	if (pipe(pfd) || socketpair(AF_UNIX, SOCK_STREAM, 0, sfd))
+		ksft_exit_fail_msg("pipe/socketpair: %s\n", strerror(errno));
+
+	if (fcntl(pfd[1], F_SETPIPE_SZ, BIG_PIPE) < 0)
+		ksft_print_msg("F_SETPIPE_SZ: %s, using default size\n",
+			       strerror(errno));
+
+	pid = fork();
+	if (pid < 0)
+		ksft_exit_fail_msg("fork: %s\n", strerror(errno));
+	if (!pid) {
+		unsigned long got = 0;
+		ssize_t n;
+
+		close(sfd[0]);
+		while (got < STREAM_BYTES) {
+			n = read(sfd[1], buf, sizeof(buf));
+			if (n <= 0)
+				_exit(1);
+			got += n;
+		}
+		_exit(0);
+	}
+	close(sfd[1]);
+
+	memset(buf, 'x', sizeof(buf));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (sent < STREAM_BYTES) {
+		if (write(pfd[1], buf, sizeof(buf)) != sizeof(buf))
+			break;
+		if (splice_full(pfd[0], sfd[0], sizeof(buf)))
+			break;
+		sent += sizeof(buf);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	close(sfd[0]);
+	close(pfd[0]);
+	close(pfd[1]);
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) || sent != STREAM_BYTES)
+		return -1;
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_nsec - start.tv_nsec) / 1e9;
+	ksft_print_msg("pipe->socket: %lu MiB in %.3fs, %.1f MiB/s\n",
+		       sent >> 20, secs, secs ? (sent >> 20) / secs : 0.0);
+	return 0;
+}
+
+int main(void)
+{
+	ksft_print_header();
+	ksft_set_plan(4);
+
+	if (test_recycle_in_flight())
+		ksft_test_result_fail("pipe page reuse while in flight\n");
+	else
+		ksft_test_result_pass("pipe page reuse while in flight\n");
+
+	if (test_gift(0, 8 * CHUNK))
+		ksft_test_result_fail("vmsplice gift, whole pages\n");
+	else
+		ksft_test_result_pass("vmsplice gift, whole pages\n");
+
+	if (test_gift(100, 3 * CHUNK + 17))
+		ksft_test_result_fail("vmsplice gift, partial pages\n");
+	else
+		ksft_test_result_pass("vmsplice gift, partial pages\n");
+
+	if (test_stream())
+		ksft_test_result_fail("pipe to socket stream\n");
+	else
+		ksft_test_result_pass("pipe to socket stream\n");
+
+	if (ksft_get_fail_cnt())
+		return ksft_exit_fail();
+	return ksft_exit_pass();
+}